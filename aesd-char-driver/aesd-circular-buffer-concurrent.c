@@ -0,0 +1,300 @@
+/**
+ * @file aesd-circular-buffer-concurrent.c
+ * @brief Variant of the circular buffer with lock-free readers, safe for concurrent readers and writers
+ *
+ * @author Looi Kian Seong
+ * @date 2026-10-18
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <string.h>
+#include <sched.h>
+
+#include "aesd-circular-buffer-concurrent.h"
+
+/**
+ * Consistent copy of the slot holding one position
+ */
+struct slot_snapshot
+{
+    const char *buffptr;
+    size_t size;
+    size_t start;
+};
+
+/**
+ * Copies the entry at @param position out of @param buffer into @param snapshot.
+ * @return false if the slot does not hold position, or was overwritten while it was copied.
+ */
+static bool read_slot(struct aesd_concurrent_circular_buffer *buffer, uint64_t position,
+            struct slot_snapshot *snapshot)
+{
+    struct aesd_concurrent_buffer_slot *slot = &buffer->slot[position & AESDCHAR_RING_MASK];
+    uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+    if (seq != ((2 * position) + 2))
+    {
+        return false;
+    }
+
+    snapshot->buffptr = atomic_load_explicit(&slot->buffptr, memory_order_relaxed);
+    snapshot->size = atomic_load_explicit(&slot->size, memory_order_relaxed);
+    snapshot->start = atomic_load_explicit(&slot->start, memory_order_relaxed);
+
+    atomic_thread_fence(memory_order_acquire);
+    return (atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq);
+}
+
+/**
+ * @return true if the slot of @param position still holds it, i.e. nothing read from it or from its payload
+ *      since read_slot() was overwritten. The fence orders those reads before the check.
+ */
+static bool slot_unchanged(struct aesd_concurrent_circular_buffer *buffer, uint64_t position)
+{
+    struct aesd_concurrent_buffer_slot *slot = &buffer->slot[position & AESDCHAR_RING_MASK];
+
+    atomic_thread_fence(memory_order_acquire);
+    return (atomic_load_explicit(&slot->seq, memory_order_relaxed) == ((2 * position) + 2));
+}
+
+/**
+ * memcpy() of a payload a writer may be rewriting meanwhile, in relaxed atomic loads so the race is defined.
+ * Words are loaded once @param src is aligned, single bytes around them.
+ */
+static void load_payload(char *dst, const char *src, size_t len)
+{
+    while ((len > 0) && (((uintptr_t)src % sizeof(uint64_t)) != 0))
+    {
+        *dst++ = atomic_load_explicit((const _Atomic char *)src++, memory_order_relaxed);
+        len--;
+    }
+
+    for (; len >= sizeof(uint64_t); len -= sizeof(uint64_t))
+    {
+        uint64_t word = atomic_load_explicit((const _Atomic uint64_t *)src, memory_order_relaxed);
+        memcpy(dst, &word, sizeof(word));
+        dst += sizeof(uint64_t);
+        src += sizeof(uint64_t);
+    }
+
+    while (len > 0)
+    {
+        *dst++ = atomic_load_explicit((const _Atomic char *)src++, memory_order_relaxed);
+        len--;
+    }
+}
+
+/**
+ * Finds the published entry holding @param char_offset, counted from the oldest entry when the search starts.
+ * @return false if char_offset is past the end, otherwise the entry's position in @param position_rtn, a copy
+ *      of its slot in @param found_rtn and the offset of char_offset in it in @param entry_offset_rtn
+ */
+static bool locate_entry(struct aesd_concurrent_circular_buffer *buffer, size_t char_offset,
+            uint64_t *position_rtn, struct slot_snapshot *found_rtn, size_t *entry_offset_rtn)
+{
+    for (;;)
+    {
+        uint64_t head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+        if (head == 0)
+        {
+            return false;
+        }
+
+        uint64_t count = (head < AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) ?
+                         head : AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+        uint64_t first = head - count;
+        struct slot_snapshot oldest;
+        struct slot_snapshot newest;
+
+        if (!read_slot(buffer, first, &oldest) || !read_slot(buffer, head - 1, &newest))
+        {
+            continue;
+        }
+
+        if (char_offset >= ((newest.start + newest.size) - oldest.start))
+        {
+            return false;
+        }
+
+        struct slot_snapshot found = oldest;
+        bool torn = false;
+        uint64_t low = 0;
+        uint64_t high = count - 1;
+        while (low < high)
+        {
+            uint64_t mid = low + ((high - low + 1) / 2);
+            struct slot_snapshot probe;
+
+            if (!read_slot(buffer, first + mid, &probe))
+            {
+                torn = true;
+                break;
+            }
+
+            if ((probe.start - oldest.start) <= char_offset)
+            {
+                low = mid;
+                found = probe;
+            }
+            else
+            {
+                high = mid - 1;
+            }
+        }
+
+        if (torn)
+        {
+            continue;
+        }
+
+        *position_rtn = first + low;
+        *found_rtn = found;
+        *entry_offset_rtn = char_offset - (found.start - oldest.start);
+        return true;
+    }
+}
+
+/**
+ * @param buffer the buffer to search for corresponding offset.  No locking is needed.
+ * @param char_offset the position to search for in the buffer list, describing the zero referenced
+ *      character index if all buffer strings were concatenated end to end
+ * @param entry_offset_byte_rtn is a pointer specifying a location to store the byte of the returned aesd_buffer_entry
+ *      buffptr member corresponding to char_offset.  This value is set to 0 when no matching char_offset is found
+ *      in aesd_buffer.
+ * @param entry_rtn receives a copy of the matching entry, since the slot itself may be reused as soon as
+ *      this function returns.
+ * @return entry_rtn, or NULL if this position is not available in the buffer (not enough data is written).
+ * The entries searched are the ones published when the lookup started. If writers overwrite one of them
+ * before the lookup finishes, it starts over with the newer entries.
+ */
+struct aesd_buffer_entry *aesd_concurrent_circular_buffer_find_entry_offset_for_fpos(
+            struct aesd_concurrent_circular_buffer *buffer, size_t char_offset,
+            size_t *entry_offset_byte_rtn, struct aesd_buffer_entry *entry_rtn)
+{
+    if ((buffer == NULL) || (entry_offset_byte_rtn == NULL) || (entry_rtn == NULL))
+    {
+        return NULL;
+    }
+
+    uint64_t position;
+    struct slot_snapshot found;
+    size_t entry_offset;
+
+    *entry_offset_byte_rtn = 0;
+
+    if (!locate_entry(buffer, char_offset, &position, &found, &entry_offset))
+    {
+        return NULL;
+    }
+
+    entry_rtn->buffptr = found.buffptr;
+    entry_rtn->size = found.size;
+    *entry_offset_byte_rtn = entry_offset;
+    return entry_rtn;
+}
+
+/**
+ * @param buffer the buffer to copy from.  No locking is needed.
+ * @param char_offset the position to copy from, counted like in aesd_concurrent_circular_buffer_find_entry_offset_for_fpos()
+ * @param buf receives up to @param count bytes from char_offset on, never past the end of the entry holding char_offset
+ * @return the number of bytes copied, or 0 if this position is not available in the buffer.
+ * Unlike the buffptr returned by the lookup, the copy is checked against the slot sequence once made, so payload
+ * memory a writer got back from add_entry and rewrote meanwhile is noticed and the copy starts over.
+ */
+size_t aesd_concurrent_circular_buffer_copy_for_fpos(struct aesd_concurrent_circular_buffer *buffer,
+            size_t char_offset, char *buf, size_t count)
+{
+    if ((buffer == NULL) || ((buf == NULL) && (count > 0)))
+    {
+        return 0;
+    }
+
+    for (;;)
+    {
+        uint64_t position;
+        struct slot_snapshot found;
+        size_t entry_offset;
+
+        if (!locate_entry(buffer, char_offset, &position, &found, &entry_offset))
+        {
+            return 0;
+        }
+
+        size_t len = found.size - entry_offset;
+        if (len > count)
+        {
+            len = count;
+        }
+
+        load_payload(buf, &found.buffptr[entry_offset], len);
+        if (slot_unchanged(buffer, position))
+        {
+            return len;
+        }
+    }
+}
+
+/**
+* Adds entry @param add_entry to @param buffer, dropping the oldest entry once the buffer holds
+* AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED entries. Any number of threads may call it, but adds are serialized:
+* each is published in the order it claimed its position, so a writer waits for earlier writers to finish and
+* one preempted mid-add holds up every writer after it. Only readers are lock-free.
+* Any memory referenced in @param add_entry must be allocated by and/or must have a lifetime managed by the caller.
+* @return the buffptr of the entry whose slot was reused, or NULL if none was. That entry left the buffer
+* AESDCHAR_RING_SIZE - AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED adds earlier, but a reader that looked it up
+* before then may still be using it, so the caller has to make sure no reader is before freeing it. Readers that
+* only use aesd_concurrent_circular_buffer_copy_for_fpos() detect a rewrite, so with them the caller may reuse the
+* memory for a later entry right away, as long as it stays mapped.
+*/
+const char *aesd_concurrent_circular_buffer_add_entry(struct aesd_concurrent_circular_buffer *buffer,
+            const struct aesd_buffer_entry *add_entry)
+{
+    if ((buffer == NULL) || (add_entry == NULL))
+    {
+        return NULL;
+    }
+
+    uint64_t position = atomic_fetch_add_explicit(&buffer->tail, 1, memory_order_relaxed);
+    while (atomic_load_explicit(&buffer->head, memory_order_acquire) != position)
+    {
+        sched_yield();
+    }
+
+    struct aesd_concurrent_buffer_slot *slot = &buffer->slot[position & AESDCHAR_RING_MASK];
+    size_t start = 0;
+    const char *dropped = NULL;
+
+    if (position > 0)
+    {
+        struct aesd_concurrent_buffer_slot *prev = &buffer->slot[(position - 1) & AESDCHAR_RING_MASK];
+        start = atomic_load_explicit(&prev->start, memory_order_relaxed) +
+                atomic_load_explicit(&prev->size, memory_order_relaxed);
+    }
+
+    if (position >= AESDCHAR_RING_SIZE)
+    {
+        dropped = atomic_load_explicit(&slot->buffptr, memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&slot->seq, (2 * position) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&slot->buffptr, add_entry->buffptr, memory_order_relaxed);
+    atomic_store_explicit(&slot->size, add_entry->size, memory_order_relaxed);
+    atomic_store_explicit(&slot->start, start, memory_order_relaxed);
+
+    atomic_store_explicit(&slot->seq, (2 * position) + 2, memory_order_release);
+    atomic_store_explicit(&buffer->head, position + 1, memory_order_release);
+
+    return dropped;
+}
+
+/**
+* Initializes the circular buffer described by @param buffer to an empty struct.
+* Must not race with any reader or writer.
+*/
+void aesd_concurrent_circular_buffer_init(struct aesd_concurrent_circular_buffer *buffer)
+{
+    memset(buffer,0,sizeof(struct aesd_concurrent_circular_buffer));
+}
@@ -0,0 +1,72 @@
+/*
+ * aesd-circular-buffer-concurrent.h
+ *
+ *  Created on: October 18th, 2026
+ *      Author: Looi Kian Seong
+ *
+ * Variant of aesd_circular_buffer for user space with lock-free readers. Any number of threads may
+ * call aesd_concurrent_circular_buffer_find_entry_offset_for_fpos() or
+ * aesd_concurrent_circular_buffer_copy_for_fpos() while entries are added, without an external
+ * lock. Readers never block. Each slot carries a sequence counter, so a reader that races with an
+ * overwrite of the entry it is copying notices and retries. Writers are serialized among
+ * themselves, in the order they claim positions.
+ */
+
+#ifndef AESD_CIRCULAR_BUFFER_CONCURRENT_H
+#define AESD_CIRCULAR_BUFFER_CONCURRENT_H
+
+#ifdef __KERNEL__
+#error "aesd-circular-buffer-concurrent relies on C11 atomics and is user space only"
+#endif
+
+#include <stdatomic.h>
+
+#include "aesd-circular-buffer.h"
+
+struct aesd_concurrent_buffer_slot
+{
+    /**
+     * 2 * position + 1 while the entry for position is being written, 2 * position + 2 once it
+     * is complete. Readers compare it before and after copying the entry.
+     */
+    _Atomic uint64_t seq;
+    /**
+     * A location where the buffer contents in buffptr are stored
+     */
+    _Atomic(const char *) buffptr;
+    /**
+     * Number of bytes stored in buffptr
+     */
+    atomic_size_t size;
+    /**
+     * Number of bytes added to the buffer before this entry, since init
+     */
+    atomic_size_t start;
+};
+
+struct aesd_concurrent_circular_buffer
+{
+    struct aesd_concurrent_buffer_slot slot[AESDCHAR_RING_SIZE];
+    /**
+     * Number of entries published to readers since init
+     */
+    _Alignas(64) _Atomic uint64_t head;
+    /**
+     * Number of entries claimed by writers since init. Writers publish in the order they claim.
+     */
+    _Alignas(64) _Atomic uint64_t tail;
+};
+
+extern struct aesd_buffer_entry *aesd_concurrent_circular_buffer_find_entry_offset_for_fpos(
+            struct aesd_concurrent_circular_buffer *buffer, size_t char_offset,
+            size_t *entry_offset_byte_rtn, struct aesd_buffer_entry *entry_rtn);
+
+extern size_t aesd_concurrent_circular_buffer_copy_for_fpos(struct aesd_concurrent_circular_buffer *buffer,
+            size_t char_offset, char *buf, size_t count);
+
+extern const char *aesd_concurrent_circular_buffer_add_entry(struct aesd_concurrent_circular_buffer *buffer,
+            const struct aesd_buffer_entry *add_entry);
+
+extern void aesd_concurrent_circular_buffer_init(struct aesd_concurrent_circular_buffer *buffer);
+
+#endif /* AESD_CIRCULAR_BUFFER_CONCURRENT_H */
@@ -0,0 +1,399 @@
+/**
+ * @file aesd-circular-buffer-file.c
+ * @brief File backed variant of the circular buffer that survives restarts and crashes
+ *
+ * @author Looi Kian Seong
+ * @date 2026-10-18
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "aesd-circular-buffer-file.h"
+
+/**
+ * @return the size of the header rounded up to a page, so the payload region is page aligned
+ */
+static size_t header_size(void)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return ((sizeof(struct aesd_ring_file_header) + page - 1) / page) * page;
+}
+
+/**
+ * Flushes @param len bytes at @param addr of the mapping to the file, if @param ring syncs its adds
+ * @return 0 on success, -errno on failure
+ */
+static int sync_range(struct aesd_circular_buffer_file *ring, void *addr, size_t len)
+{
+    if (!ring->sync)
+    {
+        return 0;
+    }
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char *begin = (char *)((uintptr_t)addr & ~(uintptr_t)(page - 1));
+
+    if (msync(begin, ((char *)addr - begin) + len, MS_SYNC) != 0)
+    {
+        return -errno;
+    }
+    return 0;
+}
+
+/**
+ * Checks the committed state of a mapped file can be trusted
+ */
+static bool header_valid(struct aesd_ring_file_header *header, size_t file_size)
+{
+    if ((header->magic != AESD_RING_FILE_MAGIC) || (header->version != AESD_RING_FILE_VERSION) ||
+        (header->ring_size != AESDCHAR_RING_SIZE) ||
+        (header->capacity != AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) ||
+        (header->payload_size != (file_size - header_size())))
+    {
+        return false;
+    }
+
+    uint64_t head = atomic_load(&header->head);
+    uint64_t tail = atomic_load(&header->tail);
+    if ((tail > head) || ((head - tail) > AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED))
+    {
+        return false;
+    }
+
+    for (uint64_t position = tail; position != head; position++)
+    {
+        struct aesd_ring_file_descriptor *desc = &header->desc[position & AESDCHAR_RING_MASK];
+        if ((desc->offset > header->payload_size) || (desc->size > (header->payload_size - desc->offset)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+* Opens the ring stored at @param path in @param ring, creating it with a payload region of @param payload_size
+* bytes if the file is new or was never completely initialized. @param payload_size may be 0 to open an
+* existing ring with whatever size it was created with.
+* When @param sync is set every add waits for each of its steps to reach the disk.
+* Any necessary locking must be handled by the caller, one process at a time.
+* @return 0 on success, -EINVAL if the file is not a ring created with this build's geometry or payload_size,
+* or -errno from the failing call, -ENOENT when payload_size is 0 and there is no file.
+*/
+int aesd_circular_buffer_file_open(struct aesd_circular_buffer_file *ring, const char *path,
+            size_t payload_size, bool sync)
+{
+    if ((ring == NULL) || (path == NULL))
+    {
+        return -EINVAL;
+    }
+
+    memset(ring,0,sizeof(struct aesd_circular_buffer_file));
+    ring->fd = -1;
+    ring->sync = sync;
+
+    int fd = open(path, O_RDWR | O_CLOEXEC | ((payload_size != 0) ? O_CREAT : 0), 0644);
+    if (fd < 0)
+    {
+        return -errno;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        int rc = -errno;
+        close(fd);
+        return rc;
+    }
+
+    bool create = ((size_t)st.st_size < header_size());
+    if (!create)
+    {
+        /* A header without its magic is a create that did not finish */
+        uint64_t magic = 0;
+        if ((pread(fd, &magic, sizeof(magic), 0) == (ssize_t)sizeof(magic)) && (magic == 0))
+        {
+            create = true;
+        }
+    }
+
+    size_t map_size = create ? (header_size() + payload_size) : (size_t)st.st_size;
+    if (create && ((payload_size == 0) || (ftruncate(fd, 0) != 0) || (ftruncate(fd, map_size) != 0)))
+    {
+        int rc = (payload_size == 0) ? -EINVAL : -errno;
+        close(fd);
+        return rc;
+    }
+
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        int rc = -errno;
+        close(fd);
+        return rc;
+    }
+
+    ring->fd = fd;
+    ring->map = map;
+    ring->map_size = map_size;
+    ring->header = map;
+    ring->payload = (char *)map + header_size();
+
+    struct aesd_ring_file_header *header = ring->header;
+    if (create)
+    {
+        header->version = AESD_RING_FILE_VERSION;
+        header->ring_size = AESDCHAR_RING_SIZE;
+        header->capacity = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+        header->payload_size = payload_size;
+
+        /* The magic goes in last, once the rest of the header is on disk */
+        int rc = sync_range(ring, header, sizeof(*header));
+        if (rc == 0)
+        {
+            header->magic = AESD_RING_FILE_MAGIC;
+            rc = sync_range(ring, header, sizeof(header->magic));
+        }
+        if (rc != 0)
+        {
+            aesd_circular_buffer_file_close(ring);
+            return rc;
+        }
+    }
+    else if (!header_valid(header, map_size) || ((payload_size != 0) && (payload_size != header->payload_size)))
+    {
+        aesd_circular_buffer_file_close(ring);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/**
+* Unmaps and closes @param ring. Committed entries stay in the file.
+*/
+void aesd_circular_buffer_file_close(struct aesd_circular_buffer_file *ring)
+{
+    if (ring == NULL)
+    {
+        return;
+    }
+
+    if (ring->map != NULL)
+    {
+        munmap(ring->map, ring->map_size);
+    }
+    if (ring->fd >= 0)
+    {
+        close(ring->fd);
+    }
+
+    ring->map = NULL;
+    ring->header = NULL;
+    ring->payload = NULL;
+    ring->fd = -1;
+}
+
+/**
+* Finds room for @param size bytes in the payload region, given the entries from *@param tail to @param head
+* are live, advancing *tail past the oldest entries until there is. Entries sit in the payload region in the
+* order they were added, wrapping to its start when the end has no room.
+* @return the payload offset to store at
+*/
+static uint64_t reserve_payload(struct aesd_ring_file_header *header, uint64_t head, uint64_t *tail, size_t size)
+{
+    for (;; (*tail)++)
+    {
+        if (*tail == head)
+        {
+            return 0;
+        }
+
+        struct aesd_ring_file_descriptor *oldest = &header->desc[*tail & AESDCHAR_RING_MASK];
+        struct aesd_ring_file_descriptor *newest = &header->desc[(head - 1) & AESDCHAR_RING_MASK];
+        uint64_t newest_end = newest->offset + newest->size;
+
+        if (newest_end > oldest->offset)
+        {
+            if ((header->payload_size - newest_end) >= size)
+            {
+                return newest_end;
+            }
+            if (oldest->offset >= size)
+            {
+                return 0;
+            }
+        }
+        else if ((oldest->offset - newest_end) >= size)
+        {
+            return newest_end;
+        }
+    }
+}
+
+/**
+* Copies the payload of @param add_entry into @param ring and commits it as the newest entry, first dropping
+* the oldest entries if the ring is full or their bytes are needed.
+* Any necessary locking must be handled by the caller
+* @return 0 on success, -EINVAL if the payload is empty or larger than the payload region, -errno if a sync
+* failed, in which case the entry may or may not be committed.
+*/
+int aesd_circular_buffer_file_add_entry(struct aesd_circular_buffer_file *ring,
+            const struct aesd_buffer_entry *add_entry)
+{
+    if ((ring == NULL) || (ring->header == NULL) || (add_entry == NULL))
+    {
+        return -EINVAL;
+    }
+
+    struct aesd_ring_file_header *header = ring->header;
+    if ((add_entry->size == 0) || (add_entry->size > header->payload_size))
+    {
+        return -EINVAL;
+    }
+
+    uint64_t head = atomic_load_explicit(&header->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&header->tail, memory_order_relaxed);
+    uint64_t new_tail = tail;
+
+    if ((head - new_tail) == AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED)
+    {
+        new_tail++;
+    }
+
+    uint64_t offset = reserve_payload(header, head, &new_tail, add_entry->size);
+    int rc;
+
+    /* Drop entries before reusing their bytes */
+    if (new_tail != tail)
+    {
+        atomic_store_explicit(&header->tail, new_tail, memory_order_release);
+        rc = sync_range(ring, &header->tail, sizeof(header->tail));
+        if (rc != 0)
+        {
+            return rc;
+        }
+    }
+
+    /*
+     * The slot for head held position head - AESDCHAR_RING_SIZE, which left the ring at least
+     * AESDCHAR_RING_SIZE - AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED entries ago
+     */
+    struct aesd_ring_file_descriptor *desc = &header->desc[head & AESDCHAR_RING_MASK];
+    uint64_t start = 0;
+    if (head > 0)
+    {
+        struct aesd_ring_file_descriptor *prev = &header->desc[(head - 1) & AESDCHAR_RING_MASK];
+        start = prev->start + prev->size;
+    }
+
+    memcpy(ring->payload + offset, add_entry->buffptr, add_entry->size);
+    desc->offset = offset;
+    desc->size = add_entry->size;
+    desc->start = start;
+
+    rc = sync_range(ring, ring->payload + offset, add_entry->size);
+    if (rc == 0)
+    {
+        rc = sync_range(ring, desc, sizeof(*desc));
+    }
+    if (rc != 0)
+    {
+        return rc;
+    }
+
+    /* Publish */
+    atomic_store_explicit(&header->head, head + 1, memory_order_release);
+    return sync_range(ring, &header->head, sizeof(header->head));
+}
+
+/**
+ * @param ring the ring to search for corresponding offset.  Any necessary locking must be performed by caller.
+ * @param char_offset the position to search for in the ring, describing the zero referenced
+ *      character index if all entries were concatenated end to end
+ * @param entry_offset_byte_rtn is a pointer specifying a location to store the byte of the returned entry
+ *      buffptr member corresponding to char_offset.  This value is only set when a matching char_offset is found.
+ * @param entry_rtn receives the matching entry, whose buffptr points into the mapping and stays valid until
+ *      the entry is dropped or the ring is closed.
+ * @return entry_rtn, or NULL if this position is not available in the ring (not enough data is written).
+ */
+struct aesd_buffer_entry *aesd_circular_buffer_file_find_entry_offset_for_fpos(
+            struct aesd_circular_buffer_file *ring, size_t char_offset,
+            size_t *entry_offset_byte_rtn, struct aesd_buffer_entry *entry_rtn)
+{
+    if ((ring == NULL) || (ring->header == NULL) || (entry_offset_byte_rtn == NULL) || (entry_rtn == NULL))
+    {
+        return NULL;
+    }
+
+    *entry_offset_byte_rtn = 0;
+
+    struct aesd_ring_file_header *header = ring->header;
+    uint64_t head = atomic_load_explicit(&header->head, memory_order_acquire);
+    uint64_t tail = atomic_load_explicit(&header->tail, memory_order_acquire);
+    if (head == tail)
+    {
+        return NULL;
+    }
+
+    struct aesd_ring_file_descriptor *oldest = &header->desc[tail & AESDCHAR_RING_MASK];
+    struct aesd_ring_file_descriptor *newest = &header->desc[(head - 1) & AESDCHAR_RING_MASK];
+    uint64_t base = oldest->start;
+    if (char_offset >= ((newest->start + newest->size) - base))
+    {
+        return NULL;
+    }
+
+    /* Binary search for the last entry starting at or before char_offset */
+    uint64_t low = tail;
+    uint64_t high = head - 1;
+    while (low < high)
+    {
+        uint64_t mid = low + ((high - low + 1) / 2);
+
+        if ((header->desc[mid & AESDCHAR_RING_MASK].start - base) <= char_offset)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+
+    struct aesd_ring_file_descriptor *found = &header->desc[low & AESDCHAR_RING_MASK];
+    entry_rtn->buffptr = ring->payload + found->offset;
+    entry_rtn->size = found->size;
+    *entry_offset_byte_rtn = char_offset - (found->start - base);
+    return entry_rtn;
+}
+
+/**
+* @return the number of payload bytes held by the entries currently in @param ring
+*/
+size_t aesd_circular_buffer_file_bytes_held(struct aesd_circular_buffer_file *ring)
+{
+    if ((ring == NULL) || (ring->header == NULL))
+    {
+        return 0;
+    }
+
+    struct aesd_ring_file_header *header = ring->header;
+    uint64_t head = atomic_load(&header->head);
+    uint64_t tail = atomic_load(&header->tail);
+    if (head == tail)
+    {
+        return 0;
+    }
+
+    struct aesd_ring_file_descriptor *newest = &header->desc[(head - 1) & AESDCHAR_RING_MASK];
+    return (newest->start + newest->size) - header->desc[tail & AESDCHAR_RING_MASK].start;
+}
@@ -0,0 +1,103 @@
+/*
+ * aesd-circular-buffer-file.h
+ *
+ *  Created on: October 18th, 2026
+ *      Author: Looi Kian Seong
+ *
+ * File backed variant of aesd_circular_buffer for user space. The ring lives in a fixed size file
+ * mapped into memory: a header with the committed head and tail positions and one descriptor per
+ * slot, followed by the payload region. Every add writes the payload and its descriptor before a
+ * single store to head publishes them, and any entries it has to drop for room are dropped by a store
+ * to tail before their bytes are reused, so a crash at any point leaves the last committed ring.
+ * Reopening only validates the header.
+ */
+
+#ifndef AESD_CIRCULAR_BUFFER_FILE_H
+#define AESD_CIRCULAR_BUFFER_FILE_H
+
+#ifdef __KERNEL__
+#error "aesd-circular-buffer-file maps a file and is user space only"
+#endif
+
+#include <stdatomic.h>
+
+#include "aesd-circular-buffer.h"
+
+/**
+ * "AESDRING" read as a little endian 64 bit value
+ */
+#define AESD_RING_FILE_MAGIC    0x474e495244534541ULL
+#define AESD_RING_FILE_VERSION  1
+
+struct aesd_ring_file_descriptor
+{
+    /**
+     * Offset of the payload in the payload region
+     */
+    uint64_t offset;
+    /**
+     * Number of bytes in the payload
+     */
+    uint64_t size;
+    /**
+     * Number of bytes added to the ring before this entry, since the file was created
+     */
+    uint64_t start;
+};
+
+struct aesd_ring_file_header
+{
+    uint64_t magic;
+    uint32_t version;
+    /**
+     * AESDCHAR_RING_SIZE and AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED the file was created with
+     */
+    uint32_t ring_size;
+    uint32_t capacity;
+    uint32_t reserved;
+    /**
+     * Number of bytes in the payload region
+     */
+    uint64_t payload_size;
+    /**
+     * Number of entries committed since the file was created
+     */
+    _Atomic uint64_t head;
+    /**
+     * Position of the oldest entry still in the ring
+     */
+    _Atomic uint64_t tail;
+    struct aesd_ring_file_descriptor desc[AESDCHAR_RING_SIZE];
+};
+
+struct aesd_circular_buffer_file
+{
+    int fd;
+    /**
+     * The whole file, header first
+     */
+    void *map;
+    size_t map_size;
+    struct aesd_ring_file_header *header;
+    char *payload;
+    /**
+     * msync() each step of an add before the next, so the ordering also holds across power loss
+     */
+    bool sync;
+};
+
+extern int aesd_circular_buffer_file_open(struct aesd_circular_buffer_file *ring, const char *path,
+            size_t payload_size, bool sync);
+
+extern void aesd_circular_buffer_file_close(struct aesd_circular_buffer_file *ring);
+
+extern int aesd_circular_buffer_file_add_entry(struct aesd_circular_buffer_file *ring,
+            const struct aesd_buffer_entry *add_entry);
+
+extern struct aesd_buffer_entry *aesd_circular_buffer_file_find_entry_offset_for_fpos(
+            struct aesd_circular_buffer_file *ring, size_t char_offset,
+            size_t *entry_offset_byte_rtn, struct aesd_buffer_entry *entry_rtn);
+
+extern size_t aesd_circular_buffer_file_bytes_held(struct aesd_circular_buffer_file *ring);
+
+#endif /* AESD_CIRCULAR_BUFFER_FILE_H */
@@ -16,12 +16,54 @@
 
 #include "aesd-circular-buffer.h"
 
+/**
+ * Locates @param char_offset in @param buffer.
+ * @param position_rtn receives the position of the matching entry, counted from buffer->out_offs
+ * @param entry_offset_byte_rtn receives the byte within that entry
+ * @return false if this position is not available in the buffer
+ */
+static bool find_position(struct aesd_circular_buffer *buffer, size_t char_offset,
+            uint32_t *position_rtn, size_t *entry_offset_byte_rtn)
+{
+    size_t base = buffer->entry_start[buffer->out_offs];
+    if ((buffer->count == 0) || (char_offset >= (buffer->total_size - base)))
+    {
+        return false;
+    }
+
+    /*
+     * Binary search for the last entry starting at or before char_offset. Positions are counted
+     * from out_offs so the search range does not wrap.
+     */
+    uint32_t low = 0;
+    uint32_t high = buffer->count - 1;
+    while (low < high)
+    {
+        uint32_t mid = low + ((high - low + 1) / 2);
+        uint32_t index = (buffer->out_offs + mid) & AESDCHAR_RING_MASK;
+
+        if ((buffer->entry_start[index] - base) <= char_offset)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+
+    uint32_t index = (buffer->out_offs + low) & AESDCHAR_RING_MASK;
+    *position_rtn = low;
+    *entry_offset_byte_rtn = char_offset - (buffer->entry_start[index] - base);
+    return true;
+}
+
 /**
  * @param buffer the buffer to search for corresponding offset.  Any necessary locking must be performed by caller.
  * @param char_offset the position to search for in the buffer list, describing the zero referenced
  *      character index if all buffer strings were concatenated end to end
  * @param entry_offset_byte_rtn is a pointer specifying a location to store the byte of the returned aesd_buffer_entry
- *      buffptr member corresponding to char_offset.  This value is only set when a matching char_offset is found
+ *      buffptr member corresponding to char_offset.  This value is set to 0 when no matching char_offset is found
  *      in aesd_buffer.
  * @return the struct aesd_buffer_entry structure representing the position described by char_offset, or
  * NULL if this position is not available in the buffer (not enough data is written).
@@ -34,61 +76,351 @@ struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct
         return NULL;
     }
 
-    bool is_first = true;
-    size_t char_len = 0;
     *entry_offset_byte_rtn = 0;
-    struct aesd_buffer_entry *entry = &buffer->entry[buffer->out_offs];
-    
-    for (uint8_t index = buffer->out_offs; 
-         (char_len <= char_offset) && ((index != buffer->in_offs) || (buffer->full && is_first)); 
-         index = (index + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED)
+
+    uint32_t position;
+    if (!find_position(buffer, char_offset, &position, entry_offset_byte_rtn))
+    {
+        return NULL;
+    }
+
+    return &buffer->entry[(buffer->out_offs + position) & AESDCHAR_RING_MASK];
+}
+
+/**
+ * Describes up to @param len bytes of @param buffer starting at @param char_offset as an iovec array,
+ * one element per entry touched, so the range can be handed to a single writev() or sendmsg().
+ * Any necessary locking must be performed by caller, and held until the iovec array is consumed.
+ * @param iov receives the elements, which point into the entries' buffptr memory
+ * @param iov_max is the number of elements available in iov
+ * @param iov_cnt_rtn receives the number of elements filled in
+ * @return the number of bytes described, less than len if the buffer ends first or iov_max elements
+ * are not enough, 0 if char_offset is not available in the buffer.
+ */
+size_t aesd_circular_buffer_fill_iovec(struct aesd_circular_buffer *buffer, size_t char_offset, size_t len,
+            struct iovec *iov, size_t iov_max, size_t *iov_cnt_rtn)
+{
+    if (iov_cnt_rtn != NULL)
+    {
+        *iov_cnt_rtn = 0;
+    }
+
+    if ((buffer == NULL) || (iov == NULL) || (iov_cnt_rtn == NULL))
     {
-        if ((char_len + buffer->entry[index].size) > char_offset)
+        return 0;
+    }
+
+    uint32_t position;
+    size_t entry_offset;
+    if (!find_position(buffer, char_offset, &position, &entry_offset))
+    {
+        return 0;
+    }
+
+    size_t filled = 0;
+    size_t iov_cnt = 0;
+    for (; (position < buffer->count) && (filled < len) && (iov_cnt < iov_max); position++)
+    {
+        struct aesd_buffer_entry *entry = &buffer->entry[(buffer->out_offs + position) & AESDCHAR_RING_MASK];
+        size_t chunk = entry->size - entry_offset;
+
+        if (chunk > (len - filled))
         {
-            *entry_offset_byte_rtn = char_offset - char_len;
-            entry = &buffer->entry[index];
+            chunk = len - filled;
         }
 
-        char_len += buffer->entry[index].size;
-        is_first = false;
+        if (chunk > 0)
+        {
+            iov[iov_cnt].iov_base = (void *)(entry->buffptr + entry_offset);
+            iov[iov_cnt].iov_len = chunk;
+            iov_cnt++;
+            filled += chunk;
+        }
+
+        entry_offset = 0;
+    }
+
+    *iov_cnt_rtn = iov_cnt;
+    return filled;
+}
+
+/**
+ * Copies up to @param len bytes of @param buffer starting at @param char_offset into @param dest.
+ * Any necessary locking must be performed by caller.
+ * @return the number of bytes copied, less than len if the buffer ends first.
+ */
+size_t aesd_circular_buffer_read_range(struct aesd_circular_buffer *buffer, size_t char_offset,
+            void *dest, size_t len)
+{
+    if ((buffer == NULL) || (dest == NULL))
+    {
+        return 0;
+    }
+
+    uint32_t position;
+    size_t entry_offset;
+    if (!find_position(buffer, char_offset, &position, &entry_offset))
+    {
+        return 0;
+    }
+
+    size_t copied = 0;
+    for (; (position < buffer->count) && (copied < len); position++)
+    {
+        struct aesd_buffer_entry *entry = &buffer->entry[(buffer->out_offs + position) & AESDCHAR_RING_MASK];
+        size_t chunk = entry->size - entry_offset;
+
+        if (chunk > (len - copied))
+        {
+            chunk = len - copied;
+        }
+
+        memcpy((char *)dest + copied, entry->buffptr + entry_offset, chunk);
+        copied += chunk;
+        entry_offset = 0;
     }
 
-    if (char_len <= char_offset)
+    return copied;
+}
+
+/**
+* Drops the oldest entry of @param buffer, handing it to the eviction callback if one is set.
+* @return the buffptr of the dropped entry
+*/
+static const char *drop_oldest(struct aesd_circular_buffer *buffer)
+{
+    struct aesd_buffer_entry *oldest = &buffer->entry[buffer->out_offs];
+    const char *buffptr = oldest->buffptr;
+
+    if (buffer->evict != NULL)
+    {
+        buffer->evict(buffer->evict_ctx, oldest);
+    }
+
+    /* The slot now belongs to the caller's dropped pointer, leave nothing behind to free twice */
+    oldest->buffptr = NULL;
+    oldest->size = 0;
+    buffer->out_offs = (buffer->out_offs + 1) & AESDCHAR_RING_MASK;
+    buffer->count--;
+    buffer->full = false;
+    return buffptr;
+}
+
+static void push_entry(struct aesd_circular_buffer *buffer, const char *buffptr, size_t size)
+{
+    uint32_t in_offs = buffer->in_offs;
+
+    buffer->entry[in_offs].buffptr = buffptr;
+    buffer->entry[in_offs].size = size;
+    buffer->entry_start[in_offs] = buffer->total_size;
+    buffer->total_size += size;
+    buffer->in_offs = (in_offs + 1) & AESDCHAR_RING_MASK;
+    buffer->count++;
+    buffer->full = (buffer->count == AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED);
+}
+
+/**
+* Finds room for @param size bytes in the arena of @param buffer, dropping the oldest entries until
+* there is. Entries sit in the arena in the order they were added, wrapping to the start of the arena
+* when the end has no room, so the free space is the gap after the newest entry and, once the newest
+* entry has wrapped, before the oldest one.
+* @return the arena offset to store at
+*/
+static size_t reserve_arena(struct aesd_circular_buffer *buffer, size_t size)
+{
+    for (;;)
+    {
+        if (buffer->count == 0)
+        {
+            return 0;
+        }
+
+        struct aesd_buffer_entry *oldest = &buffer->entry[buffer->out_offs];
+        struct aesd_buffer_entry *newest = &buffer->entry[(buffer->in_offs - 1) & AESDCHAR_RING_MASK];
+        size_t oldest_offs = oldest->buffptr - buffer->arena;
+        size_t newest_end = (newest->buffptr - buffer->arena) + newest->size;
+
+        if (newest_end > oldest_offs)
+        {
+            if ((buffer->arena_size - newest_end) >= size)
+            {
+                return newest_end;
+            }
+            if (oldest_offs >= size)
+            {
+                return 0;
+            }
+        }
+        else if ((oldest_offs - newest_end) >= size)
+        {
+            return newest_end;
+        }
+
+        drop_oldest(buffer);
+    }
+}
+
+/**
+* Copies the payload of @param add_entry into the arena of @param buffer and adds it as the newest entry,
+* dropping as many of the oldest entries as it takes to make room.
+* Any necessary locking must be handled by the caller
+* @return the stored entry, whose buffptr points into the arena, or NULL if the buffer does not own its
+* memory, or the payload is empty or larger than the whole arena.
+*/
+struct aesd_buffer_entry *aesd_circular_buffer_copy_entry(struct aesd_circular_buffer *buffer,
+            const struct aesd_buffer_entry *add_entry)
+{
+    if ((buffer == NULL) || (add_entry == NULL) || (buffer->arena == NULL) ||
+        (add_entry->size == 0) || (add_entry->size > buffer->arena_size))
     {
         return NULL;
     }
 
-    return entry;
+    if (buffer->full)
+    {
+        drop_oldest(buffer);
+    }
+
+    size_t offs = reserve_arena(buffer, add_entry->size);
+    uint32_t in_offs = buffer->in_offs;
+
+    memcpy(buffer->arena + offs, add_entry->buffptr, add_entry->size);
+    push_entry(buffer, buffer->arena + offs, add_entry->size);
+    return &buffer->entry[in_offs];
 }
 
 /**
 * Adds entry @param add_entry to @param buffer in the location specified in buffer->in_offs.
-* If the buffer was already full, overwrites the oldest entry and advances buffer->out_offs to the
-* new start location.
+* If the buffer was already full, drops the oldest entry and advances buffer->out_offs to the
+* new start location. Dropped entries are also handed to the eviction callback, if one is set.
 * Any necessary locking must be handled by the caller
-* Any memory referenced in @param add_entry must be allocated by and/or must have a lifetime managed by the caller.
+* Any memory referenced in @param add_entry must be allocated by and/or must have a lifetime managed by the caller,
+* unless the buffer owns its memory, in which case the payload is copied as by aesd_circular_buffer_copy_entry().
+* @return the buffptr of the entry dropped to make room, so the caller can release it, or NULL if none was dropped
+* or the buffer owns its memory.
 */
-void aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry)
+const char *aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry)
 {
     if ((buffer == NULL) || (add_entry == NULL))
     {
-        return;
+        return NULL;
     }
 
-    uint8_t in_offs = buffer->in_offs;
-    uint8_t out_offs = buffer->out_offs;
+    if (buffer->arena != NULL)
+    {
+        aesd_circular_buffer_copy_entry(buffer, add_entry);
+        return NULL;
+    }
 
-    buffer->entry[in_offs] = *add_entry;
-    buffer->in_offs = (in_offs + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    const char *dropped = NULL;
 
     if (buffer->full)
     {
-        buffer->out_offs = (out_offs + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+        dropped = drop_oldest(buffer);
+    }
+
+    push_entry(buffer, add_entry->buffptr, add_entry->size);
+    return dropped;
+}
+
+/**
+* Adds the @param n entries of @param add_entries to @param buffer, oldest first, with the same result as
+* adding them one at a time with aesd_circular_buffer_add_entry(). Entries dropped to make room, including
+* ones from this batch when n exceeds the capacity, are only reported through the eviction callback.
+* Any necessary locking must be handled by the caller
+* @return the number of entries added, which is less than n only if the buffer owns its memory and some
+* payloads could not be copied.
+*/
+size_t aesd_circular_buffer_add_entries(struct aesd_circular_buffer *buffer,
+            const struct aesd_buffer_entry *add_entries, size_t n)
+{
+    if ((buffer == NULL) || (add_entries == NULL))
+    {
+        return 0;
+    }
+
+    if (buffer->arena != NULL)
+    {
+        size_t added = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (aesd_circular_buffer_copy_entry(buffer, &add_entries[i]) != NULL)
+            {
+                added++;
+            }
+        }
+        return added;
+    }
+
+    /* Entries the batch pushes out before they would ever be read */
+    size_t skip = 0;
+    if (n > AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED)
+    {
+        skip = n - AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
     }
-    else if (buffer->in_offs == buffer->out_offs)
+
+    size_t keep = n - skip;
+    size_t room = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - buffer->count;
+    while ((buffer->count > 0) && (keep > room))
     {
-        buffer->full = true;
+        drop_oldest(buffer);
+        room++;
     }
+
+    size_t total_size = buffer->total_size;
+    for (size_t i = 0; i < skip; i++)
+    {
+        if (buffer->evict != NULL)
+        {
+            buffer->evict(buffer->evict_ctx, &add_entries[i]);
+        }
+        total_size += add_entries[i].size;
+    }
+
+    uint32_t in_offs = buffer->in_offs;
+    for (size_t i = skip; i < n; i++)
+    {
+        buffer->entry[in_offs] = add_entries[i];
+        buffer->entry_start[in_offs] = total_size;
+        total_size += add_entries[i].size;
+        in_offs = (in_offs + 1) & AESDCHAR_RING_MASK;
+    }
+
+    buffer->in_offs = in_offs;
+    buffer->total_size = total_size;
+    buffer->count += keep;
+    buffer->full = (buffer->count == AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED);
+    if (buffer->count == keep)
+    {
+        /* Everything older was dropped, the batch now starts the buffer */
+        buffer->out_offs = (in_offs - keep) & AESDCHAR_RING_MASK;
+    }
+
+    return n;
+}
+
+/**
+* @return the number of payload bytes held by the entries currently in @param buffer
+*/
+size_t aesd_circular_buffer_bytes_held(struct aesd_circular_buffer *buffer)
+{
+    if ((buffer == NULL) || (buffer->count == 0))
+    {
+        return 0;
+    }
+
+    return buffer->total_size - buffer->entry_start[buffer->out_offs];
+}
+
+/**
+* Sets @param evict to be called with @param ctx for every entry dropped from @param buffer, before it is
+* dropped. When the buffer owns its memory the entry's buffptr is only valid until the callback returns.
+*/
+void aesd_circular_buffer_set_evict_callback(struct aesd_circular_buffer *buffer,
+            aesd_circular_buffer_evict_fn evict, void *ctx)
+{
+    buffer->evict = evict;
+    buffer->evict_ctx = ctx;
 }
 
 /**
@@ -98,3 +430,15 @@ void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer)
 {
     memset(buffer,0,sizeof(struct aesd_circular_buffer));
 }
+
+/**
+* Initializes @param buffer to an empty struct that owns its memory: payloads are copied into
+* @param arena of @param arena_size bytes, allocated and freed by the caller, so adding an entry
+* never allocates and the buffer never holds more than arena_size bytes.
+*/
+void aesd_circular_buffer_init_owned(struct aesd_circular_buffer *buffer, char *arena, size_t arena_size)
+{
+    aesd_circular_buffer_init(buffer);
+    buffer->arena = arena;
+    buffer->arena_size = arena_size;
+}
@@ -10,13 +10,46 @@
 
 #ifdef __KERNEL__
 #include <linux/types.h>
+#include <linux/uio.h>
 #else
 #include <stddef.h> // size_t
 #include <stdint.h> // uintx_t
 #include <stdbool.h>
+#include <sys/uio.h> // struct iovec
 #endif
 
+/**
+ * Number of most recent write operations kept, override with -D to size the buffer
+ */
+#ifndef AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED
 #define AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED 10
+#endif
+
+/**
+ * Smallest power of two not below @param n, for 1 <= n <= 2^32, as a constant expression
+ */
+#define AESDCHAR_SMEAR(n, shift) ((n) | ((n) >> (shift)))
+#define AESDCHAR_NEXT_POW2(n) (AESDCHAR_SMEAR(AESDCHAR_SMEAR(AESDCHAR_SMEAR(AESDCHAR_SMEAR(AESDCHAR_SMEAR( \
+            ((unsigned long)(n) - 1UL), 1), 2), 4), 8), 16) + 1UL)
+
+/**
+ * Number of entry slots backing the buffer. Slot indexes wrap with a mask instead of a modulo,
+ * so this has to be a power of two, and at least AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED.
+ * Defaults to the smallest one that holds them, at least 16.
+ */
+#ifndef AESDCHAR_RING_SIZE
+#if AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED <= 16
+#define AESDCHAR_RING_SIZE 16
+#else
+#define AESDCHAR_RING_SIZE AESDCHAR_NEXT_POW2(AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED)
+#endif
+#endif
+
+#define AESDCHAR_RING_MASK (AESDCHAR_RING_SIZE - 1U)
+
+_Static_assert((AESDCHAR_RING_SIZE & AESDCHAR_RING_MASK) == 0, "AESDCHAR_RING_SIZE must be a power of two");
+_Static_assert(AESDCHAR_RING_SIZE >= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED,
+               "AESDCHAR_RING_SIZE must hold AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED entries");
 
 struct aesd_buffer_entry
 {
@@ -30,52 +63,108 @@ struct aesd_buffer_entry
     size_t size;
 };
 
+/**
+ * Called with each entry dropped from the buffer, see aesd_circular_buffer_set_evict_callback()
+ */
+typedef void (*aesd_circular_buffer_evict_fn)(void *ctx, const struct aesd_buffer_entry *entry);
+
 struct aesd_circular_buffer
 {
+    /**
+     * Number of bytes written to the buffer before the entry in the same slot, since init.
+     * Offsets of the entries relative to the oldest one are differences of these, so they
+     * keep working when the running total wraps. Lookups only touch this array, so it is kept
+     * apart from the entries and starts on its own cache line.
+     */
+    _Alignas(64) size_t entry_start[AESDCHAR_RING_SIZE];
     /**
      * An array of pointers to memory allocated for the most recent write operations
      */
-    struct aesd_buffer_entry  entry[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    struct aesd_buffer_entry  entry[AESDCHAR_RING_SIZE];
     /**
      * The current location in the entry structure where the next write should
      * be stored.
      */
-    uint8_t in_offs;
+    uint32_t in_offs;
     /**
      * The first location in the entry structure to read from
      */
-    uint8_t out_offs;
+    uint32_t out_offs;
+    /**
+     * Number of entries between out_offs and in_offs
+     */
+    uint32_t count;
+    /**
+     * Number of bytes written to the buffer since init
+     */
+    size_t total_size;
     /**
      * set to true when the buffer entry structure is full
      */
     bool full;
+    /**
+     * Memory payloads are copied into when the buffer owns its memory, NULL otherwise
+     */
+    char *arena;
+    /**
+     * Number of bytes in arena
+     */
+    size_t arena_size;
+    /**
+     * Called for every entry dropped from the buffer, may be NULL
+     */
+    aesd_circular_buffer_evict_fn evict;
+    /**
+     * Passed to evict
+     */
+    void *evict_ctx;
 };
 
 extern struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct aesd_circular_buffer *buffer,
             size_t char_offset, size_t *entry_offset_byte_rtn );
 
-extern void aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry);
+extern size_t aesd_circular_buffer_fill_iovec(struct aesd_circular_buffer *buffer, size_t char_offset, size_t len,
+            struct iovec *iov, size_t iov_max, size_t *iov_cnt_rtn);
+
+extern size_t aesd_circular_buffer_read_range(struct aesd_circular_buffer *buffer, size_t char_offset,
+            void *dest, size_t len);
+
+extern const char *aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry);
+
+extern size_t aesd_circular_buffer_add_entries(struct aesd_circular_buffer *buffer,
+            const struct aesd_buffer_entry *add_entries, size_t n);
+
+extern struct aesd_buffer_entry *aesd_circular_buffer_copy_entry(struct aesd_circular_buffer *buffer,
+            const struct aesd_buffer_entry *add_entry);
+
+extern size_t aesd_circular_buffer_bytes_held(struct aesd_circular_buffer *buffer);
+
+extern void aesd_circular_buffer_set_evict_callback(struct aesd_circular_buffer *buffer,
+            aesd_circular_buffer_evict_fn evict, void *ctx);
 
 extern void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer);
 
+extern void aesd_circular_buffer_init_owned(struct aesd_circular_buffer *buffer, char *arena, size_t arena_size);
+
 /**
- * Create a for loop to iterate over each member of the circular buffer.
- * Useful when you've allocated memory for circular buffer entries and need to free it
+ * Create a for loop to iterate over each entry held by the circular buffer, oldest first.
+ * Useful when you've allocated memory for circular buffer entries and need to free it.
+ * Entries already dropped were handed back by aesd_circular_buffer_add_entry() and are not visited.
  * @param entryptr is a struct aesd_buffer_entry* to set with the current entry
  * @param buffer is the struct aesd_buffer * describing the buffer
- * @param index is a uint8_t stack allocated value used by this macro for an index
+ * @param index is a uint32_t stack allocated value used by this macro for an index
  * Example usage:
- * uint8_t index;
+ * uint32_t index;
  * struct aesd_circular_buffer buffer;
  * struct aesd_buffer_entry *entry;
  * AESD_CIRCULAR_BUFFER_FOREACH(entry,&buffer,index) {
- *      free(entry->buffptr);
+ *      free((void *)entry->buffptr);
  * }
  */
 #define AESD_CIRCULAR_BUFFER_FOREACH(entryptr,buffer,index) \
-    for(index=0, entryptr=&((buffer)->entry[index]); \
-            index<AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED; \
-            index++, entryptr=&((buffer)->entry[index]))
+    for(index=0, entryptr=&((buffer)->entry[(buffer)->out_offs]); \
+            index<(buffer)->count; \
+            index++, entryptr=&((buffer)->entry[((buffer)->out_offs + index) & AESDCHAR_RING_MASK]))
 
 
 
@@ -0,0 +1,328 @@
+/**
+ * @file aesd-circular-buffer-bench.c
+ * @brief Microbenchmark for aesd-circular-buffer.c add and lookup throughput
+ *
+ * Measures add_entry and add_entries rates, and find_entry_offset_for_fpos latency at several
+ * fill levels and entry size distributions, with the live entries both contiguous in the ring
+ * and wrapped around its end. Each case runs a fixed, seeded workload several times and
+ * reports the fastest run, which is the one least disturbed by the rest of the machine, and
+ * results are printed as JSON in a fixed order so runs can be diffed.
+ *
+ * Usage: aesd-circular-buffer-bench [-o results.json] [-b baseline.json] [-t tolerance_percent]
+ * With -b, each case is compared with the same case in a previous result file and the exit
+ * status is 2 if any case got slower by more than the tolerance, 10% by default.
+ *
+ * @author Looi Kian Seong
+ * @date 2026-10-18
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aesd-circular-buffer.h"
+
+#define CAPACITY            (AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED)
+#define REPETITIONS         (7)
+#define OPS_PER_REPETITION  (1000000)
+#define LOOKUP_OFFSETS      (4096)
+#define MAX_CASES           (64)
+#define MAX_NAME            (64)
+#define PAYLOAD_BYTES       (8192)
+
+typedef enum
+{
+    SIZES_FIXED,
+    SIZES_UNIFORM,
+    SIZES_SKEWED,
+} SizeDistribution_t;
+
+static const char *const size_distribution_names[] = { "fixed", "uniform", "skewed" };
+
+typedef struct
+{
+    char name[MAX_NAME];
+    double ns_per_op;
+} BenchResult_t;
+
+static BenchResult_t results[MAX_CASES];
+static int result_count;
+static char payload[PAYLOAD_BYTES];
+static struct aesd_circular_buffer buffer;
+static size_t lookup_offsets[LOOKUP_OFFSETS];
+
+/* Keeps the compiler from discarding lookups whose results are otherwise unused */
+static volatile size_t sink;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double)ts.tv_sec * 1e9) + (double)ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void record(const char *name, double samples[REPETITIONS])
+{
+    qsort(samples, REPETITIONS, sizeof(double), compare_double);
+    if (result_count < MAX_CASES)
+    {
+        snprintf(results[result_count].name, MAX_NAME, "%s", name);
+        results[result_count].ns_per_op = samples[0];
+        result_count++;
+    }
+}
+
+/**
+ * @return an entry size drawn from @param distribution with the seeded generator in @param seed
+ */
+static size_t entry_size(SizeDistribution_t distribution, unsigned int *seed)
+{
+    switch (distribution)
+    {
+        case SIZES_UNIFORM:
+            return 1 + (rand_r(seed) % 512);
+        case SIZES_SKEWED:
+            /* Mostly short lines with the occasional large write */
+            return (rand_r(seed) % 10 == 0) ? 4096 : 16;
+        case SIZES_FIXED:
+        default:
+            return 64;
+    }
+}
+
+/**
+ * Refills the buffer with @param fill entries, starting at slot @param ring_start so the live entries
+ * can be placed across the end of the ring
+ */
+static void fill_buffer(size_t fill, SizeDistribution_t distribution, uint32_t ring_start)
+{
+    unsigned int seed = 42;
+    struct aesd_buffer_entry entry = { payload, 0 };
+
+    /* An empty buffer may start at any slot */
+    aesd_circular_buffer_init(&buffer);
+    buffer.in_offs = ring_start & AESDCHAR_RING_MASK;
+    buffer.out_offs = buffer.in_offs;
+
+    for (size_t i = 0; i < fill; i++)
+    {
+        entry.size = entry_size(distribution, &seed);
+        aesd_circular_buffer_add_entry(&buffer, &entry);
+    }
+
+    size_t bytes = aesd_circular_buffer_bytes_held(&buffer);
+    for (size_t i = 0; i < LOOKUP_OFFSETS; i++)
+    {
+        lookup_offsets[i] = (size_t)rand_r(&seed) % bytes;
+    }
+}
+
+static void bench_add_entry(void)
+{
+    double samples[REPETITIONS];
+    struct aesd_buffer_entry entry = { payload, 64 };
+
+    for (int rep = 0; rep < REPETITIONS; rep++)
+    {
+        aesd_circular_buffer_init(&buffer);
+        double start = now_ns();
+        for (int i = 0; i < OPS_PER_REPETITION; i++)
+        {
+            sink += (size_t)aesd_circular_buffer_add_entry(&buffer, &entry);
+        }
+        samples[rep] = (now_ns() - start) / OPS_PER_REPETITION;
+    }
+    record("add_entry", samples);
+}
+
+static void bench_add_entries(size_t batch)
+{
+    double samples[REPETITIONS];
+    struct aesd_buffer_entry entries[64];
+    char name[MAX_NAME];
+
+    for (size_t i = 0; i < batch; i++)
+    {
+        entries[i].buffptr = payload;
+        entries[i].size = 64;
+    }
+
+    for (int rep = 0; rep < REPETITIONS; rep++)
+    {
+        aesd_circular_buffer_init(&buffer);
+        double start = now_ns();
+        for (int i = 0; i < OPS_PER_REPETITION; i += (int)batch)
+        {
+            sink += aesd_circular_buffer_add_entries(&buffer, entries, batch);
+        }
+        samples[rep] = (now_ns() - start) / OPS_PER_REPETITION;
+    }
+
+    snprintf(name, sizeof(name), "add_entries_batch%zu", batch);
+    record(name, samples);
+}
+
+static void bench_find(size_t fill, SizeDistribution_t distribution, bool wrapped)
+{
+    double samples[REPETITIONS];
+    char name[MAX_NAME];
+
+    /* Starting half the entries before the end of the ring puts them across it */
+    uint32_t ring_start = wrapped ? (uint32_t)(AESDCHAR_RING_SIZE - (fill / 2)) : 0;
+    fill_buffer(fill, distribution, ring_start);
+
+    for (int rep = 0; rep < REPETITIONS; rep++)
+    {
+        double start = now_ns();
+        for (int i = 0; i < OPS_PER_REPETITION; i++)
+        {
+            size_t offset_rtn;
+            struct aesd_buffer_entry *entry = aesd_circular_buffer_find_entry_offset_for_fpos(&buffer,
+                        lookup_offsets[i & (LOOKUP_OFFSETS - 1)], &offset_rtn);
+            sink += offset_rtn + (size_t)entry;
+        }
+        samples[rep] = (now_ns() - start) / OPS_PER_REPETITION;
+    }
+
+    snprintf(name, sizeof(name), "find_fill%zu_%s%s", fill, size_distribution_names[distribution],
+             wrapped ? "_wrapped" : "");
+    record(name, samples);
+}
+
+static int write_results(FILE *out)
+{
+    fprintf(out, "{\n  \"capacity\": %d,\n  \"ring_size\": %d,\n  \"benchmarks\": [\n",
+            CAPACITY, (int)AESDCHAR_RING_SIZE);
+    for (int i = 0; i < result_count; i++)
+    {
+        fprintf(out, "    {\"name\": \"%s\", \"ns_per_op\": %.2f}%s\n", results[i].name,
+                results[i].ns_per_op, (i + 1 < result_count) ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    return ferror(out) ? -1 : 0;
+}
+
+/**
+ * Looks up the result for @param name in a file written by write_results()
+ * @return true and sets *@param ns_per_op if the case is there
+ */
+static bool baseline_lookup(const char *text, const char *name, double *ns_per_op)
+{
+    char key[MAX_NAME + 16];
+    snprintf(key, sizeof(key), "\"name\": \"%.*s\",", MAX_NAME - 1, name);
+
+    const char *found = strstr(text, key);
+    if (found == NULL)
+    {
+        return false;
+    }
+
+    found = strstr(found, "\"ns_per_op\":");
+    return (found != NULL) && (sscanf(found, "\"ns_per_op\": %lf", ns_per_op) == 1);
+}
+
+/**
+ * @return 0 if no case regressed by more than @param tolerance percent against @param path, 2 if one did,
+ * 1 if the baseline cannot be read
+ */
+static int compare_baseline(const char *path, double tolerance)
+{
+    FILE *in = fopen(path, "r");
+    if (in == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+
+    static char text[65536];
+    size_t len = fread(text, 1, sizeof(text) - 1, in);
+    text[len] = '\0';
+    fclose(in);
+
+    int rc = 0;
+    for (int i = 0; i < result_count; i++)
+    {
+        double base;
+        if (!baseline_lookup(text, results[i].name, &base) || (base <= 0))
+        {
+            fprintf(stderr, "%-32s %10.2f ns  (not in baseline)\n", results[i].name, results[i].ns_per_op);
+            continue;
+        }
+
+        double change = ((results[i].ns_per_op - base) / base) * 100.0;
+        bool regressed = (change > tolerance);
+        fprintf(stderr, "%-32s %10.2f ns  baseline %10.2f ns  %+7.1f%%%s\n", results[i].name,
+                results[i].ns_per_op, base, change, regressed ? "  REGRESSION" : "");
+        if (regressed)
+        {
+            rc = 2;
+        }
+    }
+    return rc;
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = NULL;
+    const char *baseline = NULL;
+    double tolerance = 10.0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:b:t:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'o':
+                output = optarg;
+                break;
+            case 'b':
+                baseline = optarg;
+                break;
+            case 't':
+                tolerance = strtod(optarg, NULL);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-o results.json] [-b baseline.json] [-t tolerance_percent]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    bench_add_entry();
+    bench_add_entries(8);
+    bench_add_entries(CAPACITY < 64 ? CAPACITY : 64);
+
+    size_t fills[] = { 1, (CAPACITY + 1) / 2, CAPACITY };
+    for (size_t f = 0; f < sizeof(fills) / sizeof(fills[0]); f++)
+    {
+        for (int d = SIZES_FIXED; d <= SIZES_SKEWED; d++)
+        {
+            bench_find(fills[f], (SizeDistribution_t)d, false);
+        }
+    }
+    bench_find(CAPACITY, SIZES_UNIFORM, true);
+
+    FILE *out = stdout;
+    if ((output != NULL) && ((out = fopen(output, "w")) == NULL))
+    {
+        perror(output);
+        return 1;
+    }
+    if ((write_results(out) != 0) || ((out != stdout) && (fclose(out) != 0)))
+    {
+        fprintf(stderr, "Failed to write results\n");
+        return 1;
+    }
+
+    return (baseline != NULL) ? compare_baseline(baseline, tolerance) : 0;
+}
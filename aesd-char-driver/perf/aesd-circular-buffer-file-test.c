@@ -0,0 +1,202 @@
+/**
+ * @file aesd-circular-buffer-file-test.c
+ * @brief Crash consistency test of aesd-circular-buffer-file.c
+ *
+ * Repeatedly forks a writer that reopens the ring file and appends entries as fast as it can, kills it
+ * with SIGKILL at a random point, then reopens the file and checks the ring it left behind: the file
+ * opens, the entries from tail to head are all intact and numbered consecutively, there are no more
+ * than the buffer capacity of them, and head is either the number of adds the writer saw return or
+ * one more, for an add killed between its publishing store and returning.
+ *
+ * Entry n starts with n itself, and its size and remaining bytes are derived from n, so any torn or stale
+ * payload shows up. The payload region is small, so most adds drop entries to make room.
+ *
+ * Usage: aesd-circular-buffer-file-test [-f ring_file] [-k kills] [-s seed]
+ *
+ * @author Looi Kian Seong
+ * @date 2026-10-18
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "aesd-circular-buffer-file.h"
+
+#define PAYLOAD_SIZE        (4096)
+#define MAX_ENTRY_SIZE      (sizeof(uint64_t) + 256)
+#define MAX_KILL_DELAY_US   (20000)
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "kill %d: %s (%s:%d)\n", kill_round, #cond, __FILE__, __LINE__); \
+            exit(1); \
+        } \
+    } while (0)
+
+static int kill_round;
+
+static size_t entry_size(uint64_t n)
+{
+    return sizeof(uint64_t) + (size_t)((n * 7919U) % 257U);
+}
+
+static void fill_entry(uint64_t n, char *buf)
+{
+    memcpy(buf, &n, sizeof(n));
+    for (size_t i = sizeof(n); i < entry_size(n); i++)
+    {
+        buf[i] = (char)((n * 31U) + i);
+    }
+}
+
+/**
+ * Appends entries numbered on from the ring's head until killed, counting the adds that returned in @param done
+ */
+static void run_writer(const char *path, _Atomic uint64_t *done)
+{
+    struct aesd_circular_buffer_file ring;
+    char buf[MAX_ENTRY_SIZE];
+
+    if (aesd_circular_buffer_file_open(&ring, path, PAYLOAD_SIZE, false) != 0)
+    {
+        _exit(2);
+    }
+
+    for (uint64_t n = atomic_load(&ring.header->head); ; n++)
+    {
+        struct aesd_buffer_entry entry = { .buffptr = buf, .size = entry_size(n) };
+
+        fill_entry(n, buf);
+        if (aesd_circular_buffer_file_add_entry(&ring, &entry) != 0)
+        {
+            _exit(3);
+        }
+        atomic_store(done, n + 1);
+    }
+}
+
+static void check_ring(const char *path, uint64_t done)
+{
+    struct aesd_circular_buffer_file ring;
+    char expected[MAX_ENTRY_SIZE];
+
+    CHECK(aesd_circular_buffer_file_open(&ring, path, 0, false) == 0);
+
+    uint64_t head = atomic_load(&ring.header->head);
+    uint64_t tail = atomic_load(&ring.header->tail);
+    CHECK((head == done) || (head == done + 1));
+    CHECK(tail <= head);
+    CHECK((head - tail) <= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED);
+    CHECK((head == 0) || (tail < head));
+
+    /* Walk the concatenated entries through the public lookup, which must land on every entry start */
+    size_t held = aesd_circular_buffer_file_bytes_held(&ring);
+    size_t char_offset = 0;
+    for (uint64_t n = tail; n < head; n++)
+    {
+        struct aesd_buffer_entry entry;
+        size_t entry_offset = 0;
+
+        CHECK(aesd_circular_buffer_file_find_entry_offset_for_fpos(&ring, char_offset, &entry_offset, &entry) != NULL);
+        CHECK(entry_offset == 0);
+        CHECK(entry.size == entry_size(n));
+        fill_entry(n, expected);
+        CHECK(memcmp(entry.buffptr, expected, entry.size) == 0);
+        char_offset += entry.size;
+    }
+    CHECK(char_offset == held);
+
+    aesd_circular_buffer_file_close(&ring);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = "aesd-circular-buffer-file-test.ring";
+    unsigned int seed = 1;
+    int kills = 50;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:k:s:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'f':
+                path = optarg;
+                break;
+            case 'k':
+                kills = atoi(optarg);
+                break;
+            case 's':
+                seed = (unsigned int)strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-f ring_file] [-k kills] [-s seed]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    _Atomic uint64_t *done = mmap(NULL, sizeof(*done), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (done == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+    atomic_init(done, 0);
+
+    srand(seed);
+
+    /* Create the ring up front, a writer killed mid create legitimately leaves no ring to check */
+    struct aesd_circular_buffer_file ring;
+    unlink(path);
+    if (aesd_circular_buffer_file_open(&ring, path, PAYLOAD_SIZE, false) != 0)
+    {
+        perror(path);
+        return 1;
+    }
+    aesd_circular_buffer_file_close(&ring);
+
+    for (kill_round = 0; kill_round < kills; kill_round++)
+    {
+        pid_t pid = fork();
+        if (pid == -1)
+        {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0)
+        {
+            run_writer(path, done);
+        }
+
+        struct timespec delay = { .tv_sec = 0, .tv_nsec = (long)(1 + (rand() % MAX_KILL_DELAY_US)) * 1000L };
+        nanosleep(&delay, NULL);
+        kill(pid, SIGKILL);
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        CHECK(WIFSIGNALED(status) && (WTERMSIG(status) == SIGKILL));
+
+        /* The count of a killed add that did publish is taken over by the next round's first entry */
+        check_ring(path, atomic_load(done));
+        CHECK(aesd_circular_buffer_file_open(&ring, path, 0, false) == 0);
+        atomic_store(done, atomic_load(&ring.header->head));
+        aesd_circular_buffer_file_close(&ring);
+    }
+
+    printf("%d kills left a consistent ring, %llu entries committed (capacity %d, ring %d, seed %u)\n",
+           kills, (unsigned long long)atomic_load(done), AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED,
+           (int)AESDCHAR_RING_SIZE, seed);
+    unlink(path);
+    return 0;
+}
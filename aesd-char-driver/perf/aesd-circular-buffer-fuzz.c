@@ -0,0 +1,504 @@
+/**
+ * @file aesd-circular-buffer-fuzz.c
+ * @brief Randomized differential test of aesd-circular-buffer.c against naive reference models
+ *
+ * Runs a seeded random mix of single and batched adds, lookups, range reads and iovec fills
+ * against two buffers and a reference model of each, and fails on the first difference:
+ *
+ *  - plain: the buffer references the caller's payloads. Its model keeps the live entries in
+ *           a plain array and walks it linearly.
+ *  - owned: the buffer copies payloads into an arena (aesd_circular_buffer_init_owned()), added
+ *           alternately with aesd_circular_buffer_add_entry() and aesd_circular_buffer_copy_entry().
+ *           Its model keeps its own copy of every payload and a map of the arena bytes in use, and
+ *           places each payload right after the newest one, else at the start of the arena, at the
+ *           first of those where it overlaps no live entry, dropping the oldest until one does.
+ *
+ * Both see the same operation stream. Evictions are checked through the eviction callback
+ * against each model's, by pointer, size and content, along with the bytes held and the
+ * entries visited by AESD_CIRCULAR_BUFFER_FOREACH.
+ *
+ * Usage: aesd-circular-buffer-fuzz [-s seed] [-n operations]
+ *
+ * @author Looi Kian Seong
+ * @date 2026-10-18
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "aesd-circular-buffer.h"
+
+#define CAPACITY            (AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED)
+#define MAX_ENTRY_SIZE      (64)
+#define MAX_BATCH           (CAPACITY + 4)
+#define POOL_SIZE           (CAPACITY * 4 + MAX_BATCH)
+#define MAX_IOV             (8)
+/* Small enough that payloads regularly drop entries for bytes, and now and then do not fit at all */
+#define ARENA_SIZE          (CAPACITY * MAX_ENTRY_SIZE / 4)
+/* An operation drops at most every entry held before it plus every one it adds */
+#define MAX_EVICTIONS       (CAPACITY + MAX_BATCH)
+
+struct model_entry
+{
+    /**
+     * What the buffer should report: the caller's payload, or where it was copied in the arena
+     */
+    struct aesd_buffer_entry expected;
+    /**
+     * The bytes the entry should hold, never in the buffer's own memory
+     */
+    const char *data;
+};
+
+struct eviction
+{
+    const char *buffptr;
+    size_t size;
+    char data[MAX_ENTRY_SIZE];
+};
+
+struct eviction_log
+{
+    struct eviction eviction[MAX_EVICTIONS];
+    size_t count;
+};
+
+/**
+ * Live entries, oldest first from first, and what the buffer should report as evicted
+ */
+struct model
+{
+    struct model_entry entry[CAPACITY];
+    size_t first;
+    size_t count;
+    /**
+     * Arena of the buffer under test in owned mode, NULL in plain mode
+     */
+    const char *arena;
+    /**
+     * Owned mode only: copies of the live payloads by entry slot, and the arena bytes they cover
+     */
+    char (*copy)[MAX_ENTRY_SIZE];
+    unsigned char *in_use;
+    struct eviction_log evicted;
+};
+
+struct subject
+{
+    const char *name;
+    struct aesd_circular_buffer buffer;
+    struct model model;
+    struct eviction_log evicted;
+};
+
+static struct subject plain = { .name = "plain" };
+static struct subject owned = { .name = "owned" };
+static struct subject *const subjects[] = { &plain, &owned };
+static char arena[ARENA_SIZE];
+static char owned_copy[CAPACITY][MAX_ENTRY_SIZE];
+static unsigned char owned_in_use[ARENA_SIZE];
+static char pool[POOL_SIZE][MAX_ENTRY_SIZE];
+static size_t pool_next;
+static const struct subject *current;
+static unsigned long op;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "mismatch at operation %lu (%s): %s (%s:%d)\n", op, \
+                    (current != NULL) ? current->name : "-", #cond, __FILE__, __LINE__); \
+            exit(1); \
+        } \
+    } while (0)
+
+static void log_eviction(struct eviction_log *log, const char *buffptr, size_t size, const char *data)
+{
+    CHECK(log->count < MAX_EVICTIONS);
+    CHECK(size <= MAX_ENTRY_SIZE);
+
+    struct eviction *eviction = &log->eviction[log->count++];
+    eviction->buffptr = buffptr;
+    eviction->size = size;
+    memcpy(eviction->data, data, size);
+}
+
+static void on_evict(void *ctx, const struct aesd_buffer_entry *entry)
+{
+    log_eviction((struct eviction_log *)ctx, entry->buffptr, entry->size, entry->buffptr);
+}
+
+static struct model_entry *model_at(struct model *model, size_t i)
+{
+    return &model->entry[(model->first + i) % CAPACITY];
+}
+
+static void mark_arena(struct model *model, const struct model_entry *entry, unsigned char in_use)
+{
+    size_t offset = (size_t)(entry->expected.buffptr - model->arena);
+    memset(&model->in_use[offset], in_use, entry->expected.size);
+}
+
+static void model_evict_oldest(struct model *model)
+{
+    struct model_entry *oldest = model_at(model, 0);
+
+    log_eviction(&model->evicted, oldest->expected.buffptr, oldest->expected.size, oldest->data);
+    if (model->arena != NULL)
+    {
+        mark_arena(model, oldest, 0);
+    }
+    model->first = (model->first + 1) % CAPACITY;
+    model->count--;
+}
+
+static bool arena_free(const struct model *model, size_t offset, size_t size)
+{
+    if ((offset + size) > ARENA_SIZE)
+    {
+        return false;
+    }
+    for (size_t i = offset; i < (offset + size); i++)
+    {
+        if (model->in_use[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @return false if the buffer should refuse the entry, which only an owned buffer does
+ */
+static bool model_add(struct model *model, const struct aesd_buffer_entry *add_entry)
+{
+    if ((model->arena != NULL) && ((add_entry->size == 0) || (add_entry->size > ARENA_SIZE)))
+    {
+        return false;
+    }
+
+    if (model->count == CAPACITY)
+    {
+        model_evict_oldest(model);
+    }
+
+    size_t slot = (model->first + model->count) % CAPACITY;
+    struct model_entry *entry = &model->entry[slot];
+
+    if (model->arena == NULL)
+    {
+        entry->expected = *add_entry;
+        entry->data = add_entry->buffptr;
+    }
+    else
+    {
+        size_t offset;
+        for (;;)
+        {
+            if (model->count == 0)
+            {
+                offset = 0;
+                break;
+            }
+
+            const struct model_entry *newest = model_at(model, model->count - 1);
+            size_t newest_end = (size_t)(newest->expected.buffptr - model->arena) + newest->expected.size;
+            if (arena_free(model, newest_end, add_entry->size))
+            {
+                offset = newest_end;
+                break;
+            }
+            if (arena_free(model, 0, add_entry->size))
+            {
+                offset = 0;
+                break;
+            }
+            model_evict_oldest(model);
+        }
+
+        memcpy(model->copy[slot], add_entry->buffptr, add_entry->size);
+        entry->expected.buffptr = model->arena + offset;
+        entry->expected.size = add_entry->size;
+        entry->data = model->copy[slot];
+        mark_arena(model, entry, 1);
+    }
+
+    model->count++;
+    return true;
+}
+
+static size_t model_bytes(struct model *model)
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < model->count; i++)
+    {
+        bytes += model_at(model, i)->expected.size;
+    }
+    return bytes;
+}
+
+static const struct model_entry *model_find(struct model *model, size_t char_offset, size_t *entry_offset)
+{
+    for (size_t i = 0; i < model->count; i++)
+    {
+        const struct model_entry *entry = model_at(model, i);
+        if (char_offset < entry->expected.size)
+        {
+            *entry_offset = char_offset;
+            return entry;
+        }
+        char_offset -= entry->expected.size;
+    }
+    return NULL;
+}
+
+/**
+ * Fills a pooled payload with random bytes. Sizes lean small with the odd empty entry.
+ */
+static struct aesd_buffer_entry random_entry(void)
+{
+    struct aesd_buffer_entry entry;
+    char *payload = pool[pool_next];
+    size_t size = (size_t)(rand() % 8 == 0 ? rand() % MAX_ENTRY_SIZE : rand() % 12);
+
+    pool_next = (pool_next + 1) % POOL_SIZE;
+    for (size_t i = 0; i < size; i++)
+    {
+        payload[i] = (char)rand();
+    }
+    entry.buffptr = payload;
+    entry.size = size;
+    return entry;
+}
+
+static void check_evictions(struct subject *subject)
+{
+    struct eviction_log *expected = &subject->model.evicted;
+
+    CHECK(subject->evicted.count == expected->count);
+    for (size_t i = 0; i < expected->count; i++)
+    {
+        CHECK(subject->evicted.eviction[i].buffptr == expected->eviction[i].buffptr);
+        CHECK(subject->evicted.eviction[i].size == expected->eviction[i].size);
+        CHECK(memcmp(subject->evicted.eviction[i].data, expected->eviction[i].data, expected->eviction[i].size) == 0);
+    }
+    subject->evicted.count = 0;
+    expected->count = 0;
+}
+
+static void check_lookup(struct subject *subject, size_t char_offset)
+{
+    size_t offset_rtn = 0;
+    size_t model_offset = 0;
+    struct aesd_buffer_entry *found = aesd_circular_buffer_find_entry_offset_for_fpos(&subject->buffer, char_offset,
+                                                                                     &offset_rtn);
+    const struct model_entry *expected = model_find(&subject->model, char_offset, &model_offset);
+
+    CHECK((found == NULL) == (expected == NULL));
+    if (found != NULL)
+    {
+        CHECK(found->buffptr == expected->expected.buffptr);
+        CHECK(found->size == expected->expected.size);
+        CHECK(offset_rtn == model_offset);
+    }
+}
+
+static void check_range(struct subject *subject, size_t char_offset, size_t len)
+{
+    static char expected[CAPACITY * MAX_ENTRY_SIZE];
+    static char copied[CAPACITY * MAX_ENTRY_SIZE];
+    size_t expected_len = 0;
+    size_t skip = char_offset;
+
+    for (size_t i = 0; (i < subject->model.count) && (expected_len < len); i++)
+    {
+        const struct model_entry *entry = model_at(&subject->model, i);
+        if (skip >= entry->expected.size)
+        {
+            skip -= entry->expected.size;
+            continue;
+        }
+        size_t chunk = entry->expected.size - skip;
+        if (chunk > (len - expected_len))
+        {
+            chunk = len - expected_len;
+        }
+        memcpy(&expected[expected_len], entry->data + skip, chunk);
+        expected_len += chunk;
+        skip = 0;
+    }
+
+    CHECK(aesd_circular_buffer_read_range(&subject->buffer, char_offset, copied, len) == expected_len);
+    CHECK(memcmp(copied, expected, expected_len) == 0);
+
+    struct iovec iov[MAX_IOV];
+    size_t iov_max = 1 + (size_t)(rand() % MAX_IOV);
+    size_t iov_cnt = 0;
+    size_t described = aesd_circular_buffer_fill_iovec(&subject->buffer, char_offset, len, iov, iov_max, &iov_cnt);
+    size_t walked = 0;
+
+    CHECK(iov_cnt <= iov_max);
+    CHECK(described <= expected_len);
+    CHECK((iov_cnt == iov_max) || (described == expected_len));
+    for (size_t i = 0; i < iov_cnt; i++)
+    {
+        CHECK(iov[i].iov_len > 0);
+        CHECK(memcmp(iov[i].iov_base, &expected[walked], iov[i].iov_len) == 0);
+        walked += iov[i].iov_len;
+    }
+    CHECK(walked == described);
+}
+
+/**
+ * AESD_CIRCULAR_BUFFER_FOREACH must visit exactly the live entries, oldest first, so a cleanup loop
+ * never frees a payload the buffer already handed back as dropped.
+ */
+static void check_foreach(struct subject *subject)
+{
+    struct aesd_buffer_entry *entry;
+    uint32_t index;
+    size_t visited = 0;
+
+    AESD_CIRCULAR_BUFFER_FOREACH(entry, &subject->buffer, index)
+    {
+        CHECK(visited < subject->model.count);
+        CHECK(entry->buffptr == model_at(&subject->model, visited)->expected.buffptr);
+        CHECK(entry->size == model_at(&subject->model, visited)->expected.size);
+        visited++;
+    }
+    CHECK(visited == subject->model.count);
+}
+
+static void add_one(struct subject *subject, const struct aesd_buffer_entry *entry)
+{
+    bool added = model_add(&subject->model, entry);
+
+    if ((subject == &owned) && (rand() % 2 == 0))
+    {
+        struct aesd_buffer_entry *stored = aesd_circular_buffer_copy_entry(&subject->buffer, entry);
+        CHECK((stored != NULL) == added);
+        if (stored != NULL)
+        {
+            const struct model_entry *newest = model_at(&subject->model, subject->model.count - 1);
+            CHECK(stored->buffptr == newest->expected.buffptr);
+            CHECK(stored->size == newest->expected.size);
+        }
+        return;
+    }
+
+    const char *dropped = aesd_circular_buffer_add_entry(&subject->buffer, entry);
+    if (subject == &owned)
+    {
+        /* An owned buffer releases its own memory and only reports drops through the callback */
+        CHECK(dropped == NULL);
+    }
+    else
+    {
+        CHECK(dropped == ((subject->model.evicted.count > 0) ? subject->model.evicted.eviction[0].buffptr : NULL));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int seed = 1;
+    unsigned long operations = 200000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                seed = (unsigned int)strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                operations = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s seed] [-n operations]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    srand(seed);
+    aesd_circular_buffer_init(&plain.buffer);
+    aesd_circular_buffer_init_owned(&owned.buffer, arena, sizeof(arena));
+    owned.model.arena = arena;
+    owned.model.copy = owned_copy;
+    owned.model.in_use = owned_in_use;
+    for (size_t s = 0; s < sizeof(subjects) / sizeof(subjects[0]); s++)
+    {
+        aesd_circular_buffer_set_evict_callback(&subjects[s]->buffer, on_evict, &subjects[s]->evicted);
+    }
+
+    for (op = 0; op < operations; op++)
+    {
+        int choice = rand() % 10;
+        struct aesd_buffer_entry batch[MAX_BATCH];
+        size_t n = 0;
+        size_t char_offset = 0;
+        size_t len = 0;
+
+        if (choice < 4)
+        {
+            batch[0] = random_entry();
+        }
+        else if (choice < 5)
+        {
+            n = (size_t)(rand() % (MAX_BATCH + 1));
+            for (size_t i = 0; i < n; i++)
+            {
+                batch[i] = random_entry();
+            }
+        }
+        else
+        {
+            char_offset = (size_t)rand();
+            len = (size_t)rand();
+        }
+
+        for (size_t s = 0; s < sizeof(subjects) / sizeof(subjects[0]); s++)
+        {
+            struct subject *subject = subjects[s];
+            current = subject;
+
+            if (choice < 4)
+            {
+                add_one(subject, &batch[0]);
+            }
+            else if (choice < 5)
+            {
+                size_t added = 0;
+                for (size_t i = 0; i < n; i++)
+                {
+                    added += model_add(&subject->model, &batch[i]) ? 1U : 0U;
+                }
+                CHECK(aesd_circular_buffer_add_entries(&subject->buffer, batch, n) == added);
+            }
+            else
+            {
+                size_t bytes = model_bytes(&subject->model);
+
+                CHECK(aesd_circular_buffer_bytes_held(&subject->buffer) == bytes);
+                check_lookup(subject, char_offset % (bytes + 2));
+                check_range(subject, char_offset % (bytes + 2), len % (bytes + 2));
+            }
+
+            check_evictions(subject);
+            check_foreach(subject);
+            CHECK(subject->buffer.count == subject->model.count);
+            CHECK(subject->buffer.full == (subject->model.count == CAPACITY));
+            CHECK(aesd_circular_buffer_bytes_held(&subject->buffer) == model_bytes(&subject->model));
+        }
+        current = NULL;
+    }
+
+    printf("%lu operations matched the reference models (capacity %d, ring %d, arena %d, seed %u)\n",
+           operations, CAPACITY, (int)AESDCHAR_RING_SIZE, ARENA_SIZE, seed);
+    return 0;
+}
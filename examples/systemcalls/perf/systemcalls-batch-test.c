@@ -0,0 +1,182 @@
+/**
+ * @file systemcalls-batch-test.c
+ * @brief Checks do_exec_batch() per command results and its concurrency bound
+ *
+ * Runs one batch mixing commands that succeed, exit non-zero, cannot be spawned and redirect their
+ * output, interleaved with sleeps long enough to overlap, and checks:
+ *
+ *  - each command's spawn_error, wait status and success flag, and the batch result
+ *  - the redirected output landed in its file
+ *  - no more than max_parallel commands were ever running at once, judged from the started and
+ *    finished times do_exec_batch() records, and the sleeps did run side by side up to that bound
+ *
+ * Usage: systemcalls-batch-test [-p max_parallel]
+ *
+ * @author Looi Kian Seong
+ * @date 2026-10-18
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "systemcalls.h"
+
+#define OUTPUT_FILE "systemcalls-batch-test.out"
+
+static int failures;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "FAIL: %s (%s:%d)\n", #cond, __FILE__, __LINE__); \
+            failures++; \
+        } \
+    } while (0)
+
+/**
+ * What a command in the batch should come back with
+ */
+struct expected{
+    int spawn_error;
+    int exit_code;
+};
+
+static int compare_timespec(const struct timespec *a, const struct timespec *b)
+{
+    if (a->tv_sec != b->tv_sec)
+    {
+        return (a->tv_sec < b->tv_sec) ? -1 : 1;
+    }
+    return (a->tv_nsec < b->tv_nsec) ? -1 : (a->tv_nsec > b->tv_nsec);
+}
+
+/**
+ * @return the most commands running at once, counted at each start as those started no later and not yet finished
+ */
+static size_t peak_running(const struct exec_command *commands, size_t count)
+{
+    size_t peak = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t running = 0;
+        for (size_t j = 0; j < count; j++)
+        {
+            if ((compare_timespec(&commands[j].started, &commands[i].started) <= 0) &&
+                (compare_timespec(&commands[j].finished, &commands[i].started) > 0))
+            {
+                running++;
+            }
+        }
+        peak = (running > peak) ? running : peak;
+    }
+
+    return peak;
+}
+
+int main(int argc, char **argv)
+{
+    size_t max_parallel = 3;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'p':
+                max_parallel = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-p max_parallel]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    char *const sleep_cmd[] = { "/bin/sleep", "0.2", NULL };
+    char *const true_cmd[] = { "/bin/true", NULL };
+    char *const false_cmd[] = { "/bin/false", NULL };
+    char *const exit_cmd[] = { "/bin/sh", "-c", "exit 7", NULL };
+    char *const missing_cmd[] = { "/nonexistent/command", NULL };
+    char *const relative_cmd[] = { "echo", "relative paths are not searched", NULL };
+    char *const echo_cmd[] = { "/bin/echo", "batched", NULL };
+
+    struct exec_command commands[] = {
+        { .argv = sleep_cmd }, { .argv = true_cmd }, { .argv = sleep_cmd }, { .argv = missing_cmd },
+        { .argv = sleep_cmd }, { .argv = false_cmd }, { .argv = sleep_cmd }, { .argv = exit_cmd },
+        { .argv = sleep_cmd }, { .argv = relative_cmd }, { .argv = echo_cmd, .outputfile = OUTPUT_FILE },
+        { .argv = sleep_cmd }, { .argv = sleep_cmd },
+    };
+    const struct expected expected[] = {
+        { 0, 0 }, { 0, 0 }, { 0, 0 }, { ENOENT, 0 },
+        { 0, 0 }, { 0, 1 }, { 0, 0 }, { 0, 7 },
+        { 0, 0 }, { ENOENT, 0 }, { 0, 0 },
+        { 0, 0 }, { 0, 0 },
+    };
+    size_t count = sizeof(commands) / sizeof(commands[0]);
+
+    unlink(OUTPUT_FILE);
+    CHECK(!do_exec_batch(commands, count, max_parallel));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const struct exec_command *command = &commands[i];
+        bool should_succeed = (expected[i].spawn_error == 0) && (expected[i].exit_code == 0);
+
+        if (command->spawn_error != expected[i].spawn_error)
+        {
+            fprintf(stderr, "command %zu (%s): spawn_error %d, expected %d\n", i, command->argv[0],
+                    command->spawn_error, expected[i].spawn_error);
+            failures++;
+            continue;
+        }
+        if (expected[i].spawn_error == 0)
+        {
+            CHECK(WIFEXITED(command->status) && (WEXITSTATUS(command->status) == expected[i].exit_code));
+        }
+        CHECK(command->success == should_succeed);
+        CHECK(compare_timespec(&command->started, &command->finished) <= 0);
+    }
+
+    char output[32] = { 0 };
+    FILE *fp = fopen(OUTPUT_FILE, "r");
+    CHECK(fp != NULL);
+    if (fp != NULL)
+    {
+        CHECK(fgets(output, sizeof(output), fp) != NULL);
+        CHECK(strcmp(output, "batched\n") == 0);
+        fclose(fp);
+    }
+    unlink(OUTPUT_FILE);
+
+    /* The sleeps alone keep the batch at its bound for most of its run */
+    size_t peak = peak_running(commands, count);
+    if (peak != max_parallel)
+    {
+        fprintf(stderr, "peak of %zu commands running at once, expected exactly %zu\n", peak, max_parallel);
+        failures++;
+    }
+
+    /* An empty batch has nothing to fail */
+    CHECK(do_exec_batch(commands, 0, max_parallel));
+
+    /* A batch of only successes succeeds as a whole */
+    struct exec_command ok[] = { { .argv = true_cmd }, { .argv = true_cmd }, { .argv = echo_cmd,
+                                 .outputfile = "/dev/null" } };
+    CHECK(do_exec_batch(ok, sizeof(ok) / sizeof(ok[0]), 0));
+
+    if (failures != 0)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("%zu commands checked, at most %zu running at once\n", count, peak);
+    return 0;
+}
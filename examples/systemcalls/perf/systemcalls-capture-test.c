@@ -0,0 +1,225 @@
+/**
+ * @file systemcalls-capture-test.c
+ * @brief Checks what do_exec_capture() collects from a command and where it delivers it
+ *
+ * Runs commands writing to standard output, standard error or both and checks:
+ *
+ *  - the captured contents and byte counts of each stream, also past the initial buffer size
+ *  - standard output spliced into a file instead of kept in memory
+ *  - the fallback to plain writes for an O_APPEND file, which splice() refuses with EINVAL
+ *  - a splice descriptor that cannot be written fails the capture
+ *  - the wait status and success flag for non-zero exits, and the error for a command that
+ *    cannot be spawned
+ *
+ * @author Looi Kian Seong
+ * @date 2026-10-18
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "systemcalls.h"
+
+#define OUTPUT_FILE "systemcalls-capture-test.out"
+#define APPEND_PREFIX "existing line\n"
+/* Well past the initial buffer and one splice at a time */
+#define LARGE_OUTPUT_SIZE (3 * 1024 * 1024 + 17)
+#define LARGE_OUTPUT_COMMAND "head -c 3145745 /dev/zero | tr '\\0' x"
+
+static int failures;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "FAIL: %s (%s:%d)\n", #cond, __FILE__, __LINE__); \
+            failures++; \
+        } \
+    } while (0)
+
+static int compare_timespec(const struct timespec *a, const struct timespec *b)
+{
+    if (a->tv_sec != b->tv_sec)
+    {
+        return (a->tv_sec < b->tv_sec) ? -1 : 1;
+    }
+    return (a->tv_nsec < b->tv_nsec) ? -1 : (a->tv_nsec > b->tv_nsec);
+}
+
+/**
+ * @return true if @param buf holds @param len bytes, all of them @param c
+ */
+static bool all_bytes(const char *buf, size_t len, char c)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (buf[i] != c)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Reads the whole of OUTPUT_FILE into a NUL terminated buffer the caller frees
+ * @return the buffer, or NULL if the file cannot be read
+ */
+static char *read_output(size_t *len)
+{
+    int fd = open(OUTPUT_FILE, O_RDONLY);
+    struct stat st;
+    char *buf = NULL;
+
+    if ((fd >= 0) && (fstat(fd, &st) == 0) && ((buf = malloc((size_t)st.st_size + 1)) != NULL))
+    {
+        *len = 0;
+        ssize_t rc;
+        while ((*len < (size_t)st.st_size) && ((rc = read(fd, &buf[*len], (size_t)st.st_size - *len)) > 0))
+        {
+            *len += (size_t)rc;
+        }
+        buf[*len] = '\0';
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    return buf;
+}
+
+static void test_in_memory(void)
+{
+    struct exec_capture capture;
+
+    CHECK(do_exec_capture(&capture, -1, 3, "/bin/sh", "-c", "printf 'to stdout\\n'; printf 'to stderr' >&2"));
+    CHECK((capture.stdout_buf != NULL) && (strcmp(capture.stdout_buf, "to stdout\n") == 0));
+    CHECK((capture.stderr_buf != NULL) && (strcmp(capture.stderr_buf, "to stderr") == 0));
+    CHECK((capture.stdout_bytes == 10) && (capture.stderr_bytes == 9));
+    CHECK((capture.error == 0) && WIFEXITED(capture.status) && (WEXITSTATUS(capture.status) == 0));
+    CHECK(compare_timespec(&capture.started, &capture.first_output) <= 0);
+    CHECK(compare_timespec(&capture.first_output, &capture.finished) <= 0);
+    exec_capture_free(&capture);
+
+    /* Buffers grow to hold everything, and a silent stream is an empty string rather than NULL */
+    CHECK(do_exec_capture(&capture, -1, 3, "/bin/sh", "-c", LARGE_OUTPUT_COMMAND));
+    CHECK(capture.stdout_bytes == LARGE_OUTPUT_SIZE);
+    CHECK((capture.stdout_buf != NULL) && all_bytes(capture.stdout_buf, LARGE_OUTPUT_SIZE, 'x') &&
+          (capture.stdout_buf[LARGE_OUTPUT_SIZE] == '\0'));
+    CHECK((capture.stderr_buf != NULL) && (capture.stderr_buf[0] == '\0') && (capture.stderr_bytes == 0));
+    exec_capture_free(&capture);
+
+    /* Nothing written leaves first_output zero */
+    CHECK(do_exec_capture(&capture, -1, 1, "/bin/true"));
+    CHECK((capture.stdout_bytes == 0) && (capture.stderr_bytes == 0));
+    CHECK((capture.first_output.tv_sec == 0) && (capture.first_output.tv_nsec == 0));
+    exec_capture_free(&capture);
+}
+
+static void test_exit_status(void)
+{
+    struct exec_capture capture;
+
+    /* A failing command still has its output collected */
+    CHECK(!do_exec_capture(&capture, -1, 3, "/bin/sh", "-c", "echo partial; echo reason >&2; exit 3"));
+    CHECK(capture.error == 0);
+    CHECK(WIFEXITED(capture.status) && (WEXITSTATUS(capture.status) == 3));
+    CHECK((capture.stdout_buf != NULL) && (strcmp(capture.stdout_buf, "partial\n") == 0));
+    CHECK((capture.stderr_buf != NULL) && (strcmp(capture.stderr_buf, "reason\n") == 0));
+    exec_capture_free(&capture);
+
+    /* Killed by a signal is not a success either */
+    CHECK(!do_exec_capture(&capture, -1, 3, "/bin/sh", "-c", "kill -TERM $$"));
+    CHECK((capture.error == 0) && WIFSIGNALED(capture.status) && (WTERMSIG(capture.status) == SIGTERM));
+    exec_capture_free(&capture);
+}
+
+static void test_spawn_error(void)
+{
+    struct exec_capture capture;
+
+    CHECK(!do_exec_capture(&capture, -1, 1, "/nonexistent/command"));
+    CHECK(capture.error == ENOENT);
+    CHECK((capture.stdout_buf == NULL) && (capture.stderr_buf == NULL));
+    CHECK((capture.stdout_bytes == 0) && (capture.stderr_bytes == 0));
+    CHECK(compare_timespec(&capture.started, &capture.finished) <= 0);
+    exec_capture_free(&capture);
+
+    /* Relative paths are not searched */
+    CHECK(!do_exec_capture(&capture, -1, 2, "echo", "hello"));
+    CHECK(capture.error == ENOENT);
+    exec_capture_free(&capture);
+}
+
+static void test_splice(void)
+{
+    struct exec_capture capture;
+    size_t len = 0;
+    char *output;
+
+    /* A plain file takes splice() directly, standard error stays in memory */
+    int fd = open(OUTPUT_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    CHECK(fd >= 0);
+    CHECK(do_exec_capture(&capture, fd, 3, "/bin/sh", "-c", LARGE_OUTPUT_COMMAND "; printf done >&2"));
+    close(fd);
+    CHECK(capture.stdout_buf == NULL);
+    CHECK(capture.stdout_bytes == LARGE_OUTPUT_SIZE);
+    CHECK((capture.stderr_buf != NULL) && (strcmp(capture.stderr_buf, "done") == 0));
+    output = read_output(&len);
+    CHECK((output != NULL) && (len == LARGE_OUTPUT_SIZE) && all_bytes(output, len, 'x'));
+    free(output);
+    exec_capture_free(&capture);
+
+    /* splice() refuses an O_APPEND file with EINVAL, the output must still land after what is there */
+    fd = open(OUTPUT_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    CHECK((fd >= 0) && (write(fd, APPEND_PREFIX, strlen(APPEND_PREFIX)) == (ssize_t)strlen(APPEND_PREFIX)));
+    close(fd);
+    fd = open(OUTPUT_FILE, O_WRONLY | O_APPEND);
+    CHECK(fd >= 0);
+    CHECK(do_exec_capture(&capture, fd, 3, "/bin/sh", "-c", LARGE_OUTPUT_COMMAND));
+    close(fd);
+    CHECK((capture.error == 0) && (capture.stdout_bytes == LARGE_OUTPUT_SIZE));
+    output = read_output(&len);
+    CHECK((output != NULL) && (len == strlen(APPEND_PREFIX) + LARGE_OUTPUT_SIZE) &&
+          (strncmp(output, APPEND_PREFIX, strlen(APPEND_PREFIX)) == 0) &&
+          all_bytes(&output[strlen(APPEND_PREFIX)], LARGE_OUTPUT_SIZE, 'x'));
+    free(output);
+    exec_capture_free(&capture);
+
+    /* Output that cannot be delivered fails the capture even though the command exited with 0 */
+    fd = open(OUTPUT_FILE, O_RDONLY);
+    CHECK(fd >= 0);
+    CHECK(!do_exec_capture(&capture, fd, 2, "/bin/echo", "undeliverable"));
+    close(fd);
+    CHECK(capture.error != 0);
+    CHECK(WIFEXITED(capture.status) && (WEXITSTATUS(capture.status) == 0));
+    exec_capture_free(&capture);
+
+    unlink(OUTPUT_FILE);
+}
+
+int main(void)
+{
+    test_in_memory();
+    test_exit_status();
+    test_spawn_error();
+    test_splice();
+
+    if (failures != 0)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("do_exec_capture() checks passed\n");
+    return 0;
+}
@@ -0,0 +1,302 @@
+/**
+ * @file systemcalls-spawn-bench.c
+ * @brief Spawn latency of fork(), vfork(), posix_spawn() and a zygote as the parent's resident memory grows
+ *
+ * For each resident size, maps and touches that much anonymous memory, then times running a
+ * trivial command to completion with fork() and execv(), vfork() and execv(), do_exec(),
+ * do_exec_redirect(), do_exec_capture() and a zygote started before the memory was touched.
+ * fork() has to copy the page tables of every touched page so its latency grows with the parent,
+ * while the others share the parent's memory until exec or fork from a process that stays small.
+ * Each case runs several times and reports the fastest run, and results are printed as JSON in a fixed order.
+ *
+ * Usage: systemcalls-spawn-bench [-o results.json] [-n spawns] [-m max_rss_mb] [-c command]
+ *
+ * @author Looi Kian Seong
+ * @date 2026-10-18
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "systemcalls.h"
+#include "zygote.h"
+
+#define REPETITIONS         (5)
+#define MAX_CASES           (64)
+#define MAX_NAME            (64)
+
+typedef struct
+{
+    char name[MAX_NAME];
+    size_t rss_mb;
+    size_t measured_rss_kb;
+    double us_per_spawn;
+} BenchResult_t;
+
+static BenchResult_t results[MAX_CASES];
+static int result_count;
+static const char *command_path = "/bin/true";
+static int spawns = 200;
+static struct zygote zygote;
+
+static const size_t rss_levels_mb[] = { 0, 64, 256, 1024, 4096 };
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double)ts.tv_sec * 1e6) + ((double)ts.tv_nsec / 1e3);
+}
+
+/**
+ * @return the resident set size of this process in kB, from /proc/self/statm
+ */
+static size_t resident_kb(void)
+{
+    unsigned long pages = 0;
+    unsigned long resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+
+    if (statm != NULL)
+    {
+        if (fscanf(statm, "%lu %lu", &pages, &resident) != 2)
+        {
+            resident = 0;
+        }
+        fclose(statm);
+    }
+    return (size_t)resident * ((size_t)sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Reference implementation: what do_exec() did before it moved to posix_spawn()
+ */
+static bool fork_exec(char *const command[])
+{
+    int status = 0;
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        execv(command[0], command);
+        _exit(EXIT_FAILURE);
+    }
+    if ((pid < 0) || (waitpid(pid, &status, 0) != pid))
+    {
+        return false;
+    }
+    return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+static bool vfork_exec(char *const command[])
+{
+    int status = 0;
+    pid_t pid = vfork();
+
+    if (pid == 0)
+    {
+        execv(command[0], command);
+        _exit(EXIT_FAILURE);
+    }
+    if ((pid < 0) || (waitpid(pid, &status, 0) != pid))
+    {
+        return false;
+    }
+    return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+typedef enum
+{
+    SPAWN_FORK,
+    SPAWN_VFORK,
+    SPAWN_DO_EXEC,
+    SPAWN_DO_EXEC_REDIRECT,
+    SPAWN_DO_EXEC_CAPTURE,
+    SPAWN_ZYGOTE_EXEC,
+} SpawnMethod_t;
+
+static const char *const spawn_method_names[] = { "fork_execv", "vfork_execv", "do_exec", "do_exec_redirect",
+                                                    "do_exec_capture", "zygote_exec" };
+
+static bool spawn_once(SpawnMethod_t method)
+{
+    char *command[] = { (char *)command_path, NULL };
+
+    switch (method)
+    {
+        case SPAWN_FORK:
+            return fork_exec(command);
+        case SPAWN_VFORK:
+            return vfork_exec(command);
+        case SPAWN_DO_EXEC:
+            return do_exec(1, command_path);
+        case SPAWN_DO_EXEC_REDIRECT:
+            return do_exec_redirect("/dev/null", 1, command_path);
+        case SPAWN_DO_EXEC_CAPTURE:
+        {
+            struct exec_capture capture;
+            bool ok = do_exec_capture(&capture, -1, 1, command_path);
+            exec_capture_free(&capture);
+            return ok;
+        }
+        case SPAWN_ZYGOTE_EXEC:
+        default:
+            return zygote_exec(&zygote, 1, command_path);
+    }
+}
+
+/**
+ * @return 0 on success, -1 if a spawn failed
+ */
+static int bench_spawn(SpawnMethod_t method, size_t rss_mb)
+{
+    double best = 0;
+
+    for (int rep = 0; rep < REPETITIONS; rep++)
+    {
+        double start = now_us();
+        for (int i = 0; i < spawns; i++)
+        {
+            if (!spawn_once(method))
+            {
+                fprintf(stderr, "%s of %s failed\n", spawn_method_names[method], command_path);
+                return -1;
+            }
+        }
+        double elapsed = (now_us() - start) / spawns;
+        if ((rep == 0) || (elapsed < best))
+        {
+            best = elapsed;
+        }
+    }
+
+    if (result_count < MAX_CASES)
+    {
+        BenchResult_t *result = &results[result_count++];
+        snprintf(result->name, MAX_NAME, "%s_rss%zum", spawn_method_names[method], rss_mb);
+        result->rss_mb = rss_mb;
+        result->measured_rss_kb = resident_kb();
+        result->us_per_spawn = best;
+    }
+    return 0;
+}
+
+/**
+ * Grows the touched part of @param ballast, which is @param ballast_size bytes, to @param rss_mb
+ */
+static void grow_ballast(char *ballast, size_t ballast_size, size_t *touched, size_t rss_mb)
+{
+    size_t target = rss_mb << 20;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    if (target > ballast_size)
+    {
+        target = ballast_size;
+    }
+    for (; *touched < target; *touched += page)
+    {
+        ballast[*touched] = 1;
+    }
+}
+
+static int write_results(FILE *out)
+{
+    fprintf(out, "{\n  \"command\": \"%s\",\n  \"spawns\": %d,\n  \"benchmarks\": [\n", command_path, spawns);
+    for (int i = 0; i < result_count; i++)
+    {
+        fprintf(out, "    {\"name\": \"%s\", \"rss_mb\": %zu, \"measured_rss_kb\": %zu, \"us_per_spawn\": %.2f}%s\n",
+                results[i].name, results[i].rss_mb, results[i].measured_rss_kb, results[i].us_per_spawn,
+                (i + 1 < result_count) ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    return ferror(out) ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = NULL;
+    size_t max_rss_mb = 1024;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:n:m:c:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'o':
+                output = optarg;
+                break;
+            case 'n':
+                spawns = atoi(optarg);
+                break;
+            case 'm':
+                max_rss_mb = strtoul(optarg, NULL, 0);
+                break;
+            case 'c':
+                command_path = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-o results.json] [-n spawns] [-m max_rss_mb] [-c command]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (spawns <= 0)
+    {
+        spawns = 1;
+    }
+
+    /* The zygote copies the parent as it is now, before any ballast is touched */
+    if (!zygote_start(&zygote))
+    {
+        perror("zygote_start");
+        return 1;
+    }
+
+    /* Reserve the largest level up front so growing it never moves what is already touched */
+    size_t ballast_size = (max_rss_mb > 0) ? (max_rss_mb << 20) : (size_t)sysconf(_SC_PAGESIZE);
+    char *ballast = mmap(NULL, ballast_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    size_t touched = 0;
+    if (ballast == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+
+    for (size_t l = 0; l < sizeof(rss_levels_mb) / sizeof(rss_levels_mb[0]); l++)
+    {
+        if (rss_levels_mb[l] > max_rss_mb)
+        {
+            break;
+        }
+        grow_ballast(ballast, ballast_size, &touched, rss_levels_mb[l]);
+        for (int m = SPAWN_FORK; m <= SPAWN_ZYGOTE_EXEC; m++)
+        {
+            if (bench_spawn((SpawnMethod_t)m, rss_levels_mb[l]) != 0)
+            {
+                return 1;
+            }
+        }
+    }
+    munmap(ballast, ballast_size);
+    zygote_stop(&zygote);
+
+    FILE *out = stdout;
+    if ((output != NULL) && ((out = fopen(output, "w")) == NULL))
+    {
+        perror(output);
+        return 1;
+    }
+    if ((write_results(out) != 0) || ((out != stdout) && (fclose(out) != 0)))
+    {
+        fprintf(stderr, "Failed to write results\n");
+        return 1;
+    }
+
+    return 0;
+}
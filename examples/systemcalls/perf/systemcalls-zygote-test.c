@@ -0,0 +1,160 @@
+/**
+ * @file systemcalls-zygote-test.c
+ * @brief Checks zygote_spawn(), zygote_wait() and zygote_exec() end to end
+ *
+ * Starts a zygote while the test holds an extra descriptor without FD_CLOEXEC, then checks that:
+ *
+ *  - a command's standard output comes back through output_fd, complete, followed by EOF
+ *  - exit statuses are reported under the ids zygote_spawn() handed out, including 127 for a
+ *    command that does not exist, whatever order the commands finish in
+ *  - the extra descriptor reached neither the zygote nor the commands it starts
+ *  - zygote_exec() reports success and failure like do_exec()
+ *
+ * Built twice, once with ZYGOTE_NO_CLOSE_RANGE so the /proc/self/fd fallback of kernels before
+ * close_range() is tested too.
+ *
+ * Usage: systemcalls-zygote-test
+ *
+ * @author Looi Kian Seong
+ * @date 2026-10-18
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "zygote.h"
+
+/* High enough not to be taken by anything the zygote opens itself */
+#define LEAK_FD         (100)
+#define NUM_COMMANDS    (4)
+
+static int failures;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "FAIL: %s (%s:%d)\n", #cond, __FILE__, __LINE__); \
+            failures++; \
+        } \
+    } while (0)
+
+/**
+ * @return everything readable from @param fd up to EOF, NUL terminated, in @param buf
+ */
+static size_t read_all(int fd, char *buf, size_t len)
+{
+    size_t total = 0;
+    ssize_t n;
+
+    while ((total < len - 1) && ((n = read(fd, buf + total, len - 1 - total)) > 0))
+    {
+        total += (size_t)n;
+    }
+    buf[total] = '\0';
+    return total;
+}
+
+int main(void)
+{
+    struct zygote zygote;
+    char leak_check[64];
+
+    int devnull = open("/dev/null", O_RDONLY);
+    CHECK((devnull >= 0) && (dup2(devnull, LEAK_FD) == LEAK_FD));
+    close(devnull);
+
+    if (!zygote_start(&zygote))
+    {
+        fprintf(stderr, "zygote_start failed\n");
+        return 1;
+    }
+
+    /* The shell exits 1 if it inherited the descriptor */
+    snprintf(leak_check, sizeof(leak_check), "[ -e /proc/$$/fd/%d ] && exit 1; exit 0", LEAK_FD);
+
+    char *const echo_cmd[] = { "/bin/echo", "hello from the zygote", NULL };
+    char *const exit_cmd[] = { "/bin/sh", "-c", "sleep 0.1; exit 3", NULL };
+    char *const missing_cmd[] = { "/nonexistent/command", NULL };
+    char *const leak_cmd[] = { "/bin/sh", "-c", leak_check, NULL };
+    char *const *const argvs[NUM_COMMANDS] = { echo_cmd, exit_cmd, missing_cmd, leak_cmd };
+    const int expected_exit[NUM_COMMANDS] = { 0, 3, 127, 0 };
+    uint32_t ids[NUM_COMMANDS];
+    int output_fd = -1;
+
+    CHECK(zygote_spawn(&zygote, echo_cmd, &output_fd, &ids[0]));
+    for (int i = 1; i < NUM_COMMANDS; i++)
+    {
+        CHECK(zygote_spawn(&zygote, argvs[i], NULL, &ids[i]));
+    }
+
+    CHECK(output_fd >= 0);
+    if (output_fd >= 0)
+    {
+        char output[128];
+        read_all(output_fd, output, sizeof(output));
+        CHECK(strcmp(output, "hello from the zygote\n") == 0);
+        close(output_fd);
+    }
+
+    bool seen[NUM_COMMANDS] = { false };
+    for (int n = 0; n < NUM_COMMANDS; n++)
+    {
+        uint32_t id;
+        int status;
+
+        if (!zygote_wait(&zygote, &id, &status))
+        {
+            fprintf(stderr, "zygote_wait failed after %d of %d commands\n", n, NUM_COMMANDS);
+            failures++;
+            break;
+        }
+
+        int i = 0;
+        while ((i < NUM_COMMANDS) && (ids[i] != id))
+        {
+            i++;
+        }
+        CHECK(i < NUM_COMMANDS);
+        if (i == NUM_COMMANDS)
+        {
+            continue;
+        }
+        CHECK(!seen[i]);
+        seen[i] = true;
+        if (!WIFEXITED(status) || (WEXITSTATUS(status) != expected_exit[i]))
+        {
+            fprintf(stderr, "command %d (%s): wait status %#x, expected exit %d\n", i, argvs[i][0], status,
+                    expected_exit[i]);
+            failures++;
+        }
+    }
+
+    /* The zygote has served requests by now, so it is past closing what it inherited */
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%d/fd/%d", (int)zygote.pid, LEAK_FD);
+    CHECK(access(path, F_OK) != 0);
+
+    CHECK(zygote_exec(&zygote, 1, "/bin/true"));
+    CHECK(!zygote_exec(&zygote, 1, "/bin/false"));
+    CHECK(!zygote_exec(&zygote, 1, "/nonexistent/command"));
+    CHECK(zygote_exec(&zygote, 3, "/bin/sh", "-c", leak_check));
+
+    zygote_stop(&zygote);
+    close(LEAK_FD);
+
+    if (failures != 0)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("zygote commands, output and exit statuses checked\n");
+    return 0;
+}
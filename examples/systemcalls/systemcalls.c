@@ -1,9 +1,17 @@
+#define _GNU_SOURCE
 #include "systemcalls.h"
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <spawn.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <stdlib.h>
 
+extern char **environ;
+
 /**
  * @param cmd the command to execute with system()
  * @return true if the command in @param cmd was executed
@@ -23,6 +31,73 @@ bool do_system(const char *cmd)
     return true;
 }
 
+/**
+ * Starts @param command, a NULL terminated argument list whose first entry is the absolute path to execute,
+ * with standard output sent to @param outputfile when it is not NULL, and sets *@param pid to the child.
+ *
+ * Uses posix_spawn() rather than fork() and execv(). fork() copies the page tables of the whole caller,
+ * so its cost grows with the caller's memory, while glibc implements posix_spawn() with
+ * clone(CLONE_VM | CLONE_VFORK): the child runs on the caller's memory until it calls exec, and the
+ * redirect is done by a file action in the child instead of code running between fork and exec.
+ * @return 0 if the command was started, otherwise an error number
+ */
+static int spawn_command(char *const command[], const char *outputfile, pid_t *pid)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_t *actions_ptr = NULL;
+    int rc;
+
+    if (outputfile != NULL)
+    {
+        rc = posix_spawn_file_actions_init(&actions);
+        if (rc != 0)
+        {
+            return rc;
+        }
+        actions_ptr = &actions;
+
+        rc = posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, outputfile,
+                    O_WRONLY | O_TRUNC | O_CREAT, 0666);
+        if (rc != 0)
+        {
+            posix_spawn_file_actions_destroy(&actions);
+            return rc;
+        }
+    }
+
+    /* posix_spawn() does no path search, and reports a failed open or exec here rather than as a child exit status */
+    rc = posix_spawn(pid, command[0], actions_ptr, NULL, command, environ);
+
+    if (actions_ptr != NULL)
+    {
+        posix_spawn_file_actions_destroy(actions_ptr);
+    }
+
+    return rc;
+}
+
+/**
+ * Runs @param command with spawn_command() and waits for it to finish.
+ * @return true if the command ran and exited with status 0
+ */
+static bool exec_command(char *const command[], const char *outputfile)
+{
+    pid_t pid;
+    int status = 0;
+
+    if (spawn_command(command, outputfile, &pid) != 0)
+    {
+        return false;
+    }
+
+    if (waitpid(pid, &status, 0) != pid)
+    {
+        return false;
+    }
+
+    return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
 /**
 * @param count -The numbers of variables passed to the function. The variables are command to execute.
 *   followed by arguments to pass to the command
@@ -49,36 +124,368 @@ bool do_exec(int count, ...)
     }
     command[count] = NULL;
 
-    int rc = 0;
+    va_end(args);
+
+    return exec_command(command, NULL);
+}
+
+/**
+* @param outputfile - The full path to the file to write with command output.
+*   This file will be closed at completion of the function call.
+* All other parameters, see do_exec above
+*/
+bool do_exec_redirect(const char *outputfile, int count, ...)
+{
+    va_list args;
+    va_start(args, count);
+    char * command[count+1];
+    int i;
+    for(i=0; i<count; i++)
+    {
+        command[i] = va_arg(args, char *);
+    }
+    command[count] = NULL;
+
+    va_end(args);
+
+    return exec_command(command, outputfile);
+}
+
+/**
+ * @return a pidfd for @param pid, or -1 if the kernel has no pidfd_open()
+ */
+static int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * Records how @param command ended, given its wait @param status
+ */
+static void finish_command(struct exec_command *command, int status)
+{
+    clock_gettime(CLOCK_MONOTONIC, &command->finished);
+    command->status = status;
+    command->success = WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+bool do_exec_batch(struct exec_command *commands, size_t count, size_t max_parallel)
+{
+    size_t next = 0;
+    size_t running = 0;
+    size_t finished = 0;
     bool ret = true;
-    pid_t pid = fork();
 
-    if (pid > 0)
+    if (max_parallel == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        max_parallel = (cpus > 0) ? (size_t)cpus : 1;
+    }
+    if (max_parallel > count)
+    {
+        max_parallel = count;
+    }
+    if (count == 0)
+    {
+        return true;
+    }
+
+    /* Slot i of each array describes the same running command */
+    struct pollfd *fds = calloc(max_parallel, sizeof(*fds));
+    pid_t *pids = calloc(max_parallel, sizeof(*pids));
+    size_t *indexes = calloc(max_parallel, sizeof(*indexes));
+    if ((fds == NULL) || (pids == NULL) || (indexes == NULL))
+    {
+        free(fds);
+        free(pids);
+        free(indexes);
+        return false;
+    }
+
+    while (finished < count)
     {
-        waitpid(pid, &rc, 0);
-        
-        if (!WIFEXITED(rc) || (WEXITSTATUS(rc) != 0))
+        bool polling = false;
+
+        while ((running < max_parallel) && (next < count))
+        {
+            struct exec_command *command = &commands[next];
+            pid_t pid;
+
+            command->status = 0;
+            command->success = false;
+            clock_gettime(CLOCK_MONOTONIC, &command->started);
+            command->spawn_error = spawn_command(command->argv, command->outputfile, &pid);
+            if (command->spawn_error != 0)
+            {
+                command->finished = command->started;
+                finished++;
+                next++;
+                continue;
+            }
+
+            /* A child that already exited is a zombie until reaped, so its pidfd still opens and polls readable */
+            fds[running].fd = open_pidfd(pid);
+            fds[running].events = POLLIN;
+            fds[running].revents = 0;
+            pids[running] = pid;
+            indexes[running] = next;
+            running++;
+            next++;
+        }
+
+        if (running == 0)
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < running; i++)
+        {
+            polling |= (fds[i].fd < 0);
+        }
+
+        /* poll() skips slots without a pidfd, so those are checked with WNOHANG on a short timeout instead */
+        if (poll(fds, running, polling ? 10 : -1) < 0)
         {
-            ret = false;
+            continue;
+        }
+
+        for (size_t i = running; i-- > 0;)
+        {
+            int status = 0;
+            pid_t rc;
+
+            if (fds[i].fd >= 0)
+            {
+                if (fds[i].revents == 0)
+                {
+                    continue;
+                }
+                rc = waitpid(pids[i], &status, 0);
+            }
+            else
+            {
+                rc = waitpid(pids[i], &status, WNOHANG);
+            }
+
+            if ((rc == 0) || ((rc < 0) && (errno == EINTR)))
+            {
+                continue;
+            }
+
+            if (rc == pids[i])
+            {
+                finish_command(&commands[indexes[i]], status);
+            }
+            else
+            {
+                /* Reaped elsewhere, so the exit status is lost */
+                clock_gettime(CLOCK_MONOTONIC, &commands[indexes[i]].finished);
+                commands[indexes[i]].status = -1;
+            }
+
+            if (fds[i].fd >= 0)
+            {
+                close(fds[i].fd);
+            }
+            running--;
+            fds[i] = fds[running];
+            pids[i] = pids[running];
+            indexes[i] = indexes[running];
+            finished++;
         }
     }
-    else if (pid == 0)
+
+    for (size_t i = 0; i < count; i++)
     {
-        rc = execv(command[0], command);
-        _exit(EXIT_FAILURE);
+        ret &= commands[i].success;
     }
 
-    va_end(args);
+    free(fds);
+    free(pids);
+    free(indexes);
 
     return ret;
 }
 
+#define CAPTURE_INITIAL_SIZE    (4096)
+#define CAPTURE_SPLICE_SIZE     (65536)
+
 /**
-* @param outputfile - The full path to the file to write with command output.
-*   This file will be closed at completion of the function call.
-* All other parameters, see do_exec above
-*/
-bool do_exec_redirect(const char *outputfile, int count, ...)
+ * Growable, NUL terminated buffer one output stream is collected into
+ */
+struct capture_buffer{
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+/**
+ * Makes room for at least @param extra more bytes and the terminator in @param buffer
+ * @return 0, or ENOMEM
+ */
+static int capture_reserve(struct capture_buffer *buffer, size_t extra)
+{
+    size_t cap = (buffer->cap != 0) ? buffer->cap : CAPTURE_INITIAL_SIZE;
+
+    while (cap < buffer->len + extra + 1)
+    {
+        cap *= 2;
+    }
+    if (cap != buffer->cap)
+    {
+        char *data = realloc(buffer->data, cap);
+        if (data == NULL)
+        {
+            return ENOMEM;
+        }
+        buffer->data = data;
+        buffer->cap = cap;
+    }
+    return 0;
+}
+
+/**
+ * Writes all @param len bytes of @param buf to @param fd
+ * @return 0, or the error number the write failed with
+ */
+static int write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t rc = write(fd, buf, len);
+        if (rc < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN)
+            {
+                struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            return errno;
+        }
+        buf += rc;
+        len -= (size_t)rc;
+    }
+    return 0;
+}
+
+/**
+ * Moves what is available on @param pipe_fd to @param splice_fd, with splice() while the descriptor
+ * accepts it and through a bounce buffer after it refuses with EINVAL, such as for an O_APPEND file.
+ * @param use_splice is cleared on that fallback. Once delivery failed, @param *error is set and
+ * the rest of the output is read and dropped so the command is not left blocked on a full pipe.
+ * @return the number of bytes taken from the pipe, 0 at end of file, or -1 if none were ready
+ */
+static ssize_t drain_to_fd(int pipe_fd, int splice_fd, bool *use_splice, int *error)
+{
+    char bounce[CAPTURE_SPLICE_SIZE];
+    ssize_t rc;
+
+    if (*use_splice && (*error == 0))
+    {
+        rc = splice(pipe_fd, NULL, splice_fd, NULL, CAPTURE_SPLICE_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (rc >= 0)
+        {
+            return rc;
+        }
+        if (errno == EAGAIN)
+        {
+            /* Either the pipe is empty or a nonblocking splice_fd is full, in which case wait for it to drain */
+            struct pollfd pfd = { .fd = splice_fd, .events = POLLOUT };
+            poll(&pfd, 1, -1);
+            errno = EAGAIN;
+            return -1;
+        }
+        if (errno != EINVAL)
+        {
+            if (errno != EINTR)
+            {
+                *error = errno;
+            }
+            return -1;
+        }
+        *use_splice = false;
+    }
+
+    rc = read(pipe_fd, bounce, sizeof(bounce));
+    if ((rc > 0) && (*error == 0))
+    {
+        *error = write_all(splice_fd, bounce, (size_t)rc);
+    }
+    return rc;
+}
+
+/**
+ * Reads what is available on @param pipe_fd into @param buffer, or discards it once @param *error is set
+ * @return the number of bytes read, 0 at end of file, or -1 if none were ready
+ */
+static ssize_t drain_to_buffer(int pipe_fd, struct capture_buffer *buffer, int *error)
+{
+    char discard[CAPTURE_INITIAL_SIZE];
+    ssize_t rc;
+
+    if (*error != 0)
+    {
+        return read(pipe_fd, discard, sizeof(discard));
+    }
+
+    /* Read straight into the buffer, growing it once it fills */
+    *error = capture_reserve(buffer, CAPTURE_INITIAL_SIZE);
+    if (*error != 0)
+    {
+        return read(pipe_fd, discard, sizeof(discard));
+    }
+
+    rc = read(pipe_fd, buffer->data + buffer->len, buffer->cap - buffer->len - 1);
+    if (rc > 0)
+    {
+        buffer->len += (size_t)rc;
+        buffer->data[buffer->len] = '\0';
+    }
+    return rc;
+}
+
+/**
+ * Starts @param command with its standard output and standard error on the write ends of
+ * @param out_pipe and @param err_pipe
+ * @return 0 if the command was started, otherwise an error number
+ */
+static int spawn_captured(char *const command[], int out_pipe[2], int err_pipe[2], pid_t *pid)
+{
+    posix_spawn_file_actions_t actions;
+    int rc = posix_spawn_file_actions_init(&actions);
+
+    if (rc != 0)
+    {
+        return rc;
+    }
+
+    /* The pipes are close on exec, so only the duplicates survive into the command */
+    rc = posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+    if (rc == 0)
+    {
+        rc = posix_spawn_file_actions_adddup2(&actions, err_pipe[1], STDERR_FILENO);
+    }
+    if (rc == 0)
+    {
+        rc = posix_spawn(pid, command[0], &actions, NULL, command, environ);
+    }
+
+    posix_spawn_file_actions_destroy(&actions);
+    return rc;
+}
+
+bool do_exec_capture(struct exec_capture *capture, int splice_fd, int count, ...)
 {
     va_list args;
     va_start(args, count);
@@ -90,42 +497,147 @@ bool do_exec_redirect(const char *outputfile, int count, ...)
     }
     command[count] = NULL;
 
-    pid_t pid = fork();
-    bool ret = true;
-    int rc = 0;
-    
-    if (pid > 0)
+    va_end(args);
+
+    int out_pipe[2] = { -1, -1 };
+    int err_pipe[2] = { -1, -1 };
+    struct capture_buffer out_buffer = { 0 };
+    struct capture_buffer err_buffer = { 0 };
+    bool use_splice = true;
+    pid_t pid;
+
+    memset(capture, 0, sizeof(*capture));
+    clock_gettime(CLOCK_MONOTONIC, &capture->started);
+
+    if ((pipe2(out_pipe, O_CLOEXEC) != 0) || (pipe2(err_pipe, O_CLOEXEC) != 0))
+    {
+        capture->error = errno;
+    }
+    else
+    {
+        capture->error = spawn_captured(command, out_pipe, err_pipe, &pid);
+    }
+
+    /* Only the command may hold the write ends, so the reads below see end of file when it exits */
+    if (out_pipe[1] >= 0)
+    {
+        close(out_pipe[1]);
+    }
+    if (err_pipe[1] >= 0)
     {
-        waitpid(pid, &rc, 0);
+        close(err_pipe[1]);
+    }
 
-        if (!WIFEXITED(rc) || (WEXITSTATUS(rc) != 0))
-        {   
-            ret = false;
+    if (capture->error != 0)
+    {
+        if (out_pipe[0] >= 0)
+        {
+            close(out_pipe[0]);
         }
+        if (err_pipe[0] >= 0)
+        {
+            close(err_pipe[0]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &capture->finished);
+        return false;
     }
-    else if (pid == 0)
+
+    fcntl(out_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(err_pipe[0], F_SETFL, O_NONBLOCK);
+
+    struct pollfd fds[2] = {
+        { .fd = out_pipe[0], .events = POLLIN },
+        { .fd = err_pipe[0], .events = POLLIN },
+    };
+
+    while ((fds[0].fd >= 0) || (fds[1].fd >= 0))
     {
-        int fd = open(outputfile, O_WRONLY | O_TRUNC | O_CREAT, 0666);
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            capture->error = errno;
+            break;
+        }
 
-        if (fd >= 0)
+        for (i = 0; i < 2; i++)
         {
-            rc = dup2(fd, STDOUT_FILENO);
-            close(fd);
+            ssize_t rc;
+
+            if ((fds[i].fd < 0) || (fds[i].revents == 0))
+            {
+                continue;
+            }
 
-            if (rc >= 0)
+            if (i == 0)
+            {
+                rc = (splice_fd >= 0) ? drain_to_fd(fds[i].fd, splice_fd, &use_splice, &capture->error) :
+                            drain_to_buffer(fds[i].fd, &out_buffer, &capture->error);
+            }
+            else
             {
-                rc = execv(command[0], command);
+                rc = drain_to_buffer(fds[i].fd, &err_buffer, &capture->error);
+            }
+
+            if (rc > 0)
+            {
+                if ((capture->stdout_bytes + capture->stderr_bytes) == 0)
+                {
+                    clock_gettime(CLOCK_MONOTONIC, &capture->first_output);
+                }
+                *((i == 0) ? &capture->stdout_bytes : &capture->stderr_bytes) += (size_t)rc;
+            }
+            else if ((rc == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+            {
+                if ((rc < 0) && (capture->error == 0))
+                {
+                    capture->error = errno;
+                }
+                close(fds[i].fd);
+                fds[i].fd = -1;
             }
         }
+    }
 
-        _exit(EXIT_FAILURE);
+    for (i = 0; i < 2; i++)
+    {
+        if (fds[i].fd >= 0)
+        {
+            close(fds[i].fd);
+        }
     }
-    else
+
+    while ((waitpid(pid, &capture->status, 0) < 0) && (errno == EINTR))
     {
-        ret = false;
     }
+    clock_gettime(CLOCK_MONOTONIC, &capture->finished);
 
-    va_end(args);
+    /* Callers get an empty string rather than NULL for a stream the command never wrote to */
+    if ((capture_reserve(&err_buffer, 0) != 0) || ((splice_fd < 0) && (capture_reserve(&out_buffer, 0) != 0)))
+    {
+        capture->error = ENOMEM;
+    }
+    if (err_buffer.data != NULL)
+    {
+        err_buffer.data[err_buffer.len] = '\0';
+    }
+    if (out_buffer.data != NULL)
+    {
+        out_buffer.data[out_buffer.len] = '\0';
+    }
+    capture->stdout_buf = out_buffer.data;
+    capture->stderr_buf = err_buffer.data;
+    capture->success = (capture->error == 0) && WIFEXITED(capture->status) && (WEXITSTATUS(capture->status) == 0);
 
-    return ret;
+    return capture->success;
+}
+
+void exec_capture_free(struct exec_capture *capture)
+{
+    free(capture->stdout_buf);
+    free(capture->stderr_buf);
+    capture->stdout_buf = NULL;
+    capture->stderr_buf = NULL;
 }
@@ -1,9 +1,114 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <time.h>
 
 bool do_system(const char *command);
 
 bool do_exec(int count, ...);
 
 bool do_exec_redirect(const char *outputfile, int count, ...);
+
+/**
+ * One command run by do_exec_batch(). The caller fills in argv and outputfile,
+ * do_exec_batch() fills in the rest.
+ */
+struct exec_command{
+    /**
+     * NULL terminated argument list, the first entry being the absolute path to execute
+     */
+    char *const *argv;
+
+    /**
+     * File to send standard output to, or NULL to leave it alone
+     */
+    const char *outputfile;
+
+    /**
+     * 0 if the command was started, otherwise the error number posix_spawn() failed with
+     */
+    int spawn_error;
+
+    /**
+     * Wait status of the command as returned by waitpid(), valid when spawn_error is 0
+     */
+    int status;
+
+    /**
+     * Set to true if the command was started and exited with status 0
+     */
+    bool success;
+
+    /**
+     * CLOCK_MONOTONIC times the command was started and was seen to exit
+     */
+    struct timespec started;
+    struct timespec finished;
+};
+
+/**
+* Runs the @param count commands in @param commands, keeping at most @param max_parallel of them
+* running at once, or one per online CPU if @param max_parallel is 0. Commands are started in order
+* as earlier ones finish, and each finished command is reaped as soon as its pidfd reports it exited
+* rather than by waiting on the commands in turn.
+* @return true if every command was started and exited with status 0, false otherwise. The
+*   outcome and timing of each command is in its entry in @param commands.
+*/
+bool do_exec_batch(struct exec_command *commands, size_t count, size_t max_parallel);
+
+/**
+ * Output and outcome of a command run by do_exec_capture()
+ */
+struct exec_capture{
+    /**
+     * Everything the command wrote to standard output and standard error, each NUL terminated.
+     * Allocated by do_exec_capture() and released with exec_capture_free().
+     * stdout_buf stays NULL when standard output is spliced to a descriptor instead.
+     */
+    char *stdout_buf;
+    char *stderr_buf;
+
+    /**
+     * Number of bytes the command wrote to each stream, including any spliced out
+     */
+    size_t stdout_bytes;
+    size_t stderr_bytes;
+
+    /**
+     * Wait status of the command as returned by waitpid()
+     */
+    int status;
+
+    /**
+     * 0, or the error number of the first failure to start the command, read its output or
+     * write it to the splice descriptor
+     */
+    int error;
+
+    /**
+     * Set to true if the command ran, all of its output was delivered and it exited with status 0
+     */
+    bool success;
+
+    /**
+     * CLOCK_MONOTONIC times the command was started, first wrote output and was reaped.
+     * first_output is zero if the command wrote nothing.
+     */
+    struct timespec started;
+    struct timespec first_output;
+    struct timespec finished;
+};
+
+/**
+* Runs a command like do_exec(), with its standard output and standard error connected to pipes
+* instead of a file, and collects both into memory in @param capture.
+* @param splice_fd - If not -1, standard output is moved to this descriptor, such as a socket or
+*   file, with splice() instead of being kept in memory.
+* All other parameters, see do_exec above
+* @return the value of capture->success. Call exec_capture_free() on @param capture afterwards
+*   whatever the result.
+*/
+bool do_exec_capture(struct exec_capture *capture, int splice_fd, int count, ...);
+
+void exec_capture_free(struct exec_capture *capture);
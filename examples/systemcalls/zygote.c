@@ -0,0 +1,597 @@
+#define _GNU_SOURCE
+#include "zygote.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Largest request, header and NUL separated arguments together
+ */
+#define ZYGOTE_MAX_REQUEST      (65536)
+#define ZYGOTE_MAX_ARGS         (256)
+/**
+ * Commands one zygote can have running at once; requests past this are refused with EAGAIN
+ */
+#define ZYGOTE_MAX_RUNNING      (256)
+
+#define ZYGOTE_CAPTURE_OUTPUT   (1u << 0)
+
+#define ZYGOTE_REPLY_STARTED    (1)
+#define ZYGOTE_REPLY_EXITED     (2)
+
+/**
+ * Request sent to the zygote, followed in the same message by argc NUL terminated arguments
+ */
+struct zygote_request{
+    uint32_t id;
+    uint32_t flags;
+    uint32_t argc;
+};
+
+/**
+ * Reply from the zygote. ZYGOTE_REPLY_STARTED answers every request, with error set if the command could
+ * not be started and carrying the output pipe when it was asked for. ZYGOTE_REPLY_EXITED follows once
+ * the command has been reaped.
+ */
+struct zygote_reply{
+    uint32_t type;
+    uint32_t id;
+    int32_t status;
+    int32_t error;
+};
+
+/**
+ * Sends @param reply on @param sock, with @param fd attached if it is not -1
+ */
+static bool send_reply(int sock, const struct zygote_reply *reply, int fd)
+{
+    struct iovec iov = { .iov_base = (void *)reply, .iov_len = sizeof(*reply) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+    if (fd >= 0)
+    {
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    while (sendmsg(sock, &msg, MSG_NOSIGNAL) < 0)
+    {
+        if (errno != EINTR)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Receives one reply from @param sock, setting *@param fd to any descriptor attached to it, or -1
+ */
+static bool recv_reply(int sock, struct zygote_reply *reply, int *fd)
+{
+    struct iovec iov = { .iov_base = reply, .iov_len = sizeof(*reply) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf,
+                          .msg_controllen = sizeof(control.buf) };
+    ssize_t rc;
+
+    while ((rc = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0)
+    {
+        if (errno != EINTR)
+        {
+            return false;
+        }
+    }
+
+    *fd = -1;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS))
+        {
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+
+    return (rc == (ssize_t)sizeof(*reply));
+}
+
+/**
+ * Zygote side: starts the command in @param request, @param len bytes, and sends its ZYGOTE_REPLY_STARTED.
+ * Does not allocate, since the zygote may have been forked from a threaded caller.
+ * @return the command's pid, or -1 if it was not started
+ */
+static pid_t start_request(int sock, const char *request, size_t len, const sigset_t *child_mask)
+{
+    struct zygote_request header;
+    struct zygote_reply reply = { .type = ZYGOTE_REPLY_STARTED };
+    char *argv[ZYGOTE_MAX_ARGS + 1];
+    int out_pipe[2] = { -1, -1 };
+    const char *arg = request + sizeof(header);
+    const char *end = request + len;
+    pid_t pid = -1;
+
+    memcpy(&header, request, sizeof(header));
+    reply.id = header.id;
+
+    if ((header.argc == 0) || (header.argc > ZYGOTE_MAX_ARGS))
+    {
+        reply.error = EINVAL;
+    }
+    for (uint32_t i = 0; (reply.error == 0) && (i < header.argc); i++)
+    {
+        const char *nul = memchr(arg, '\0', (size_t)(end - arg));
+        if (nul == NULL)
+        {
+            reply.error = EINVAL;
+            break;
+        }
+        argv[i] = (char *)arg;
+        arg = nul + 1;
+    }
+    argv[(reply.error == 0) ? header.argc : 0] = NULL;
+
+    if ((reply.error == 0) && (header.flags & ZYGOTE_CAPTURE_OUTPUT) && (pipe2(out_pipe, O_CLOEXEC) != 0))
+    {
+        reply.error = errno;
+    }
+
+    if (reply.error == 0)
+    {
+        pid = fork();
+        if (pid == 0)
+        {
+            /* The zygote blocks SIGCHLD for its signalfd, which the command should not inherit */
+            sigprocmask(SIG_SETMASK, child_mask, NULL);
+            if ((out_pipe[1] >= 0) && (dup2(out_pipe[1], STDOUT_FILENO) < 0))
+            {
+                _exit(127);
+            }
+            execv(argv[0], argv);
+            _exit(127);
+        }
+        if (pid < 0)
+        {
+            reply.error = errno;
+        }
+    }
+
+    if (out_pipe[1] >= 0)
+    {
+        close(out_pipe[1]);
+    }
+    send_reply(sock, &reply, (pid > 0) ? out_pipe[0] : -1);
+    if (out_pipe[0] >= 0)
+    {
+        close(out_pipe[0]);
+    }
+
+    return pid;
+}
+
+/**
+ * Closes every descriptor past the standard streams except @param keep, so the caller's descriptors leak
+ * neither into the zygote nor into the commands it starts. close_range() needs Linux 5.9, so older kernels
+ * close what /proc/self/fd lists, or every possible descriptor without /proc. Does not allocate.
+ */
+static void close_inherited_fds(int keep)
+{
+#if defined(SYS_close_range) && !defined(ZYGOTE_NO_CLOSE_RANGE)
+    if (((keep <= STDERR_FILENO + 1) ||
+         (syscall(SYS_close_range, STDERR_FILENO + 1, (unsigned int)keep - 1, 0) == 0)) &&
+        (syscall(SYS_close_range, (unsigned int)keep + 1, ~0U, 0) == 0))
+    {
+        return;
+    }
+#endif
+
+    int dir = open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir < 0)
+    {
+        long max = sysconf(_SC_OPEN_MAX);
+        for (long fd = STDERR_FILENO + 1; fd < ((max > 0) ? max : 1024); fd++)
+        {
+            if (fd != keep)
+            {
+                close((int)fd);
+            }
+        }
+        return;
+    }
+
+    /* Closing while reading the directory can make it skip entries, so read it again until a pass closes nothing */
+    bool closed;
+    do
+    {
+        union {
+            char buf[4096];
+            struct dirent64 align;
+        } entries;
+        long n;
+
+        closed = false;
+        lseek(dir, 0, SEEK_SET);
+        while ((n = syscall(SYS_getdents64, dir, entries.buf, sizeof(entries.buf))) > 0)
+        {
+            for (long offset = 0; offset < n;)
+            {
+                struct dirent64 *entry = (struct dirent64 *)(entries.buf + offset);
+                char *end;
+                long fd = strtol(entry->d_name, &end, 10);
+
+                offset += entry->d_reclen;
+                if ((*end == '\0') && (end != entry->d_name) && (fd > STDERR_FILENO) && (fd != keep) && (fd != dir))
+                {
+                    close((int)fd);
+                    closed = true;
+                }
+            }
+        }
+    } while (closed);
+
+    close(dir);
+}
+
+/**
+ * Body of the zygote process. Serves requests on @param sock until the caller closes it, reaping commands
+ * through a signalfd and reporting each one as it exits.
+ */
+static void zygote_main(int sock) __attribute__((noreturn));
+static void zygote_main(int sock)
+{
+    static char request[ZYGOTE_MAX_REQUEST];
+    static pid_t running_pid[ZYGOTE_MAX_RUNNING];
+    static uint32_t running_id[ZYGOTE_MAX_RUNNING];
+    size_t running = 0;
+    sigset_t chld_mask;
+    sigset_t child_mask;
+
+    close_inherited_fds(sock);
+
+    /* A caller that ignores SIGCHLD would have the commands reaped before their status could be reported */
+    signal(SIGCHLD, SIG_DFL);
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &child_mask);
+    sigdelset(&child_mask, SIGCHLD);
+    int sfd = signalfd(-1, &chld_mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (sfd < 0)
+    {
+        _exit(EXIT_FAILURE);
+    }
+
+    struct pollfd fds[2] = {
+        { .fd = sock, .events = POLLIN },
+        { .fd = sfd, .events = POLLIN },
+    };
+
+    for (;;)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            _exit(EXIT_FAILURE);
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            struct signalfd_siginfo info;
+            while (read(sfd, &info, sizeof(info)) == (ssize_t)sizeof(info))
+            {
+            }
+
+            /* Signals coalesce, so reap everything that has exited rather than one child per signal */
+            int status;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+            {
+                for (size_t i = 0; i < running; i++)
+                {
+                    if (running_pid[i] == pid)
+                    {
+                        struct zygote_reply reply = { .type = ZYGOTE_REPLY_EXITED, .id = running_id[i],
+                                                      .status = status };
+                        send_reply(sock, &reply, -1);
+                        running--;
+                        running_pid[i] = running_pid[running];
+                        running_id[i] = running_id[running];
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            ssize_t len = recv(sock, request, sizeof(request), 0);
+            if (len == 0)
+            {
+                _exit(EXIT_SUCCESS);
+            }
+            if (len < (ssize_t)sizeof(struct zygote_request))
+            {
+                if ((len < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+                {
+                    continue;
+                }
+                _exit(EXIT_FAILURE);
+            }
+
+            if (running == ZYGOTE_MAX_RUNNING)
+            {
+                struct zygote_request header;
+                memcpy(&header, request, sizeof(header));
+                struct zygote_reply reply = { .type = ZYGOTE_REPLY_STARTED, .id = header.id, .error = EAGAIN };
+                send_reply(sock, &reply, -1);
+                continue;
+            }
+
+            pid_t pid = start_request(sock, request, (size_t)len, &child_mask);
+            if (pid > 0)
+            {
+                running_pid[running] = pid;
+                running_id[running] = ((const struct zygote_request *)(const void *)request)->id;
+                running++;
+            }
+        }
+        else if (fds[0].revents & (POLLHUP | POLLERR))
+        {
+            _exit(EXIT_SUCCESS);
+        }
+    }
+}
+
+bool zygote_start(struct zygote *zygote)
+{
+    int sv[2];
+
+    memset(zygote, 0, sizeof(*zygote));
+    zygote->sock = -1;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) != 0)
+    {
+        return false;
+    }
+
+    zygote->pid = fork();
+    if (zygote->pid == 0)
+    {
+        close(sv[0]);
+        zygote_main(sv[1]);
+    }
+
+    close(sv[1]);
+    if (zygote->pid < 0)
+    {
+        close(sv[0]);
+        return false;
+    }
+
+    zygote->sock = sv[0];
+    return true;
+}
+
+/**
+ * Keeps a completion that arrived ahead of the reply zygote_spawn() was waiting for
+ */
+static bool queue_pending(struct zygote *zygote, uint32_t id, int status)
+{
+    if (zygote->pending_count == zygote->pending_cap)
+    {
+        size_t cap = (zygote->pending_cap != 0) ? zygote->pending_cap * 2 : 16;
+        uint32_t *ids = realloc(zygote->pending_id, cap * sizeof(*ids));
+        if (ids == NULL)
+        {
+            return false;
+        }
+        zygote->pending_id = ids;
+        int *statuses = realloc(zygote->pending_status, cap * sizeof(*statuses));
+        if (statuses == NULL)
+        {
+            return false;
+        }
+        zygote->pending_status = statuses;
+        zygote->pending_cap = cap;
+    }
+
+    zygote->pending_id[zygote->pending_count] = id;
+    zygote->pending_status[zygote->pending_count] = status;
+    zygote->pending_count++;
+    return true;
+}
+
+bool zygote_spawn(struct zygote *zygote, char *const argv[], int *output_fd, uint32_t *id)
+{
+    struct zygote_request header = { .id = zygote->next_id++, .flags = 0, .argc = 0 };
+    size_t len = sizeof(header);
+
+    if (zygote->sock < 0)
+    {
+        return false;
+    }
+
+    while (argv[header.argc] != NULL)
+    {
+        if (header.argc == ZYGOTE_MAX_ARGS)
+        {
+            return false;
+        }
+        header.argc++;
+    }
+
+    /* The header and every argument with its terminator go out as one message */
+    struct iovec iov[header.argc + 1];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    for (uint32_t i = 0; i < header.argc; i++)
+    {
+        iov[i + 1].iov_base = argv[i];
+        iov[i + 1].iov_len = strlen(argv[i]) + 1;
+        len += iov[i + 1].iov_len;
+    }
+    if (len > ZYGOTE_MAX_REQUEST)
+    {
+        return false;
+    }
+
+    if (output_fd != NULL)
+    {
+        header.flags |= ZYGOTE_CAPTURE_OUTPUT;
+        *output_fd = -1;
+    }
+
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = header.argc + 1 };
+    while (sendmsg(zygote->sock, &msg, MSG_NOSIGNAL) < 0)
+    {
+        if (errno != EINTR)
+        {
+            return false;
+        }
+    }
+
+    for (;;)
+    {
+        struct zygote_reply reply;
+        int fd;
+
+        if (!recv_reply(zygote->sock, &reply, &fd))
+        {
+            return false;
+        }
+        if ((reply.type == ZYGOTE_REPLY_STARTED) && (reply.id == header.id))
+        {
+            if (output_fd != NULL)
+            {
+                *output_fd = fd;
+            }
+            else if (fd >= 0)
+            {
+                close(fd);
+            }
+            if (id != NULL)
+            {
+                *id = header.id;
+            }
+            return (reply.error == 0);
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        if ((reply.type == ZYGOTE_REPLY_EXITED) && !queue_pending(zygote, reply.id, reply.status))
+        {
+            return false;
+        }
+    }
+}
+
+bool zygote_wait(struct zygote *zygote, uint32_t *id, int *status)
+{
+    if (zygote->pending_count > 0)
+    {
+        *id = zygote->pending_id[0];
+        *status = zygote->pending_status[0];
+        zygote->pending_count--;
+        memmove(zygote->pending_id, zygote->pending_id + 1, zygote->pending_count * sizeof(*zygote->pending_id));
+        memmove(zygote->pending_status, zygote->pending_status + 1,
+                zygote->pending_count * sizeof(*zygote->pending_status));
+        return true;
+    }
+
+    for (;;)
+    {
+        struct zygote_reply reply;
+        int fd;
+
+        if ((zygote->sock < 0) || !recv_reply(zygote->sock, &reply, &fd))
+        {
+            return false;
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        if (reply.type == ZYGOTE_REPLY_EXITED)
+        {
+            *id = reply.id;
+            *status = reply.status;
+            return true;
+        }
+    }
+}
+
+bool zygote_exec(struct zygote *zygote, int count, ...)
+{
+    va_list args;
+    va_start(args, count);
+    char * command[count+1];
+    int i;
+    for(i=0; i<count; i++)
+    {
+        command[i] = va_arg(args, char *);
+    }
+    command[count] = NULL;
+
+    va_end(args);
+
+    uint32_t id;
+    uint32_t done_id;
+    int status;
+
+    if (!zygote_spawn(zygote, command, NULL, &id))
+    {
+        return false;
+    }
+    do
+    {
+        if (!zygote_wait(zygote, &done_id, &status))
+        {
+            return false;
+        }
+    } while (done_id != id);
+
+    return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+void zygote_stop(struct zygote *zygote)
+{
+    if (zygote->sock >= 0)
+    {
+        close(zygote->sock);
+        zygote->sock = -1;
+        while ((waitpid(zygote->pid, NULL, 0) < 0) && (errno == EINTR))
+        {
+        }
+    }
+
+    free(zygote->pending_id);
+    free(zygote->pending_status);
+    zygote->pending_id = NULL;
+    zygote->pending_status = NULL;
+    zygote->pending_count = 0;
+    zygote->pending_cap = 0;
+}
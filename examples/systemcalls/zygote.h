@@ -0,0 +1,72 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * Handle on a zygote, a helper process that runs commands on behalf of its caller.
+ *
+ * The zygote is forked once by zygote_start() and then forks each command from its own address
+ * space, so command start up cost does not depend on how large the caller has grown since, and
+ * the fork happens in the zygote instead of on the calling thread. Requests and replies travel
+ * over a Unix socket. A handle is not safe to share between threads without external locking.
+ */
+struct zygote{
+    pid_t pid;
+
+    /**
+     * Caller's end of the SOCK_SEQPACKET socket pair, -1 if not started
+     */
+    int sock;
+
+    /**
+     * Id given to the next command sent with zygote_spawn()
+     */
+    uint32_t next_id;
+
+    /**
+     * Completions that arrived while zygote_spawn() waited for its own reply, handed out by zygote_wait() first
+     */
+    uint32_t *pending_id;
+    int *pending_status;
+    size_t pending_count;
+    size_t pending_cap;
+};
+
+/**
+* Forks the zygote. Call this early, while the caller is still small, because the zygote keeps
+* a copy of the caller's address space as it was at this point.
+* @return true if the zygote was started
+*/
+bool zygote_start(struct zygote *zygote);
+
+/**
+* Asks the zygote to run @param argv, a NULL terminated argument list whose first entry is the absolute path
+* to execute. Returns once the request is sent; the outcome arrives through zygote_wait().
+* @param output_fd - If not NULL, set to the read end of a pipe carrying the command's standard output,
+*   passed back by the zygote, which the caller must close. Otherwise the command shares the zygote's
+*   standard output.
+* @param id - If not NULL, set to the id zygote_wait() reports for this command
+* @return true if the command was started
+*/
+bool zygote_spawn(struct zygote *zygote, char *const argv[], int *output_fd, uint32_t *id);
+
+/**
+* Waits for the next command started with zygote_spawn() to finish, in whatever order they finish.
+* @param id - Set to the id of the command that finished
+* @param status - Set to its wait status as returned by waitpid()
+* @return true if a command finished, false if the zygote is gone
+*/
+bool zygote_wait(struct zygote *zygote, uint32_t *id, int *status);
+
+/**
+* Runs a command through the zygote and waits for it, like do_exec().
+* Must not be called while commands started with zygote_spawn() are still outstanding.
+* @return true if the command ran and exited with status 0
+*/
+bool zygote_exec(struct zygote *zygote, int count, ...);
+
+/**
+* Closes the connection, which makes the zygote exit, and reaps it. Commands still running carry on.
+*/
+void zygote_stop(struct zygote *zygote);
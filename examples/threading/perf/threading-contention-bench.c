@@ -0,0 +1,315 @@
+/**
+ * @file threading-contention-bench.c
+ * @brief Lock throughput under contention for pthread and adaptive mutexes
+ *
+ * Extends the examples/threading pattern of threads fighting over one mutex into a benchmark:
+ * each case starts a number of threads that repeatedly take a shared lock, do a fixed amount of
+ * work inside it and some outside, for the lock kinds below. Each case runs several times and
+ * reports the fastest run in ns per acquisition. Every run also checks that the counter the lock
+ * protects came out exact, and fails if it did not.
+ *
+ *  - pthread:          default pthread_mutex_t
+ *  - pthread_adaptive: PTHREAD_MUTEX_ADAPTIVE_NP, glibc's spin-then-sleep mutex
+ *  - adaptive:         AdaptiveMutex_t from the server, unprofiled
+ *  - adaptive_stats:   AdaptiveMutex_t with a contention profile
+ *  - pthread_stats:    pthread_mutex_t through the lock_stats_mutex_lock() wrapper, as the server's
+ *                      condition variable protected locks use it
+ *
+ * The profiles gathered by the _stats cases are printed to stderr in the server's stats format.
+ *
+ * Usage: threading-contention-bench [-o results.json] [-n acquisitions_per_thread] [-r repetitions]
+ *
+ * @author Looi Kian Seong
+ * @date 2026-10-18
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "adaptive_lock.h"
+
+#define MAX_REPETITIONS     (16)
+#define MAX_CASES           (128)
+#define MAX_NAME            (64)
+#define MAX_THREADS         (16)
+
+typedef enum
+{
+    LOCK_PTHREAD,
+    LOCK_PTHREAD_ADAPTIVE,
+    LOCK_ADAPTIVE,
+    LOCK_ADAPTIVE_STATS,
+    LOCK_PTHREAD_STATS,
+} LockKind_t;
+
+static const char *const lock_kind_names[] = { "pthread", "pthread_adaptive", "adaptive", "adaptive_stats",
+                                               "pthread_stats" };
+
+typedef struct
+{
+    char name[MAX_NAME];
+    double ns_per_op;
+} BenchResult_t;
+
+/**
+ * The lock under test and what it protects, on separate cache lines from the per thread state
+ */
+static struct
+{
+    LockKind_t kind;
+    pthread_mutex_t pthread_mutex;
+    AdaptiveMutex_t adaptive_mutex;
+    LockStats_t *stats;
+    uint64_t acquired_ns;
+    unsigned long counter;
+    unsigned long shadow;
+    unsigned int work_inside;
+    unsigned int work_outside;
+    long acquisitions;
+} shared __attribute__((aligned(64)));
+
+static BenchResult_t results[MAX_CASES];
+static int result_count;
+static pthread_barrier_t start_barrier;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double)ts.tv_sec * 1e9) + (double)ts.tv_nsec;
+}
+
+/**
+ * Busy work the compiler cannot drop, roughly @param rounds dependent multiplies
+ */
+static unsigned long spin_work(unsigned long seed, unsigned int rounds)
+{
+    for (unsigned int i = 0; i < rounds; i++)
+    {
+        seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+    }
+    return seed;
+}
+
+static void lock(void)
+{
+    switch (shared.kind)
+    {
+        case LOCK_ADAPTIVE:
+        case LOCK_ADAPTIVE_STATS:
+            adaptive_mutex_lock(&shared.adaptive_mutex);
+            break;
+        case LOCK_PTHREAD_STATS:
+            lock_stats_mutex_lock(&shared.pthread_mutex, shared.stats, &shared.acquired_ns);
+            break;
+        default:
+            pthread_mutex_lock(&shared.pthread_mutex);
+            break;
+    }
+}
+
+static void unlock(void)
+{
+    switch (shared.kind)
+    {
+        case LOCK_ADAPTIVE:
+        case LOCK_ADAPTIVE_STATS:
+            adaptive_mutex_unlock(&shared.adaptive_mutex);
+            break;
+        case LOCK_PTHREAD_STATS:
+            lock_stats_mutex_unlock(&shared.pthread_mutex, shared.stats, shared.acquired_ns);
+            break;
+        default:
+            pthread_mutex_unlock(&shared.pthread_mutex);
+            break;
+    }
+}
+
+static void *contender(void *arg)
+{
+    unsigned long seed = (unsigned long)(size_t)arg;
+
+    pthread_barrier_wait(&start_barrier);
+    for (long i = 0; i < shared.acquisitions; i++)
+    {
+        lock();
+        /* Two writes a torn critical section would let other threads interleave */
+        unsigned long counter = shared.counter;
+        seed = spin_work(seed, shared.work_inside);
+        shared.counter = counter + 1;
+        shared.shadow++;
+        unlock();
+        seed = spin_work(seed, shared.work_outside);
+    }
+
+    return (void *)(size_t)seed;
+}
+
+static void init_lock(LockKind_t kind)
+{
+    pthread_mutexattr_t attr;
+
+    shared.kind = kind;
+    pthread_mutexattr_init(&attr);
+    if (kind == LOCK_PTHREAD_ADAPTIVE)
+    {
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ADAPTIVE_NP);
+    }
+    pthread_mutex_init(&shared.pthread_mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    adaptive_mutex_init(&shared.adaptive_mutex, (kind == LOCK_ADAPTIVE_STATS) ? "bench_adaptive" : NULL);
+    shared.stats = (kind == LOCK_PTHREAD_STATS) ? lock_stats_register("bench_pthread") : NULL;
+}
+
+/**
+ * @return 0 on success, -1 if the lock let two threads in at once
+ */
+static int bench_case(LockKind_t kind, int threads, unsigned int work_inside, unsigned int work_outside,
+                      long acquisitions, int repetitions)
+{
+    pthread_t tids[MAX_THREADS];
+    double best = 0;
+
+    shared.work_inside = work_inside;
+    shared.work_outside = work_outside;
+    shared.acquisitions = acquisitions;
+
+    for (int rep = 0; rep < repetitions; rep++)
+    {
+        init_lock(kind);
+        shared.counter = 0;
+        shared.shadow = 0;
+        pthread_barrier_init(&start_barrier, NULL, (unsigned int)threads + 1U);
+        for (int t = 0; t < threads; t++)
+        {
+            pthread_create(&tids[t], NULL, contender, (void *)(size_t)(t + 1));
+        }
+
+        double start = now_ns();
+        pthread_barrier_wait(&start_barrier);
+        for (int t = 0; t < threads; t++)
+        {
+            pthread_join(tids[t], NULL);
+        }
+        double elapsed = (now_ns() - start) / ((double)acquisitions * threads);
+
+        pthread_barrier_destroy(&start_barrier);
+        pthread_mutex_destroy(&shared.pthread_mutex);
+        adaptive_mutex_destroy(&shared.adaptive_mutex);
+
+        unsigned long expected = (unsigned long)acquisitions * (unsigned long)threads;
+        if ((shared.counter != expected) || (shared.shadow != expected))
+        {
+            fprintf(stderr, "%s with %d threads: counter %lu shadow %lu, expected %lu\n", lock_kind_names[kind],
+                    threads, shared.counter, shared.shadow, expected);
+            return -1;
+        }
+
+        if ((rep == 0) || (elapsed < best))
+        {
+            best = elapsed;
+        }
+    }
+
+    if (result_count < MAX_CASES)
+    {
+        snprintf(results[result_count].name, MAX_NAME, "%s_t%d_in%u_out%u", lock_kind_names[kind], threads,
+                 work_inside, work_outside);
+        results[result_count].ns_per_op = best;
+        result_count++;
+    }
+    return 0;
+}
+
+static int write_results(FILE *out, long acquisitions)
+{
+    fprintf(out, "{\n  \"cpus\": %ld,\n  \"acquisitions_per_thread\": %ld,\n  \"benchmarks\": [\n",
+            sysconf(_SC_NPROCESSORS_ONLN), acquisitions);
+    for (int i = 0; i < result_count; i++)
+    {
+        fprintf(out, "    {\"name\": \"%s\", \"ns_per_op\": %.2f}%s\n", results[i].name,
+                results[i].ns_per_op, (i + 1 < result_count) ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    return ferror(out) ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = NULL;
+    long acquisitions = 200000;
+    int repetitions = 5;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:n:r:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'o':
+                output = optarg;
+                break;
+            case 'n':
+                acquisitions = strtol(optarg, NULL, 0);
+                break;
+            case 'r':
+                repetitions = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-o results.json] [-n acquisitions_per_thread] [-r repetitions]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (acquisitions <= 0)
+    {
+        acquisitions = 1;
+    }
+    if ((repetitions <= 0) || (repetitions > MAX_REPETITIONS))
+    {
+        repetitions = (repetitions <= 0) ? 1 : MAX_REPETITIONS;
+    }
+
+    lock_stats_set_hold_timing(true);
+
+    const int thread_counts[] = { 1, 2, 4, 8 };
+    /* Short critical sections with little work between them, and longer ones with more */
+    const unsigned int work[][2] = { { 10, 10 }, { 200, 800 } };
+
+    for (size_t w = 0; w < sizeof(work) / sizeof(work[0]); w++)
+    {
+        for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++)
+        {
+            for (int k = LOCK_PTHREAD; k <= LOCK_PTHREAD_STATS; k++)
+            {
+                if (bench_case((LockKind_t)k, thread_counts[t], work[w][0], work[w][1], acquisitions,
+                               repetitions) != 0)
+                {
+                    return 1;
+                }
+            }
+        }
+    }
+
+    FILE *out = stdout;
+    if ((output != NULL) && ((out = fopen(output, "w")) == NULL))
+    {
+        perror(output);
+        return 1;
+    }
+    if ((write_results(out, acquisitions) != 0) || ((out != stdout) && (fclose(out) != 0)))
+    {
+        fprintf(stderr, "Failed to write results\n");
+        return 1;
+    }
+
+    lock_stats_write(stderr);
+    return 0;
+}
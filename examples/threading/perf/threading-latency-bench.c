@@ -0,0 +1,440 @@
+/**
+ * @file threading-latency-bench.c
+ * @brief Wake up lateness and lock handoff latency of many start_thread_obtaining_mutex() style workers
+ *
+ * Starts a few thousand workers shaped like threadfunc() in examples/threading/threading.c: each one
+ * sleeps until an absolute deadline with clock_nanosleep(TIMER_ABSTIME), takes a shared mutex, holds
+ * it until a second absolute deadline and releases it. Deadlines are spread over a window so that
+ * wake ups overlap with holds. Per worker it records:
+ *
+ *  - wake_late:     how far past its obtain deadline the worker woke up
+ *  - release_late:  how far past its release deadline it woke up while holding the mutex
+ *  - handoff:       for workers that found the mutex held, the time from the previous holder's
+ *                   unlock to this worker owning it
+ *
+ * Workers can be pinned round robin to a CPU list and run under any scheduling policy, so the
+ * distributions can be compared across kernel, cgroup and isolation settings. Results are printed
+ * as JSON with percentiles and log2 histograms in ns.
+ *
+ * Usage: threading-latency-bench [-o results.json] [-n workers] [-w window_us] [-h hold_us]
+ *                                [-c cpu_list] [-p other|batch|idle|fifo|rr] [-r priority]
+ *                                [-l pthread|adaptive]
+ *
+ * @author Looi Kian Seong
+ * @date 2026-10-18
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "adaptive_lock.h"
+
+#define MAX_WORKERS         (32768)
+#define HISTOGRAM_BUCKETS   (40)
+#define WORKER_STACK_SIZE   (64 * 1024)
+/* Time given to thread creation before the first deadline, per worker */
+#define START_MARGIN_NS     (20000000LL)
+#define START_NS_PER_WORKER (50000LL)
+
+typedef enum
+{
+    METRIC_WAKE_LATE,
+    METRIC_RELEASE_LATE,
+    METRIC_HANDOFF,
+    METRIC_COUNT,
+} Metric_t;
+
+static const char *const metric_names[] = { "wake_late", "release_late", "handoff" };
+
+/**
+ * What a worker is told and what it measured, like struct thread_data with timings added
+ */
+typedef struct
+{
+    int64_t obtain_offset_ns;
+    int64_t hold_ns;
+    int cpu;
+    /* -1 when the worker did not measure that metric, handoff for uncontended acquisitions */
+    int64_t sample[METRIC_COUNT];
+    bool complete_success;
+} Worker_t;
+
+static struct
+{
+    bool adaptive;
+    pthread_mutex_t pthread_mutex;
+    AdaptiveMutex_t adaptive_mutex;
+    /* Written by the holder just before it unlocks, read by the next holder */
+    int64_t last_release_ns;
+} lock;
+
+static Worker_t *workers;
+static int64_t start_ns;
+static pthread_barrier_t start_barrier;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t)ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+}
+
+static void sleep_until_ns(int64_t deadline_ns)
+{
+    struct timespec deadline = { .tv_sec = deadline_ns / 1000000000LL, .tv_nsec = deadline_ns % 1000000000LL };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+    {
+    }
+}
+
+/**
+ * @return true if the lock was free, false if it had to be waited for
+ */
+static bool lock_acquire(void)
+{
+    if (lock.adaptive)
+    {
+        if (adaptive_mutex_trylock(&lock.adaptive_mutex))
+        {
+            return true;
+        }
+        adaptive_mutex_lock(&lock.adaptive_mutex);
+        return false;
+    }
+
+    if (pthread_mutex_trylock(&lock.pthread_mutex) == 0)
+    {
+        return true;
+    }
+    pthread_mutex_lock(&lock.pthread_mutex);
+    return false;
+}
+
+static void lock_release(void)
+{
+    lock.last_release_ns = now_ns();
+    if (lock.adaptive)
+    {
+        adaptive_mutex_unlock(&lock.adaptive_mutex);
+    }
+    else
+    {
+        pthread_mutex_unlock(&lock.pthread_mutex);
+    }
+}
+
+static void *worker_thread(void *arg)
+{
+    Worker_t *worker = (Worker_t *)arg;
+
+    pthread_barrier_wait(&start_barrier);
+
+    int64_t obtain_deadline = start_ns + worker->obtain_offset_ns;
+    sleep_until_ns(obtain_deadline);
+    int64_t woke = now_ns();
+    worker->sample[METRIC_WAKE_LATE] = woke - obtain_deadline;
+
+    bool free_lock = lock_acquire();
+    int64_t acquired = now_ns();
+    worker->sample[METRIC_HANDOFF] = free_lock ? -1 : (acquired - lock.last_release_ns);
+
+    int64_t release_deadline = acquired + worker->hold_ns;
+    sleep_until_ns(release_deadline);
+    worker->sample[METRIC_RELEASE_LATE] = now_ns() - release_deadline;
+    lock_release();
+
+    worker->complete_success = true;
+    return NULL;
+}
+
+/**
+ * Parses a list like "0,2-3" into @param cpus
+ * @return the number of CPUs, or -1 if @param list is malformed
+ */
+static int parse_cpu_list(const char *list, int *cpus, int max)
+{
+    int count = 0;
+    const char *p = list;
+
+    while (*p != '\0')
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+
+        if ((end == p) || (first < 0))
+        {
+            return -1;
+        }
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            if ((end == p + 1) || (last < first))
+            {
+                return -1;
+            }
+            p = end;
+        }
+        for (long cpu = first; (cpu <= last) && (count < max); cpu++)
+        {
+            cpus[count++] = (int)cpu;
+        }
+        if (*p == ',')
+        {
+            p++;
+        }
+        else if (*p != '\0')
+        {
+            return -1;
+        }
+    }
+    return count;
+}
+
+static int parse_policy(const char *name)
+{
+    static const struct
+    {
+        const char *name;
+        int policy;
+    } policies[] = {
+        { "other", SCHED_OTHER }, { "batch", SCHED_BATCH }, { "idle", SCHED_IDLE },
+        { "fifo", SCHED_FIFO }, { "rr", SCHED_RR },
+    };
+
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+    {
+        if (strcmp(name, policies[i].name) == 0)
+        {
+            return policies[i].policy;
+        }
+    }
+    return -1;
+}
+
+static int compare_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Writes the distribution of @param metric over the workers that measured it
+ */
+static void write_metric(FILE *out, Metric_t metric, int num_workers, bool last)
+{
+    int64_t *values = malloc(sizeof(int64_t) * (size_t)num_workers);
+    unsigned long histogram[HISTOGRAM_BUCKETS] = { 0 };
+    int count = 0;
+    double sum = 0;
+
+    for (int i = 0; (values != NULL) && (i < num_workers); i++)
+    {
+        int64_t value = workers[i].sample[metric];
+        if (value < 0)
+        {
+            continue;
+        }
+        values[count++] = value;
+        sum += (double)value;
+
+        int bucket = (value == 0) ? 0 : (64 - __builtin_clzll((unsigned long long)value));
+        histogram[(bucket < HISTOGRAM_BUCKETS) ? bucket : (HISTOGRAM_BUCKETS - 1)]++;
+    }
+    qsort(values, (size_t)count, sizeof(int64_t), compare_int64);
+
+    fprintf(out, "    \"%s\": {\"count\": %d", metric_names[metric], count);
+    if (count > 0)
+    {
+        const int permille[] = { 500, 900, 990, 999 };
+        const char *const labels[] = { "p50", "p90", "p99", "p999" };
+
+        fprintf(out, ", \"mean_ns\": %.0f", sum / count);
+        for (size_t q = 0; q < sizeof(permille) / sizeof(permille[0]); q++)
+        {
+            int rank = (int)(((long)count * permille[q] + 999) / 1000) - 1;
+            fprintf(out, ", \"%s_ns\": %lld", labels[q], (long long)values[(rank < 0) ? 0 : rank]);
+        }
+        fprintf(out, ", \"max_ns\": %lld", (long long)values[count - 1]);
+
+        /* Bucket b holds values below 2^b ns */
+        fprintf(out, ",\n      \"histogram_lt_ns\": {");
+        bool first = true;
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+        {
+            if (histogram[b] != 0)
+            {
+                fprintf(out, "%s\"%llu\": %lu", first ? "" : ", ", 1ULL << b, histogram[b]);
+                first = false;
+            }
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "}%s\n", last ? "" : ",");
+
+    free(values);
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = NULL;
+    const char *cpu_list = NULL;
+    const char *policy_name = "other";
+    const char *lock_name = "pthread";
+    int num_workers = 2000;
+    int64_t window_ns = 200000000LL;
+    int64_t hold_ns = 20000LL;
+    int priority = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:n:w:h:c:p:r:l:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'o':
+                output = optarg;
+                break;
+            case 'n':
+                num_workers = atoi(optarg);
+                break;
+            case 'w':
+                window_ns = strtoll(optarg, NULL, 0) * 1000LL;
+                break;
+            case 'h':
+                hold_ns = strtoll(optarg, NULL, 0) * 1000LL;
+                break;
+            case 'c':
+                cpu_list = optarg;
+                break;
+            case 'p':
+                policy_name = optarg;
+                break;
+            case 'r':
+                priority = atoi(optarg);
+                break;
+            case 'l':
+                lock_name = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-o results.json] [-n workers] [-w window_us] [-h hold_us] "
+                        "[-c cpu_list] [-p other|batch|idle|fifo|rr] [-r priority] [-l pthread|adaptive]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
+    int cpus[CPU_SETSIZE];
+    int num_cpus = 0;
+    int policy = parse_policy(policy_name);
+    if ((num_workers <= 0) || (num_workers > MAX_WORKERS) || (window_ns < 0) || (hold_ns < 0) || (policy < 0) ||
+        ((cpu_list != NULL) && ((num_cpus = parse_cpu_list(cpu_list, cpus, CPU_SETSIZE)) <= 0)) ||
+        ((strcmp(lock_name, "pthread") != 0) && (strcmp(lock_name, "adaptive") != 0)))
+    {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    workers = calloc((size_t)num_workers, sizeof(Worker_t));
+    pthread_t *threads = calloc((size_t)num_workers, sizeof(pthread_t));
+    if ((workers == NULL) || (threads == NULL))
+    {
+        perror("calloc");
+        return 1;
+    }
+
+    lock.adaptive = (strcmp(lock_name, "adaptive") == 0);
+    pthread_mutex_init(&lock.pthread_mutex, NULL);
+    adaptive_mutex_init(&lock.adaptive_mutex, NULL);
+
+    pthread_attr_t attr;
+    struct sched_param param = { .sched_priority = priority };
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, WORKER_STACK_SIZE);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, policy);
+    pthread_attr_setschedparam(&attr, &param);
+
+    unsigned int seed = 1;
+    pthread_barrier_init(&start_barrier, NULL, (unsigned int)num_workers + 1U);
+
+    for (int i = 0; i < num_workers; i++)
+    {
+        Worker_t *worker = &workers[i];
+        worker->obtain_offset_ns = (window_ns > 0) ? (int64_t)(((double)rand_r(&seed) / RAND_MAX) * window_ns) : 0;
+        worker->hold_ns = hold_ns;
+        worker->cpu = (num_cpus > 0) ? cpus[i % num_cpus] : -1;
+        for (int m = 0; m < METRIC_COUNT; m++)
+        {
+            worker->sample[m] = -1;
+        }
+
+        if (worker->cpu >= 0)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(worker->cpu, &set);
+            pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        }
+
+        int rc = pthread_create(&threads[i], &attr, worker_thread, worker);
+        if (rc != 0)
+        {
+            /* Real-time policies need CAP_SYS_NICE or an RLIMIT_RTPRIO allowance */
+            fprintf(stderr, "pthread_create for worker %d: %s\n", i, strerror(rc));
+            return 1;
+        }
+    }
+    pthread_attr_destroy(&attr);
+
+    /* Deadlines start once every worker exists, so creation cost does not count as lateness */
+    start_ns = now_ns() + START_MARGIN_NS + (START_NS_PER_WORKER * num_workers / 100);
+    pthread_barrier_wait(&start_barrier);
+
+    int failures = 0;
+    for (int i = 0; i < num_workers; i++)
+    {
+        pthread_join(threads[i], NULL);
+        failures += workers[i].complete_success ? 0 : 1;
+    }
+    pthread_barrier_destroy(&start_barrier);
+
+    FILE *out = stdout;
+    if ((output != NULL) && ((out = fopen(output, "w")) == NULL))
+    {
+        perror(output);
+        return 1;
+    }
+
+    fprintf(out, "{\n  \"workers\": %d,\n  \"window_us\": %lld,\n  \"hold_us\": %lld,\n  \"cpus\": \"%s\",\n"
+            "  \"policy\": \"%s\",\n  \"priority\": %d,\n  \"lock\": \"%s\",\n  \"online_cpus\": %ld,\n"
+            "  \"metrics\": {\n", num_workers, (long long)(window_ns / 1000), (long long)(hold_ns / 1000),
+            (cpu_list != NULL) ? cpu_list : "any", policy_name, priority, lock_name, sysconf(_SC_NPROCESSORS_ONLN));
+    for (int m = 0; m < METRIC_COUNT; m++)
+    {
+        write_metric(out, (Metric_t)m, num_workers, m + 1 == METRIC_COUNT);
+    }
+    fprintf(out, "  }\n}\n");
+
+    if (ferror(out) || ((out != stdout) && (fclose(out) != 0)))
+    {
+        fprintf(stderr, "Failed to write results\n");
+        return 1;
+    }
+
+    free(threads);
+    free(workers);
+    return (failures == 0) ? 0 : 1;
+}
@@ -1,4 +1,6 @@
 #include "threading.h"
+#include <errno.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -8,19 +10,51 @@
 //#define DEBUG_LOG(msg,...) printf("threading: " msg "\n" , ##__VA_ARGS__)
 #define ERROR_LOG(msg,...) printf("threading ERROR: " msg "\n" , ##__VA_ARGS__)
 
+/**
+ * Advances @param deadline by @param ms milliseconds
+ */
+static void add_ms(struct timespec *deadline, int ms)
+{
+    deadline->tv_sec += ms / 1000;
+    deadline->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L)
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+/**
+ * Sleeps until the absolute CLOCK_MONOTONIC time @param deadline, resuming after signals
+ */
+static void sleep_until(const struct timespec *deadline)
+{
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == EINTR)
+    {
+    }
+}
+
 void* threadfunc(void* thread_param)
 {
     struct thread_data *thread_args = (struct thread_data *)thread_param;
-
-    int wait_to_obtain_us = thread_args->wait_to_obtain_ms * 1000;
-    int wait_to_release_us = thread_args->wait_to_release_ms * 1000;
     pthread_mutex_t *mutex = thread_args->mutex;
+    struct timespec deadline;
 
-    usleep(wait_to_obtain_us);
+    /* Absolute deadlines keep the waits from stretching by however late each wake up was */
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    add_ms(&deadline, thread_args->wait_to_obtain_ms);
+    sleep_until(&deadline);
 
-    pthread_mutex_lock(mutex);
+    if (pthread_mutex_lock(mutex) != 0)
+    {
+        ERROR_LOG("pthread_mutex_lock failed");
+        thread_args->thread_complete_success = false;
+        return thread_param;
+    }
 
-    usleep(wait_to_release_us);
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    add_ms(&deadline, thread_args->wait_to_release_ms);
+    sleep_until(&deadline);
 
     pthread_mutex_unlock(mutex);
 
@@ -52,8 +86,11 @@ bool start_thread_obtaining_mutex(pthread_t *thread, pthread_mutex_t *mutex,int
     thread_param->wait_to_release_ms = wait_to_release_ms;
     thread_param->mutex = mutex;
 
+    thread_param->thread_complete_success = false;
+
     if (pthread_create(thread, NULL, threadfunc, (void *)thread_param) != 0)
     {
+        free(thread_param);
         return false;
     }
 
@@ -53,10 +53,8 @@ fi
 #make clean
 #make
 
-for i in $( seq 1 $NUMFILES)
-do
-	writer "$WRITEDIR/${username}$i.txt" "$WRITESTR"
-done
+# One writer process creates all the files instead of one per file
+writer -d "$WRITEDIR" -n "$NUMFILES" -p "${username}%d.txt" "$WRITESTR"
 
 OUTPUTSTRING=$(finder.sh "$WRITEDIR" "$WRITESTR")
 echo ${OUTPUTSTRING} > /tmp/assignment4-result.txt
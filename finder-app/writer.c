@@ -1,20 +1,798 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
 #include <syslog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+// IORING_OP_OPENAT and IORING_OP_CLOSE came with the same kernel headers as IORING_FEAT_RW_CUR_POS
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup)
+#define WRITER_HAVE_IO_URING 1
+#endif
 
 const char *ARGS[] =
 {
     "",         // placeholder for the executable filename during invocation
-    "writefile", 
-    "writestr", 
+    "writefile",
+    "writestr",
 };
 
 const int N_ARGS = sizeof(ARGS) / sizeof(ARGS[0]);
 
+#define BULK_FILE_MODE      (0666)
+#define BULK_OPEN_FLAGS     (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC)
+// Files handled per io_uring submission, each takes up to two submission queue entries
+#define BULK_BATCH          (128)
+#define BULK_RING_ENTRIES   (2 * BULK_BATCH)
+// Copies of the content described by one pwritev() call
+#define BULK_IOV_PER_WRITE  (16)
+
+struct manifest_entry
+{
+    // Start of the line buffer the entry was read into
+    char *name;
+    const char *content;
+    size_t content_len;
+};
+
+// What bulk mode writes: either the files listed in a manifest, or count files named by a pattern
+struct bulk_job
+{
+    int dir_fd;
+    struct manifest_entry *entries;
+    size_t count;
+    // Pattern names are prefix, file number starting at 1, suffix
+    const char *prefix;
+    size_t prefix_len;
+    const char *suffix;
+    const char *content;
+    size_t content_len;
+    // Every file holds its content this many times over
+    size_t repeat;
+};
+
+static void bulk_usage(void)
+{
+    syslog(LOG_ERR, "Invalid bulk mode arguments");
+    fprintf(stderr, "Usage: writer writefile writestr\n"
+                    "       writer -d dir (-n count -p pattern | -m manifest) [-r repeat] [-u] [-S] [writestr]\n"
+                    "  pattern   file name with one %%d for the file number, e.g. user%%d.txt\n"
+                    "  manifest  one file per line, name or name<TAB>content, - for stdin\n"
+                    "  -r        write the content this many times into each file\n"
+                    "  -u        submit opens, writes and closes through io_uring\n"
+                    "  -S        syncfs() the directory's file system once everything is written\n");
+}
+
+static const char *bulk_file(const struct bulk_job *job, size_t i, char *buf, size_t buf_len,
+                             const char **content, size_t *content_len)
+{
+    if (job->entries != NULL)
+    {
+        *content = job->entries[i].content;
+        *content_len = job->entries[i].content_len;
+        return job->entries[i].name;
+    }
+
+    *content = job->content;
+    *content_len = job->content_len;
+    int len = snprintf(buf, buf_len, "%.*s%zu%s", (int)job->prefix_len, job->prefix, i + 1, job->suffix);
+    return ((len < 0) || ((size_t)len >= buf_len)) ? NULL : buf;
+}
+
+// Describes the content repeated job->repeat times, from byte offset on, in at most max entries of iov
+static int bulk_iov(const struct bulk_job *job, const char *content, size_t content_len, size_t offset,
+                    struct iovec *iov, int max)
+{
+    size_t total = content_len * job->repeat;
+    int n = 0;
+
+    while ((offset < total) && (n < max))
+    {
+        size_t skip = offset % content_len;
+        iov[n].iov_base = (void *)(content + skip);
+        iov[n].iov_len = content_len - skip;
+        offset += iov[n].iov_len;
+        n++;
+    }
+
+    return n;
+}
+
+// Writes the content from byte offset on, returns 0 or an errno value
+static int bulk_write_rest(const struct bulk_job *job, int fd, const char *content, size_t content_len,
+                           size_t offset)
+{
+    size_t total = content_len * job->repeat;
+    struct iovec iov[BULK_IOV_PER_WRITE];
+
+    while (offset < total)
+    {
+        int n = bulk_iov(job, content, content_len, offset, iov, BULK_IOV_PER_WRITE);
+        ssize_t written = pwritev(fd, iov, n, (off_t)offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno;
+        }
+        if (written == 0)
+        {
+            return EIO;
+        }
+        offset += (size_t)written;
+    }
+
+    return 0;
+}
+
+static int bulk_write_file(const struct bulk_job *job, const char *name, const char *content, size_t content_len)
+{
+    int fd = openat(job->dir_fd, name, BULK_OPEN_FLAGS, BULK_FILE_MODE);
+    if (fd < 0)
+    {
+        return errno;
+    }
+
+    int error = bulk_write_rest(job, fd, content, content_len, 0);
+    if ((close(fd) != 0) && (error == 0))
+    {
+        error = errno;
+    }
+
+    return error;
+}
+
+static size_t bulk_report(const char *name, int error)
+{
+    syslog(LOG_ERR, "Writing to %s failed: %s", (name != NULL) ? name : "(name too long)", strerror(error));
+    return 1;
+}
+
+static size_t bulk_write_sync(const struct bulk_job *job)
+{
+    char name_buf[PATH_MAX];
+    size_t failed = 0;
+
+    for (size_t i = 0; i < job->count; ++i)
+    {
+        const char *content;
+        size_t content_len;
+        const char *name = bulk_file(job, i, name_buf, sizeof(name_buf), &content, &content_len);
+        int error = (name == NULL) ? ENAMETOOLONG : bulk_write_file(job, name, content, content_len);
+
+        if (error != 0)
+        {
+            failed += bulk_report(name, error);
+        }
+    }
+
+    return failed;
+}
+
+#ifdef WRITER_HAVE_IO_URING
+
+struct uring
+{
+    int fd;
+    void *sq_ring;
+    size_t sq_ring_len;
+    void *cq_ring;
+    size_t cq_ring_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned queued;
+};
+
+// Where a file of the current batch stands
+struct bulk_slot
+{
+    char name_buf[PATH_MAX];
+    const char *name;
+    const char *content;
+    size_t content_len;
+    int fd;
+    int error;
+    // Bytes the ring wrote, or the negated errno of the write
+    ssize_t written;
+    // The ring closed fd
+    int closed;
+    struct iovec iov[BULK_IOV_PER_WRITE];
+};
+
+enum
+{
+    BULK_OP_OPEN,
+    BULK_OP_WRITE,
+    BULK_OP_CLOSE,
+};
+
+static void uring_free(struct uring *ring)
+{
+    if (ring->sqes != NULL)
+    {
+        munmap(ring->sqes, ring->sqes_len);
+    }
+    if ((ring->cq_ring != NULL) && (ring->cq_ring != ring->sq_ring))
+    {
+        munmap(ring->cq_ring, ring->cq_ring_len);
+    }
+    if (ring->sq_ring != NULL)
+    {
+        munmap(ring->sq_ring, ring->sq_ring_len);
+    }
+    close(ring->fd);
+}
+
+static int uring_init(struct uring *ring, unsigned entries)
+{
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0)
+    {
+        return errno;
+    }
+
+    ring->sq_ring_len = params.sq_off.array + (params.sq_entries * sizeof(unsigned));
+    ring->cq_ring_len = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cq_ring_len > ring->sq_ring_len)
+        {
+            ring->sq_ring_len = ring->cq_ring_len;
+        }
+        ring->cq_ring_len = ring->sq_ring_len;
+    }
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    void *sq_ring = mmap(NULL, ring->sq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    ring->sq_ring = (sq_ring == MAP_FAILED) ? NULL : sq_ring;
+
+    void *cq_ring = ring->sq_ring;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        cq_ring = mmap(NULL, ring->cq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring->fd, IORING_OFF_CQ_RING);
+    }
+    ring->cq_ring = (cq_ring == MAP_FAILED) ? NULL : cq_ring;
+
+    void *sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    ring->sqes = (sqes == MAP_FAILED) ? NULL : sqes;
+
+    if ((ring->sq_ring == NULL) || (ring->cq_ring == NULL) || (ring->sqes == NULL))
+    {
+        int error = errno;
+        uring_free(ring);
+        return error;
+    }
+
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    return 0;
+}
+
+// Only ever called for fewer entries than the ring holds, with nothing else in flight
+static struct io_uring_sqe *uring_sqe(struct uring *ring, uint8_t opcode, size_t slot, unsigned op)
+{
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = ((uint64_t)slot << 2) | op;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->queued++;
+
+    return sqe;
+}
+
+// Submits what was queued and waits for all of it to complete
+static int uring_run(struct uring *ring)
+{
+    unsigned to_submit = ring->queued;
+
+    while (to_submit > 0)
+    {
+        long submitted = syscall(__NR_io_uring_enter, ring->fd, to_submit, ring->queued,
+                                 IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno;
+        }
+        to_submit -= (unsigned)submitted;
+    }
+
+    unsigned head = *ring->cq_head;
+    while ((__atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) - head) < ring->queued)
+    {
+        if ((syscall(__NR_io_uring_enter, ring->fd, 0, ring->queued, IORING_ENTER_GETEVENTS, NULL, 0) < 0) &&
+            (errno != EINTR))
+        {
+            return errno;
+        }
+    }
+
+    return 0;
+}
+
+static void uring_complete(struct uring *ring, struct bulk_slot *slots)
+{
+    unsigned head = *ring->cq_head;
+
+    for (; ring->queued > 0; ring->queued--, head++)
+    {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        struct bulk_slot *slot = &slots[cqe->user_data >> 2];
+
+        switch (cqe->user_data & 3)
+        {
+            case BULK_OP_OPEN:
+                slot->fd = (cqe->res >= 0) ? cqe->res : -1;
+                slot->error = (cqe->res >= 0) ? 0 : -cqe->res;
+                break;
+            case BULK_OP_WRITE:
+                slot->written = cqe->res;
+                break;
+            default:
+                // -ECANCELED when the write before it fell short, fd is still open then
+                slot->closed = (cqe->res != -ECANCELED) && (cqe->res != -EINVAL);
+                if ((cqe->res < 0) && slot->closed)
+                {
+                    slot->error = -cqe->res;
+                }
+                break;
+        }
+    }
+
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/**
+ * Each batch goes through the ring twice: all the opens, then every file's write linked to its close.
+ * Kernels older than 5.6 reject those opcodes with EINVAL, such files are written synchronously, and
+ * once an open is rejected the rest of the job skips the ring.
+ */
+static size_t bulk_write_uring(const struct bulk_job *job, struct uring *ring)
+{
+    struct bulk_slot *slots = calloc(BULK_BATCH, sizeof(struct bulk_slot));
+    size_t failed = 0;
+    int use_ring = 1;
+
+    if (slots == NULL)
+    {
+        syslog(LOG_ERR, "Out of memory");
+        return job->count;
+    }
+
+    for (size_t first = 0; first < job->count; first += BULK_BATCH)
+    {
+        size_t n = ((job->count - first) < BULK_BATCH) ? (job->count - first) : BULK_BATCH;
+
+        for (size_t s = 0; s < n; ++s)
+        {
+            struct bulk_slot *slot = &slots[s];
+            slot->name = bulk_file(job, first + s, slot->name_buf, sizeof(slot->name_buf),
+                                   &slot->content, &slot->content_len);
+            slot->fd = -1;
+            slot->error = (slot->name == NULL) ? ENAMETOOLONG : 0;
+            slot->written = 0;
+            slot->closed = 0;
+
+            if (use_ring && (slot->name != NULL))
+            {
+                struct io_uring_sqe *sqe = uring_sqe(ring, IORING_OP_OPENAT, s, BULK_OP_OPEN);
+                sqe->fd = job->dir_fd;
+                sqe->addr = (uintptr_t)slot->name;
+                sqe->len = BULK_FILE_MODE;
+                sqe->open_flags = BULK_OPEN_FLAGS;
+            }
+        }
+
+        int error = uring_run(ring);
+        if (error != 0)
+        {
+            syslog(LOG_ERR, "io_uring submission failed: %s", strerror(error));
+            free(slots);
+            return failed + (job->count - first);
+        }
+        uring_complete(ring, slots);
+
+        for (size_t s = 0; s < n; ++s)
+        {
+            struct bulk_slot *slot = &slots[s];
+            if (slot->error == EINVAL)
+            {
+                use_ring = 0;
+            }
+            if ((slot->fd < 0) || !use_ring)
+            {
+                continue;
+            }
+
+            size_t total = slot->content_len * job->repeat;
+            size_t described = 0;
+            if (total > 0)
+            {
+                struct io_uring_sqe *sqe = uring_sqe(ring, IORING_OP_WRITEV, s, BULK_OP_WRITE);
+                sqe->fd = slot->fd;
+                sqe->addr = (uintptr_t)slot->iov;
+                sqe->len = bulk_iov(job, slot->content, slot->content_len, 0, slot->iov, BULK_IOV_PER_WRITE);
+                sqe->flags = IOSQE_IO_LINK;
+                for (unsigned v = 0; v < sqe->len; ++v)
+                {
+                    described += slot->iov[v].iov_len;
+                }
+            }
+            // Content too long for one write is finished synchronously below, which closes the file too
+            if (described == total)
+            {
+                uring_sqe(ring, IORING_OP_CLOSE, s, BULK_OP_CLOSE)->fd = slot->fd;
+            }
+        }
+
+        error = uring_run(ring);
+        if (error != 0)
+        {
+            syslog(LOG_ERR, "io_uring submission failed: %s", strerror(error));
+            free(slots);
+            return failed + (job->count - first);
+        }
+        uring_complete(ring, slots);
+
+        for (size_t s = 0; s < n; ++s)
+        {
+            struct bulk_slot *slot = &slots[s];
+
+            if ((slot->name != NULL) && ((slot->error == EINVAL) || ((slot->fd < 0) && (slot->error == 0))))
+            {
+                slot->error = bulk_write_file(job, slot->name, slot->content, slot->content_len);
+            }
+            else if ((slot->fd >= 0) && !slot->closed)
+            {
+                // Finish what the ring left undone: a short or rejected write, or a rejected close
+                if (slot->written < 0)
+                {
+                    slot->error = (slot->written == -EINVAL) ? 0 : (int)-slot->written;
+                    slot->written = 0;
+                }
+                if (slot->error == 0)
+                {
+                    slot->error = bulk_write_rest(job, slot->fd, slot->content, slot->content_len,
+                                                  (size_t)slot->written);
+                }
+                if ((close(slot->fd) != 0) && (slot->error == 0))
+                {
+                    slot->error = errno;
+                }
+            }
+
+            if (slot->error != 0)
+            {
+                failed += bulk_report(slot->name, slot->error);
+            }
+        }
+    }
+
+    free(slots);
+
+    return failed;
+}
+
+#endif
+
+static int open_dir(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if ((fd >= 0) || (errno != ENOENT))
+    {
+        return fd;
+    }
+
+    // Create the missing directories, like mkdir -p
+    char buf[PATH_MAX];
+    if (snprintf(buf, sizeof(buf), "%s", path) >= (int)sizeof(buf))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    for (char *p = buf + 1; ; ++p)
+    {
+        if ((*p == '/') || (*p == '\0'))
+        {
+            char c = *p;
+            *p = '\0';
+            if ((mkdir(buf, 0777) != 0) && (errno != EEXIST))
+            {
+                return -1;
+            }
+            *p = c;
+            if (c == '\0')
+            {
+                break;
+            }
+        }
+    }
+
+    return open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+// Reads the whole manifest, names and contents point into line buffers kept for the lifetime of the process
+static int read_manifest(const char *path, const char *content, struct bulk_job *job)
+{
+    FILE *fp = (strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+    struct manifest_entry *entries = NULL;
+    size_t cap = 0;
+    size_t count = 0;
+    int ret = 0;
+
+    if (fp == NULL)
+    {
+        syslog(LOG_ERR, "Opening manifest %s failed: %s", path, strerror(errno));
+        return -1;
+    }
+
+    for (;;)
+    {
+        char *line = NULL;
+        size_t line_cap = 0;
+        ssize_t len = getline(&line, &line_cap, fp);
+        if (len < 0)
+        {
+            free(line);
+            break;
+        }
+        if ((len > 0) && (line[len - 1] == '\n'))
+        {
+            line[--len] = '\0';
+        }
+        if (len == 0)
+        {
+            free(line);
+            continue;
+        }
+
+        if (count == cap)
+        {
+            cap = (cap == 0) ? 1024 : (2 * cap);
+            struct manifest_entry *grown = realloc(entries, cap * sizeof(*entries));
+            if (grown == NULL)
+            {
+                syslog(LOG_ERR, "Out of memory reading manifest %s", path);
+                free(line);
+                ret = -1;
+                break;
+            }
+            entries = grown;
+        }
+
+        struct manifest_entry *entry = &entries[count++];
+        char *tab = strchr(line, '\t');
+        entry->name = line;
+        if (tab != NULL)
+        {
+            *tab = '\0';
+            entry->content = tab + 1;
+            entry->content_len = (size_t)(line + len - (tab + 1));
+        }
+        else
+        {
+            entry->content = content;
+            entry->content_len = strlen(content);
+        }
+    }
+
+    if ((ret == 0) && ferror(fp))
+    {
+        syslog(LOG_ERR, "Reading manifest %s failed", path);
+        ret = -1;
+    }
+    if (fp != stdin)
+    {
+        fclose(fp);
+    }
+
+    job->entries = entries;
+    job->count = count;
+
+    return ret;
+}
+
+static void free_manifest(struct bulk_job *job)
+{
+    for (size_t i = 0; (job->entries != NULL) && (i < job->count); ++i)
+    {
+        free(job->entries[i].name);
+    }
+    free(job->entries);
+    job->entries = NULL;
+}
+
+static int bulk_main(int argc, char **argv)
+{
+    struct bulk_job job;
+    const char *dir = NULL;
+    const char *manifest = NULL;
+    const char *pattern = NULL;
+    long long count = -1;
+    long long repeat = 1;
+    int use_uring = 0;
+    int sync_fs = 0;
+    int opt;
+
+    memset(&job, 0, sizeof(job));
+
+    while ((opt = getopt(argc, argv, "d:n:p:m:r:uS")) != -1)
+    {
+        switch (opt)
+        {
+            case 'd':
+                dir = optarg;
+                break;
+            case 'n':
+                count = strtoll(optarg, NULL, 10);
+                break;
+            case 'p':
+                pattern = optarg;
+                break;
+            case 'm':
+                manifest = optarg;
+                break;
+            case 'r':
+                repeat = strtoll(optarg, NULL, 10);
+                break;
+            case 'u':
+                use_uring = 1;
+                break;
+            case 'S':
+                sync_fs = 1;
+                break;
+            default:
+                bulk_usage();
+                return 1;
+        }
+    }
+
+    job.content = (optind < argc) ? argv[optind] : "";
+    job.content_len = strlen(job.content);
+    job.repeat = (size_t)repeat;
+
+    // The pattern takes exactly one %d and no other conversion
+    const char *number = (pattern != NULL) ? strstr(pattern, "%d") : NULL;
+    int pattern_ok = (number != NULL) && (strchr(number + 2, '%') == NULL) &&
+                     ((size_t)(strchr(pattern, '%') - pattern) == (size_t)(number - pattern));
+
+    if ((dir == NULL) || (repeat < 0) || (optind + 1 < argc) ||
+        ((manifest == NULL) == (pattern == NULL)) ||
+        ((pattern != NULL) && (!pattern_ok || (count < 0))))
+    {
+        bulk_usage();
+        return 1;
+    }
+
+    if ((job.content_len > 0) && (job.repeat > SIZE_MAX / job.content_len))
+    {
+        bulk_usage();
+        return 1;
+    }
+
+    if (manifest != NULL)
+    {
+        if (read_manifest(manifest, job.content, &job) != 0)
+        {
+            free_manifest(&job);
+            return 1;
+        }
+    }
+    else
+    {
+        job.count = (size_t)count;
+        job.prefix = pattern;
+        job.prefix_len = (size_t)(number - pattern);
+        job.suffix = number + 2;
+    }
+
+    job.dir_fd = open_dir(dir);
+    if (job.dir_fd < 0)
+    {
+        syslog(LOG_ERR, "Opening directory %s failed: %s", dir, strerror(errno));
+        free_manifest(&job);
+        return 1;
+    }
+
+    syslog(LOG_DEBUG, "Writing %zu files to %s", job.count, dir);
+
+    size_t failed;
+#ifdef WRITER_HAVE_IO_URING
+    struct uring ring;
+    int error = use_uring ? uring_init(&ring, BULK_RING_ENTRIES) : ENOSYS;
+    if (error == 0)
+    {
+        failed = bulk_write_uring(&job, &ring);
+        uring_free(&ring);
+    }
+    else
+    {
+        if (use_uring)
+        {
+            syslog(LOG_NOTICE, "io_uring unavailable, writing synchronously: %s", strerror(error));
+        }
+        failed = bulk_write_sync(&job);
+    }
+#else
+    if (use_uring)
+    {
+        syslog(LOG_NOTICE, "Built without io_uring, writing synchronously");
+    }
+    failed = bulk_write_sync(&job);
+#endif
+
+    if (sync_fs && (syncfs(job.dir_fd) != 0))
+    {
+        syslog(LOG_ERR, "Syncing %s failed: %s", dir, strerror(errno));
+        failed++;
+    }
+
+    close(job.dir_fd);
+    free_manifest(&job);
+
+    return (failed == 0) ? 0 : 1;
+}
+
 int main(int argc, char **argv)
 {
     openlog(NULL, 0, LOG_USER);
 
+    // Options select bulk mode, which writes many files from one process
+    if ((argc > 1) && (argv[1][0] == '-'))
+    {
+        int ret = bulk_main(argc, argv);
+        closelog();
+        return ret;
+    }
+
     if (argc < N_ARGS)
     {
         syslog(LOG_ERR, "Not enough positional arguments");
@@ -38,9 +816,9 @@ int main(int argc, char **argv)
     }
 
     syslog(LOG_DEBUG, "Writing %s to %s", argv[2], argv[1]);
-    int written = fprintf(fp, argv[2]);
+    int written = fputs(argv[2], fp);
 
-    if (written < 0)
+    if ((written < 0) || (fclose(fp) != 0))
     {
         error = errno;
         syslog(LOG_ERR, "Writing to file failed: %s", strerror(error));
@@ -48,10 +826,7 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    fclose(fp);
-
     closelog();
 
     return 0;
 }
-
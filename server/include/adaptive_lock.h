@@ -0,0 +1,158 @@
+/**
+ * \file    adaptive_lock.h
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Spin-then-futex mutex and per-lock contention profiling
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#ifndef ADAPTIVE_LOCK_H_
+#define ADAPTIVE_LOCK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#define LOCK_STATS_MAX_LOCKS                        (32U)
+#define LOCK_STATS_NAME_LEN                         (32U)
+/* Histogram bucket b counts durations below 2^b ns, the last one everything longer */
+#define LOCK_STATS_BUCKETS                          (32U)
+
+/* Upper bound on the spins an adaptive mutex tries before sleeping on the futex */
+#define ADAPTIVE_MUTEX_MAX_SPINS                    (1000U)
+
+/**
+ * Contention profile shared by every lock registered under the same name. 
+ * Waits are only timed when the uncontended fast path fails, so a lock nobody 
+ * fights over costs no clock reads; hold times need a clock read on every 
+ * acquire and release and are only recorded once lock_stats_set_hold_timing() 
+ * turned them on. 
+ */
+typedef struct
+{
+    char name[LOCK_STATS_NAME_LEN];
+    atomic_ulong acquisitions;
+    atomic_ulong contended;
+    atomic_ulong wait_ns_total;
+    atomic_ulong hold_ns_total;
+    atomic_ulong wait_hist[LOCK_STATS_BUCKETS];
+    atomic_ulong hold_hist[LOCK_STATS_BUCKETS];
+} LockStats_t;
+
+/**
+ * Mutex that spins for a while before sleeping on a futex, the way 
+ * PTHREAD_MUTEX_ADAPTIVE_NP does. The spin limit follows a running average 
+ * of how long recent acquisitions had to spin, and is zero on a single CPU 
+ * where the holder cannot run while we spin. 
+ * 
+ * @ref state is 0 when free, 1 when held and 2 when held with sleepers. 
+ */
+typedef struct
+{
+    atomic_uint state;
+    atomic_uint spin_average;
+    LockStats_t *stats;
+    /* Hold timing start, written by the holder only */
+    uint64_t acquired_ns;
+} AdaptiveMutex_t;
+
+/**
+ * Find or create the profile for @param name. Locks registered under one name, 
+ * such as one per worker thread, are profiled together. 
+ * @return NULL once LOCK_STATS_MAX_LOCKS names are in use 
+ */
+LockStats_t *lock_stats_register (const char *name);
+
+/**
+ * Record hold times from now on if @param enable is set. 
+ */
+void lock_stats_set_hold_timing (bool enable);
+
+bool lock_stats_hold_timing (void);
+
+static inline uint64_t lock_stats_now_ns (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Account one acquisition of a lock profiled by @param stats, which waited 
+ * @param wait_ns if @param contended. @param stats may be NULL. 
+ * @return the start of the hold, or 0 if hold times are not recorded 
+ */
+uint64_t lock_stats_acquired (LockStats_t *stats, bool contended, uint64_t wait_ns);
+
+/**
+ * Account the end of a hold which started at @param acquired_ns. 
+ */
+void lock_stats_released (LockStats_t *stats, uint64_t acquired_ns);
+
+/**
+ * Lock @param mutex like pthread_mutex_lock(), profiled by @param stats. 
+ * @param acquired_ns receives the start of the hold, to be passed back on unlock. 
+ * @return the result of pthread_mutex_lock(), EOWNERDEAD included 
+ */
+int lock_stats_mutex_lock (pthread_mutex_t *mutex, LockStats_t *stats, uint64_t *acquired_ns);
+
+void lock_stats_mutex_unlock (pthread_mutex_t *mutex, LockStats_t *stats, uint64_t acquired_ns);
+
+/**
+ * pthread_cond_wait() and pthread_cond_timedwait() on a mutex locked with 
+ * lock_stats_mutex_lock(). Time spent waiting on @param cond does not count 
+ * as holding the mutex. 
+ */
+int lock_stats_cond_wait (pthread_cond_t *cond, pthread_mutex_t *mutex, LockStats_t *stats, 
+                          uint64_t *acquired_ns);
+
+int lock_stats_cond_timedwait (pthread_cond_t *cond, pthread_mutex_t *mutex, LockStats_t *stats, 
+                               uint64_t *acquired_ns, const struct timespec *deadline);
+
+/**
+ * Write "lock_<name>_<counter> value" lines for every registered lock, with 
+ * the wait and hold histograms as one line per non-empty bucket. 
+ */
+void lock_stats_write (FILE *fp);
+
+/**
+ * Initialize @param mutex unlocked, profiled under @param name, which may be NULL. 
+ */
+void adaptive_mutex_init (AdaptiveMutex_t *mutex, const char *name);
+
+void adaptive_mutex_destroy (AdaptiveMutex_t *mutex);
+
+void adaptive_mutex_lock (AdaptiveMutex_t *mutex);
+
+bool adaptive_mutex_trylock (AdaptiveMutex_t *mutex);
+
+void adaptive_mutex_unlock (AdaptiveMutex_t *mutex);
+
+#endif  /* ADAPTIVE_LOCK_H_ */
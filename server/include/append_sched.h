@@ -0,0 +1,165 @@
+/**
+ * \file    append_sched.h
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Function prototypes for the per-client fair append scheduler: 
+ *          token-bucket rate limiting and deficit round robin commits
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#ifndef APPEND_SCHED_H_
+#define APPEND_SCHED_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "data_store.h"
+
+#define APPEND_SCHED_OK                             (0)
+#define APPEND_SCHED_THREAD_CREATE_FAILED           (1)
+#define APPEND_SCHED_NO_MEMORY                      (2)
+#define APPEND_SCHED_STOPPED                        (3)
+
+#define APPEND_SCHED_INVALID_PARAM                  (-1)
+
+/* Number of client hash buckets, must be a power of two */
+#define APPEND_SCHED_HASH_SIZE                      (256U)
+#define APPEND_SCHED_DEFAULT_QUANTUM                (4096U)
+
+typedef struct
+{
+    /* 0 disables the corresponding limit */
+    uint64_t bytes_per_sec;
+    uint64_t records_per_sec;
+    /* Bytes a client may commit per round robin turn */
+    uint32_t quantum;
+} AppendSchedConfig_t;
+
+typedef struct AppendRequest
+{
+    const char *buf;
+    size_t len;
+    /* Result, valid once the request completed */
+    int rc;
+    int error_code;
+    off_t size_after;
+    /**
+     * Called from the committer thread once the record is in the store. 
+     * NULL for append_sched_submit(), which waits on @ref cond instead. 
+     */
+    void (*on_done)(struct AppendRequest *req);
+    void *ctx;
+    bool done;
+    bool throttled;
+    struct timespec enqueued;
+    pthread_cond_t cond;
+    struct AppendRequest *next;
+} AppendRequest_t;
+
+typedef struct AppendClient
+{
+    char key[16];
+    unsigned int refs;
+    double byte_tokens;
+    double record_tokens;
+    struct timespec last_refill;
+    uint64_t deficit;
+    bool active;
+    bool turn_started;
+    AppendRequest_t *head;
+    AppendRequest_t *tail;
+    struct AppendClient *next_active;
+    struct AppendClient *prev_active;
+    struct AppendClient *hash_next;
+
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t throttled_records;
+    uint64_t throttle_wait_ns;
+} AppendClient_t;
+
+/**
+ * Records are queued per client and committed by a single committer thread. 
+ * Active clients are served in deficit round robin order, each turn granting 
+ * @ref AppendSchedConfig_t.quantum bytes, and a client only gets its turn 
+ * while its token buckets cover the head record, so a runaway client can not 
+ * take the store from the others. 
+ */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    LockStats_t *lock_stats;
+    uint64_t lock_acquired_ns;
+    pthread_cond_t work_cond;
+    pthread_t committer;
+    bool running;
+    DataStore_t *store;
+    AppendSchedConfig_t config;
+    AppendClient_t *buckets[APPEND_SCHED_HASH_SIZE];
+    AppendClient_t *cursor;
+    unsigned int num_of_clients;
+} AppendScheduler_t;
+
+int append_sched_start (AppendScheduler_t *sched, DataStore_t *store, const AppendSchedConfig_t *config, 
+                        int *error_code);
+
+/**
+ * Commit every queued record, then stop the committer thread. 
+ */
+void append_sched_stop (AppendScheduler_t *sched);
+
+/**
+ * Look up the client keyed by @param key, typically the peer address, creating 
+ * it if needed, and take a reference on it. 
+ */
+AppendClient_t *append_sched_client_get (AppendScheduler_t *sched, const char *key);
+
+void append_sched_client_put (AppendScheduler_t *sched, AppendClient_t *client);
+
+/**
+ * Queue @param len bytes of @param buf for @param client and block until they 
+ * are committed. Same results as data_store_append(). 
+ */
+int append_sched_submit (AppendScheduler_t *sched, AppendClient_t *client, const char *buf, size_t len, 
+                         off_t *size_after, int *error_code);
+
+/**
+ * Queue @param req for @param client without blocking, @ref AppendRequest_t.on_done 
+ * is called once it is committed. @param req and its buffer must stay valid until then. 
+ */
+int append_sched_submit_async (AppendScheduler_t *sched, AppendClient_t *client, AppendRequest_t *req);
+
+/**
+ * Write one line of throttle counters per known client to @param fp and forget 
+ * clients which are unreferenced, idle and back to full buckets. 
+ */
+void append_sched_write_stats (AppendScheduler_t *sched, FILE *fp);
+
+#endif  /* APPEND_SCHED_H_ */
@@ -0,0 +1,119 @@
+/**
+ * \file    async_log.h
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Function prototypes for the asynchronous logging pipeline. 
+ *          Threads push preformatted records into a lock-free MPSC ring 
+ *          which is drained to syslog or a file by a background thread
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#ifndef ASYNC_LOG_H_
+#define ASYNC_LOG_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define ASYNC_LOG_SETUP_OK                          (0)
+#define ASYNC_LOG_OPEN_FAILED                       (1)
+#define ASYNC_LOG_EVENTFD_FAILED                    (2)
+#define ASYNC_LOG_THREAD_CREATE_FAILED              (3)
+
+/* Number of records in the ring, must be a power of two */
+#define ASYNC_LOG_RING_SIZE                         (1024U)
+#define ASYNC_LOG_MSG_SIZE                          (240U)
+
+/* Rate limiting applied by ASYNC_LOG_RATELIMITED() to each call site */
+#define ASYNC_LOG_RATELIMIT_INTERVAL_SEC            (5)
+#define ASYNC_LOG_RATELIMIT_BURST                   (10U)
+
+typedef struct
+{
+    atomic_long window_start;
+    atomic_uint passed;
+    atomic_uint suppressed;
+} AsyncLogRateLimit_t;
+
+/**
+ * Start the drainer thread. Records are forwarded to syslog when @param log_path 
+ * is NULL, otherwise appended to the file at @param log_path. 
+ * Until this is called (or after async_log_stop()), async_log() falls back to 
+ * a synchronous syslog() call. 
+ */
+int async_log_start (const char *log_path, int *error_code);
+
+/**
+ * Drain all pending records, report the drop count and stop the drainer thread. 
+ */
+void async_log_stop (void);
+
+/**
+ * To be called in a child right after fork(), where the drainer thread does not 
+ * exist. Records the parent had not drained yet are left to the parent, the 
+ * child starts over with an empty ring and its own drainer on the same sink. 
+ */
+int async_log_restart_in_child (int *error_code);
+
+/**
+ * Format a record and push it into the ring without blocking. The record is 
+ * dropped and counted if the ring is full. 
+ */
+void async_log (int priority, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * Total number of records dropped because the ring was full
+ */
+uint64_t async_log_dropped (void);
+
+/**
+ * @return true if the call site owning @param ratelimit may log now. 
+ *      @param suppressed is set to the number of records suppressed since the 
+ *      previous interval when a new interval begins, 0 otherwise. 
+ */
+bool async_log_ratelimit_pass (AsyncLogRateLimit_t *ratelimit, unsigned int *suppressed);
+
+/**
+ * Log at most ASYNC_LOG_RATELIMIT_BURST records per ASYNC_LOG_RATELIMIT_INTERVAL_SEC 
+ * from this call site, e.g. for errors which may fire repeatedly in a loop. 
+ */
+#define ASYNC_LOG_RATELIMITED(priority, ...)                                        \
+    do                                                                              \
+    {                                                                               \
+        static AsyncLogRateLimit_t ratelimit_;                                      \
+        unsigned int suppressed_ = 0U;                                              \
+        if (async_log_ratelimit_pass(&ratelimit_, &suppressed_))                    \
+        {                                                                           \
+            if (suppressed_ > 0U)                                                   \
+            {                                                                       \
+                async_log(priority, "%u similar messages suppressed", suppressed_); \
+            }                                                                       \
+            async_log(priority, __VA_ARGS__);                                       \
+        }                                                                           \
+    } while (0)
+
+#endif  /* ASYNC_LOG_H_ */
@@ -0,0 +1,121 @@
+/**
+ * \file    conn_table.h
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Slab-backed connection table with generation-tagged handles 
+ *          and an eventfd-signalled completion queue for reaping finished 
+ *          connection threads
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#ifndef CONN_TABLE_H_
+#define CONN_TABLE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "conn_thread.h"
+
+#define CONN_TABLE_SETUP_OK                         (0)
+#define CONN_TABLE_EVENTFD_FAILED                   (1)
+
+/* Slots are allocated in chunks which are never moved, so pointers to a slot stay valid */
+#define CONN_TABLE_CHUNK_SIZE                       (64U)
+#define CONN_TABLE_MAX_CHUNKS                       (1024U)
+#define CONN_TABLE_INDEX_BITS                       (16U)
+#define CONN_TABLE_INDEX_MASK                       ((1U << CONN_TABLE_INDEX_BITS) - 1U)
+
+/* Handle 0 is never handed out since generations start at 1 */
+#define CONN_TABLE_INVALID_HANDLE                   (0U)
+#define CONN_TABLE_NO_SLOT                          (UINT32_MAX)
+
+typedef uint32_t ConnHandle_t;
+
+typedef struct
+{
+    struct ConnTable *table;
+    ConnHandle_t handle;
+    pthread_t thread_id;
+    void *(*func)(void *params);
+    ConnThreadParams_t thread_params;
+    uint16_t generation;
+    bool in_use;
+    uint32_t next_free;
+    _Atomic uint32_t next_completed;
+} ConnSlot_t;
+
+typedef struct ConnTable
+{
+    ConnSlot_t *chunks[CONN_TABLE_MAX_CHUNKS];
+    unsigned int num_of_chunks;
+    unsigned int num_in_use;
+    uint32_t free_head;
+    _Atomic uint32_t completed_head;
+    int completion_fd;
+} ConnTable_t;
+
+int conn_table_init (ConnTable_t *table, int *error_code);
+
+/**
+ * Take a free slot, growing the slab by one chunk if needed. Only called by the 
+ * thread owning the table. 
+ * @return the handle of the slot, or CONN_TABLE_INVALID_HANDLE when out of slots 
+ */
+ConnHandle_t conn_table_alloc (ConnTable_t *table);
+
+/**
+ * @return the slot referred to by @param handle or NULL if the handle is stale 
+ */
+ConnSlot_t *conn_table_lookup (ConnTable_t *table, ConnHandle_t handle);
+
+/**
+ * Return the slot of @param handle to the free list and bump its generation so 
+ * that older handles no longer resolve. 
+ */
+void conn_table_free (ConnTable_t *table, ConnHandle_t handle);
+
+/**
+ * Push @param handle onto the completion queue and wake the reaper. Safe to call 
+ * from any thread, lock-free. 
+ */
+void conn_table_complete (ConnTable_t *table, ConnHandle_t handle);
+
+/**
+ * Join and free every connection which signalled completion. Each completed 
+ * connection costs O(1), regardless of the number of live connections. 
+ * @return number of connections reaped 
+ */
+unsigned int conn_table_reap_completed (ConnTable_t *table);
+
+/**
+ * Join every remaining connection thread and release the table. 
+ */
+void conn_table_destroy (ConnTable_t *table);
+
+#endif  /* CONN_TABLE_H_ */
@@ -33,19 +33,52 @@
 #ifndef CONN_THREAD_H_
 #define CONN_THREAD_H_
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <pthread.h>
 
+#include "data_store.h"
+#include "append_sched.h"
+#include "record_index.h"
+#include "replay_cache.h"
+#include "coro_sched.h"
+
+/* Connection threads only need a shallow stack, the default reserves 8 MB of VM each */
+#define CONN_THREAD_STACK_SIZE                      (256U * 1024U)
+
+struct ConnTable;
+
 typedef struct
 {
     char client_ipv4[16];
     int client_fd;
-    int output_fd;
-    pthread_mutex_t *mutex;
-    bool done;
+    DataStore_t *store;
+    /* NULL unless records go through the append scheduler */
+    AppendScheduler_t *append_sched;
+    AppendClient_t *client;
+    RecordIndex_t *index;
+    /* NULL if compressed replays are unavailable */
+    ReplayCache_t *replay_cache;
 } ConnThreadParams_t;
 
-bool spawn_connection_thread (pthread_t *thread_id, void *(*func)(void* params), char client_ipv4[16], 
-                              int cfd, int output_fd, pthread_mutex_t *mutex, 
-                              ConnThreadParams_t **thread_params_ptr, int *error_code);
+/**
+ * Allocate a slot in @param table for the connection and start @param func on 
+ * a copy of @param params in it. 
+ * The slot is pushed onto the table's completion queue as soon as @param func returns, 
+ * whichever path it returns through. 
+ * When @ref ConnThreadParams_t.append_sched is not NULL, the thread holds a 
+ * reference on the scheduler client of its peer address while @param func runs. 
+ * @param handle is set to the handle of the connection slot on success. 
+ */
+bool spawn_connection_thread (struct ConnTable *table, void *(*func)(void* params), 
+                              const ConnThreadParams_t *params, uint32_t *handle, int *error_code);
+
+/**
+ * Same as spawn_connection_thread(), but run @param func in a coroutine of 
+ * @param runtime, which holds the only reference to the copy of @param params. 
+ * The client socket has to be non-blocking. 
+ */
+bool spawn_connection_coro (CoroRuntime_t *runtime, void *(*func)(void* params), 
+                            const ConnThreadParams_t *params, int *error_code);
 
 #endif  /* CONN_THREAD_H_ */
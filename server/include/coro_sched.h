@@ -0,0 +1,200 @@
+/**
+ * \file    coro_sched.h
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Function prototypes for the stackful coroutine runtime running
+ *          connection handlers on one epoll scheduler thread per core
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#ifndef CORO_SCHED_H_
+#define CORO_SCHED_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include "adaptive_lock.h"
+
+#define CORO_SCHED_OK                               (0)
+#define CORO_SCHED_THREAD_CREATE_FAILED             (1)
+#define CORO_SCHED_EPOLL_FAILED                     (2)
+#define CORO_SCHED_NO_MEMORY                        (3)
+#define CORO_SCHED_STOPPED                          (4)
+
+#define CORO_SCHED_INVALID_PARAM                    (-1)
+
+/* Usable stack of a coroutine, a PROT_NONE guard page below it catches overflows */
+#define CORO_SCHED_STACK_SIZE                       (64U * 1024U)
+/* Stacks of finished coroutines kept for reuse */
+#define CORO_SCHED_STACK_POOL_SIZE                  (256U)
+#define CORO_SCHED_MAX_THREADS                      (64U)
+#define CORO_SCHED_MAX_EVENTS                       (256)
+
+typedef enum
+{
+    CORO_STATE_READY,
+    CORO_STATE_WAIT_FD,
+    CORO_STATE_SLEEPING,
+    CORO_STATE_PARKED,
+    CORO_STATE_DONE,
+} CoroState_t;
+
+struct CoroThread;
+
+typedef struct Coro
+{
+    ucontext_t ctx;
+    void *stack;
+    void (*func)(void *arg);
+    void *arg;
+    struct CoroThread *thread;
+    CoroState_t state;
+    /* Not picked up by its thread yet */
+    bool is_new;
+    /* Set when the runtime stops while the coroutine waits on an fd or sleeps */
+    bool cancelled;
+    /* Descriptor currently in the epoll set of the thread on behalf of this coroutine */
+    int registered_fd;
+    uint64_t wake_at_ms;
+    /* Ready queue or incoming list */
+    struct Coro *next;
+    LIST_ENTRY(Coro) node;
+    LIST_ENTRY(Coro) sleep_node;
+} Coro_t;
+
+LIST_HEAD(coro_list, Coro);
+
+typedef struct CoroThread
+{
+    pthread_t thread;
+    int epfd;
+    /* eventfd signalled when coroutines are spawned on or woken from another thread */
+    int wake_fd;
+    struct CoroRuntime *runtime;
+    ucontext_t sched_ctx;
+    Coro_t *current;
+    /* Only touched by the thread itself */
+    Coro_t *ready_head;
+    Coro_t *ready_tail;
+    struct coro_list coros;
+    struct coro_list sleeping;
+    unsigned int num_of_coros;
+    bool waits_cancelled;
+    /* Spawned or woken from other threads, under @ref mutex */
+    AdaptiveMutex_t mutex;
+    Coro_t *incoming;
+} CoroThread_t;
+
+/**
+ * Every coroutine stays on the scheduler thread it was spawned on. It runs 
+ * until it blocks on a descriptor, sleeps or parks itself, then the thread 
+ * switches to the next ready one, and to epoll_wait() once none is left. 
+ * Stacks are mapped once and recycled through a pool shared by the threads, 
+ * taken when the coroutine is spawned so that running out of memory fails 
+ * coro_spawn() rather than the coroutine. 
+ * 
+ * On stop, coroutines waiting on a descriptor or sleeping are resumed with 
+ * their wait failing with ECANCELED so that they unwind through their normal 
+ * error paths. Parked coroutines wait for their coro_wake() as usual. 
+ */
+typedef struct CoroRuntime
+{
+    CoroThread_t *threads;
+    unsigned int num_of_threads;
+    atomic_uint next_thread;
+    atomic_uint num_of_coros;
+    atomic_bool stopping;
+    AdaptiveMutex_t pool_mutex;
+    void *stack_pool;
+    unsigned int num_of_pooled;
+} CoroRuntime_t;
+
+/**
+ * Start @param num_of_threads scheduler threads, one per online core when 0. 
+ */
+int coro_sched_start (CoroRuntime_t *runtime, unsigned int num_of_threads, int *error_code);
+
+/**
+ * Cancel the waits of every coroutine, wait for all of them to return and 
+ * stop the scheduler threads. 
+ */
+void coro_sched_stop (CoroRuntime_t *runtime);
+
+/**
+ * Run @param func on @param arg in a new coroutine, on the scheduler threads in turn. 
+ * Not to be called concurrently with coro_sched_stop(). 
+ */
+int coro_spawn (CoroRuntime_t *runtime, void (*func)(void *arg), void *arg, int *error_code);
+
+/**
+ * @return number of coroutines which have not returned yet 
+ */
+unsigned int coro_sched_count (CoroRuntime_t *runtime);
+
+/**
+ * @return the calling coroutine, NULL when called from a plain thread 
+ */
+Coro_t *coro_self (void);
+
+/**
+ * Suspend the calling coroutine until @param fd reports one of @param events. 
+ * @return false with errno set to ECANCELED if the runtime is stopping 
+ */
+bool coro_wait_fd (int fd, uint32_t events);
+
+/**
+ * Suspend the calling coroutine for @param ms milliseconds. 
+ * @return false with errno set to ECANCELED if the runtime is stopping 
+ */
+bool coro_sleep_ms (unsigned int ms);
+
+/**
+ * Suspend the calling coroutine until coro_wake() is called on it, which may 
+ * happen before it got to park itself as long as it does not suspend any 
+ * other way in between. 
+ */
+void coro_park (void);
+
+/**
+ * Resume parked @param coro, callable from any thread. 
+ */
+void coro_wake (Coro_t *coro);
+
+/**
+ * recv() and send() which, inside a coroutine, suspend it on EAGAIN until the 
+ * descriptor is ready instead of failing. Outside a coroutine they behave 
+ * exactly like the plain calls. 
+ */
+ssize_t coro_recv (int fd, void *buf, size_t len, int flags);
+ssize_t coro_send (int fd, const void *buf, size_t len, int flags);
+
+#endif  /* CORO_SCHED_H_ */
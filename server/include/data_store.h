@@ -0,0 +1,139 @@
+/**
+ * \file    data_store.h
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Function prototypes for the append-only data store backing 
+ *          the socket server packets
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#ifndef DATA_STORE_H_
+#define DATA_STORE_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "adaptive_lock.h"
+
+#define DATA_STORE_OK                               (0)
+#define DATA_STORE_OPEN_FAILED                      (1)
+#define DATA_STORE_WRITE_FAILED                     (2)
+#define DATA_STORE_WRITE_INTERRUPTED                (3)
+#define DATA_STORE_READ_FAILED                      (4)
+#define DATA_STORE_MUTEX_INIT_FAILED                (5)
+#define DATA_STORE_MAP_FAILED                       (6)
+
+#define DATA_STORE_INVALID_PARAM                    (-1)
+
+#define DATA_STORE_RECOVER_CHUNK                    (65536U)
+
+/**
+ * Appends are serialized by @ref mutex and written with pwrite() at @ref size, which 
+ * is only advanced once the whole record is in the file. Bytes below @ref size never 
+ * change again, so readers use pread() on a size snapshot without taking the mutex. 
+ * 
+ * Both live in a memfd mapping, so processes forked after data_store_open() 
+ * as well as a successor the descriptors are handed to append to the same 
+ * store. The mutex is robust: when a process dies holding it, the next owner 
+ * drops whatever the dead one wrote past @ref size. 
+ */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    atomic_llong size;
+} DataStoreShared_t;
+
+/**
+ * Called with every record appended, while the store mutex is still held, so 
+ * records reach it in store order from every process sharing the store. 
+ */
+typedef void (*DataStorePublishFn_t)(void *ctx, const char *buf, size_t len, off_t offset);
+
+typedef struct
+{
+    int fd;
+    /* memfd backing @ref shared */
+    int shared_fd;
+    /* Process which opened the store and owns the shared mutex */
+    pid_t owner;
+    DataStoreShared_t *shared;
+    /* NULL unless records are published, see data_store_set_publisher() */
+    DataStorePublishFn_t publish;
+    void *publish_ctx;
+    /* Contention profile of the shared mutex as seen by this process */
+    LockStats_t *lock_stats;
+    uint64_t lock_acquired_ns;
+} DataStore_t;
+
+/**
+ * Open the store at @param path, emptying it unless @param persist is set. 
+ * A persisted store keeps its records, minus a trailing partial one left by 
+ * a crash mid-append. 
+ */
+int data_store_open (DataStore_t *store, const char *path, bool persist, int *error_code);
+
+/**
+ * Take over a store opened by another process from its descriptors, keeping 
+ * its content and sharing its mutex and size. 
+ */
+int data_store_adopt (DataStore_t *store, int fd, int shared_fd, int *error_code);
+
+/**
+ * Give up ownership of the shared state once another process adopted the store. 
+ */
+void data_store_disown (DataStore_t *store);
+
+/**
+ * Only the process which owns the store destroys the shared state, children 
+ * just drop their references to it. 
+ */
+void data_store_close (DataStore_t *store);
+
+/**
+ * Append @param len bytes of @param buf as one record. 
+ * @param size_after is set to the store size right after this record, i.e. the end 
+ *      of the snapshot a replay triggered by this record has to send. May be NULL. 
+ */
+int data_store_append (DataStore_t *store, const char *buf, size_t len, off_t *size_after, int *error_code);
+
+/**
+ * Call @param publish with @param ctx for every record appended from now on, 
+ * or stop publishing if @param publish is NULL. 
+ */
+void data_store_set_publisher (DataStore_t *store, DataStorePublishFn_t publish, void *ctx);
+
+off_t data_store_size (DataStore_t *store);
+
+/**
+ * Read up to @param len bytes at @param offset, never past the committed size. 
+ * @return number of bytes read, 0 at the end of the store, -1 on error with errno set 
+ */
+ssize_t data_store_read (DataStore_t *store, off_t offset, char *buf, size_t len);
+
+#endif  /* DATA_STORE_H_ */
@@ -0,0 +1,116 @@
+/**
+ * \file    event_server.h
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Function prototypes for the event-driven (C10K) connection 
+ *          handling mode
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#ifndef EVENT_SERVER_H_
+#define EVENT_SERVER_H_
+
+#include <stdbool.h>
+
+#include "data_store.h"
+#include "scheduler.h"
+#include "append_sched.h"
+#include "record_index.h"
+#include "replay_cache.h"
+
+#define EVENT_SERVER_OK                             (0)
+#define EVENT_SERVER_EPOLL_FAILED                   (1)
+#define EVENT_SERVER_LISTENER_FAILED                (2)
+
+#define EVENT_SERVER_INVALID_PARAM                  (-1)
+
+/**
+ * Memory budget of an idle connection in event mode. 
+ * 
+ * User space: one EventConn_t, checked at compile time against 
+ * EVENT_SERVER_IDLE_CONN_BUDGET. Receive buffers are only allocated while a 
+ * connection holds a partial packet and are freed as soon as it completes, and 
+ * replays are sent with sendfile() straight from the data store, so an idle 
+ * connection owns no buffer at all. A compressed replay holds the frames of its 
+ * partial first and last segment until they are sent, the rest comes from the 
+ * replay cache file through sendfile() as well. 
+ * 
+ * Kernel: the socket itself (roughly 2 KB of struct sock/socket/file/inode) 
+ * plus one epoll item. Socket buffers are only charged while data is queued. 
+ * 
+ * That puts an idle connection at a few KB in total, versus a pthread stack, 
+ * a ConnSlot_t and a 4 KB receive chunk per connection in thread mode. 
+ */
+#define EVENT_SERVER_IDLE_CONN_BUDGET               (128U)
+
+/* Size of the loop-owned buffer every recv() lands in first */
+#define EVENT_SERVER_SCRATCH_SIZE                   (65536U)
+#define EVENT_SERVER_MAX_EVENTS                     (256)
+#define EVENT_SERVER_IDLE_SWEEP_INTERVAL_MS         (1000U)
+
+typedef struct
+{
+    /* Must already be listening */
+    int sfd;
+    DataStore_t *store;
+    /* Its jobs are dispatched from the event loop, may be NULL */
+    Scheduler_t *scheduler;
+    /**
+     * When not NULL, packets are committed through it asynchronously and a 
+     * connection is neither read nor swept while its commit is in flight. 
+     */
+    AppendScheduler_t *append_sched;
+    /**
+     * Resolves seek commands. A connection whose seek arrives before the 
+     * initial build finished is parked until then, the loop never blocks on it. 
+     */
+    RecordIndex_t *index;
+    /**
+     * Serves the replays of connections which asked for compression, replays 
+     * stay raw when NULL. 
+     */
+    ReplayCache_t *replay_cache;
+    /* When not 0, a sweep job closes connections which have not sent anything for that long */
+    unsigned int idle_timeout_sec;
+    /* Close every connection and return */
+    volatile bool *stop;
+    /**
+     * Call @ref handoff, and if it succeeds, stop accepting and return once 
+     * the remaining connections are done. 
+     */
+    volatile bool *drain;
+    bool (*handoff)(void *ctx);
+    void *handoff_ctx;
+} EventServerParams_t;
+
+/**
+ * Serve every connection accepted on @ref EventServerParams_t.sfd from a 
+ * single epoll loop until told to stop or drained. 
+ */
+int run_event_server (const EventServerParams_t *params, int *error_code);
+
+#endif  /* EVENT_SERVER_H_ */
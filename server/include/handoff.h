@@ -0,0 +1,79 @@
+/**
+ * \file    handoff.h
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Listener and data store handoff to an upgraded server binary
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#ifndef HANDOFF_H_
+#define HANDOFF_H_
+
+#include <sys/types.h>
+
+#define HANDOFF_OK                                  (0)
+#define HANDOFF_SOCKETPAIR_FAILED                   (1)
+#define HANDOFF_SPAWN_FAILED                        (2)
+#define HANDOFF_SEND_FAILED                         (3)
+#define HANDOFF_RECV_FAILED                         (4)
+#define HANDOFF_NOT_READY                           (5)
+
+#define HANDOFF_INVALID_PARAM                       (-1)
+
+/* Option through which the successor learns its end of the handoff channel */
+#define HANDOFF_CHANNEL_OPTION                      "-H"
+/* How long the predecessor keeps serving while waiting for the successor */
+#define HANDOFF_READY_TIMEOUT_MS                    (10000)
+
+typedef struct
+{
+    int listener_fd;
+    int store_fd;
+    int store_shared_fd;
+} HandoffState_t;
+
+/**
+ * Start the binary at the path of the running one with @param argv plus HANDOFF_CHANNEL_OPTION, pass it 
+ * the descriptors in @param state over SCM_RIGHTS and wait until it reports 
+ * that it serves the listener. The listening socket is never closed, so 
+ * connections queued meanwhile are accepted by whichever process gets to them. 
+ * @param successor is set to the pid of the new process on success. A process 
+ * started but not ready is terminated and reaped before returning. 
+ */
+int handoff_start_successor (char *const argv[], const HandoffState_t *state, pid_t *successor, int *error_code);
+
+/**
+ * In the successor: receive the descriptors sent by the predecessor on @param channel_fd. 
+ */
+int handoff_receive (int channel_fd, HandoffState_t *state, int *error_code);
+
+/**
+ * In the successor: tell the predecessor to stop accepting and close @param channel_fd. 
+ */
+void handoff_ready (int channel_fd);
+
+#endif  /* HANDOFF_H_ */
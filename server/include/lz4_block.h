@@ -0,0 +1,72 @@
+/**
+ * \file    lz4_block.h
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Function prototypes for the LZ4 block format codec used by
+ *          compressed replays
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#ifndef LZ4_BLOCK_H_
+#define LZ4_BLOCK_H_
+
+#include <stddef.h>
+
+#define LZ4_BLOCK_OK                                (0)
+#define LZ4_BLOCK_NO_SPACE                          (1)
+#define LZ4_BLOCK_CORRUPT                           (2)
+
+#define LZ4_BLOCK_INVALID_PARAM                     (-1)
+
+/* Largest input a block may hold, match offsets are 16 bit */
+#define LZ4_BLOCK_MAX_INPUT                         (65536U)
+/* Worst case size of a compressed block of @param len bytes, i.e. incompressible input */
+#define LZ4_BLOCK_BOUND(len)                        ((len) + ((len) / 255U) + 16U)
+
+/**
+ * Blocks follow the LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md), 
+ * so any LZ4 implementation decodes them given the uncompressed size. The 
+ * compressor is the greedy single-probe one of the reference implementation: 
+ * log lines repeat most of their bytes from the lines before, which it catches 
+ * at a fraction of the cost of a deeper match search. 
+ */
+
+/**
+ * Compress @param len bytes of @param src, at most LZ4_BLOCK_MAX_INPUT, into @param dst. 
+ * @return LZ4_BLOCK_NO_SPACE if the block does not fit in @param dst_cap bytes, 
+ *      size it LZ4_BLOCK_BOUND(len) to always succeed 
+ */
+int lz4_block_compress (const char *src, size_t len, char *dst, size_t dst_cap, size_t *out_len);
+
+/**
+ * Decompress the block of @param len bytes in @param src into @param dst. 
+ * Every offset and length is checked, a malformed block yields LZ4_BLOCK_CORRUPT 
+ * and never touches memory outside the two buffers. 
+ */
+int lz4_block_decompress (const char *src, size_t len, char *dst, size_t dst_cap, size_t *out_len);
+
+#endif  /* LZ4_BLOCK_H_ */
@@ -0,0 +1,93 @@
+/**
+ * \file    prefork.h
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Prefork worker supervisor
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#ifndef PREFORK_H_
+#define PREFORK_H_
+
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "scheduler.h"
+
+#define PREFORK_OK                                  (0)
+#define PREFORK_FORK_FAILED                         (1)
+#define PREFORK_POLL_FAILED                         (2)
+
+#define PREFORK_INVALID_PARAM                       (-1)
+
+#define PREFORK_MAX_WORKERS                         (64U)
+/* A worker which keeps dying is restarted at most this often */
+#define PREFORK_RESPAWN_INTERVAL_MS                 (1000)
+
+typedef enum
+{
+    PREFORK_ROLE_MASTER, 
+    PREFORK_ROLE_WORKER, 
+} PreforkRole_t;
+
+typedef struct
+{
+    pid_t pid;
+    struct timespec spawned;
+} PreforkWorker_t;
+
+typedef struct
+{
+    unsigned int num_of_workers;
+    PreforkWorker_t workers[PREFORK_MAX_WORKERS];
+} Prefork_t;
+
+int prefork_init (Prefork_t *prefork, unsigned int num_of_workers);
+
+/**
+ * Start the missing workers of @param prefork and supervise them. 
+ * 
+ * Returns in every worker with @param role set to PREFORK_ROLE_WORKER and 
+ * @param worker_id to its index, including workers respawned after one exits. 
+ * The caller then sets up whatever must not be shared with the master and 
+ * serves connections on the listener inherited from it. 
+ * 
+ * The master dispatches @param scheduler meanwhile and returns, with 
+ * @param role set to PREFORK_ROLE_MASTER, as soon as @param stop or 
+ * @param upgrade becomes true. The workers keep running until prefork_stop(), 
+ * and calling this again resumes supervising them. 
+ */
+int prefork_run (Prefork_t *prefork, Scheduler_t *scheduler, volatile bool *stop, volatile bool *upgrade, 
+                 PreforkRole_t *role, unsigned int *worker_id, int *error_code);
+
+/**
+ * Send @param sig to every worker and wait until all of them exited. 
+ */
+void prefork_stop (Prefork_t *prefork, int sig);
+
+#endif  /* PREFORK_H_ */
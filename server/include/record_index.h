@@ -0,0 +1,124 @@
+/**
+ * \file    record_index.h
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Record index over the data store
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#ifndef RECORD_INDEX_H_
+#define RECORD_INDEX_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "data_store.h"
+
+#define RECORD_INDEX_OK                             (0)
+#define RECORD_INDEX_NOT_READY                      (1)
+#define RECORD_INDEX_OUT_OF_RANGE                   (2)
+#define RECORD_INDEX_NO_MEMORY                      (3)
+#define RECORD_INDEX_THREAD_CREATE_FAILED           (4)
+#define RECORD_INDEX_EVENTFD_FAILED                 (5)
+#define RECORD_INDEX_READ_FAILED                    (6)
+
+#define RECORD_INDEX_INVALID_PARAM                  (-1)
+
+/* Only every RECORD_INDEX_STRIDE-th record start is kept, a seek walks at most that many records */
+#define RECORD_INDEX_STRIDE                         (64U)
+#define RECORD_INDEX_MAX_SCANNERS                   (64U)
+/* Smallest share of the store given to one scanner thread */
+#define RECORD_INDEX_MIN_SCAN_CHUNK                 (1024L * 1024L)
+
+/* Packet asking for the store content from byte Y of record X, "AESDCHAR_IOCSEEKTO:X,Y\n" */
+#define RECORD_INDEX_SEEK_COMMAND                   "AESDCHAR_IOCSEEKTO:"
+
+/**
+ * Records are the newline terminated lines of the store. The initial build maps 
+ * the store and scans it from several threads in the background, so the server 
+ * accepts connections meanwhile and only seeks wait for it. Records appended 
+ * later, by this process or any other sharing the store, are indexed on the 
+ * next seek. 
+ */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    LockStats_t *lock_stats;
+    uint64_t lock_acquired_ns;
+    pthread_cond_t ready_cond;
+    bool ready;
+    /* Result of the initial build, a failed one is returned by every seek */
+    int build_status;
+    /* Becomes readable once the initial build is done */
+    int ready_fd;
+    pthread_t builder;
+    bool builder_started;
+    DataStore_t *store;
+
+    off_t indexed_size;
+    uint64_t num_of_records;
+    /* Start of record i * RECORD_INDEX_STRIDE */
+    off_t *samples;
+    size_t num_of_samples;
+    size_t samples_capacity;
+} RecordIndex_t;
+
+/**
+ * Start building the index of @param store in the background and return. 
+ */
+int record_index_start (RecordIndex_t *index, DataStore_t *store, int *error_code);
+
+/**
+ * Wait for the build to finish and release the index. 
+ */
+void record_index_stop (RecordIndex_t *index);
+
+int record_index_get_ready_fd (RecordIndex_t *index);
+
+/**
+ * Resolve byte @param offset of record @param record to a store position. 
+ * When @param wait is false and the initial build is still running, returns 
+ * RECORD_INDEX_NOT_READY instead of blocking. Once the initial build has 
+ * failed, returns its error. 
+ */
+int record_index_seek (RecordIndex_t *index, uint32_t record, uint32_t offset, bool wait, off_t *position);
+
+/**
+ * Write the index counters as "name value" lines to @param fp. 
+ */
+void record_index_write_stats (RecordIndex_t *index, FILE *fp);
+
+/**
+ * @return true if the packet in @param buf is a seek command, with its 
+ *      arguments in @param record and @param offset 
+ */
+bool record_index_parse_seek (const char *buf, size_t len, uint32_t *record, uint32_t *offset);
+
+#endif  /* RECORD_INDEX_H_ */
@@ -0,0 +1,152 @@
+/**
+ * \file    record_ring.h
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Function prototypes for the shared-memory ring publishing
+ *          the most recent records to local readers
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#ifndef RECORD_RING_H_
+#define RECORD_RING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#define RECORD_RING_OK                              (0)
+#define RECORD_RING_OPEN_FAILED                     (1)
+#define RECORD_RING_MAP_FAILED                      (2)
+#define RECORD_RING_INVALID_FORMAT                  (3)
+#define RECORD_RING_NO_SPACE                        (4)
+#define RECORD_RING_BUSY                            (5)
+
+#define RECORD_RING_INVALID_PARAM                   (-1)
+
+/* POSIX shared memory name, i.e. /dev/shm/aesdsocket-records */
+#define RECORD_RING_NAME                            "/aesdsocket-records"
+/* "AESDRECS" read as a little endian 64 bit value */
+#define RECORD_RING_MAGIC                           (0x5343455244534541ULL)
+#define RECORD_RING_VERSION                         (1U)
+/* Power of two, slots wrap with a mask */
+#define RECORD_RING_MAX_RECORDS                     (1024U)
+#define RECORD_RING_PAYLOAD_SIZE                    (1024UL * 1024UL)
+/* Attempts a reader makes at a consistent copy before giving up on a writer that died mid-update */
+#define RECORD_RING_READ_ATTEMPTS                   (10000U)
+
+typedef struct
+{
+    /* Where the record sits in the payload region */
+    uint64_t payload_offset;
+    uint64_t size;
+    /* Where the record starts in the data store */
+    uint64_t store_offset;
+} RecordRingEntry_t;
+
+/**
+ * Laid out like aesd_circular_buffer, with offsets into the payload region in 
+ * place of pointers so every process can map it anywhere. The header is 
+ * followed by the payload region at the next page boundary. 
+ * 
+ * Every field other than @ref seq is only consistent between two equal even 
+ * reads of it: the writer makes it odd before changing anything and even 
+ * again once done. Readers copy what they need and retry when it moved. 
+ */
+typedef struct
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t max_records;
+    uint64_t payload_size;
+    atomic_uint_least64_t seq;
+    /* Records published since the ring was created, the newest one is number records_published - 1 */
+    uint64_t records_published;
+    /* Records too large for the payload region, never published */
+    uint64_t records_skipped;
+    uint32_t in_offs;
+    uint32_t out_offs;
+    uint32_t count;
+    uint32_t full;
+    RecordRingEntry_t entry[RECORD_RING_MAX_RECORDS];
+} RecordRingHeader_t;
+
+typedef struct
+{
+    int fd;
+    void *map;
+    size_t map_size;
+    RecordRingHeader_t *header;
+    char *payload;
+} RecordRing_t;
+
+/**
+ * What record_ring_copy() copied 
+ */
+typedef struct
+{
+    /* Number of the oldest record copied, counted like records_published */
+    uint64_t first_record;
+    uint64_t num_of_records;
+    /* Bytes copied, or the bytes needed when the copy returns RECORD_RING_NO_SPACE */
+    size_t len;
+} RecordRingSnapshot_t;
+
+/**
+ * Create the ring @param name for publishing, or reuse it when @param keep is 
+ * set and it already holds a valid ring, e.g. one inherited from the server 
+ * handing its listener over on upgrade. Otherwise it starts out empty. 
+ */
+int record_ring_open (RecordRing_t *ring, const char *name, bool keep, int *error_code);
+
+/**
+ * Map the ring @param name read-only, as a local reader. 
+ */
+int record_ring_attach (RecordRing_t *ring, const char *name, int *error_code);
+
+void record_ring_close (RecordRing_t *ring);
+
+/**
+ * Add the record in @param buf, which starts at @param store_offset in the 
+ * data store, dropping the oldest records until it fits. Publishers have to 
+ * be serialized by the caller, across processes. 
+ */
+void record_ring_publish (RecordRing_t *ring, const char *buf, size_t len, off_t store_offset);
+
+/**
+ * Copy every record in the ring, oldest first, into @param buf of @param cap 
+ * bytes without taking any lock or making any system call. 
+ */
+int record_ring_copy (RecordRing_t *ring, char *buf, size_t cap, RecordRingSnapshot_t *snapshot);
+
+/**
+ * @return the number of records published so far, so readers can poll for new 
+ *      ones before copying 
+ */
+uint64_t record_ring_published (RecordRing_t *ring);
+
+#endif  /* RECORD_RING_H_ */
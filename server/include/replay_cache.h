@@ -0,0 +1,159 @@
+/**
+ * \file    replay_cache.h
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Function prototypes for compressed replays served from a cache
+ *          of sealed store segments
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#ifndef REPLAY_CACHE_H_
+#define REPLAY_CACHE_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "adaptive_lock.h"
+#include "data_store.h"
+#include "lz4_block.h"
+
+#define REPLAY_CACHE_OK                             (0)
+#define REPLAY_CACHE_OPEN_FAILED                    (1)
+#define REPLAY_CACHE_NO_MEMORY                      (2)
+#define REPLAY_CACHE_READ_FAILED                    (3)
+#define REPLAY_CACHE_WRITE_FAILED                   (4)
+#define REPLAY_CACHE_SEND_FAILED                    (5)
+#define REPLAY_CACHE_WOULD_BLOCK                    (6)
+#define REPLAY_CACHE_THREAD_CREATE_FAILED           (7)
+
+#define REPLAY_CACHE_INVALID_PARAM                  (-1)
+
+/* The store is compressed in segments of this size, each one a single LZ4 block */
+#define REPLAY_CACHE_SEGMENT_SIZE                   (LZ4_BLOCK_MAX_INPUT)
+#define REPLAY_CACHE_FRAME_HEADER_SIZE              (8U)
+/* The cache file is unnamed, it goes away with the last process holding it open */
+#define REPLAY_CACHE_DIR                            "/var/tmp"
+
+/* Packet selecting the replay encoding of its connection, "AESDSOCKET_COMPRESS:lz4\n" or ":none\n" */
+#define REPLAY_CACHE_COMPRESS_COMMAND               "AESDSOCKET_COMPRESS:"
+
+typedef enum
+{
+    REPLAY_ENCODING_RAW,
+    REPLAY_ENCODING_LZ4,
+} ReplayEncoding_t;
+
+/**
+ * A compressed replay is a sequence of frames, each an 8 byte header of two 
+ * little endian uint32, the uncompressed and the payload length, followed by 
+ * the payload. The payload is an LZ4 block, or the bytes themselves when both 
+ * lengths are equal because compression did not pay off. A frame of 
+ * uncompressed length 0 ends the replay. 
+ * 
+ * Bytes below the store size never change, so once the size passed the end 
+ * of a segment, its frame is compressed a single time and appended to the 
+ * cache file. Replays send those frames straight from the cache file with 
+ * sendfile(), only the partial segments at either end of a replay are 
+ * compressed per replay. Segments are sealed by a background thread, woken 
+ * by the first replay reaching them. Until it catches up, replays send the 
+ * whole segments it has not sealed yet as frames stored as is, straight from 
+ * the store, so no replay waits for compression. 
+ */
+typedef struct
+{
+    AdaptiveMutex_t mutex;
+    DataStore_t *store;
+    int fd;
+    /* Frame of segment i ends at frame_ends[i] in the cache file and starts where the previous one ends */
+    off_t *frame_ends;
+    size_t num_of_segments;
+    size_t capacity;
+
+    pthread_t sealer;
+    pthread_mutex_t sealer_mutex;
+    pthread_cond_t sealer_cond;
+    /* Number of segments replays asked the sealer to reach, guarded by sealer_mutex */
+    size_t seal_target;
+    atomic_bool sealer_stop;
+} ReplayCache_t;
+
+/**
+ * Progress of one compressed replay: the frames of the partial head segment, 
+ * the sealed frames from the cache file, the segments not sealed yet stored 
+ * as is from the store, then the frames of the partial tail segment followed 
+ * by the end frame. 
+ */
+typedef struct
+{
+    off_t cache_off;
+    off_t cache_end;
+    off_t raw_off;
+    off_t raw_end;
+    /* Header bytes of the stored frame at raw_off already sent */
+    uint32_t raw_header_sent;
+    uint32_t head_len;
+    uint32_t len;
+    uint32_t sent;
+    char data[];
+} CompressedReplay_t;
+
+int replay_cache_init (ReplayCache_t *cache, DataStore_t *store, int *error_code);
+
+void replay_cache_destroy (ReplayCache_t *cache);
+
+/**
+ * Set up the replay of the store range [@param start, @param end), and have 
+ * the sealer compress the segments below @param end it has not reached yet. 
+ * Free @param replay with free() once sent. 
+ */
+int replay_cache_prepare (ReplayCache_t *cache, off_t start, off_t end, CompressedReplay_t **replay, 
+                          int *error_code);
+
+/**
+ * Send as much of @param replay to @param fd as it takes, counting the bytes 
+ * that went out in compressed_replay_bytes_sent. 
+ * @return REPLAY_CACHE_OK once all of it is out, REPLAY_CACHE_WOULD_BLOCK when 
+ *      a non-blocking @param fd is full 
+ */
+int replay_cache_send (ReplayCache_t *cache, CompressedReplay_t *replay, int fd, int *error_code);
+
+/**
+ * Write the cache counters as "name value" lines to @param fp. 
+ */
+void replay_cache_write_stats (ReplayCache_t *cache, FILE *fp);
+
+/**
+ * @return true if the packet in @param buf is a compress command naming a 
+ *      supported encoding, which is then set in @param encoding 
+ */
+bool replay_cache_parse_command (const char *buf, size_t len, ReplayEncoding_t *encoding);
+
+#endif  /* REPLAY_CACHE_H_ */
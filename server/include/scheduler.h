@@ -0,0 +1,92 @@
+/**
+ * \file    scheduler.h
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Function prototypes for the timerfd-based periodic job scheduler
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdbool.h>
+#include <time.h>
+
+#define SCHEDULER_OK                                (0)
+#define SCHEDULER_TIMERFD_FAILED                    (1)
+#define SCHEDULER_TOO_MANY_JOBS                     (2)
+#define SCHEDULER_SETTIME_FAILED                    (3)
+
+#define SCHEDULER_INVALID_PARAM                     (-1)
+
+#define SCHEDULER_MAX_JOBS                          (8U)
+
+typedef void (*SchedulerJobFunc_t)(void *ctx);
+
+typedef struct
+{
+    const char *name;
+    SchedulerJobFunc_t func;
+    void *ctx;
+    struct timespec interval;
+    struct timespec next;
+} SchedulerJob_t;
+
+/**
+ * Jobs share a single CLOCK_MONOTONIC timerfd armed for the earliest deadline. 
+ * The owner polls scheduler_get_fd() from its own event loop and calls 
+ * scheduler_dispatch() when it becomes readable, so jobs run on that loop's 
+ * thread and no thread is ever created per tick. 
+ */
+typedef struct
+{
+    int timer_fd;
+    SchedulerJob_t jobs[SCHEDULER_MAX_JOBS];
+    unsigned int num_of_jobs;
+} Scheduler_t;
+
+int scheduler_init (Scheduler_t *scheduler, int *error_code);
+
+/**
+ * Run @param func every @param interval_ms milliseconds, first one interval from now. 
+ */
+int scheduler_add_job (Scheduler_t *scheduler, const char *name, unsigned int interval_ms, 
+                       SchedulerJobFunc_t func, void *ctx, int *error_code);
+
+void scheduler_remove_job (Scheduler_t *scheduler, SchedulerJobFunc_t func, void *ctx);
+
+int scheduler_get_fd (Scheduler_t *scheduler);
+
+/**
+ * Run every job which is due and re-arm the timer. Periods missed while the 
+ * loop was busy are skipped rather than run back to back. 
+ */
+void scheduler_dispatch (Scheduler_t *scheduler);
+
+void scheduler_destroy (Scheduler_t *scheduler);
+
+#endif  /* SCHEDULER_H_ */
@@ -0,0 +1,85 @@
+/**
+ * \file    server_stats.h
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Server-wide counters and their periodic export
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#ifndef SERVER_STATS_H_
+#define SERVER_STATS_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "data_store.h"
+#include "append_sched.h"
+#include "record_index.h"
+#include "replay_cache.h"
+
+typedef struct
+{
+    atomic_ulong connections_accepted;
+    atomic_ulong connections_active;
+    atomic_ulong connections_idle_closed;
+    atomic_ulong packets_committed;
+    atomic_ulong bytes_committed;
+    atomic_ulong compressed_replays;
+    /* Store bytes covered by compressed replays and what actually went out for them */
+    atomic_ulong compressed_replay_raw_bytes;
+    atomic_ulong compressed_replay_bytes_sent;
+} ServerStats_t;
+
+/* Points at process-local counters until server_stats_share() moves them */
+extern ServerStats_t *server_stats;
+
+static inline void server_stats_inc (atomic_ulong *counter, unsigned long value)
+{
+    atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+static inline void server_stats_dec (atomic_ulong *counter)
+{
+    atomic_fetch_sub_explicit(counter, 1UL, memory_order_relaxed);
+}
+
+/**
+ * Move the counters into a shared anonymous mapping so that processes forked 
+ * afterwards all count into the same snapshot. 
+ */
+bool server_stats_share (void);
+
+/**
+ * Write a "name value" line per counter to @param path, replacing the previous 
+ * snapshot atomically through a rename(). Per-client throttle counters of 
+ * @param append_sched and the counters of @param index and @param replay_cache 
+ * follow when they are not NULL. 
+ */
+bool server_stats_flush (const char *path, DataStore_t *store, AppendScheduler_t *append_sched, 
+                         RecordIndex_t *index, ReplayCache_t *replay_cache);
+
+#endif  /* SERVER_STATS_H_ */
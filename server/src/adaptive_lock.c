@@ -0,0 +1,363 @@
+/**
+ * \file    adaptive_lock.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Spin-then-futex mutex and per-lock contention profiling
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "adaptive_lock.h"
+
+static LockStats_t lock_stats_table[LOCK_STATS_MAX_LOCKS];
+static atomic_uint lock_stats_count;
+static pthread_mutex_t lock_stats_register_mutex = PTHREAD_MUTEX_INITIALIZER;
+static atomic_bool hold_timing;
+
+/* Spin cap of every adaptive mutex, 0 until the first one is initialized */
+static atomic_uint adaptive_spin_cap;
+
+static inline void cpu_relax (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+static inline unsigned int histogram_bucket (uint64_t ns)
+{
+    unsigned int bucket = (ns == 0U) ? 0U : (unsigned int)(64 - __builtin_clzll(ns));
+
+    return (bucket < LOCK_STATS_BUCKETS) ? bucket : (LOCK_STATS_BUCKETS - 1U);
+}
+
+LockStats_t *lock_stats_register (const char *name)
+{
+    LockStats_t *stats = NULL;
+
+    pthread_mutex_lock(&lock_stats_register_mutex);
+
+    unsigned int count = atomic_load(&lock_stats_count);
+    for (unsigned int i = 0U; i < count; i++)
+    {
+        if (strncmp(lock_stats_table[i].name, name, LOCK_STATS_NAME_LEN - 1U) == 0)
+        {
+            stats = &lock_stats_table[i];
+            break;
+        }
+    }
+
+    if ((stats == NULL) && (count < LOCK_STATS_MAX_LOCKS))
+    {
+        stats = &lock_stats_table[count];
+        snprintf(stats->name, sizeof(stats->name), "%s", name);
+        /* Published after the name so lock_stats_write() never sees a blank entry */
+        atomic_store(&lock_stats_count, count + 1U);
+    }
+
+    pthread_mutex_unlock(&lock_stats_register_mutex);
+
+    return stats;
+}
+
+void lock_stats_set_hold_timing (bool enable)
+{
+    atomic_store(&hold_timing, enable);
+}
+
+bool lock_stats_hold_timing (void)
+{
+    return atomic_load_explicit(&hold_timing, memory_order_relaxed);
+}
+
+uint64_t lock_stats_acquired (LockStats_t *stats, bool contended, uint64_t wait_ns)
+{
+    if (stats == NULL)
+    {
+        return 0U;
+    }
+
+    atomic_fetch_add_explicit(&stats->acquisitions, 1UL, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->wait_hist[histogram_bucket(wait_ns)], 1UL, memory_order_relaxed);
+    if (contended)
+    {
+        atomic_fetch_add_explicit(&stats->contended, 1UL, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stats->wait_ns_total, (unsigned long)wait_ns, memory_order_relaxed);
+    }
+
+    return lock_stats_hold_timing() ? lock_stats_now_ns() : 0U;
+}
+
+void lock_stats_released (LockStats_t *stats, uint64_t acquired_ns)
+{
+    if ((stats == NULL) || (acquired_ns == 0U))
+    {
+        return;
+    }
+
+    uint64_t hold_ns = lock_stats_now_ns() - acquired_ns;
+    atomic_fetch_add_explicit(&stats->hold_ns_total, (unsigned long)hold_ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->hold_hist[histogram_bucket(hold_ns)], 1UL, memory_order_relaxed);
+}
+
+int lock_stats_mutex_lock (pthread_mutex_t *mutex, LockStats_t *stats, uint64_t *acquired_ns)
+{
+    int rc = pthread_mutex_trylock(mutex);
+    bool contended = (rc == EBUSY);
+    uint64_t start = 0U;
+
+    if (contended)
+    {
+        start = lock_stats_now_ns();
+        rc = pthread_mutex_lock(mutex);
+    }
+
+    if ((rc == 0) || (rc == EOWNERDEAD))
+    {
+        *acquired_ns = lock_stats_acquired(stats, contended, contended ? (lock_stats_now_ns() - start) : 0U);
+    }
+
+    return rc;
+}
+
+void lock_stats_mutex_unlock (pthread_mutex_t *mutex, LockStats_t *stats, uint64_t acquired_ns)
+{
+    lock_stats_released(stats, acquired_ns);
+    pthread_mutex_unlock(mutex);
+}
+
+int lock_stats_cond_wait (pthread_cond_t *cond, pthread_mutex_t *mutex, LockStats_t *stats, 
+                          uint64_t *acquired_ns)
+{
+    lock_stats_released(stats, *acquired_ns);
+    int rc = pthread_cond_wait(cond, mutex);
+    *acquired_ns = ((stats != NULL) && lock_stats_hold_timing()) ? lock_stats_now_ns() : 0U;
+
+    return rc;
+}
+
+int lock_stats_cond_timedwait (pthread_cond_t *cond, pthread_mutex_t *mutex, LockStats_t *stats, 
+                               uint64_t *acquired_ns, const struct timespec *deadline)
+{
+    lock_stats_released(stats, *acquired_ns);
+    int rc = pthread_cond_timedwait(cond, mutex, deadline);
+    *acquired_ns = ((stats != NULL) && lock_stats_hold_timing()) ? lock_stats_now_ns() : 0U;
+
+    return rc;
+}
+
+/**
+ * Upper bound of the bucket holding the @param permille -th duration in @param hist, 
+ * the last bucket being reported by its lower bound. 
+ */
+static unsigned long long histogram_quantile (atomic_ulong *hist, unsigned long total, unsigned int permille)
+{
+    unsigned long rank = (unsigned long)(((unsigned long long)total * permille + 999ULL) / 1000ULL);
+    unsigned long seen = 0UL;
+
+    for (unsigned int b = 0U; b < LOCK_STATS_BUCKETS; b++)
+    {
+        seen += atomic_load_explicit(&hist[b], memory_order_relaxed);
+        if ((seen >= rank) && (seen > 0UL))
+        {
+            return (b + 1U < LOCK_STATS_BUCKETS) ? (1ULL << b) : (1ULL << (b - 1U));
+        }
+    }
+
+    return 0ULL;
+}
+
+static void write_histogram (FILE *fp, const char *name, const char *kind, atomic_ulong *hist)
+{
+    unsigned long total = 0UL;
+
+    for (unsigned int b = 0U; b < LOCK_STATS_BUCKETS; b++)
+    {
+        unsigned long count = atomic_load_explicit(&hist[b], memory_order_relaxed);
+
+        total += count;
+        if (count == 0UL)
+        {
+            continue;
+        }
+        if (b + 1U < LOCK_STATS_BUCKETS)
+        {
+            fprintf(fp, "lock_%s_%s_lt_%lluns %lu\n", name, kind, 1ULL << b, count);
+        }
+        else
+        {
+            fprintf(fp, "lock_%s_%s_ge_%lluns %lu\n", name, kind, 1ULL << (b - 1U), count);
+        }
+    }
+
+    if (total > 0UL)
+    {
+        fprintf(fp, "lock_%s_%s_p50_ns %llu\n", name, kind, histogram_quantile(hist, total, 500U));
+        fprintf(fp, "lock_%s_%s_p99_ns %llu\n", name, kind, histogram_quantile(hist, total, 990U));
+    }
+}
+
+void lock_stats_write (FILE *fp)
+{
+    unsigned int count = atomic_load(&lock_stats_count);
+
+    for (unsigned int i = 0U; i < count; i++)
+    {
+        LockStats_t *stats = &lock_stats_table[i];
+
+        fprintf(fp, "lock_%s_acquisitions %lu\n", stats->name, atomic_load(&stats->acquisitions));
+        fprintf(fp, "lock_%s_contended %lu\n", stats->name, atomic_load(&stats->contended));
+        fprintf(fp, "lock_%s_wait_ns_total %lu\n", stats->name, atomic_load(&stats->wait_ns_total));
+        write_histogram(fp, stats->name, "wait", stats->wait_hist);
+        if (lock_stats_hold_timing())
+        {
+            fprintf(fp, "lock_%s_hold_ns_total %lu\n", stats->name, atomic_load(&stats->hold_ns_total));
+            write_histogram(fp, stats->name, "hold", stats->hold_hist);
+        }
+    }
+}
+
+static inline void futex_wait (atomic_uint *word, unsigned int expected)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static inline void futex_wake (atomic_uint *word, int waiters)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, waiters, NULL, NULL, 0);
+}
+
+void adaptive_mutex_init (AdaptiveMutex_t *mutex, const char *name)
+{
+    if (atomic_load_explicit(&adaptive_spin_cap, memory_order_relaxed) == 0U)
+    {
+        /* On one CPU the holder cannot make progress while we spin, so go straight to the futex */
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        atomic_store_explicit(&adaptive_spin_cap, (cpus > 1) ? ADAPTIVE_MUTEX_MAX_SPINS : 1U, 
+                              memory_order_relaxed);
+    }
+
+    atomic_init(&mutex->state, 0U);
+    atomic_init(&mutex->spin_average, 0U);
+    mutex->stats = (name != NULL) ? lock_stats_register(name) : NULL;
+    mutex->acquired_ns = 0U;
+}
+
+void adaptive_mutex_destroy (AdaptiveMutex_t *mutex)
+{
+    mutex->stats = NULL;
+}
+
+void adaptive_mutex_lock (AdaptiveMutex_t *mutex)
+{
+    unsigned int expected = 0U;
+
+    if (atomic_compare_exchange_strong_explicit(&mutex->state, &expected, 1U, 
+                                                memory_order_acquire, memory_order_relaxed))
+    {
+        mutex->acquired_ns = lock_stats_acquired(mutex->stats, false, 0U);
+        return;
+    }
+
+    uint64_t start = (mutex->stats != NULL) ? lock_stats_now_ns() : 0U;
+    unsigned int cap = atomic_load_explicit(&adaptive_spin_cap, memory_order_relaxed);
+    unsigned int average = atomic_load_explicit(&mutex->spin_average, memory_order_relaxed);
+    unsigned int limit = (cap > 1U) ? ((average * 2U + 10U < cap) ? (average * 2U + 10U) : cap) : 0U;
+    unsigned int spins = 0U;
+    bool acquired = false;
+
+    while (spins < limit)
+    {
+        spins++;
+        cpu_relax();
+        expected = 0U;
+        if ((atomic_load_explicit(&mutex->state, memory_order_relaxed) == 0U) && 
+            atomic_compare_exchange_weak_explicit(&mutex->state, &expected, 1U, 
+                                                  memory_order_acquire, memory_order_relaxed))
+        {
+            acquired = true;
+            break;
+        }
+    }
+
+    if (limit > 0U)
+    {
+        /* Same running average as glibc keeps for PTHREAD_MUTEX_ADAPTIVE_NP */
+        atomic_store_explicit(&mutex->spin_average, 
+                              (unsigned int)((int)average + ((int)spins - (int)average) / 8), 
+                              memory_order_relaxed);
+    }
+
+    if (!acquired)
+    {
+        /* Mark the mutex as having sleepers so the holder knows to wake one */
+        unsigned int state = atomic_exchange_explicit(&mutex->state, 2U, memory_order_acquire);
+        while (state != 0U)
+        {
+            futex_wait(&mutex->state, 2U);
+            state = atomic_exchange_explicit(&mutex->state, 2U, memory_order_acquire);
+        }
+    }
+
+    mutex->acquired_ns = lock_stats_acquired(mutex->stats, true, 
+                                             (mutex->stats != NULL) ? (lock_stats_now_ns() - start) : 0U);
+}
+
+bool adaptive_mutex_trylock (AdaptiveMutex_t *mutex)
+{
+    unsigned int expected = 0U;
+
+    if (!atomic_compare_exchange_strong_explicit(&mutex->state, &expected, 1U, 
+                                                 memory_order_acquire, memory_order_relaxed))
+    {
+        return false;
+    }
+
+    mutex->acquired_ns = lock_stats_acquired(mutex->stats, false, 0U);
+
+    return true;
+}
+
+void adaptive_mutex_unlock (AdaptiveMutex_t *mutex)
+{
+    lock_stats_released(mutex->stats, mutex->acquired_ns);
+
+    if (atomic_fetch_sub_explicit(&mutex->state, 1U, memory_order_release) != 1U)
+    {
+        atomic_store_explicit(&mutex->state, 0U, memory_order_release);
+        futex_wake(&mutex->state, 1);
+    }
+}
@@ -0,0 +1,608 @@
+/**
+ * \file    append_sched.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Per-client fair append scheduler implementation
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "append_sched.h"
+
+#define NSEC_PER_SEC        (1000000000LL)
+
+static inline int64_t timespec_diff_ns (const struct timespec *end, const struct timespec *start)
+{
+    return ((int64_t)(end->tv_sec - start->tv_sec) * NSEC_PER_SEC) + (end->tv_nsec - start->tv_nsec);
+}
+
+static inline void lock_sched (AppendScheduler_t *sched)
+{
+    lock_stats_mutex_lock(&sched->mutex, sched->lock_stats, &sched->lock_acquired_ns);
+}
+
+static inline void unlock_sched (AppendScheduler_t *sched)
+{
+    lock_stats_mutex_unlock(&sched->mutex, sched->lock_stats, sched->lock_acquired_ns);
+}
+
+static uint32_t hash_key (const char *key)
+{
+    uint32_t hash = 2166136261U;
+
+    for (; *key != '\0'; ++key)
+    {
+        hash = (hash ^ (uint8_t)*key) * 16777619U;
+    }
+
+    return hash & (APPEND_SCHED_HASH_SIZE - 1U);
+}
+
+static inline double byte_burst (const AppendScheduler_t *sched)
+{
+    return (double)sched->config.bytes_per_sec;
+}
+
+static inline double record_burst (const AppendScheduler_t *sched)
+{
+    return (sched->config.records_per_sec < 1U) ? 1.0 : (double)sched->config.records_per_sec;
+}
+
+static void refill (AppendScheduler_t *sched, AppendClient_t *client, const struct timespec *now)
+{
+    double elapsed = (double)timespec_diff_ns(now, &client->last_refill) / (double)NSEC_PER_SEC;
+
+    if (elapsed <= 0.0)
+    {
+        return;
+    }
+
+    client->byte_tokens += elapsed * (double)sched->config.bytes_per_sec;
+    if (client->byte_tokens > byte_burst(sched))
+    {
+        client->byte_tokens = byte_burst(sched);
+    }
+
+    client->record_tokens += elapsed * (double)sched->config.records_per_sec;
+    if (client->record_tokens > record_burst(sched))
+    {
+        client->record_tokens = record_burst(sched);
+    }
+
+    client->last_refill = *now;
+}
+
+/**
+ * A record larger than the byte burst only waits for a full bucket and then 
+ * drives it negative, so it is delayed in proportion to its size but never starved. 
+ */
+static inline double bytes_needed (const AppendScheduler_t *sched, const AppendRequest_t *req)
+{
+    return ((double)req->len < byte_burst(sched)) ? (double)req->len : byte_burst(sched);
+}
+
+static bool tokens_available (const AppendScheduler_t *sched, const AppendClient_t *client, 
+                              const AppendRequest_t *req)
+{
+    if (!sched->running)
+    {
+        return true;
+    }
+
+    if ((sched->config.bytes_per_sec > 0U) && (client->byte_tokens < bytes_needed(sched, req)))
+    {
+        return false;
+    }
+
+    if ((sched->config.records_per_sec > 0U) && (client->record_tokens < 1.0))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+static int64_t token_wait_ns (const AppendScheduler_t *sched, const AppendClient_t *client, 
+                              const AppendRequest_t *req)
+{
+    int64_t wait_ns = 0;
+
+    if ((sched->config.bytes_per_sec > 0U) && (client->byte_tokens < bytes_needed(sched, req)))
+    {
+        wait_ns = (int64_t)(((bytes_needed(sched, req) - client->byte_tokens) * NSEC_PER_SEC) / 
+                            (double)sched->config.bytes_per_sec);
+    }
+
+    if ((sched->config.records_per_sec > 0U) && (client->record_tokens < 1.0))
+    {
+        int64_t record_wait_ns = (int64_t)(((1.0 - client->record_tokens) * NSEC_PER_SEC) / 
+                                           (double)sched->config.records_per_sec);
+        if (record_wait_ns > wait_ns)
+        {
+            wait_ns = record_wait_ns;
+        }
+    }
+
+    return (wait_ns < 1000) ? 1000 : wait_ns;
+}
+
+static void activate (AppendScheduler_t *sched, AppendClient_t *client)
+{
+    client->active = true;
+    client->turn_started = false;
+
+    if (sched->cursor == NULL)
+    {
+        client->next_active = client;
+        client->prev_active = client;
+        sched->cursor = client;
+    }
+    else
+    {
+        /* Join at the end of the current round */
+        client->next_active = sched->cursor;
+        client->prev_active = sched->cursor->prev_active;
+        sched->cursor->prev_active->next_active = client;
+        sched->cursor->prev_active = client;
+    }
+}
+
+static void deactivate (AppendScheduler_t *sched, AppendClient_t *client)
+{
+    if (client->next_active == client)
+    {
+        sched->cursor = NULL;
+    }
+    else
+    {
+        client->prev_active->next_active = client->next_active;
+        client->next_active->prev_active = client->prev_active;
+        if (sched->cursor == client)
+        {
+            sched->cursor = client->next_active;
+        }
+    }
+
+    client->active = false;
+    client->turn_started = false;
+    client->deficit = 0U;
+    client->next_active = NULL;
+    client->prev_active = NULL;
+}
+
+/**
+ * Deficit round robin over the active clients, skipping clients whose buckets do 
+ * not cover their head record. 
+ * @param wait_ns is set to the time until the first throttled client may go again 
+ *      when every active client is throttled, -1 when nothing is queued. 
+ */
+static AppendRequest_t *pick_next (AppendScheduler_t *sched, const struct timespec *now, int64_t *wait_ns)
+{
+    unsigned int throttled_in_row = 0U;
+    unsigned int num_of_active = 0U;
+
+    *wait_ns = -1;
+
+    if (sched->cursor != NULL)
+    {
+        AppendClient_t *client = sched->cursor;
+        do
+        {
+            num_of_active++;
+            client = client->next_active;
+        } while (client != sched->cursor);
+    }
+
+    while (sched->cursor != NULL)
+    {
+        AppendClient_t *client = sched->cursor;
+        AppendRequest_t *req = client->head;
+
+        refill(sched, client, now);
+
+        if (!tokens_available(sched, client, req))
+        {
+            if (!req->throttled)
+            {
+                req->throttled = true;
+                client->throttled_records++;
+            }
+
+            int64_t client_wait_ns = token_wait_ns(sched, client, req);
+            if ((*wait_ns < 0) || (client_wait_ns < *wait_ns))
+            {
+                *wait_ns = client_wait_ns;
+            }
+
+            client->turn_started = false;
+            sched->cursor = client->next_active;
+            throttled_in_row++;
+            if (throttled_in_row >= num_of_active)
+            {
+                return NULL;
+            }
+            continue;
+        }
+
+        throttled_in_row = 0U;
+
+        if (!client->turn_started)
+        {
+            client->deficit += sched->config.quantum;
+            client->turn_started = true;
+        }
+
+        if (req->len <= client->deficit)
+        {
+            client->deficit -= req->len;
+            if (sched->config.bytes_per_sec > 0U)
+            {
+                client->byte_tokens -= (double)req->len;
+            }
+            if (sched->config.records_per_sec > 0U)
+            {
+                client->record_tokens -= 1.0;
+            }
+            client->records++;
+            client->bytes += req->len;
+            if (req->throttled)
+            {
+                client->throttle_wait_ns += timespec_diff_ns(now, &req->enqueued);
+            }
+
+            client->head = req->next;
+            if (client->head == NULL)
+            {
+                client->tail = NULL;
+                deactivate(sched, client);
+            }
+
+            req->next = NULL;
+            return req;
+        }
+
+        client->turn_started = false;
+        sched->cursor = client->next_active;
+    }
+
+    return NULL;
+}
+
+static void *committer_thread (void *params)
+{
+    AppendScheduler_t *sched = (AppendScheduler_t *)params;
+    struct timespec now;
+    int64_t wait_ns = -1;
+
+    lock_sched(sched);
+    for (;;)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        AppendRequest_t *req = pick_next(sched, &now, &wait_ns);
+
+        if (req == NULL)
+        {
+            if (!sched->running && (sched->cursor == NULL))
+            {
+                break;
+            }
+
+            if (wait_ns < 0)
+            {
+                lock_stats_cond_wait(&sched->work_cond, &sched->mutex, sched->lock_stats, 
+                                     &sched->lock_acquired_ns);
+            }
+            else
+            {
+                struct timespec deadline = now;
+                deadline.tv_sec += wait_ns / NSEC_PER_SEC;
+                deadline.tv_nsec += wait_ns % NSEC_PER_SEC;
+                if (deadline.tv_nsec >= NSEC_PER_SEC)
+                {
+                    deadline.tv_sec++;
+                    deadline.tv_nsec -= NSEC_PER_SEC;
+                }
+                lock_stats_cond_timedwait(&sched->work_cond, &sched->mutex, sched->lock_stats, 
+                                          &sched->lock_acquired_ns, &deadline);
+            }
+            continue;
+        }
+
+        /* Commits are serialized by this thread anyway, submitters may keep queueing meanwhile */
+        unlock_sched(sched);
+        req->rc = data_store_append(sched->store, req->buf, req->len, &req->size_after, &req->error_code);
+
+        if (req->on_done != NULL)
+        {
+            req->on_done(req);
+            lock_sched(sched);
+        }
+        else
+        {
+            lock_sched(sched);
+            req->done = true;
+            pthread_cond_signal(&req->cond);
+        }
+    }
+    unlock_sched(sched);
+
+    return NULL;
+}
+
+int append_sched_start (AppendScheduler_t *sched, DataStore_t *store, const AppendSchedConfig_t *config, 
+                        int *error_code)
+{
+    pthread_condattr_t condattr;
+
+    if ((sched == NULL) || (store == NULL) || (config == NULL) || (error_code == NULL))
+    {
+        return APPEND_SCHED_INVALID_PARAM;
+    }
+
+    memset(sched, 0, sizeof(AppendScheduler_t));
+    sched->store = store;
+    sched->config = *config;
+    if (sched->config.quantum == 0U)
+    {
+        sched->config.quantum = APPEND_SCHED_DEFAULT_QUANTUM;
+    }
+
+    pthread_mutex_init(&sched->mutex, NULL);
+    sched->lock_stats = lock_stats_register("append_sched");
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sched->work_cond, &condattr);
+    pthread_condattr_destroy(&condattr);
+
+    sched->running = true;
+    *error_code = pthread_create(&sched->committer, NULL, committer_thread, (void *)sched);
+    if (*error_code != 0)
+    {
+        sched->running = false;
+        pthread_cond_destroy(&sched->work_cond);
+        pthread_mutex_destroy(&sched->mutex);
+        return APPEND_SCHED_THREAD_CREATE_FAILED;
+    }
+
+    return APPEND_SCHED_OK;
+}
+
+void append_sched_stop (AppendScheduler_t *sched)
+{
+    if ((sched == NULL) || (sched->store == NULL))
+    {
+        return;
+    }
+
+    lock_sched(sched);
+    bool was_running = sched->running;
+    sched->running = false;
+    pthread_cond_signal(&sched->work_cond);
+    unlock_sched(sched);
+
+    if (!was_running)
+    {
+        return;
+    }
+
+    pthread_join(sched->committer, NULL);
+
+    for (unsigned int i = 0U; i < APPEND_SCHED_HASH_SIZE; ++i)
+    {
+        while (sched->buckets[i] != NULL)
+        {
+            AppendClient_t *client = sched->buckets[i];
+            sched->buckets[i] = client->hash_next;
+            free(client);
+        }
+    }
+
+    pthread_cond_destroy(&sched->work_cond);
+    pthread_mutex_destroy(&sched->mutex);
+}
+
+AppendClient_t *append_sched_client_get (AppendScheduler_t *sched, const char *key)
+{
+    struct timespec now;
+
+    if ((sched == NULL) || (key == NULL))
+    {
+        return NULL;
+    }
+
+    uint32_t bucket = hash_key(key);
+
+    lock_sched(sched);
+    AppendClient_t *client = sched->buckets[bucket];
+    while ((client != NULL) && (strncmp(client->key, key, sizeof(client->key)) != 0))
+    {
+        client = client->hash_next;
+    }
+
+    if (client == NULL)
+    {
+        client = (AppendClient_t *)calloc(1, sizeof(AppendClient_t));
+        if (client != NULL)
+        {
+            strncpy(client->key, key, sizeof(client->key) - 1U);
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            client->last_refill = now;
+            client->byte_tokens = byte_burst(sched);
+            client->record_tokens = record_burst(sched);
+            client->hash_next = sched->buckets[bucket];
+            sched->buckets[bucket] = client;
+            sched->num_of_clients++;
+        }
+    }
+
+    if (client != NULL)
+    {
+        client->refs++;
+    }
+    unlock_sched(sched);
+
+    return client;
+}
+
+void append_sched_client_put (AppendScheduler_t *sched, AppendClient_t *client)
+{
+    if ((sched == NULL) || (client == NULL))
+    {
+        return;
+    }
+
+    lock_sched(sched);
+    client->refs--;
+    unlock_sched(sched);
+}
+
+static int enqueue (AppendScheduler_t *sched, AppendClient_t *client, AppendRequest_t *req)
+{
+    if (!sched->running)
+    {
+        return APPEND_SCHED_STOPPED;
+    }
+
+    req->done = false;
+    req->throttled = false;
+    req->next = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &req->enqueued);
+
+    if (client->tail == NULL)
+    {
+        client->head = req;
+    }
+    else
+    {
+        client->tail->next = req;
+    }
+    client->tail = req;
+
+    if (!client->active)
+    {
+        activate(sched, client);
+    }
+
+    pthread_cond_signal(&sched->work_cond);
+
+    return APPEND_SCHED_OK;
+}
+
+int append_sched_submit (AppendScheduler_t *sched, AppendClient_t *client, const char *buf, size_t len, 
+                         off_t *size_after, int *error_code)
+{
+    AppendRequest_t req = { .buf = buf, .len = len };
+
+    if ((sched == NULL) || (client == NULL) || (buf == NULL) || (error_code == NULL))
+    {
+        return DATA_STORE_INVALID_PARAM;
+    }
+
+    pthread_cond_init(&req.cond, NULL);
+
+    lock_sched(sched);
+    if (enqueue(sched, client, &req) != APPEND_SCHED_OK)
+    {
+        unlock_sched(sched);
+        pthread_cond_destroy(&req.cond);
+        /* Late submitters after shutdown bypass the scheduler */
+        return data_store_append(sched->store, buf, len, size_after, error_code);
+    }
+
+    while (!req.done)
+    {
+        lock_stats_cond_wait(&req.cond, &sched->mutex, sched->lock_stats, &sched->lock_acquired_ns);
+    }
+    unlock_sched(sched);
+    pthread_cond_destroy(&req.cond);
+
+    *error_code = req.error_code;
+    if (size_after != NULL)
+    {
+        *size_after = req.size_after;
+    }
+
+    return req.rc;
+}
+
+int append_sched_submit_async (AppendScheduler_t *sched, AppendClient_t *client, AppendRequest_t *req)
+{
+    if ((sched == NULL) || (client == NULL) || (req == NULL) || (req->on_done == NULL))
+    {
+        return APPEND_SCHED_INVALID_PARAM;
+    }
+
+    lock_sched(sched);
+    int rc = enqueue(sched, client, req);
+    unlock_sched(sched);
+
+    return rc;
+}
+
+void append_sched_write_stats (AppendScheduler_t *sched, FILE *fp)
+{
+    struct timespec now;
+
+    if ((sched == NULL) || (fp == NULL))
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    lock_sched(sched);
+    for (unsigned int i = 0U; i < APPEND_SCHED_HASH_SIZE; ++i)
+    {
+        AppendClient_t **link = &sched->buckets[i];
+        while (*link != NULL)
+        {
+            AppendClient_t *client = *link;
+
+            fprintf(fp, "client %s records %llu bytes %llu throttled_records %llu throttle_wait_ms %llu\n", 
+                    client->key, (unsigned long long)client->records, (unsigned long long)client->bytes, 
+                    (unsigned long long)client->throttled_records, 
+                    (unsigned long long)(client->throttle_wait_ns / 1000000U));
+
+            refill(sched, client, &now);
+            if ((client->refs == 0U) && !client->active && 
+                (client->byte_tokens >= byte_burst(sched)) && (client->record_tokens >= record_burst(sched)))
+            {
+                *link = client->hash_next;
+                sched->num_of_clients--;
+                free(client);
+            }
+            else
+            {
+                link = &client->hash_next;
+            }
+        }
+    }
+    unlock_sched(sched);
+}
@@ -0,0 +1,399 @@
+/**
+ * \file    async_log.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Asynchronous logging pipeline implementation. Producers claim 
+ *          a slot of a bounded MPSC ring with a CAS on the enqueue position, 
+ *          format the record in place and publish it through the slot sequence
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+#include "async_log.h"
+
+#define ASYNC_LOG_RING_MASK                 (ASYNC_LOG_RING_SIZE - 1U)
+#define ASYNC_LOG_DRAINER_TIMEOUT_MS        (1000)
+
+_Static_assert((ASYNC_LOG_RING_SIZE & ASYNC_LOG_RING_MASK) == 0U, "ASYNC_LOG_RING_SIZE must be a power of two");
+
+typedef struct
+{
+    atomic_size_t seq;
+    int priority;
+    struct timespec timestamp;
+    char msg[ASYNC_LOG_MSG_SIZE];
+} AsyncLogRecord_t;
+
+typedef struct
+{
+    AsyncLogRecord_t ring[ASYNC_LOG_RING_SIZE];
+    atomic_size_t enqueue_pos;
+    size_t dequeue_pos;
+    atomic_uint_fast64_t dropped;
+    uint64_t dropped_reported;
+    atomic_bool running;
+    atomic_bool drainer_sleeping;
+    int wakeup_fd;
+    int log_fd;
+    pthread_t drainer_thread;
+} AsyncLog_t;
+
+static AsyncLog_t async_logger = { .wakeup_fd = -1, .log_fd = -1 };
+
+static const char *priority_name (int priority)
+{
+    static const char *names[] = { "EMERG", "ALERT", "CRIT", "ERR", "WARNING", "NOTICE", "INFO", "DEBUG" };
+
+    return names[LOG_PRI(priority)];
+}
+
+static void emit_record (AsyncLog_t *logger, AsyncLogRecord_t *record)
+{
+    if (logger->log_fd == -1)
+    {
+        syslog(record->priority, "%s", record->msg);
+    }
+    else
+    {
+        char line[ASYNC_LOG_MSG_SIZE + 64];
+        struct tm tm;
+        localtime_r(&record->timestamp.tv_sec, &tm);
+        size_t n_byte = strftime(line, sizeof(line), "%F %T", &tm);
+        n_byte += snprintf(&line[n_byte], sizeof(line) - n_byte, ".%06ld %s: %s\n", 
+                           record->timestamp.tv_nsec / 1000L, priority_name(record->priority), record->msg);
+        ssize_t written = write(logger->log_fd, line, n_byte);
+        (void)written;
+    }
+}
+
+static bool drain_records (AsyncLog_t *logger)
+{
+    bool drained_any = false;
+
+    for (;;)
+    {
+        AsyncLogRecord_t *record = &logger->ring[logger->dequeue_pos & ASYNC_LOG_RING_MASK];
+        size_t seq = atomic_load_explicit(&record->seq, memory_order_acquire);
+
+        if (seq != (logger->dequeue_pos + 1U))
+        {
+            break;
+        }
+
+        emit_record(logger, record);
+        atomic_store_explicit(&record->seq, logger->dequeue_pos + ASYNC_LOG_RING_SIZE, memory_order_release);
+        logger->dequeue_pos++;
+        drained_any = true;
+    }
+
+    return drained_any;
+}
+
+static void report_dropped (AsyncLog_t *logger)
+{
+    uint64_t dropped = atomic_load_explicit(&logger->dropped, memory_order_relaxed);
+
+    if (dropped != logger->dropped_reported)
+    {
+        AsyncLogRecord_t record = { .priority = LOG_WARNING };
+        clock_gettime(CLOCK_REALTIME, &record.timestamp);
+        snprintf(record.msg, sizeof(record.msg), "async log dropped %llu records (%llu total)", 
+                 (unsigned long long)(dropped - logger->dropped_reported), (unsigned long long)dropped);
+        emit_record(logger, &record);
+        logger->dropped_reported = dropped;
+    }
+}
+
+static void *drainer_thread (void *params)
+{
+    AsyncLog_t *logger = (AsyncLog_t *)params;
+    struct pollfd pfd = { .fd = logger->wakeup_fd, .events = POLLIN };
+    uint64_t counter;
+
+    while (atomic_load(&logger->running))
+    {
+        if (drain_records(logger))
+        {
+            continue;
+        }
+
+        report_dropped(logger);
+
+        /* Producers only pay for the eventfd write when the drainer is about to sleep */
+        atomic_store(&logger->drainer_sleeping, true);
+        /* Pairs with the fence in async_log(), either this drain sees the record or the producer sees the flag */
+        atomic_thread_fence(memory_order_seq_cst);
+        if (drain_records(logger))
+        {
+            atomic_store(&logger->drainer_sleeping, false);
+            continue;
+        }
+
+        if (poll(&pfd, 1, ASYNC_LOG_DRAINER_TIMEOUT_MS) > 0)
+        {
+            ssize_t n_read = read(logger->wakeup_fd, &counter, sizeof(counter));
+            (void)n_read;
+        }
+        atomic_store(&logger->drainer_sleeping, false);
+    }
+
+    drain_records(logger);
+    report_dropped(logger);
+
+    return NULL;
+}
+
+static void reset_ring (AsyncLog_t *logger)
+{
+    for (size_t i = 0U; i < ASYNC_LOG_RING_SIZE; ++i)
+    {
+        atomic_init(&logger->ring[i].seq, i);
+    }
+    atomic_init(&logger->enqueue_pos, 0U);
+    logger->dequeue_pos = 0U;
+    atomic_init(&logger->dropped, 0U);
+    logger->dropped_reported = 0U;
+    atomic_init(&logger->drainer_sleeping, false);
+}
+
+int async_log_start (const char *log_path, int *error_code)
+{
+    AsyncLog_t *logger = &async_logger;
+
+    if (error_code == NULL)
+    {
+        return ASYNC_LOG_THREAD_CREATE_FAILED;
+    }
+
+    *error_code = 0;
+    reset_ring(logger);
+
+    if (log_path != NULL)
+    {
+        logger->log_fd = open(log_path, O_CREAT | O_WRONLY | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        if (logger->log_fd == -1)
+        {
+            *error_code = errno;
+            return ASYNC_LOG_OPEN_FAILED;
+        }
+    }
+
+    logger->wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (logger->wakeup_fd == -1)
+    {
+        *error_code = errno;
+        async_log_stop();
+        return ASYNC_LOG_EVENTFD_FAILED;
+    }
+
+    atomic_store(&logger->running, true);
+    *error_code = pthread_create(&logger->drainer_thread, NULL, drainer_thread, (void *)logger);
+    if (*error_code != 0)
+    {
+        atomic_store(&logger->running, false);
+        async_log_stop();
+        return ASYNC_LOG_THREAD_CREATE_FAILED;
+    }
+
+    return ASYNC_LOG_SETUP_OK;
+}
+
+void async_log_stop (void)
+{
+    AsyncLog_t *logger = &async_logger;
+    uint64_t counter = 1U;
+
+    if (atomic_exchange(&logger->running, false))
+    {
+        ssize_t written = write(logger->wakeup_fd, &counter, sizeof(counter));
+        (void)written;
+        pthread_join(logger->drainer_thread, NULL);
+    }
+
+    if (logger->wakeup_fd != -1)
+    {
+        close(logger->wakeup_fd);
+        logger->wakeup_fd = -1;
+    }
+
+    if (logger->log_fd != -1)
+    {
+        close(logger->log_fd);
+        logger->log_fd = -1;
+    }
+}
+
+int async_log_restart_in_child (int *error_code)
+{
+    AsyncLog_t *logger = &async_logger;
+
+    if (error_code == NULL)
+    {
+        return ASYNC_LOG_THREAD_CREATE_FAILED;
+    }
+
+    *error_code = 0;
+
+    if (!atomic_load(&logger->running))
+    {
+        return ASYNC_LOG_SETUP_OK;
+    }
+
+    /* Stop producers from touching the ring while it is reset */
+    atomic_store(&logger->running, false);
+    reset_ring(logger);
+
+    /* A fresh eventfd, the inherited one would wake the parent's drainer too */
+    close(logger->wakeup_fd);
+    logger->wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (logger->wakeup_fd == -1)
+    {
+        *error_code = errno;
+        async_log_stop();
+        return ASYNC_LOG_EVENTFD_FAILED;
+    }
+
+    atomic_store(&logger->running, true);
+    *error_code = pthread_create(&logger->drainer_thread, NULL, drainer_thread, (void *)logger);
+    if (*error_code != 0)
+    {
+        atomic_store(&logger->running, false);
+        async_log_stop();
+        return ASYNC_LOG_THREAD_CREATE_FAILED;
+    }
+
+    return ASYNC_LOG_SETUP_OK;
+}
+
+void async_log (int priority, const char *format, ...)
+{
+    AsyncLog_t *logger = &async_logger;
+    AsyncLogRecord_t *record = NULL;
+    va_list args;
+
+    va_start(args, format);
+
+    if (!atomic_load_explicit(&logger->running, memory_order_acquire))
+    {
+        vsyslog(priority, format, args);
+        va_end(args);
+        return;
+    }
+
+    size_t pos = atomic_load_explicit(&logger->enqueue_pos, memory_order_relaxed);
+    for (;;)
+    {
+        record = &logger->ring[pos & ASYNC_LOG_RING_MASK];
+        size_t seq = atomic_load_explicit(&record->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&logger->enqueue_pos, &pos, pos + 1U, 
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            atomic_fetch_add_explicit(&logger->dropped, 1U, memory_order_relaxed);
+            va_end(args);
+            return;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&logger->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    record->priority = priority;
+    clock_gettime(CLOCK_REALTIME, &record->timestamp);
+    vsnprintf(record->msg, sizeof(record->msg), format, args);
+    va_end(args);
+
+    atomic_store_explicit(&record->seq, pos + 1U, memory_order_release);
+
+    /* A release store may still pass the load below, which would miss a drainer going to sleep */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&logger->drainer_sleeping) && atomic_exchange(&logger->drainer_sleeping, false))
+    {
+        uint64_t counter = 1U;
+        ssize_t written = write(logger->wakeup_fd, &counter, sizeof(counter));
+        (void)written;
+    }
+}
+
+uint64_t async_log_dropped (void)
+{
+    return atomic_load_explicit(&async_logger.dropped, memory_order_relaxed);
+}
+
+bool async_log_ratelimit_pass (AsyncLogRateLimit_t *ratelimit, unsigned int *suppressed)
+{
+    struct timespec now;
+
+    if ((ratelimit == NULL) || (suppressed == NULL))
+    {
+        return false;
+    }
+
+    *suppressed = 0U;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+    long window_start = atomic_load_explicit(&ratelimit->window_start, memory_order_relaxed);
+    if ((now.tv_sec - window_start) >= ASYNC_LOG_RATELIMIT_INTERVAL_SEC)
+    {
+        if (atomic_compare_exchange_strong(&ratelimit->window_start, &window_start, now.tv_sec))
+        {
+            atomic_store(&ratelimit->passed, 0U);
+            *suppressed = atomic_exchange(&ratelimit->suppressed, 0U);
+        }
+    }
+
+    if (atomic_fetch_add_explicit(&ratelimit->passed, 1U, memory_order_relaxed) < ASYNC_LOG_RATELIMIT_BURST)
+    {
+        return true;
+    }
+
+    atomic_fetch_add_explicit(&ratelimit->suppressed, 1U, memory_order_relaxed);
+
+    return false;
+}
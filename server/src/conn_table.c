@@ -0,0 +1,263 @@
+/**
+ * \file    conn_table.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Slab-backed connection table implementation
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "conn_table.h"
+
+static inline uint32_t handle_index (ConnHandle_t handle)
+{
+    return handle & CONN_TABLE_INDEX_MASK;
+}
+
+static inline uint16_t handle_generation (ConnHandle_t handle)
+{
+    return (uint16_t)(handle >> CONN_TABLE_INDEX_BITS);
+}
+
+static inline ConnHandle_t make_handle (uint32_t index, uint16_t generation)
+{
+    return ((ConnHandle_t)generation << CONN_TABLE_INDEX_BITS) | index;
+}
+
+static inline ConnSlot_t *slot_at (ConnTable_t *table, uint32_t index)
+{
+    return &table->chunks[index / CONN_TABLE_CHUNK_SIZE][index % CONN_TABLE_CHUNK_SIZE];
+}
+
+static bool grow_table (ConnTable_t *table)
+{
+    if ((table->num_of_chunks == CONN_TABLE_MAX_CHUNKS) || 
+        (((table->num_of_chunks + 1U) * CONN_TABLE_CHUNK_SIZE) > (CONN_TABLE_INDEX_MASK + 1U)))
+    {
+        return false;
+    }
+
+    ConnSlot_t *chunk = (ConnSlot_t *)calloc(CONN_TABLE_CHUNK_SIZE, sizeof(ConnSlot_t));
+    if (chunk == NULL)
+    {
+        return false;
+    }
+
+    uint32_t base = table->num_of_chunks * CONN_TABLE_CHUNK_SIZE;
+    for (uint32_t i = 0U; i < CONN_TABLE_CHUNK_SIZE; ++i)
+    {
+        chunk[i].generation = 1U;
+        chunk[i].next_free = ((i + 1U) < CONN_TABLE_CHUNK_SIZE) ? (base + i + 1U) : table->free_head;
+        atomic_init(&chunk[i].next_completed, CONN_TABLE_NO_SLOT);
+    }
+
+    table->chunks[table->num_of_chunks] = chunk;
+    table->num_of_chunks++;
+    table->free_head = base;
+
+    return true;
+}
+
+int conn_table_init (ConnTable_t *table, int *error_code)
+{
+    if ((table == NULL) || (error_code == NULL))
+    {
+        return CONN_TABLE_EVENTFD_FAILED;
+    }
+
+    memset(table, 0, sizeof(ConnTable_t));
+    *error_code = 0;
+    table->free_head = CONN_TABLE_NO_SLOT;
+    atomic_init(&table->completed_head, CONN_TABLE_NO_SLOT);
+
+    table->completion_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (table->completion_fd == -1)
+    {
+        *error_code = errno;
+        return CONN_TABLE_EVENTFD_FAILED;
+    }
+
+    return CONN_TABLE_SETUP_OK;
+}
+
+ConnHandle_t conn_table_alloc (ConnTable_t *table)
+{
+    if (table == NULL)
+    {
+        return CONN_TABLE_INVALID_HANDLE;
+    }
+
+    if ((table->free_head == CONN_TABLE_NO_SLOT) && !grow_table(table))
+    {
+        return CONN_TABLE_INVALID_HANDLE;
+    }
+
+    uint32_t index = table->free_head;
+    ConnSlot_t *slot = slot_at(table, index);
+
+    table->free_head = slot->next_free;
+    slot->next_free = CONN_TABLE_NO_SLOT;
+    slot->in_use = true;
+    slot->table = table;
+    slot->handle = make_handle(index, slot->generation);
+    table->num_in_use++;
+
+    return slot->handle;
+}
+
+ConnSlot_t *conn_table_lookup (ConnTable_t *table, ConnHandle_t handle)
+{
+    if ((table == NULL) || (handle == CONN_TABLE_INVALID_HANDLE))
+    {
+        return NULL;
+    }
+
+    uint32_t index = handle_index(handle);
+    if (index >= (table->num_of_chunks * CONN_TABLE_CHUNK_SIZE))
+    {
+        return NULL;
+    }
+
+    ConnSlot_t *slot = slot_at(table, index);
+    if (!slot->in_use || (slot->generation != handle_generation(handle)))
+    {
+        return NULL;
+    }
+
+    return slot;
+}
+
+void conn_table_free (ConnTable_t *table, ConnHandle_t handle)
+{
+    ConnSlot_t *slot = conn_table_lookup(table, handle);
+
+    if (slot == NULL)
+    {
+        return;
+    }
+
+    slot->in_use = false;
+    slot->handle = CONN_TABLE_INVALID_HANDLE;
+    slot->func = NULL;
+    memset(&slot->thread_params, 0, sizeof(slot->thread_params));
+    atomic_store_explicit(&slot->next_completed, CONN_TABLE_NO_SLOT, memory_order_relaxed);
+
+    /* Skip 0 on wrap-around so that a valid handle never equals CONN_TABLE_INVALID_HANDLE */
+    slot->generation++;
+    if (slot->generation == 0U)
+    {
+        slot->generation = 1U;
+    }
+
+    slot->next_free = table->free_head;
+    table->free_head = handle_index(handle);
+    table->num_in_use--;
+}
+
+void conn_table_complete (ConnTable_t *table, ConnHandle_t handle)
+{
+    uint32_t index = handle_index(handle);
+    ConnSlot_t *slot = slot_at(table, index);
+    uint32_t head = atomic_load_explicit(&table->completed_head, memory_order_relaxed);
+    uint64_t counter = 1U;
+
+    do
+    {
+        atomic_store_explicit(&slot->next_completed, head, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&table->completed_head, &head, index, 
+                                                    memory_order_release, memory_order_relaxed));
+
+    ssize_t written = write(table->completion_fd, &counter, sizeof(counter));
+    (void)written;
+}
+
+unsigned int conn_table_reap_completed (ConnTable_t *table)
+{
+    unsigned int reaped = 0U;
+    uint64_t counter = 0U;
+
+    if (table == NULL)
+    {
+        return 0U;
+    }
+
+    ssize_t n_read = read(table->completion_fd, &counter, sizeof(counter));
+    (void)n_read;
+
+    /* Only the reaper pops, and always the whole list at once, so there is no ABA hazard */
+    uint32_t index = atomic_exchange_explicit(&table->completed_head, CONN_TABLE_NO_SLOT, memory_order_acquire);
+    while (index != CONN_TABLE_NO_SLOT)
+    {
+        ConnSlot_t *slot = slot_at(table, index);
+        uint32_t next = atomic_load_explicit(&slot->next_completed, memory_order_relaxed);
+
+        pthread_join(slot->thread_id, NULL);
+        conn_table_free(table, slot->handle);
+        reaped++;
+        index = next;
+    }
+
+    return reaped;
+}
+
+void conn_table_destroy (ConnTable_t *table)
+{
+    if (table == NULL)
+    {
+        return;
+    }
+
+    for (uint32_t index = 0U; index < (table->num_of_chunks * CONN_TABLE_CHUNK_SIZE); ++index)
+    {
+        ConnSlot_t *slot = slot_at(table, index);
+        if (slot->in_use)
+        {
+            pthread_join(slot->thread_id, NULL);
+            conn_table_free(table, slot->handle);
+        }
+    }
+
+    for (unsigned int i = 0U; i < table->num_of_chunks; ++i)
+    {
+        free(table->chunks[i]);
+        table->chunks[i] = NULL;
+    }
+
+    table->num_of_chunks = 0U;
+    table->free_head = CONN_TABLE_NO_SLOT;
+
+    if (table->completion_fd != -1)
+    {
+        close(table->completion_fd);
+        table->completion_fd = -1;
+    }
+}
@@ -33,41 +33,126 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
 
 #include "conn_thread.h"
+#include "conn_table.h"
+#include "server_stats.h"
 
-bool spawn_connection_thread (pthread_t *thread_id, void *(*func)(void* params), char client_ipv4[16], 
-                              int cfd, int output_fd, pthread_mutex_t *mutex, 
-                              ConnThreadParams_t **thread_params_ptr, int *error_code)
+static void *connection_thread_entry (void *params)
 {
-    if ((thread_id == NULL) || (func == NULL) || (mutex == NULL) || 
-        (thread_params_ptr == NULL) || (error_code == NULL))
+    ConnSlot_t *slot = (ConnSlot_t *)params;
+    ConnThreadParams_t *thread_params = &slot->thread_params;
+
+    if (thread_params->append_sched != NULL)
+    {
+        thread_params->client = append_sched_client_get(thread_params->append_sched, thread_params->client_ipv4);
+    }
+
+    /* The slot can not be reaped before it completes, so it stays valid for the lifetime of this thread */
+    slot->func((void *)thread_params);
+
+    append_sched_client_put(thread_params->append_sched, thread_params->client);
+    server_stats_dec(&server_stats->connections_active);
+    conn_table_complete(slot->table, slot->handle);
+
+    return NULL;
+}
+
+typedef struct
+{
+    ConnThreadParams_t thread_params;
+    void *(*func)(void *params);
+} ConnCoroParams_t;
+
+static void connection_coro_entry (void *params)
+{
+    ConnCoroParams_t *coro_params = (ConnCoroParams_t *)params;
+    ConnThreadParams_t *thread_params = &coro_params->thread_params;
+
+    if (thread_params->append_sched != NULL)
+    {
+        thread_params->client = append_sched_client_get(thread_params->append_sched, thread_params->client_ipv4);
+    }
+
+    coro_params->func((void *)thread_params);
+
+    append_sched_client_put(thread_params->append_sched, thread_params->client);
+    server_stats_dec(&server_stats->connections_active);
+    free(coro_params);
+}
+
+bool spawn_connection_thread (struct ConnTable *table, void *(*func)(void* params), 
+                              const ConnThreadParams_t *params, uint32_t *handle, int *error_code)
+{
+    pthread_attr_t attr;
+
+    if ((table == NULL) || (func == NULL) || (params == NULL) || (params->store == NULL) || 
+        (handle == NULL) || (error_code == NULL))
     {
         return false;
     }
 
-    ConnThreadParams_t *thread_params = (ConnThreadParams_t *)malloc(sizeof(ConnThreadParams_t));
+    ConnHandle_t new_handle = conn_table_alloc(table);
+    ConnSlot_t *slot = conn_table_lookup(table, new_handle);
 
-    if (thread_params == NULL)
+    if (slot == NULL)
     {
+        *error_code = ENOMEM;
         return false;
     }
 
-    memcpy(thread_params->client_ipv4, client_ipv4, sizeof(thread_params->client_ipv4));
-    thread_params->client_fd = cfd;
-    thread_params->output_fd = output_fd;
-    thread_params->mutex = mutex;
-    thread_params->done = false;
+    slot->thread_params = *params;
+    slot->thread_params.client = NULL;
+    slot->func = func;
+
+    *error_code = pthread_attr_init(&attr);
+    if (*error_code != 0)
+    {
+        conn_table_free(table, new_handle);
+        return false;
+    }
 
-    *error_code = pthread_create(thread_id, NULL, func, (void *)thread_params);
+    pthread_attr_setstacksize(&attr, CONN_THREAD_STACK_SIZE);
+    *error_code = pthread_create(&slot->thread_id, &attr, connection_thread_entry, (void *)slot);
+    pthread_attr_destroy(&attr);
 
     if (*error_code != 0)
     {
-        free(thread_params);
+        conn_table_free(table, new_handle);
         return false;
     }
 
-    *thread_params_ptr = thread_params;
+    *handle = new_handle;
+
+    return true;
+}
+
+bool spawn_connection_coro (CoroRuntime_t *runtime, void *(*func)(void* params), 
+                            const ConnThreadParams_t *params, int *error_code)
+{
+    if ((runtime == NULL) || (func == NULL) || (params == NULL) || (params->store == NULL) || 
+        (error_code == NULL))
+    {
+        return false;
+    }
+
+    ConnCoroParams_t *coro_params = (ConnCoroParams_t *)malloc(sizeof(ConnCoroParams_t));
+    if (coro_params == NULL)
+    {
+        *error_code = ENOMEM;
+        return false;
+    }
+
+    coro_params->thread_params = *params;
+    coro_params->thread_params.client = NULL;
+    coro_params->func = func;
+
+    if (coro_spawn(runtime, connection_coro_entry, (void *)coro_params, error_code) != CORO_SCHED_OK)
+    {
+        free(coro_params);
+        return false;
+    }
 
     return true;
 }
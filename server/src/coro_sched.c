@@ -0,0 +1,678 @@
+/**
+ * \file    coro_sched.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Stackful coroutine runtime on ucontext with an epoll scheduler
+ *          thread per core
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "coro_sched.h"
+
+static __thread CoroThread_t *current_thread = NULL;
+
+/* epoll marker of the wake eventfd, distinct from every coroutine */
+static char wake_event_marker;
+
+static inline uint64_t monotonic_ms (void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec * 1000U) + ((uint64_t)now.tv_nsec / 1000000U);
+}
+
+static inline size_t guard_size (void)
+{
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static void *get_stack (CoroRuntime_t *runtime)
+{
+    adaptive_mutex_lock(&runtime->pool_mutex);
+    void *stack = runtime->stack_pool;
+    if (stack != NULL)
+    {
+        /* Pooled stacks link to each other through their lowest usable word */
+        runtime->stack_pool = *(void **)((char *)stack + guard_size());
+        runtime->num_of_pooled--;
+    }
+    adaptive_mutex_unlock(&runtime->pool_mutex);
+
+    if (stack != NULL)
+    {
+        return stack;
+    }
+
+    stack = mmap(NULL, guard_size() + CORO_SCHED_STACK_SIZE, PROT_READ | PROT_WRITE, 
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (stack == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    if (mprotect(stack, guard_size(), PROT_NONE) != 0)
+    {
+        munmap(stack, guard_size() + CORO_SCHED_STACK_SIZE);
+        return NULL;
+    }
+
+    return stack;
+}
+
+static void put_stack (CoroRuntime_t *runtime, void *stack)
+{
+    adaptive_mutex_lock(&runtime->pool_mutex);
+    if (runtime->num_of_pooled < CORO_SCHED_STACK_POOL_SIZE)
+    {
+        *(void **)((char *)stack + guard_size()) = runtime->stack_pool;
+        runtime->stack_pool = stack;
+        runtime->num_of_pooled++;
+        stack = NULL;
+    }
+    adaptive_mutex_unlock(&runtime->pool_mutex);
+
+    if (stack != NULL)
+    {
+        munmap(stack, guard_size() + CORO_SCHED_STACK_SIZE);
+    }
+}
+
+static void make_ready (CoroThread_t *thread, Coro_t *coro)
+{
+    coro->state = CORO_STATE_READY;
+    coro->next = NULL;
+    if (thread->ready_tail == NULL)
+    {
+        thread->ready_head = coro;
+    }
+    else
+    {
+        thread->ready_tail->next = coro;
+    }
+    thread->ready_tail = coro;
+}
+
+static void push_incoming (CoroThread_t *thread, Coro_t *coro)
+{
+    uint64_t one = 1U;
+
+    adaptive_mutex_lock(&thread->mutex);
+    coro->next = thread->incoming;
+    thread->incoming = coro;
+    adaptive_mutex_unlock(&thread->mutex);
+
+    ssize_t n_written = write(thread->wake_fd, &one, sizeof(one));
+    (void)n_written;
+}
+
+static void coro_entry (void)
+{
+    Coro_t *coro = current_thread->current;
+
+    coro->func(coro->arg);
+    coro->state = CORO_STATE_DONE;
+    /* Never comes back, the scheduler releases the stack this runs on */
+    swapcontext(&coro->ctx, &coro->thread->sched_ctx);
+}
+
+static void finish_coro (CoroThread_t *thread, Coro_t *coro)
+{
+    if (coro->registered_fd != -1)
+    {
+        /* Normally closed by the coroutine already, which dropped it from the set */
+        epoll_ctl(thread->epfd, EPOLL_CTL_DEL, coro->registered_fd, NULL);
+    }
+
+    LIST_REMOVE(coro, node);
+    put_stack(thread->runtime, coro->stack);
+    free(coro);
+    thread->num_of_coros--;
+    atomic_fetch_sub_explicit(&thread->runtime->num_of_coros, 1U, memory_order_release);
+}
+
+static void take_incoming (CoroThread_t *thread)
+{
+    uint64_t counter = 0U;
+    ssize_t n_read = read(thread->wake_fd, &counter, sizeof(counter));
+
+    (void)n_read;
+
+    adaptive_mutex_lock(&thread->mutex);
+    Coro_t *coro = thread->incoming;
+    thread->incoming = NULL;
+    adaptive_mutex_unlock(&thread->mutex);
+
+    while (coro != NULL)
+    {
+        Coro_t *next = coro->next;
+
+        if (coro->is_new)
+        {
+            coro->is_new = false;
+            LIST_INSERT_HEAD(&thread->coros, coro, node);
+            thread->num_of_coros++;
+        }
+
+        make_ready(thread, coro);
+        coro = next;
+    }
+}
+
+/**
+ * Fail the pending wait of every coroutine blocked on a descriptor or asleep, 
+ * later waits fail right away. 
+ */
+static void cancel_waits (CoroThread_t *thread)
+{
+    Coro_t *coro = NULL;
+
+    LIST_FOREACH(coro, &thread->coros, node)
+    {
+        if (coro->state == CORO_STATE_WAIT_FD)
+        {
+            epoll_ctl(thread->epfd, EPOLL_CTL_DEL, coro->registered_fd, NULL);
+            coro->registered_fd = -1;
+        }
+        else if (coro->state == CORO_STATE_SLEEPING)
+        {
+            LIST_REMOVE(coro, sleep_node);
+        }
+        else
+        {
+            continue;
+        }
+
+        coro->cancelled = true;
+        make_ready(thread, coro);
+    }
+
+    thread->waits_cancelled = true;
+}
+
+static bool thread_done (CoroThread_t *thread)
+{
+    adaptive_mutex_lock(&thread->mutex);
+    bool done = (thread->num_of_coros == 0U) && (thread->incoming == NULL);
+    adaptive_mutex_unlock(&thread->mutex);
+
+    return done;
+}
+
+static int next_timeout_ms (CoroThread_t *thread)
+{
+    int timeout_ms = -1;
+    uint64_t now = monotonic_ms();
+    Coro_t *coro = NULL;
+
+    LIST_FOREACH(coro, &thread->sleeping, sleep_node)
+    {
+        int remaining = (coro->wake_at_ms > now) ? (int)(coro->wake_at_ms - now) : 0;
+        if ((timeout_ms == -1) || (remaining < timeout_ms))
+        {
+            timeout_ms = remaining;
+        }
+    }
+
+    return timeout_ms;
+}
+
+static void wake_sleepers (CoroThread_t *thread)
+{
+    uint64_t now = monotonic_ms();
+    Coro_t *coro = LIST_FIRST(&thread->sleeping);
+
+    while (coro != NULL)
+    {
+        Coro_t *next = LIST_NEXT(coro, sleep_node);
+
+        if (coro->wake_at_ms <= now)
+        {
+            LIST_REMOVE(coro, sleep_node);
+            make_ready(thread, coro);
+        }
+
+        coro = next;
+    }
+}
+
+static void *scheduler_thread (void *arg)
+{
+    CoroThread_t *thread = (CoroThread_t *)arg;
+    CoroRuntime_t *runtime = thread->runtime;
+    struct epoll_event events[CORO_SCHED_MAX_EVENTS];
+
+    current_thread = thread;
+
+    for (;;)
+    {
+        while (thread->ready_head != NULL)
+        {
+            Coro_t *coro = thread->ready_head;
+
+            thread->ready_head = coro->next;
+            if (thread->ready_head == NULL)
+            {
+                thread->ready_tail = NULL;
+            }
+
+            thread->current = coro;
+            swapcontext(&thread->sched_ctx, &coro->ctx);
+            thread->current = NULL;
+
+            if (coro->state == CORO_STATE_DONE)
+            {
+                finish_coro(thread, coro);
+            }
+        }
+
+        if (atomic_load_explicit(&runtime->stopping, memory_order_acquire))
+        {
+            if (!thread->waits_cancelled)
+            {
+                cancel_waits(thread);
+                continue;
+            }
+
+            if (thread_done(thread))
+            {
+                break;
+            }
+        }
+
+        int n_events = epoll_wait(thread->epfd, events, CORO_SCHED_MAX_EVENTS, next_timeout_ms(thread));
+        for (int i = 0; i < n_events; ++i)
+        {
+            if (events[i].data.ptr == (void *)&wake_event_marker)
+            {
+                take_incoming(thread);
+                continue;
+            }
+
+            /* One shot, so a coroutine is only resumed once per wait */
+            Coro_t *coro = (Coro_t *)events[i].data.ptr;
+            if (coro->state == CORO_STATE_WAIT_FD)
+            {
+                make_ready(thread, coro);
+            }
+        }
+
+        wake_sleepers(thread);
+    }
+
+    return NULL;
+}
+
+static void destroy_thread (CoroThread_t *thread)
+{
+    close(thread->wake_fd);
+    close(thread->epfd);
+    adaptive_mutex_destroy(&thread->mutex);
+}
+
+static int init_thread (CoroRuntime_t *runtime, CoroThread_t *thread, int *error_code)
+{
+    thread->runtime = runtime;
+    LIST_INIT(&thread->coros);
+    LIST_INIT(&thread->sleeping);
+
+    thread->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (thread->epfd == -1)
+    {
+        *error_code = errno;
+        return CORO_SCHED_EPOLL_FAILED;
+    }
+
+    thread->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = (void *)&wake_event_marker };
+    if ((thread->wake_fd == -1) || (epoll_ctl(thread->epfd, EPOLL_CTL_ADD, thread->wake_fd, &ev) != 0))
+    {
+        *error_code = errno;
+        if (thread->wake_fd != -1)
+        {
+            close(thread->wake_fd);
+        }
+        close(thread->epfd);
+        return CORO_SCHED_EPOLL_FAILED;
+    }
+
+    adaptive_mutex_init(&thread->mutex, "coro_thread");
+
+    *error_code = pthread_create(&thread->thread, NULL, scheduler_thread, (void *)thread);
+    if (*error_code != 0)
+    {
+        destroy_thread(thread);
+        return CORO_SCHED_THREAD_CREATE_FAILED;
+    }
+
+    return CORO_SCHED_OK;
+}
+
+static void stop_threads (CoroRuntime_t *runtime, unsigned int num_of_threads)
+{
+    uint64_t one = 1U;
+
+    atomic_store_explicit(&runtime->stopping, true, memory_order_release);
+
+    for (unsigned int i = 0U; i < num_of_threads; ++i)
+    {
+        ssize_t n_written = write(runtime->threads[i].wake_fd, &one, sizeof(one));
+        (void)n_written;
+    }
+
+    for (unsigned int i = 0U; i < num_of_threads; ++i)
+    {
+        pthread_join(runtime->threads[i].thread, NULL);
+        destroy_thread(&runtime->threads[i]);
+    }
+}
+
+int coro_sched_start (CoroRuntime_t *runtime, unsigned int num_of_threads, int *error_code)
+{
+    if ((runtime == NULL) || (error_code == NULL))
+    {
+        return CORO_SCHED_INVALID_PARAM;
+    }
+
+    if (num_of_threads == 0U)
+    {
+        long num_of_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        num_of_threads = (num_of_cores > 0) ? (unsigned int)num_of_cores : 1U;
+    }
+
+    if (num_of_threads > CORO_SCHED_MAX_THREADS)
+    {
+        num_of_threads = CORO_SCHED_MAX_THREADS;
+    }
+
+    memset(runtime, 0, sizeof(CoroRuntime_t));
+    adaptive_mutex_init(&runtime->pool_mutex, "coro_pool");
+
+    runtime->threads = (CoroThread_t *)calloc(num_of_threads, sizeof(CoroThread_t));
+    if (runtime->threads == NULL)
+    {
+        *error_code = ENOMEM;
+        adaptive_mutex_destroy(&runtime->pool_mutex);
+        return CORO_SCHED_NO_MEMORY;
+    }
+
+    for (unsigned int i = 0U; i < num_of_threads; ++i)
+    {
+        int rc = init_thread(runtime, &runtime->threads[i], error_code);
+        if (rc != CORO_SCHED_OK)
+        {
+            stop_threads(runtime, i);
+            free(runtime->threads);
+            runtime->threads = NULL;
+            adaptive_mutex_destroy(&runtime->pool_mutex);
+            return rc;
+        }
+    }
+
+    runtime->num_of_threads = num_of_threads;
+
+    return CORO_SCHED_OK;
+}
+
+void coro_sched_stop (CoroRuntime_t *runtime)
+{
+    if ((runtime == NULL) || (runtime->threads == NULL))
+    {
+        return;
+    }
+
+    stop_threads(runtime, runtime->num_of_threads);
+
+    while (runtime->stack_pool != NULL)
+    {
+        void *stack = runtime->stack_pool;
+        runtime->stack_pool = *(void **)((char *)stack + guard_size());
+        munmap(stack, guard_size() + CORO_SCHED_STACK_SIZE);
+    }
+
+    free(runtime->threads);
+    runtime->threads = NULL;
+    runtime->num_of_threads = 0U;
+    adaptive_mutex_destroy(&runtime->pool_mutex);
+}
+
+int coro_spawn (CoroRuntime_t *runtime, void (*func)(void *arg), void *arg, int *error_code)
+{
+    if ((runtime == NULL) || (runtime->threads == NULL) || (func == NULL) || (error_code == NULL))
+    {
+        return CORO_SCHED_INVALID_PARAM;
+    }
+
+    if (atomic_load_explicit(&runtime->stopping, memory_order_acquire))
+    {
+        return CORO_SCHED_STOPPED;
+    }
+
+    Coro_t *coro = (Coro_t *)calloc(1, sizeof(Coro_t));
+    if (coro == NULL)
+    {
+        *error_code = ENOMEM;
+        return CORO_SCHED_NO_MEMORY;
+    }
+
+    coro->stack = get_stack(runtime);
+    if ((coro->stack == NULL) || (getcontext(&coro->ctx) != 0))
+    {
+        *error_code = errno;
+        if (coro->stack != NULL)
+        {
+            put_stack(runtime, coro->stack);
+        }
+        free(coro);
+        return CORO_SCHED_NO_MEMORY;
+    }
+
+    coro->ctx.uc_stack.ss_sp = (char *)coro->stack + guard_size();
+    coro->ctx.uc_stack.ss_size = CORO_SCHED_STACK_SIZE;
+    coro->ctx.uc_link = NULL;
+    makecontext(&coro->ctx, coro_entry, 0);
+
+    unsigned int index = atomic_fetch_add_explicit(&runtime->next_thread, 1U, memory_order_relaxed);
+    coro->thread = &runtime->threads[index % runtime->num_of_threads];
+    coro->func = func;
+    coro->arg = arg;
+    coro->registered_fd = -1;
+    coro->is_new = true;
+
+    atomic_fetch_add_explicit(&runtime->num_of_coros, 1U, memory_order_relaxed);
+    push_incoming(coro->thread, coro);
+
+    return CORO_SCHED_OK;
+}
+
+unsigned int coro_sched_count (CoroRuntime_t *runtime)
+{
+    return atomic_load_explicit(&runtime->num_of_coros, memory_order_acquire);
+}
+
+Coro_t *coro_self (void)
+{
+    return (current_thread == NULL) ? NULL : current_thread->current;
+}
+
+static inline bool stopping (CoroThread_t *thread)
+{
+    return atomic_load_explicit(&thread->runtime->stopping, memory_order_acquire) && thread->waits_cancelled;
+}
+
+bool coro_wait_fd (int fd, uint32_t events)
+{
+    CoroThread_t *thread = current_thread;
+    Coro_t *coro = coro_self();
+
+    if (coro == NULL)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (stopping(thread))
+    {
+        errno = ECANCELED;
+        return false;
+    }
+
+    struct epoll_event ev = { .events = events | EPOLLONESHOT, .data.ptr = (void *)coro };
+    if ((coro->registered_fd != -1) && (coro->registered_fd != fd))
+    {
+        epoll_ctl(thread->epfd, EPOLL_CTL_DEL, coro->registered_fd, NULL);
+        coro->registered_fd = -1;
+    }
+
+    int op = (coro->registered_fd == fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(thread->epfd, op, fd, &ev) != 0)
+    {
+        return false;
+    }
+
+    coro->registered_fd = fd;
+    coro->state = CORO_STATE_WAIT_FD;
+    swapcontext(&coro->ctx, &thread->sched_ctx);
+
+    if (coro->cancelled)
+    {
+        errno = ECANCELED;
+        return false;
+    }
+
+    return true;
+}
+
+bool coro_sleep_ms (unsigned int ms)
+{
+    CoroThread_t *thread = current_thread;
+    Coro_t *coro = coro_self();
+
+    if (coro == NULL)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (stopping(thread))
+    {
+        errno = ECANCELED;
+        return false;
+    }
+
+    coro->wake_at_ms = monotonic_ms() + ms;
+    coro->state = CORO_STATE_SLEEPING;
+    LIST_INSERT_HEAD(&thread->sleeping, coro, sleep_node);
+    swapcontext(&coro->ctx, &thread->sched_ctx);
+
+    if (coro->cancelled)
+    {
+        errno = ECANCELED;
+        return false;
+    }
+
+    return true;
+}
+
+void coro_park (void)
+{
+    Coro_t *coro = coro_self();
+
+    if (coro != NULL)
+    {
+        coro->state = CORO_STATE_PARKED;
+        swapcontext(&coro->ctx, &coro->thread->sched_ctx);
+    }
+}
+
+void coro_wake (Coro_t *coro)
+{
+    if (coro != NULL)
+    {
+        push_incoming(coro->thread, coro);
+    }
+}
+
+ssize_t coro_recv (int fd, void *buf, size_t len, int flags)
+{
+    for (;;)
+    {
+        ssize_t n_read = recv(fd, buf, len, flags);
+
+        if ((n_read != -1) || ((errno != EAGAIN) && (errno != EWOULDBLOCK)) || (coro_self() == NULL))
+        {
+            return n_read;
+        }
+
+        if (!coro_wait_fd(fd, EPOLLIN))
+        {
+            return -1;
+        }
+    }
+}
+
+ssize_t coro_send (int fd, const void *buf, size_t len, int flags)
+{
+    size_t n_done = 0U;
+
+    /* Like a blocking send(), only returns short on error */
+    while (n_done < len)
+    {
+        ssize_t n_sent = send(fd, (const char *)buf + n_done, len - n_done, flags);
+
+        if (n_sent == -1)
+        {
+            if (((errno != EAGAIN) && (errno != EWOULDBLOCK)) || (coro_self() == NULL))
+            {
+                return (n_done > 0U) ? (ssize_t)n_done : -1;
+            }
+
+            if (!coro_wait_fd(fd, EPOLLOUT))
+            {
+                return (n_done > 0U) ? (ssize_t)n_done : -1;
+            }
+            continue;
+        }
+
+        n_done += (size_t)n_sent;
+    }
+
+    return (ssize_t)n_done;
+}
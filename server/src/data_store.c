@@ -0,0 +1,335 @@
+/**
+ * \file    data_store.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Append-only data store implementation
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "data_store.h"
+
+static int init_shared_mutex (pthread_mutex_t *mutex)
+{
+    pthread_mutexattr_t attr;
+    int rc = pthread_mutexattr_init(&attr);
+
+    if (rc != 0)
+    {
+        return rc;
+    }
+
+    rc = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    if (rc == 0)
+    {
+        rc = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    }
+
+    if (rc == 0)
+    {
+        rc = pthread_mutex_init(mutex, &attr);
+    }
+
+    pthread_mutexattr_destroy(&attr);
+
+    return rc;
+}
+
+static void lock_store (DataStore_t *store)
+{
+    if (lock_stats_mutex_lock(&store->shared->mutex, store->lock_stats, &store->lock_acquired_ns) == EOWNERDEAD)
+    {
+        /* The previous owner died mid-append, anything it wrote past the watermark is not committed */
+        off_t size = atomic_load_explicit(&store->shared->size, memory_order_relaxed);
+        int rc = ftruncate(store->fd, size);
+        (void)rc;
+        pthread_mutex_consistent(&store->shared->mutex);
+    }
+}
+
+static int map_shared (DataStore_t *store, int shared_fd, int *error_code)
+{
+    store->shared = (DataStoreShared_t *)mmap(NULL, sizeof(DataStoreShared_t), PROT_READ | PROT_WRITE, 
+                                              MAP_SHARED, shared_fd, 0);
+    if (store->shared == MAP_FAILED)
+    {
+        *error_code = errno;
+        store->shared = NULL;
+        return DATA_STORE_MAP_FAILED;
+    }
+
+    store->shared_fd = shared_fd;
+
+    return DATA_STORE_OK;
+}
+
+static void unmap_shared (DataStore_t *store)
+{
+    munmap(store->shared, sizeof(DataStoreShared_t));
+    close(store->shared_fd);
+    store->shared = NULL;
+    store->shared_fd = -1;
+}
+
+/**
+ * Every record ends with a newline, so anything after the last one is the 
+ * remains of an interrupted append. 
+ * @return size of the store without it, -1 on error 
+ */
+static off_t recover_tail (int fd)
+{
+    char buf[DATA_STORE_RECOVER_CHUNK];
+    off_t end = lseek(fd, 0, SEEK_END);
+
+    if (end == -1)
+    {
+        return -1;
+    }
+
+    while (end > 0)
+    {
+        size_t len = (end < (off_t)sizeof(buf)) ? (size_t)end : sizeof(buf);
+        ssize_t n_read = pread(fd, buf, len, end - len);
+        if (n_read != (ssize_t)len)
+        {
+            return -1;
+        }
+
+        const char *nl = memrchr(buf, '\n', len);
+        if (nl != NULL)
+        {
+            end = end - len + (nl - buf) + 1;
+            break;
+        }
+
+        end -= len;
+    }
+
+    if (ftruncate(fd, end) != 0)
+    {
+        return -1;
+    }
+
+    return end;
+}
+
+int data_store_open (DataStore_t *store, const char *path, bool persist, int *error_code)
+{
+    if ((store == NULL) || (path == NULL) || (error_code == NULL))
+    {
+        return DATA_STORE_INVALID_PARAM;
+    }
+
+    store->fd = -1;
+    store->publish = NULL;
+    store->publish_ctx = NULL;
+    store->lock_stats = lock_stats_register("data_store");
+
+    int shared_fd = memfd_create("aesdsocket-store", MFD_CLOEXEC);
+    if ((shared_fd == -1) || (ftruncate(shared_fd, sizeof(DataStoreShared_t)) != 0))
+    {
+        *error_code = errno;
+        if (shared_fd != -1)
+        {
+            close(shared_fd);
+        }
+        return DATA_STORE_MAP_FAILED;
+    }
+
+    int rc = map_shared(store, shared_fd, error_code);
+    if (rc != DATA_STORE_OK)
+    {
+        close(shared_fd);
+        return rc;
+    }
+
+    *error_code = init_shared_mutex(&store->shared->mutex);
+    if (*error_code != 0)
+    {
+        unmap_shared(store);
+        return DATA_STORE_MUTEX_INIT_FAILED;
+    }
+
+    store->fd = open(path, O_CREAT | O_RDWR | O_CLOEXEC | (persist ? 0 : O_TRUNC), S_IRWXU);
+    if (store->fd == -1)
+    {
+        *error_code = errno;
+        pthread_mutex_destroy(&store->shared->mutex);
+        unmap_shared(store);
+        return DATA_STORE_OPEN_FAILED;
+    }
+
+    off_t size = persist ? recover_tail(store->fd) : 0;
+    if (size == -1)
+    {
+        *error_code = errno;
+        close(store->fd);
+        store->fd = -1;
+        pthread_mutex_destroy(&store->shared->mutex);
+        unmap_shared(store);
+        return DATA_STORE_READ_FAILED;
+    }
+
+    store->owner = getpid();
+    atomic_init(&store->shared->size, size);
+
+    return DATA_STORE_OK;
+}
+
+int data_store_adopt (DataStore_t *store, int fd, int shared_fd, int *error_code)
+{
+    if ((store == NULL) || (fd == -1) || (shared_fd == -1) || (error_code == NULL))
+    {
+        return DATA_STORE_INVALID_PARAM;
+    }
+
+    store->publish = NULL;
+    store->publish_ctx = NULL;
+    store->lock_stats = lock_stats_register("data_store");
+
+    int rc = map_shared(store, shared_fd, error_code);
+    if (rc != DATA_STORE_OK)
+    {
+        store->fd = -1;
+        return rc;
+    }
+
+    store->fd = fd;
+    store->owner = getpid();
+
+    return DATA_STORE_OK;
+}
+
+void data_store_disown (DataStore_t *store)
+{
+    if (store != NULL)
+    {
+        store->owner = 0;
+    }
+}
+
+void data_store_close (DataStore_t *store)
+{
+    if ((store == NULL) || (store->fd == -1))
+    {
+        return;
+    }
+
+    close(store->fd);
+    store->fd = -1;
+    if (store->owner == getpid())
+    {
+        pthread_mutex_destroy(&store->shared->mutex);
+    }
+    unmap_shared(store);
+}
+
+int data_store_append (DataStore_t *store, const char *buf, size_t len, off_t *size_after, int *error_code)
+{
+    int ret = DATA_STORE_OK;
+
+    if ((store == NULL) || (buf == NULL) || (error_code == NULL))
+    {
+        return DATA_STORE_INVALID_PARAM;
+    }
+
+    *error_code = 0;
+
+    lock_store(store);
+    off_t size = atomic_load_explicit(&store->shared->size, memory_order_relaxed);
+    ssize_t written = pwrite(store->fd, buf, len, size);
+
+    if (written == (ssize_t)len)
+    {
+        if (store->publish != NULL)
+        {
+            store->publish(store->publish_ctx, buf, len, size);
+        }
+        size += written;
+        atomic_store_explicit(&store->shared->size, size, memory_order_release);
+    }
+    else if (written == -1)
+    {
+        *error_code = errno;
+        ret = DATA_STORE_WRITE_FAILED;
+    }
+    else
+    {
+        /* Drop the partial record so the next append starts on a record boundary */
+        ret = DATA_STORE_WRITE_INTERRUPTED;
+        if (ftruncate(store->fd, size) != 0)
+        {
+            *error_code = errno;
+        }
+    }
+    lock_stats_mutex_unlock(&store->shared->mutex, store->lock_stats, store->lock_acquired_ns);
+
+    if (size_after != NULL)
+    {
+        *size_after = size;
+    }
+
+    return ret;
+}
+
+void data_store_set_publisher (DataStore_t *store, DataStorePublishFn_t publish, void *ctx)
+{
+    if (store != NULL)
+    {
+        store->publish = publish;
+        store->publish_ctx = ctx;
+    }
+}
+
+off_t data_store_size (DataStore_t *store)
+{
+    return atomic_load_explicit(&store->shared->size, memory_order_acquire);
+}
+ssize_t data_store_read (DataStore_t *store, off_t offset, char *buf, size_t len)
+{
+    off_t size = data_store_size(store);
+
+    if (offset >= size)
+    {
+        return 0;
+    }
+
+    if ((off_t)len > (size - offset))
+    {
+        len = size - offset;
+    }
+
+    return pread(store->fd, buf, len, offset);
+}
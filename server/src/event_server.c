@@ -0,0 +1,938 @@
+/**
+ * \file    event_server.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Event-driven connection handling: one epoll loop serves every 
+ *          connection, idle connections own no receive buffer and replays 
+ *          are sent with sendfile()
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/queue.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "event_server.h"
+#include "async_log.h"
+#include "server_stats.h"
+
+typedef struct EventConn
+{
+    int fd;
+    uint32_t len;
+    uint32_t cap;
+    uint32_t last_active;
+    char *buf;
+    off_t replay_off;
+    off_t replay_end;
+    char client_ipv4[16];
+    /* Only used with an append scheduler */
+    AppendClient_t *client;
+    struct EventCommit *pending;
+    /* Seek waiting for the record index */
+    uint32_t seek_record;
+    uint32_t seek_offset;
+    bool seek_pending;
+    /* Replays go out as LZ4 frames, the one in flight is held in @ref compressed */
+    bool compress;
+    CompressedReplay_t *compressed;
+    LIST_ENTRY(EventConn) node;
+} EventConn_t;
+
+_Static_assert(sizeof(EventConn_t) <= EVENT_SERVER_IDLE_CONN_BUDGET, "EventConn_t exceeds the idle connection budget");
+
+LIST_HEAD(event_conn_list, EventConn);
+
+typedef struct
+{
+    int epfd;
+    int sfd;
+    bool listener_paused;
+    bool draining;
+    unsigned int idle_timeout_sec;
+    DataStore_t *store;
+    Scheduler_t *scheduler;
+    char *scratch;
+    struct event_conn_list conns;
+    AppendScheduler_t *append_sched;
+    RecordIndex_t *index;
+    unsigned int seeks_pending;
+    ReplayCache_t *replay_cache;
+    /* Commits finished by the committer thread, handed back through commit_fd */
+    _Atomic(struct EventCommit *) completed;
+    int commit_fd;
+    unsigned int commits_in_flight;
+} EventServer_t;
+
+/* Copy of a packet queued on the append scheduler, the connection may keep receiving into its own buffer */
+typedef struct EventCommit
+{
+    AppendRequest_t req;
+    EventServer_t *server;
+    EventConn_t *conn;
+    struct EventCommit *next_completed;
+    char data[];
+} EventCommit_t;
+
+/* epoll markers of commit_fd and of the index ready fd, distinct from every connection and from the scheduler */
+static char commit_event_marker;
+static char index_event_marker;
+
+static inline uint32_t monotonic_sec (void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+    return (uint32_t)now.tv_sec;
+}
+
+static inline bool replay_in_flight (const EventConn_t *conn)
+{
+    return (conn->replay_off < conn->replay_end) || (conn->compressed != NULL);
+}
+
+static bool update_events (EventServer_t *server, EventConn_t *conn, uint32_t events)
+{
+    struct epoll_event ev = { .events = events, .data.ptr = conn };
+
+    return (epoll_ctl(server->epfd, EPOLL_CTL_MOD, conn->fd, &ev) == 0);
+}
+
+static void close_connection (EventServer_t *server, EventConn_t *conn, bool log_close)
+{
+    if (log_close)
+    {
+        async_log(LOG_INFO, "Closed connection from %s", conn->client_ipv4);
+    }
+
+    LIST_REMOVE(conn, node);
+    if (conn->seek_pending)
+    {
+        server->seeks_pending--;
+    }
+    append_sched_client_put(server->append_sched, conn->client);
+    server_stats_dec(&server_stats->connections_active);
+    close(conn->fd);
+    free(conn->buf);
+    free(conn->compressed);
+    free(conn);
+
+    if (server->listener_paused && !server->draining)
+    {
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+        if (epoll_ctl(server->epfd, EPOLL_CTL_MOD, server->sfd, &ev) == 0)
+        {
+            server->listener_paused = false;
+        }
+    }
+}
+
+static void accept_connections (EventServer_t *server)
+{
+    for (;;)
+    {
+        struct sockaddr_in client_addr;
+        socklen_t client_addrlen = sizeof(client_addr);
+        int cfd = accept4(server->sfd, (struct sockaddr *)&client_addr, &client_addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (cfd == -1)
+        {
+            if ((errno == EMFILE) || (errno == ENFILE) || (errno == ENOBUFS) || (errno == ENOMEM))
+            {
+                /* Stop polling the listener until a connection is released, instead of spinning on it */
+                struct epoll_event ev = { .events = 0, .data.ptr = NULL };
+                if (epoll_ctl(server->epfd, EPOLL_CTL_MOD, server->sfd, &ev) == 0)
+                {
+                    server->listener_paused = true;
+                }
+                ASYNC_LOG_RATELIMITED(LOG_ERR, "connection accept error: %s", strerror(errno));
+            }
+            else if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+            {
+                ASYNC_LOG_RATELIMITED(LOG_ERR, "connection accept error: %s", strerror(errno));
+            }
+            return;
+        }
+
+        EventConn_t *conn = (EventConn_t *)calloc(1, sizeof(EventConn_t));
+        if (conn == NULL)
+        {
+            ASYNC_LOG_RATELIMITED(LOG_ERR, "calloc() for new connection failed: %s", strerror(errno));
+            close(cfd);
+            continue;
+        }
+
+        conn->fd = cfd;
+        conn->last_active = monotonic_sec();
+        inet_ntop(AF_INET, &client_addr.sin_addr, conn->client_ipv4, sizeof(conn->client_ipv4));
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conn };
+        if (epoll_ctl(server->epfd, EPOLL_CTL_ADD, cfd, &ev) != 0)
+        {
+            ASYNC_LOG_RATELIMITED(LOG_ERR, "epoll_ctl() error: %s", strerror(errno));
+            close(cfd);
+            free(conn);
+            continue;
+        }
+
+        if (server->append_sched != NULL)
+        {
+            conn->client = append_sched_client_get(server->append_sched, conn->client_ipv4);
+        }
+
+        LIST_INSERT_HEAD(&server->conns, conn, node);
+        server_stats_inc(&server_stats->connections_accepted, 1UL);
+        server_stats_inc(&server_stats->connections_active, 1UL);
+        async_log(LOG_INFO, "Accepted connection from %s", conn->client_ipv4);
+    }
+}
+
+/**
+ * @return false if the connection failed and has to be closed 
+ */
+static bool continue_replay (EventServer_t *server, EventConn_t *conn)
+{
+    if (conn->compressed != NULL)
+    {
+        int error_code = 0;
+        int rc = replay_cache_send(server->replay_cache, conn->compressed, conn->fd, &error_code);
+
+        if (rc == REPLAY_CACHE_WOULD_BLOCK)
+        {
+            return update_events(server, conn, EPOLLOUT);
+        }
+
+        free(conn->compressed);
+        conn->compressed = NULL;
+        if (rc != REPLAY_CACHE_OK)
+        {
+            async_log(LOG_ERR, "compressed replay send error: %s", strerror(error_code));
+            return false;
+        }
+
+        return true;
+    }
+
+    while (conn->replay_off < conn->replay_end)
+    {
+        ssize_t n_sent = sendfile(conn->fd, server->store->fd, &conn->replay_off, 
+                                  conn->replay_end - conn->replay_off);
+
+        if (n_sent == -1)
+        {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                /* Stop reading until the replay is out so that packets are answered in order */
+                return update_events(server, conn, EPOLLOUT);
+            }
+
+            if (errno != EINTR)
+            {
+                async_log(LOG_ERR, "sendfile() error: %s", strerror(errno));
+                return false;
+            }
+        }
+        else if (n_sent == 0)
+        {
+            async_log(LOG_ERR, "sendfile() interrupted! ");
+            return false;
+        }
+    }
+
+    conn->replay_off = 0;
+    conn->replay_end = 0;
+
+    return true;
+}
+
+/**
+ * Replay the store range [@param start, @param end) in the encoding of the connection. 
+ * @return false if the connection failed and has to be closed 
+ */
+static bool start_replay (EventServer_t *server, EventConn_t *conn, off_t start, off_t end)
+{
+    if (conn->compress)
+    {
+        int error_code = 0;
+        int rc = replay_cache_prepare(server->replay_cache, start, end, &conn->compressed, &error_code);
+
+        if (rc != REPLAY_CACHE_OK)
+        {
+            async_log(LOG_ERR, "compressed replay setup failed (%d): %s", rc, strerror(error_code));
+            return false;
+        }
+    }
+    else
+    {
+        conn->replay_off = start;
+        conn->replay_end = end;
+    }
+
+    return continue_replay(server, conn);
+}
+
+static bool commit_done (EventServer_t *server, EventConn_t *conn, int rc, int error_code, size_t len, 
+                         off_t replay_size)
+{
+    if (rc != DATA_STORE_OK)
+    {
+        if (rc == DATA_STORE_WRITE_FAILED)
+        {
+            async_log(LOG_ERR, "write() error: %s", strerror(error_code));
+        }
+        else
+        {
+            async_log(LOG_ERR, "write() interrupted! ");
+        }
+        return false;
+    }
+
+    server_stats_inc(&server_stats->packets_committed, 1UL);
+    server_stats_inc(&server_stats->bytes_committed, (unsigned long)len);
+
+    return start_replay(server, conn, 0, replay_size);
+}
+
+/* Runs on the committer thread */
+static void commit_completed (AppendRequest_t *req)
+{
+    EventCommit_t *commit = (EventCommit_t *)req;
+    EventServer_t *server = commit->server;
+    uint64_t one = 1U;
+
+    commit->next_completed = atomic_load_explicit(&server->completed, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&server->completed, &commit->next_completed, commit, 
+                                                  memory_order_release, memory_order_relaxed))
+    {
+    }
+
+    if (write(server->commit_fd, &one, sizeof(one)) == -1)
+    {
+        ASYNC_LOG_RATELIMITED(LOG_ERR, "commit eventfd write error: %s", strerror(errno));
+    }
+}
+
+/**
+ * Hand a copy of the packet to the append scheduler. The connection leaves the 
+ * epoll set until the commit is back, so that its packets stay in order and a 
+ * hung up peer does not spin the loop meanwhile. 
+ */
+static bool queue_commit (EventServer_t *server, EventConn_t *conn, const char *buf, size_t len)
+{
+    EventCommit_t *commit = (EventCommit_t *)malloc(sizeof(EventCommit_t) + len);
+
+    if (commit == NULL)
+    {
+        async_log(LOG_ERR, "malloc() for %zu bytes failed with error: %s", len, strerror(errno));
+        return false;
+    }
+
+    memset(&commit->req, 0, sizeof(commit->req));
+    memcpy(commit->data, buf, len);
+    commit->req.buf = commit->data;
+    commit->req.len = len;
+    commit->req.on_done = commit_completed;
+    commit->server = server;
+    commit->conn = conn;
+
+    if (epoll_ctl(server->epfd, EPOLL_CTL_DEL, conn->fd, NULL) != 0)
+    {
+        async_log(LOG_ERR, "epoll_ctl() error: %s", strerror(errno));
+        free(commit);
+        return false;
+    }
+
+    if (append_sched_submit_async(server->append_sched, conn->client, &commit->req) != APPEND_SCHED_OK)
+    {
+        free(commit);
+        return false;
+    }
+
+    conn->pending = commit;
+    server->commits_in_flight++;
+
+    return true;
+}
+
+static bool commit_packet (EventServer_t *server, EventConn_t *conn, const char *buf, size_t len)
+{
+    int error_code = 0;
+    off_t replay_size = 0;
+
+    if (conn->client != NULL)
+    {
+        return queue_commit(server, conn, buf, len);
+    }
+
+    int rc = data_store_append(server->store, buf, len, &replay_size, &error_code);
+
+    return commit_done(server, conn, rc, error_code, len, replay_size);
+}
+
+/**
+ * Resume every connection whose commit came back, or just release the commits 
+ * when @param resume is false because the server is shutting down. 
+ */
+static void handle_completed_commits (EventServer_t *server, bool resume)
+{
+    uint64_t count = 0U;
+
+    if (read(server->commit_fd, &count, sizeof(count)) == -1)
+    {
+        return;
+    }
+
+    EventCommit_t *commit = atomic_exchange_explicit(&server->completed, NULL, memory_order_acquire);
+
+    while (commit != NULL)
+    {
+        EventCommit_t *next = commit->next_completed;
+        EventConn_t *conn = commit->conn;
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conn };
+
+        conn->pending = NULL;
+        server->commits_in_flight--;
+
+        if (resume)
+        {
+            if (epoll_ctl(server->epfd, EPOLL_CTL_ADD, conn->fd, &ev) != 0)
+            {
+                async_log(LOG_ERR, "epoll_ctl() error: %s", strerror(errno));
+                close_connection(server, conn, false);
+            }
+            else if (!commit_done(server, conn, commit->req.rc, commit->req.error_code, commit->req.len, 
+                                  commit->req.size_after))
+            {
+                close_connection(server, conn, false);
+            }
+        }
+
+        free(commit);
+        commit = next;
+    }
+}
+
+/**
+ * Replay the store from the position of the seek, without storing the command. 
+ * @return false if the connection failed and has to be closed 
+ */
+static bool seek_packet (EventServer_t *server, EventConn_t *conn, uint32_t record, uint32_t offset)
+{
+    off_t position = 0;
+    int rc = (server->index == NULL) ? RECORD_INDEX_INVALID_PARAM : 
+                                       record_index_seek(server->index, record, offset, false, &position);
+
+    if (rc == RECORD_INDEX_NOT_READY)
+    {
+        /* Out of the epoll set until the index is built, so later packets wait behind the seek */
+        if (epoll_ctl(server->epfd, EPOLL_CTL_DEL, conn->fd, NULL) != 0)
+        {
+            async_log(LOG_ERR, "epoll_ctl() error: %s", strerror(errno));
+            return false;
+        }
+
+        conn->seek_record = record;
+        conn->seek_offset = offset;
+        conn->seek_pending = true;
+        server->seeks_pending++;
+        return true;
+    }
+
+    if (rc != RECORD_INDEX_OK)
+    {
+        ASYNC_LOG_RATELIMITED(LOG_ERR, "seek to record %u offset %u failed (%d)", record, offset, rc);
+        return true;
+    }
+
+    return start_replay(server, conn, position, data_store_size(server->store));
+}
+
+static void resume_pending_seeks (EventServer_t *server)
+{
+    uint64_t counter = 0U;
+    ssize_t n_read = read(record_index_get_ready_fd(server->index), &counter, sizeof(counter));
+    EventConn_t *conn = LIST_FIRST(&server->conns);
+
+    (void)n_read;
+
+    while ((conn != NULL) && (server->seeks_pending > 0U))
+    {
+        EventConn_t *next = LIST_NEXT(conn, node);
+
+        if (conn->seek_pending)
+        {
+            struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conn };
+
+            conn->seek_pending = false;
+            server->seeks_pending--;
+
+            if ((epoll_ctl(server->epfd, EPOLL_CTL_ADD, conn->fd, &ev) != 0) || 
+                !seek_packet(server, conn, conn->seek_record, conn->seek_offset))
+            {
+                close_connection(server, conn, false);
+            }
+        }
+
+        conn = next;
+    }
+}
+
+static bool buffer_bytes (EventConn_t *conn, const char *data, size_t len)
+{
+    if (((size_t)conn->len + len) > UINT32_MAX)
+    {
+        return false;
+    }
+
+    if ((conn->len + len) > conn->cap)
+    {
+        uint32_t cap = (conn->cap == 0U) ? 4096U : conn->cap;
+        while (cap < (conn->len + len))
+        {
+            cap = (cap > (UINT32_MAX / 2U)) ? UINT32_MAX : (cap * 2U);
+        }
+
+        char *buf = (char *)realloc(conn->buf, cap);
+        if (buf == NULL)
+        {
+            async_log(LOG_ERR, "realloc() for %u bytes failed with error: %s", cap, strerror(errno));
+            return false;
+        }
+
+        conn->buf = buf;
+        conn->cap = cap;
+    }
+
+    memcpy(&conn->buf[conn->len], data, len);
+    conn->len += len;
+
+    return true;
+}
+
+static void release_buffer (EventConn_t *conn)
+{
+    free(conn->buf);
+    conn->buf = NULL;
+    conn->len = 0U;
+    conn->cap = 0U;
+}
+
+/**
+ * Commit everything up to the last packet delimiter in @param data, keeping the 
+ * rest in the connection buffer. 
+ * @return false if the connection failed and has to be closed 
+ */
+static bool process_bytes (EventServer_t *server, EventConn_t *conn, char *data, size_t len)
+{
+    if (data[len - 1] == '\0')
+    {
+        data[len - 1] = '\n';
+    }
+
+    char *last_delim = memrchr(data, '\n', len);
+
+    if (last_delim == NULL)
+    {
+        return buffer_bytes(conn, data, len);
+    }
+
+    size_t packet_len = (size_t)(last_delim - data) + 1U;
+    bool ok = true;
+    uint32_t seek_record = 0U;
+    uint32_t seek_offset = 0U;
+    ReplayEncoding_t encoding = REPLAY_ENCODING_RAW;
+
+    /* Commands only count as such when they are the single complete packet at hand */
+    if ((conn->len == 0U) && record_index_parse_seek(data, packet_len, &seek_record, &seek_offset))
+    {
+        ok = seek_packet(server, conn, seek_record, seek_offset);
+    }
+    else if ((conn->len == 0U) && replay_cache_parse_command(data, packet_len, &encoding))
+    {
+        /* Answered with a replay in the new encoding and not stored, without a cache replays stay raw */
+        conn->compress = (encoding == REPLAY_ENCODING_LZ4) && (server->replay_cache != NULL);
+        ok = start_replay(server, conn, 0, data_store_size(server->store));
+    }
+    else if (conn->len == 0U)
+    {
+        /* Common case: the whole packet arrived in one recv(), commit it straight from scratch */
+        ok = commit_packet(server, conn, data, packet_len);
+    }
+    else
+    {
+        ok = buffer_bytes(conn, data, packet_len) && commit_packet(server, conn, conn->buf, conn->len);
+        release_buffer(conn);
+    }
+
+    if (ok && (packet_len < len))
+    {
+        ok = buffer_bytes(conn, &data[packet_len], len - packet_len);
+    }
+
+    return ok;
+}
+
+static void handle_connection (EventServer_t *server, EventConn_t *conn, uint32_t events)
+{
+    if (replay_in_flight(conn))
+    {
+        if ((events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) == 0)
+        {
+            return;
+        }
+
+        if (!continue_replay(server, conn))
+        {
+            close_connection(server, conn, false);
+            return;
+        }
+
+        if (replay_in_flight(conn))
+        {
+            return;
+        }
+
+        if (!update_events(server, conn, EPOLLIN))
+        {
+            close_connection(server, conn, false);
+            return;
+        }
+    }
+
+    while (!replay_in_flight(conn) && (conn->pending == NULL) && !conn->seek_pending)
+    {
+        ssize_t n_read = recv(conn->fd, server->scratch, EVENT_SERVER_SCRATCH_SIZE, 0);
+
+        if (n_read == 0)
+        {
+            close_connection(server, conn, true);
+            return;
+        }
+
+        if (n_read == -1)
+        {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                return;
+            }
+
+            if (errno != EINTR)
+            {
+                ASYNC_LOG_RATELIMITED(LOG_ERR, "recv() error: %s", strerror(errno));
+                close_connection(server, conn, false);
+                return;
+            }
+
+            continue;
+        }
+
+        conn->last_active = monotonic_sec();
+
+        if (!process_bytes(server, conn, server->scratch, n_read))
+        {
+            close_connection(server, conn, false);
+            return;
+        }
+    }
+}
+
+static void idle_sweep_job (void *ctx)
+{
+    EventServer_t *server = (EventServer_t *)ctx;
+    uint32_t now = monotonic_sec();
+    EventConn_t *conn = LIST_FIRST(&server->conns);
+
+    while (conn != NULL)
+    {
+        EventConn_t *next = LIST_NEXT(conn, node);
+
+        /* Connections still sending a replay or waiting on a commit or seek are not idle */
+        if (((now - conn->last_active) >= server->idle_timeout_sec) && !replay_in_flight(conn) && 
+            (conn->pending == NULL) && !conn->seek_pending)
+        {
+            async_log(LOG_INFO, "Closed idle connection from %s", conn->client_ipv4);
+            server_stats_inc(&server_stats->connections_idle_closed, 1UL);
+            close_connection(server, conn, false);
+        }
+
+        conn = next;
+    }
+}
+
+static void raise_fd_limit (void)
+{
+    struct rlimit limit;
+
+    if ((getrlimit(RLIMIT_NOFILE, &limit) == 0) && (limit.rlim_cur < limit.rlim_max))
+    {
+        limit.rlim_cur = limit.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &limit) != 0)
+        {
+            async_log(LOG_WARNING, "setrlimit() error: %s", strerror(errno));
+        }
+    }
+}
+
+static void start_draining (EventServer_t *server)
+{
+    if (epoll_ctl(server->epfd, EPOLL_CTL_DEL, server->sfd, NULL) != 0)
+    {
+        async_log(LOG_ERR, "epoll_ctl() error: %s", strerror(errno));
+    }
+
+    server->draining = true;
+    async_log(LOG_INFO, "Stopped accepting, draining %s connections", 
+              LIST_EMPTY(&server->conns) ? "no" : "remaining");
+}
+
+int run_event_server (const EventServerParams_t *params, int *error_code)
+{
+    struct epoll_event events[EVENT_SERVER_MAX_EVENTS];
+    int ret = EVENT_SERVER_OK;
+
+    if ((params == NULL) || (params->store == NULL) || (params->stop == NULL) || (error_code == NULL))
+    {
+        return EVENT_SERVER_INVALID_PARAM;
+    }
+
+    int sfd = params->sfd;
+    Scheduler_t *scheduler = params->scheduler;
+    AppendScheduler_t *append_sched = params->append_sched;
+    unsigned int idle_timeout_sec = params->idle_timeout_sec;
+    volatile bool *stop = params->stop;
+    EventServer_t server = { .sfd = sfd, .store = params->store, .scheduler = scheduler, 
+                             .idle_timeout_sec = idle_timeout_sec, .append_sched = append_sched, 
+                             .index = params->index, .replay_cache = params->replay_cache, .commit_fd = -1 };
+
+    *error_code = 0;
+    LIST_INIT(&server.conns);
+    raise_fd_limit();
+
+    int flags = fcntl(sfd, F_GETFL);
+    if ((flags == -1) || (fcntl(sfd, F_SETFL, flags | O_NONBLOCK) == -1))
+    {
+        *error_code = errno;
+        return EVENT_SERVER_LISTENER_FAILED;
+    }
+
+    server.scratch = (char *)malloc(EVENT_SERVER_SCRATCH_SIZE);
+    if (server.scratch == NULL)
+    {
+        *error_code = errno;
+        return EVENT_SERVER_EPOLL_FAILED;
+    }
+
+    server.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (server.epfd == -1)
+    {
+        *error_code = errno;
+        free(server.scratch);
+        return EVENT_SERVER_EPOLL_FAILED;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (epoll_ctl(server.epfd, EPOLL_CTL_ADD, sfd, &ev) != 0)
+    {
+        *error_code = errno;
+        close(server.epfd);
+        free(server.scratch);
+        return EVENT_SERVER_EPOLL_FAILED;
+    }
+
+    if (append_sched != NULL)
+    {
+        server.commit_fd = eventfd(0, EFD_CLOEXEC);
+        ev.events = EPOLLIN;
+        ev.data.ptr = (void *)&commit_event_marker;
+        if ((server.commit_fd == -1) || (epoll_ctl(server.epfd, EPOLL_CTL_ADD, server.commit_fd, &ev) != 0))
+        {
+            *error_code = errno;
+            if (server.commit_fd != -1)
+            {
+                close(server.commit_fd);
+            }
+            close(server.epfd);
+            free(server.scratch);
+            return EVENT_SERVER_EPOLL_FAILED;
+        }
+    }
+
+    if ((server.index != NULL) && (record_index_get_ready_fd(server.index) != -1))
+    {
+        ev.events = EPOLLIN;
+        ev.data.ptr = (void *)&index_event_marker;
+        if (epoll_ctl(server.epfd, EPOLL_CTL_ADD, record_index_get_ready_fd(server.index), &ev) != 0)
+        {
+            *error_code = errno;
+            if (server.commit_fd != -1)
+            {
+                close(server.commit_fd);
+            }
+            close(server.epfd);
+            free(server.scratch);
+            return EVENT_SERVER_EPOLL_FAILED;
+        }
+    }
+    else
+    {
+        /* Without a usable index seeks fail right away instead of waiting for a build that never ends */
+        server.index = NULL;
+    }
+
+    if (scheduler != NULL)
+    {
+        ev.events = EPOLLIN;
+        ev.data.ptr = (void *)scheduler;
+        if (epoll_ctl(server.epfd, EPOLL_CTL_ADD, scheduler_get_fd(scheduler), &ev) != 0)
+        {
+            *error_code = errno;
+            close(server.epfd);
+            free(server.scratch);
+            return EVENT_SERVER_EPOLL_FAILED;
+        }
+
+        if ((idle_timeout_sec > 0U) && 
+            (scheduler_add_job(scheduler, "idle-sweep", EVENT_SERVER_IDLE_SWEEP_INTERVAL_MS, 
+                               idle_sweep_job, (void *)&server, error_code) != SCHEDULER_OK))
+        {
+            async_log(LOG_ERR, "idle sweep job setup failed: %s", strerror(*error_code));
+        }
+    }
+
+    while (!*stop)
+    {
+        if ((params->drain != NULL) && *params->drain && !server.draining)
+        {
+            *params->drain = false;
+            if ((params->handoff == NULL) || params->handoff(params->handoff_ctx))
+            {
+                start_draining(&server);
+            }
+        }
+
+        if (server.draining && LIST_EMPTY(&server.conns) && (server.commits_in_flight == 0U))
+        {
+            break;
+        }
+
+        int n_events = epoll_wait(server.epfd, events, EVENT_SERVER_MAX_EVENTS, -1);
+        bool scheduler_due = false;
+        bool commit_due = false;
+        bool index_due = false;
+
+        if (n_events == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            *error_code = errno;
+            ret = EVENT_SERVER_EPOLL_FAILED;
+            break;
+        }
+
+        for (int i = 0; i < n_events; ++i)
+        {
+            if (events[i].data.ptr == NULL)
+            {
+                accept_connections(&server);
+            }
+            else if (events[i].data.ptr == (void *)&commit_event_marker)
+            {
+                commit_due = true;
+            }
+            else if (events[i].data.ptr == (void *)&index_event_marker)
+            {
+                index_due = true;
+            }
+            else if (events[i].data.ptr == (void *)scheduler)
+            {
+                scheduler_due = true;
+            }
+            else
+            {
+                handle_connection(&server, (EventConn_t *)events[i].data.ptr, events[i].events);
+            }
+        }
+
+        /* Completions and jobs may close connections, so they only run once no event of this batch refers to one */
+        if (commit_due)
+        {
+            handle_completed_commits(&server, true);
+        }
+
+        if (index_due)
+        {
+            resume_pending_seeks(&server);
+        }
+
+        if (scheduler_due)
+        {
+            scheduler_dispatch(scheduler);
+        }
+    }
+
+    scheduler_remove_job(scheduler, idle_sweep_job, (void *)&server);
+
+    /* The committer still refers to queued commits, they are only released once they come back */
+    while (server.commits_in_flight > 0U)
+    {
+        handle_completed_commits(&server, false);
+    }
+
+    if (server.commit_fd != -1)
+    {
+        close(server.commit_fd);
+    }
+
+    while (!LIST_EMPTY(&server.conns))
+    {
+        close_connection(&server, LIST_FIRST(&server.conns), false);
+    }
+
+    close(server.epfd);
+    free(server.scratch);
+
+    return ret;
+}
@@ -0,0 +1,306 @@
+/**
+ * \file    handoff.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Listener and data store handoff implementation
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "handoff.h"
+
+#define HANDOFF_NUM_OF_FDS                          (3)
+#define HANDOFF_MAGIC                               (0x41455344U)
+#define HANDOFF_READY                               ('R')
+#define HANDOFF_DELETED_SUFFIX                      " (deleted)"
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t num_of_fds;
+} HandoffHeader_t;
+
+/* Drop the channel option of an earlier handoff, every upgrade appends its own */
+static char **build_successor_argv (char *const argv[], const char *channel)
+{
+    size_t argc = 0U;
+
+    while (argv[argc] != NULL)
+    {
+        argc++;
+    }
+
+    char **new_argv = (char **)calloc(argc + 3U, sizeof(char *));
+    if (new_argv == NULL)
+    {
+        return NULL;
+    }
+
+    size_t n = 0U;
+    for (size_t i = 0U; i < argc; ++i)
+    {
+        if ((strcmp(argv[i], HANDOFF_CHANNEL_OPTION) == 0) && ((i + 1U) < argc))
+        {
+            i++;
+            continue;
+        }
+        new_argv[n++] = argv[i];
+    }
+
+    new_argv[n++] = HANDOFF_CHANNEL_OPTION;
+    new_argv[n++] = (char *)channel;
+    new_argv[n] = NULL;
+
+    return new_argv;
+}
+
+/**
+ * Path of the running binary. A deploy replaces the file, in which case the 
+ * link names the old, deleted inode and the new binary sits at the same path. 
+ */
+static bool resolve_exe_path (char *path, size_t size)
+{
+    ssize_t len = readlink("/proc/self/exe", path, size - 1U);
+
+    if (len <= 0)
+    {
+        return false;
+    }
+
+    path[len] = '\0';
+
+    size_t suffix_len = sizeof(HANDOFF_DELETED_SUFFIX) - 1U;
+    if (((size_t)len > suffix_len) && (strcmp(&path[len - suffix_len], HANDOFF_DELETED_SUFFIX) == 0))
+    {
+        path[len - suffix_len] = '\0';
+    }
+
+    return true;
+}
+
+static int send_state (int channel_fd, const HandoffState_t *state)
+{
+    HandoffHeader_t header = { .magic = HANDOFF_MAGIC, .num_of_fds = HANDOFF_NUM_OF_FDS };
+    int fds[HANDOFF_NUM_OF_FDS] = { state->listener_fd, state->store_fd, state->store_shared_fd };
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { .iov_base = &header, .iov_len = sizeof(header) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, 
+                          .msg_control = control.buf, .msg_controllen = sizeof(control.buf) };
+
+    memset(control.buf, 0, sizeof(control.buf));
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t n_sent;
+    do
+    {
+        n_sent = sendmsg(channel_fd, &msg, MSG_NOSIGNAL);
+    } while ((n_sent == -1) && (errno == EINTR));
+
+    return (n_sent == (ssize_t)sizeof(header)) ? 0 : -1;
+}
+
+static bool wait_ready (int channel_fd)
+{
+    struct pollfd pfd = { .fd = channel_fd, .events = POLLIN };
+    char ready = 0;
+    int rc;
+
+    do
+    {
+        rc = poll(&pfd, 1, HANDOFF_READY_TIMEOUT_MS);
+    } while ((rc == -1) && (errno == EINTR));
+
+    if (rc != 1)
+    {
+        return false;
+    }
+
+    return (read(channel_fd, &ready, sizeof(ready)) == 1) && (ready == HANDOFF_READY);
+}
+
+/**
+ * Closing the channel first makes a successor still waiting for the state give up instead of adopting 
+ * the listener and store late, and the signal stops one that already did. 
+ */
+static void stop_successor (int channel_fd, pid_t pid)
+{
+    int saved_errno = errno;
+
+    close(channel_fd);
+    kill(pid, SIGTERM);
+    while ((waitpid(pid, NULL, 0) == -1) && (errno == EINTR))
+    {
+    }
+
+    errno = saved_errno;
+}
+
+int handoff_start_successor (char *const argv[], const HandoffState_t *state, pid_t *successor, int *error_code)
+{
+    int channel[2];
+    char channel_arg[16];
+    char exe_path[PATH_MAX];
+
+    if ((argv == NULL) || (state == NULL) || (successor == NULL) || (error_code == NULL))
+    {
+        return HANDOFF_INVALID_PARAM;
+    }
+
+    *error_code = 0;
+
+    if (!resolve_exe_path(exe_path, sizeof(exe_path)))
+    {
+        *error_code = errno;
+        return HANDOFF_SPAWN_FAILED;
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channel) == -1)
+    {
+        *error_code = errno;
+        return HANDOFF_SOCKETPAIR_FAILED;
+    }
+
+    snprintf(channel_arg, sizeof(channel_arg), "%d", channel[1]);
+    char **new_argv = build_successor_argv(argv, channel_arg);
+    if (new_argv == NULL)
+    {
+        *error_code = ENOMEM;
+        close(channel[0]);
+        close(channel[1]);
+        return HANDOFF_SPAWN_FAILED;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        /* Only the successor's end of the channel survives the exec */
+        fcntl(channel[1], F_SETFD, 0);
+        execv(exe_path, new_argv);
+        _exit(127);
+    }
+
+    free(new_argv);
+    close(channel[1]);
+
+    if (pid == -1)
+    {
+        *error_code = errno;
+        close(channel[0]);
+        return HANDOFF_SPAWN_FAILED;
+    }
+
+    if (send_state(channel[0], state) != 0)
+    {
+        *error_code = errno;
+        stop_successor(channel[0], pid);
+        return HANDOFF_SEND_FAILED;
+    }
+
+    if (!wait_ready(channel[0]))
+    {
+        stop_successor(channel[0], pid);
+        return HANDOFF_NOT_READY;
+    }
+
+    close(channel[0]);
+    *successor = pid;
+
+    return HANDOFF_OK;
+}
+
+int handoff_receive (int channel_fd, HandoffState_t *state, int *error_code)
+{
+    HandoffHeader_t header = { 0 };
+    int fds[HANDOFF_NUM_OF_FDS];
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { .iov_base = &header, .iov_len = sizeof(header) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, 
+                          .msg_control = control.buf, .msg_controllen = sizeof(control.buf) };
+
+    if ((state == NULL) || (error_code == NULL))
+    {
+        return HANDOFF_INVALID_PARAM;
+    }
+
+    *error_code = 0;
+
+    ssize_t n_recv;
+    do
+    {
+        n_recv = recvmsg(channel_fd, &msg, MSG_CMSG_CLOEXEC);
+    } while ((n_recv == -1) && (errno == EINTR));
+
+    struct cmsghdr *cmsg = (n_recv == (ssize_t)sizeof(header)) ? CMSG_FIRSTHDR(&msg) : NULL;
+    if ((n_recv == -1) || (cmsg == NULL) || (header.magic != HANDOFF_MAGIC) || 
+        (header.num_of_fds != HANDOFF_NUM_OF_FDS) || (cmsg->cmsg_level != SOL_SOCKET) || 
+        (cmsg->cmsg_type != SCM_RIGHTS) || (cmsg->cmsg_len != CMSG_LEN(sizeof(fds))))
+    {
+        *error_code = (n_recv == -1) ? errno : EPROTO;
+        return HANDOFF_RECV_FAILED;
+    }
+
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    state->listener_fd = fds[0];
+    state->store_fd = fds[1];
+    state->store_shared_fd = fds[2];
+
+    return HANDOFF_OK;
+}
+
+void handoff_ready (int channel_fd)
+{
+    char ready = HANDOFF_READY;
+    ssize_t written = write(channel_fd, &ready, sizeof(ready));
+
+    (void)written;
+    close(channel_fd);
+}
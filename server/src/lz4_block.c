@@ -0,0 +1,303 @@
+/**
+ * \file    lz4_block.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   LZ4 block format compressor and decompressor
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lz4_block.h"
+
+#define MIN_MATCH                   (4U)
+/* The last 5 bytes of a block are always literals */
+#define LAST_LITERALS               (5U)
+/* The last match has to start at least 12 bytes before the end of the block */
+#define MATCH_FIND_LIMIT            (12U)
+#define HASH_LOG                    (12U)
+#define MAX_OFFSET                  (65535U)
+/* Skip faster through incompressible data, one more byte per step every 64 misses */
+#define SKIP_TRIGGER                (6U)
+
+static inline uint32_t read32 (const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+static inline uint32_t hash32 (uint32_t v)
+{
+    return (v * 2654435761U) >> (32U - HASH_LOG);
+}
+
+/**
+ * Lengths which do not fit in their 4 bit token field continue in bytes of 
+ * 255 closed by one below it. 
+ */
+static inline uint8_t *write_length (uint8_t *op, size_t len)
+{
+    while (len >= 255U)
+    {
+        *op++ = 255U;
+        len -= 255U;
+    }
+    *op++ = (uint8_t)len;
+
+    return op;
+}
+
+static uint8_t *write_literals (uint8_t *op, const uint8_t *oend, const uint8_t *anchor, size_t lit_len, 
+                                uint8_t **token)
+{
+    /* Token, literal length bytes and the literals, plus room for the offset and a match length byte */
+    if ((size_t)(oend - op) < (1U + lit_len + (lit_len / 255U) + 1U + 3U))
+    {
+        return NULL;
+    }
+
+    *token = op++;
+    if (lit_len >= 15U)
+    {
+        **token = (uint8_t)(15U << 4);
+        op = write_length(op, lit_len - 15U);
+    }
+    else
+    {
+        **token = (uint8_t)(lit_len << 4);
+    }
+
+    memcpy(op, anchor, lit_len);
+
+    return op + lit_len;
+}
+
+int lz4_block_compress (const char *src, size_t len, char *dst, size_t dst_cap, size_t *out_len)
+{
+    uint32_t table[1U << HASH_LOG];
+    const uint8_t *base = (const uint8_t *)src;
+    const uint8_t *ip = base;
+    const uint8_t *anchor = base;
+    const uint8_t *iend = base + len;
+    uint8_t *op = (uint8_t *)dst;
+    const uint8_t *oend = op + dst_cap;
+    uint8_t *token = NULL;
+
+    if ((src == NULL) || (dst == NULL) || (out_len == NULL) || (len > LZ4_BLOCK_MAX_INPUT))
+    {
+        return LZ4_BLOCK_INVALID_PARAM;
+    }
+
+    if (len > MATCH_FIND_LIMIT)
+    {
+        const uint8_t *mflimit = iend - MATCH_FIND_LIMIT;
+        const uint8_t *matchlimit = iend - LAST_LITERALS;
+        unsigned int misses = 0U;
+
+        memset(table, 0, sizeof(table));
+        table[hash32(read32(ip))] = 0U;
+        ip++;
+
+        while (ip < mflimit)
+        {
+            uint32_t h = hash32(read32(ip));
+            const uint8_t *ref = base + table[h];
+
+            table[h] = (uint32_t)(ip - base);
+            if ((ref >= ip) || ((size_t)(ip - ref) > MAX_OFFSET) || (read32(ref) != read32(ip)))
+            {
+                ip += 1U + (misses++ >> SKIP_TRIGGER);
+                continue;
+            }
+
+            misses = 0U;
+            while ((ip > anchor) && (ref > base) && (ip[-1] == ref[-1]))
+            {
+                ip--;
+                ref--;
+            }
+
+            size_t match_len = MIN_MATCH;
+            while (((ip + match_len) < matchlimit) && (ip[match_len] == ref[match_len]))
+            {
+                match_len++;
+            }
+
+            op = write_literals(op, oend, anchor, (size_t)(ip - anchor), &token);
+            if ((op == NULL) || ((size_t)(oend - op) < (2U + ((match_len - MIN_MATCH) / 255U) + 1U)))
+            {
+                return LZ4_BLOCK_NO_SPACE;
+            }
+
+            uint16_t offset = (uint16_t)(ip - ref);
+            *op++ = (uint8_t)offset;
+            *op++ = (uint8_t)(offset >> 8);
+
+            if ((match_len - MIN_MATCH) >= 15U)
+            {
+                *token |= 15U;
+                op = write_length(op, match_len - MIN_MATCH - 15U);
+            }
+            else
+            {
+                *token |= (uint8_t)(match_len - MIN_MATCH);
+            }
+
+            ip += match_len;
+            anchor = ip;
+
+            if (ip < mflimit)
+            {
+                /* Positions inside the match were skipped, index one so the next line can refer back to it */
+                table[hash32(read32(ip - 2))] = (uint32_t)(ip - 2 - base);
+            }
+        }
+    }
+
+    size_t lit_len = (size_t)(iend - anchor);
+    if ((size_t)(oend - op) < (1U + lit_len + (lit_len / 255U) + 1U))
+    {
+        return LZ4_BLOCK_NO_SPACE;
+    }
+
+    token = op++;
+    if (lit_len >= 15U)
+    {
+        *token = (uint8_t)(15U << 4);
+        op = write_length(op, lit_len - 15U);
+    }
+    else
+    {
+        *token = (uint8_t)(lit_len << 4);
+    }
+    memcpy(op, anchor, lit_len);
+    op += lit_len;
+
+    *out_len = (size_t)(op - (uint8_t *)dst);
+
+    return LZ4_BLOCK_OK;
+}
+
+/**
+ * @return false if the length bytes run past @param iend 
+ */
+static inline bool read_length (const uint8_t **ip, const uint8_t *iend, size_t *len)
+{
+    uint8_t b;
+
+    do
+    {
+        if (*ip >= iend)
+        {
+            return false;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255U);
+
+    return true;
+}
+
+int lz4_block_decompress (const char *src, size_t len, char *dst, size_t dst_cap, size_t *out_len)
+{
+    const uint8_t *ip = (const uint8_t *)src;
+    const uint8_t *iend = ip + len;
+    uint8_t *op = (uint8_t *)dst;
+    uint8_t *oend = op + dst_cap;
+
+    if ((src == NULL) || (dst == NULL) || (out_len == NULL))
+    {
+        return LZ4_BLOCK_INVALID_PARAM;
+    }
+
+    while (ip < iend)
+    {
+        uint8_t token = *ip++;
+        size_t lit_len = token >> 4;
+
+        if ((lit_len == 15U) && !read_length(&ip, iend, &lit_len))
+        {
+            return LZ4_BLOCK_CORRUPT;
+        }
+
+        if (((size_t)(iend - ip) < lit_len) || ((size_t)(oend - op) < lit_len))
+        {
+            return LZ4_BLOCK_CORRUPT;
+        }
+
+        memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        /* Only the last sequence has no match */
+        if (ip == iend)
+        {
+            break;
+        }
+
+        if ((iend - ip) < 2)
+        {
+            return LZ4_BLOCK_CORRUPT;
+        }
+
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if ((offset == 0U) || (offset > (size_t)(op - (uint8_t *)dst)))
+        {
+            return LZ4_BLOCK_CORRUPT;
+        }
+
+        size_t match_len = token & 15U;
+        if ((match_len == 15U) && !read_length(&ip, iend, &match_len))
+        {
+            return LZ4_BLOCK_CORRUPT;
+        }
+        match_len += MIN_MATCH;
+
+        if ((size_t)(oend - op) < match_len)
+        {
+            return LZ4_BLOCK_CORRUPT;
+        }
+
+        /* Matches may overlap their own output, e.g. a run repeating its last few bytes */
+        const uint8_t *ref = op - offset;
+        for (size_t i = 0U; i < match_len; i++)
+        {
+            op[i] = ref[i];
+        }
+        op += match_len;
+    }
+
+    *out_len = (size_t)(op - (uint8_t *)dst);
+
+    return LZ4_BLOCK_OK;
+}
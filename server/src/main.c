@@ -36,7 +36,6 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <sys/types.h>
-#include <sys/queue.h>
 #include <pthread.h>
 #include <time.h>
 #include <string.h>
@@ -45,13 +44,30 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <signal.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <netdb.h>
+#include <sys/epoll.h>
 
 #include "socket_server.h"
 #include "conn_thread.h"
+#include "conn_table.h"
 #include "resource_utils.h"
+#include "async_log.h"
+#include "data_store.h"
+#include "event_server.h"
+#include "scheduler.h"
+#include "server_stats.h"
+#include "append_sched.h"
+#include "prefork.h"
+#include "handoff.h"
+#include "record_index.h"
+#include "replay_cache.h"
+#include "coro_sched.h"
+#include "record_ring.h"
+#include "adaptive_lock.h"
 
 #define CLEAN_RETURN(collector, ret_code)       \
     cleanup(&collector);                        \
@@ -66,118 +82,300 @@ typedef enum
     SYSTEM_STATE_SOCK_CREATED, 
     SYSTEM_STATE_SOCK_START_LISTENING, 
     SYSTEM_STATE_SOCK_WAITING_CONN, 
+    SYSTEM_STATE_SUPERVISING_WORKERS, 
 } SystemState_t;
 
-typedef struct ThreadNode
+typedef enum
+{
+    SERVER_MODE_THREAD,     /* One thread per connection */
+    SERVER_MODE_EVENT,      /* Single epoll loop, fixed memory budget per idle connection */
+    SERVER_MODE_CORO,       /* Connection handlers as coroutines on one epoll scheduler thread per core */
+} ServerMode_t;
+
+typedef struct
 {
-    pthread_t thread_id;
-    ConnThreadParams_t *thread_params;
-    SLIST_ENTRY(ThreadNode) node;
-} ThreadNode_t;
+    DataStore_t *store;
+    const char *format;
+} TimestampJobParams_t;
 
 typedef struct
 {
-    int output_fd;
-    pthread_mutex_t *mutex;
-} TimerThreadParams_t;
+    DataStore_t *store;
+    AppendScheduler_t *append_sched;
+    RecordIndex_t *index;
+    ReplayCache_t *replay_cache;
+} MetricsJobParams_t;
 
-SLIST_HEAD(slisthead, ThreadNode);
+typedef struct
+{
+    char **argv;
+    int sfd;
+    DataStore_t *store;
+    Scheduler_t *scheduler;
+    TimestampJobParams_t *timestamp_params;
+    MetricsJobParams_t *metrics_params;
+    /* Workers have nothing to hand off, they just drain once the master did */
+    bool is_worker;
+    bool handed_off;
+} UpgradeParams_t;
 
 const static char tempfile[] = "/var/tmp/aesdsocketdata";
+const static char statsfile[] = "/var/tmp/aesdsocketstats";
+const static unsigned int default_timestamp_interval_sec = 10U;
+const static unsigned int metrics_flush_interval_ms = 10000U;
 const static int allocated_chunk_size = 4096;
+const static int replay_chunk_size = 65536;
+const static unsigned int seek_retry_interval_ms = 10U;
+const static int drain_poll_interval_ms = 100;
 const static char rfc2822_compliant_datetime_format[] = "%a, %d %b %Y %T %z\n";
 
-static bool interrupt_signal_received = false;
+static volatile bool interrupt_signal_received = false;
+static volatile bool upgrade_signal_received = false;
 static SystemState_t system_state = SYSTEM_STATE_INIT;
 
+bool parse_server_mode (const char *name, ServerMode_t *mode);
 void signal_handler (int sig);
-void timer_handler (union sigval sigval);
-void handle_completed_threads (struct slisthead *thread_list_head);
+bool start_periodic_jobs (Scheduler_t *scheduler, TimestampJobParams_t *timestamp_params, 
+                          unsigned int timestamp_interval_sec, MetricsJobParams_t *metrics_params);
+void timestamp_job (void *ctx);
+void metrics_flush_job (void *ctx);
+bool setup_worker (ConnTable_t *conn_table, Scheduler_t *scheduler, int sfd, unsigned int worker_id);
+bool start_append_scheduler (AppendScheduler_t *append_sched, DataStore_t *store, 
+                             const AppendSchedConfig_t *config, AppendScheduler_t **active_append_sched);
+bool hand_off_server (void *ctx);
+void start_record_index (RecordIndex_t *index, DataStore_t *store);
+ReplayCache_t *start_replay_cache (ReplayCache_t *cache, DataStore_t *store);
+void start_record_ring (RecordRing_t *ring, DataStore_t *store, bool keep);
+void publish_record (void *ctx, const char *buf, size_t len, off_t offset);
+bool start_coro_runtime (CoroRuntime_t *runtime, ServerMode_t server_mode);
 void *socket_connection_thread (void *params);
+int commit_packet (ConnThreadParams_t *thread_params, const char *buf, size_t len, off_t *size_after, 
+                   int *error_code);
+bool send_compressed_replay (ReplayCache_t *cache, int cfd, off_t start, off_t end);
+int seek_position (RecordIndex_t *index, uint32_t record, uint32_t offset, off_t *position);
+void commit_resume (AppendRequest_t *req);
 
 int main (int argc, char *argv[])
 {
     ResourcesCollector_t main_thread_res_collector;
     int open_file_fd[3] = { -1 , -1, -1 };
     bool run_as_daemon = false;
+    const char *log_path = NULL;
+    ServerMode_t server_mode = SERVER_MODE_THREAD;
+    int opt = 0;
+    bool usage_error = false;
     char port[] = "9000";
     int sfd = -1;
     int cfd = -1;
-    int output_fd = -1;
+    DataStore_t store;
     int rc = 0;
     int error_code = 0;
     struct sockaddr client_addr = { 0 };
     socklen_t client_addrlen = sizeof(client_addr);
     struct sigaction sigact = { 0 };
-    pthread_mutex_t output_file_mutex;
-    struct slisthead thread_list_head;
-    struct slisthead *thread_list_head_ptr = &thread_list_head;
-    ThreadNode_t *last_thread_node = NULL;
+    ConnTable_t conn_table;
+    struct pollfd pfds[3];
     bool unexpected_error = false;
-    struct sigevent sev;
-    TimerThreadParams_t timer_thread_params;
-    timer_t timer_id = 0;
-    struct itimerspec its;
+    Scheduler_t scheduler = { .timer_fd = -1 };
+    TimestampJobParams_t timestamp_params = { .format = rfc2822_compliant_datetime_format };
+    unsigned int timestamp_interval_sec = default_timestamp_interval_sec;
+    unsigned int idle_timeout_sec = 0U;
+    AppendScheduler_t append_sched = { 0 };
+    AppendSchedConfig_t append_sched_config = { 0 };
+    /* Only set when a per-client limit is configured, records go straight to the store otherwise */
+    AppendScheduler_t *active_append_sched = NULL;
+    MetricsJobParams_t metrics_params = { .store = &store };
+    unsigned int num_of_workers = 0U;
+    PreforkRole_t prefork_role = PREFORK_ROLE_MASTER;
+    unsigned int worker_id = 0U;
+    Prefork_t prefork;
+    int handoff_channel_fd = -1;
+    HandoffState_t handoff_state;
+    UpgradeParams_t upgrade_params = { .argv = argv, .store = &store, .scheduler = &scheduler, 
+                                       .timestamp_params = &timestamp_params, .metrics_params = &metrics_params };
+    bool draining = false;
+    bool persist = false;
+    RecordIndex_t record_index = { 0 };
+    ReplayCache_t replay_cache = { .fd = -1 };
+    /* NULL if the cache file could not be created, connections asking for compression then get raw replays */
+    ReplayCache_t *active_replay_cache = NULL;
+    CoroRuntime_t coro_runtime = { 0 };
+    bool drained = false;
+    bool publish_records = false;
+    RecordRing_t record_ring = { .fd = -1 };
 
     openlog(NULL, 0, LOG_USER);
 
     initialize_resource_collector(&main_thread_res_collector, NULL, 0U, 
                                   open_file_fd, sizeof(open_file_fd) / sizeof(open_file_fd[0]));
 
-    rc = pthread_mutex_init(&output_file_mutex, NULL);
-    if (rc != 0)
+    rc = conn_table_init(&conn_table, &error_code);
+    if (rc != CONN_TABLE_SETUP_OK)
     {
-        syslog(LOG_ERR, "mutex init error: %s", strerror(rc));
+        async_log(LOG_ERR, "connection table init error: %s", strerror(error_code));
         closelog();
         return 1;
     }
-    
-    SLIST_INIT(thread_list_head_ptr);
 
-    output_fd = open(tempfile, O_CREAT | O_RDWR | O_TRUNC, S_IRWXU);
-    if (output_fd == -1)
+    sigact.sa_handler = signal_handler;
+
+    if (sigaction(SIGINT, &sigact, NULL) != 0)
     {
-        syslog(LOG_ERR, "open() %s file error: %s", tempfile, strerror(errno));
+        async_log(LOG_ERR, "sigaction() error for SIGINT: %s", strerror(errno));
         closelog();
         return 1;
     }
 
-    register_fd(&main_thread_res_collector, output_fd);
+    if (sigaction(SIGTERM, &sigact, NULL) != 0)
+    {
+        async_log(LOG_ERR, "sigaction() error for SIGTERM: %s", strerror(errno));
+        closelog();
+        return 1;
+    }
 
-    sigact.sa_handler = signal_handler;
+    if (sigaction(SIGUSR2, &sigact, NULL) != 0)
+    {
+        async_log(LOG_ERR, "sigaction() error for SIGUSR2: %s", strerror(errno));
+        closelog();
+        return 1;
+    }
 
-    if (sigaction(SIGINT, &sigact, NULL) != 0)
+    /* sendfile() has no MSG_NOSIGNAL, a peer closing mid-replay must fail the call instead of killing the server */
+    sigact.sa_handler = SIG_IGN;
+    if (sigaction(SIGPIPE, &sigact, NULL) != 0)
     {
-        syslog(LOG_ERR, "sigaction() error for SIGINT: %s", strerror(errno));
+        async_log(LOG_ERR, "sigaction() error for SIGPIPE: %s", strerror(errno));
         closelog();
         return 1;
     }
 
-    if (sigaction(SIGTERM, &sigact, NULL) != 0)
+    while ((opt = getopt(argc, argv, "dl:m:t:f:i:r:R:w:H:psL")) != -1)
     {
-        syslog(LOG_ERR, "sigaction() error for SIGTERM: %s", strerror(errno));
+        switch (opt)
+        {
+        case 'd':
+            run_as_daemon = true;
+            break;
+
+        case 'l':
+            log_path = optarg;
+            break;
+
+        case 'm':
+            if (!parse_server_mode(optarg, &server_mode))
+            {
+                usage_error = true;
+            }
+            break;
+
+        case 't':
+            timestamp_interval_sec = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+
+        case 'f':
+            timestamp_params.format = optarg;
+            break;
+
+        case 'i':
+            idle_timeout_sec = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+
+        case 'r':
+            append_sched_config.bytes_per_sec = strtoull(optarg, NULL, 10);
+            break;
+
+        case 'R':
+            append_sched_config.records_per_sec = strtoull(optarg, NULL, 10);
+            break;
+
+        case 'p':
+            persist = true;
+            break;
+
+        case 's':
+            publish_records = true;
+            break;
+
+        case 'L':
+            /* Wait times are always profiled, hold times cost two clock reads per critical section */
+            lock_stats_set_hold_timing(true);
+            break;
+
+        case 'H':
+            handoff_channel_fd = (int)strtol(optarg, NULL, 10);
+            break;
+
+        case 'w':
+            num_of_workers = (unsigned int)strtoul(optarg, NULL, 10);
+            if (num_of_workers > PREFORK_MAX_WORKERS)
+            {
+                usage_error = true;
+            }
+            break;
+
+        default:
+            usage_error = true;
+            break;
+        }
+    }
+
+    if (usage_error)
+    {
+        async_log(LOG_ERR, "Usage: %s [-d] [-l log_file] [-m thread|event|coro] [-t timestamp_interval_sec] "
+                  "[-f timestamp_format] [-i idle_timeout_sec] [-r client_bytes_per_sec] "
+                  "[-R client_records_per_sec] [-w num_of_workers] [-p] [-s] [-L] "
+                  "[-H handoff_channel_fd]", argv[0]);
+        cleanup(&main_thread_res_collector);
         closelog();
         return 1;
     }
 
-    if ((argc > 1) && (strcmp(argv[1], "-d") == 0))
+    if (handoff_channel_fd != -1)
     {
-        run_as_daemon = true;
+        /* Started by a running server on upgrade: take over its listener and store instead of starting afresh */
+        rc = handoff_receive(handoff_channel_fd, &handoff_state, &error_code);
+        if (rc == HANDOFF_OK)
+        {
+            rc = data_store_adopt(&store, handoff_state.store_fd, handoff_state.store_shared_fd, &error_code);
+        }
+
+        if (rc != HANDOFF_OK)
+        {
+            async_log(LOG_ERR, "handoff from predecessor failed: %s", strerror(error_code));
+            cleanup(&main_thread_res_collector);
+            closelog();
+            return 1;
+        }
+
+        sfd = handoff_state.listener_fd;
+        register_fd(&main_thread_res_collector, sfd);
+        upgrade_params.sfd = sfd;
+        /* Already detached if the predecessor ran as a daemon */
+        run_as_daemon = false;
+        system_state = SYSTEM_STATE_SOCK_CREATED;
+    }
+    else
+    {
+        rc = data_store_open(&store, tempfile, persist, &error_code);
+        if (rc != DATA_STORE_OK)
+        {
+            async_log(LOG_ERR, "data store %s open error: %s", tempfile, strerror(error_code));
+            cleanup(&main_thread_res_collector);
+            closelog();
+            return 1;
+        }
     }
-    
-    memset(&sev, 0, sizeof(sev));
-    timer_thread_params.mutex = &output_file_mutex;
-    timer_thread_params.output_fd = output_fd;
-    sev.sigev_notify = SIGEV_THREAD;
-    sev.sigev_value.sival_ptr = (void *)&timer_thread_params;
-    sev.sigev_notify_function = timer_handler;
 
-    its.it_value.tv_sec = 10;
-    its.it_value.tv_nsec = 0;
-    its.it_interval.tv_sec = its.it_value.tv_sec;
-    its.it_interval.tv_nsec = its.it_value.tv_nsec;
+    if (publish_records)
+    {
+        /* Records already in the store or published by the predecessor stay in the ring */
+        start_record_ring(&record_ring, &store, persist || (handoff_channel_fd != -1));
+    }
+    
+    /* Load the timezone once, localtime_r() then reuses it on every tick */
+    tzset();
 
-    while ((interrupt_signal_received == false) && (unexpected_error == false))
+    while ((interrupt_signal_received == false) && (unexpected_error == false) && (drained == false))
     {
         switch (system_state)
         {
@@ -186,25 +384,26 @@ int main (int argc, char *argv[])
             switch (rc)
             {
             case SOCKET_SERVER_SETUP_OK: 
-                syslog(LOG_INFO, "Socket server created! ");
+                async_log(LOG_INFO, "Socket server created! ");
                 register_fd(&main_thread_res_collector, sfd);
+                upgrade_params.sfd = sfd;
                 system_state = SYSTEM_STATE_SOCK_CREATED;
                 break;
             
             case SOCKET_SERVER_GET_ADDRINFO_FAILED: 
-                syslog(LOG_ERR, "getaddrinfo error: %s", gai_strerror(error_code));
+                async_log(LOG_ERR, "getaddrinfo error: %s", gai_strerror(error_code));
                 break;
             
             case SOCKET_SERVER_CREATE_FAILED: 
-                syslog(LOG_ERR, "Socket creation error: %s", strerror(error_code));
+                async_log(LOG_ERR, "Socket creation error: %s", strerror(error_code));
                 break;
             
             case SOCKET_SERVER_BIND_FAILED: 
-                syslog(LOG_ERR, "socket binding error: %s", strerror(error_code));
+                async_log(LOG_ERR, "socket binding error: %s", strerror(error_code));
                 break;
             
             case SOCKET_SERVER_INVALID_PARAM: 
-                syslog(LOG_ERR, "Invalid param for create_socket_server()");
+                async_log(LOG_ERR, "Invalid param for create_socket_server()");
                 break;
             
             default:
@@ -223,7 +422,7 @@ int main (int argc, char *argv[])
                     break;
 
                 case -1:
-                    syslog(LOG_ERR, "fork() error: %s", strerror(errno));
+                    async_log(LOG_ERR, "fork() error: %s", strerror(errno));
                     break;
                 
                 default:
@@ -237,21 +436,26 @@ int main (int argc, char *argv[])
 
             if (system_state == SYSTEM_STATE_SOCK_START_LISTENING)
             {
-                rc = timer_create(CLOCK_MONOTONIC, &sev, &timer_id);
-                if (rc != 0)
+                /* The drainer thread has to be started after fork() to exist in the daemon */
+                rc = async_log_start(log_path, &error_code);
+                if (rc != ASYNC_LOG_SETUP_OK)
                 {
-                    syslog(LOG_ERR, "timer creation failed: %s", strerror(errno));
-                    cleanup(&main_thread_res_collector);
-                    closelog();
-                    return 1;
+                    async_log(LOG_ERR, "async log start failed (%d): %s, logging synchronously", 
+                              rc, strerror(error_code));
                 }
 
-                rc = timer_settime(timer_id, 0, &its, NULL);
-                if (rc != 0)
+                /* Workers count into the same snapshot the master flushes */
+                if ((num_of_workers > 0U) && !server_stats_share())
                 {
-                    syslog(LOG_ERR, "timer creation failed: %s", strerror(errno));
-                    timer_delete(timer_id);
+                    async_log(LOG_ERR, "server stats mapping failed: %s", strerror(errno));
+                }
+
+                if (!start_periodic_jobs(&scheduler, &timestamp_params, timestamp_interval_sec, &metrics_params))
+                {
+                    scheduler_destroy(&scheduler);
+                    data_store_close(&store);
                     cleanup(&main_thread_res_collector);
+                    async_log_stop();
                     closelog();
                     return 1;
                 }
@@ -262,67 +466,216 @@ int main (int argc, char *argv[])
             rc = listen(sfd, SOMAXCONN);
             if (rc == -1)
             {
-                syslog(LOG_ERR, "listen() error: %s", strerror(errno));
+                async_log(LOG_ERR, "listen() error: %s", strerror(errno));
+                break;
             }
-            else
+
+            if (handoff_channel_fd != -1)
             {
-                system_state = SYSTEM_STATE_SOCK_WAITING_CONN;
+                /* The listener never closed, the predecessor stops accepting once it reads this */
+                handoff_ready(handoff_channel_fd);
+                handoff_channel_fd = -1;
+                async_log(LOG_INFO, "Took over the listener from the previous server");
+            }
+
+            if (num_of_workers > 0U)
+            {
+                prefork_init(&prefork, num_of_workers);
+                system_state = SYSTEM_STATE_SUPERVISING_WORKERS;
+                break;
+            }
+
+            if (!start_append_scheduler(&append_sched, &store, &append_sched_config, &active_append_sched))
+            {
+                unexpected_error = true;
+                break;
+            }
+            metrics_params.append_sched = active_append_sched;
+            start_record_index(&record_index, &store);
+            metrics_params.index = &record_index;
+            active_replay_cache = start_replay_cache(&replay_cache, &store);
+            metrics_params.replay_cache = active_replay_cache;
+            if (!start_coro_runtime(&coro_runtime, server_mode))
+            {
+                unexpected_error = true;
+                break;
             }
+
+            system_state = SYSTEM_STATE_SOCK_WAITING_CONN;
             break;
         
+        case SYSTEM_STATE_SUPERVISING_WORKERS:
+            /* The master stays in here supervising until it is told to stop or upgrade */
+            rc = prefork_run(&prefork, &scheduler, &interrupt_signal_received, &upgrade_signal_received, 
+                             &prefork_role, &worker_id, &error_code);
+            if (rc != PREFORK_OK)
+            {
+                async_log(LOG_ERR, "prefork error: %s", strerror(error_code));
+                prefork_stop(&prefork, SIGTERM);
+                unexpected_error = true;
+                break;
+            }
+
+            if (prefork_role == PREFORK_ROLE_WORKER)
+            {
+                upgrade_params.is_worker = true;
+                /* Every worker runs its own committer thread */
+                if (!setup_worker(&conn_table, &scheduler, sfd, worker_id) || 
+                    !start_append_scheduler(&append_sched, &store, &append_sched_config, &active_append_sched))
+                {
+                    unexpected_error = true;
+                    break;
+                }
+                start_record_index(&record_index, &store);
+                active_replay_cache = start_replay_cache(&replay_cache, &store);
+                if (!start_coro_runtime(&coro_runtime, server_mode))
+                {
+                    unexpected_error = true;
+                    break;
+                }
+                system_state = SYSTEM_STATE_SOCK_WAITING_CONN;
+                break;
+            }
+
+            if (upgrade_signal_received)
+            {
+                upgrade_signal_received = false;
+                if (hand_off_server(&upgrade_params))
+                {
+                    /* Workers take SIGUSR2 as drain, their connections stay up until the clients are done */
+                    prefork_stop(&prefork, SIGUSR2);
+                    drained = true;
+                }
+                break;
+            }
+
+            prefork_stop(&prefork, SIGTERM);
+            break;
+
         case SYSTEM_STATE_SOCK_WAITING_CONN:
+            if (server_mode == SERVER_MODE_EVENT)
+            {
+                EventServerParams_t event_params = { .sfd = sfd, .store = &store, .scheduler = &scheduler, 
+                                                     .append_sched = active_append_sched, 
+                                                     .index = &record_index, 
+                                                     .replay_cache = active_replay_cache, 
+                                                     .idle_timeout_sec = idle_timeout_sec, 
+                                                     .stop = &interrupt_signal_received, 
+                                                     .drain = &upgrade_signal_received, 
+                                                     .handoff = hand_off_server, .handoff_ctx = &upgrade_params };
+                rc = run_event_server(&event_params, &error_code);
+                if (rc != EVENT_SERVER_OK)
+                {
+                    async_log(LOG_ERR, "event server error: %s", strerror(error_code));
+                    unexpected_error = true;
+                }
+                else if (!interrupt_signal_received)
+                {
+                    drained = true;
+                }
+                break;
+            }
+
+            if (upgrade_signal_received && !draining)
+            {
+                upgrade_signal_received = false;
+                draining = hand_off_server(&upgrade_params);
+            }
+
+            /* Once handed off, exit as soon as the last connection finished */
+            if (draining && (conn_table.num_in_use == 0U) && 
+                ((server_mode != SERVER_MODE_CORO) || (coro_sched_count(&coro_runtime) == 0U)))
+            {
+                drained = true;
+                break;
+            }
+
+            /* poll() skips negative descriptors, so a draining server stops accepting */
+            pfds[0].fd = draining ? -1 : sfd;
+            pfds[0].events = POLLIN;
+            pfds[1].fd = conn_table.completion_fd;
+            pfds[1].events = POLLIN;
+            pfds[2].fd = scheduler_get_fd(&scheduler);
+            pfds[2].events = POLLIN;
+
+            /* Finished coroutines do not signal the main thread, a draining server checks on them periodically */
+            rc = poll(pfds, sizeof(pfds) / sizeof(pfds[0]), 
+                      (draining && (server_mode == SERVER_MODE_CORO)) ? drain_poll_interval_ms : -1);
+            if (rc == -1)
+            {
+                if (errno != EINTR)
+                {
+                    async_log(LOG_ERR, "poll() error: %s", strerror(errno));
+                }
+                break;
+            }
+
+            /* Finished connections are reaped as soon as they signal completion */
+            if (pfds[1].revents & POLLIN)
+            {
+                conn_table_reap_completed(&conn_table);
+            }
+
+            if (pfds[2].revents & POLLIN)
+            {
+                scheduler_dispatch(&scheduler);
+            }
+
+            if ((pfds[0].revents & POLLIN) == 0)
+            {
+                break;
+            }
+
             rc = wait_connection(sfd, &cfd, &client_addr, &client_addrlen, &error_code);
             if (rc == SOCKET_SERVER_WAIT_CONN_OK)
             {
                 char client_ipv4[16] = { 0 };
-                pthread_t thread_id;
+                ConnHandle_t handle = CONN_TABLE_INVALID_HANDLE;
                 rc = getnameinfo(&client_addr, client_addrlen, client_ipv4, sizeof(client_ipv4), NULL, 0, NI_NUMERICHOST);
                 if (rc == -1)
                 {
-                    syslog(LOG_ERR, "getnameinfo() error: %s", strerror(errno));
+                    async_log(LOG_ERR, "getnameinfo() error: %s", strerror(errno));
                 }
                 else
                 {
-                    syslog(LOG_INFO, "Accepted connection from %s", client_ipv4);
+                    async_log(LOG_INFO, "Accepted connection from %s", client_ipv4);
                 }
 
-                handle_completed_threads(thread_list_head_ptr);
+                server_stats_inc(&server_stats->connections_accepted, 1UL);
+                server_stats_inc(&server_stats->connections_active, 1UL);
+
+                ConnThreadParams_t thread_params = { .client_fd = cfd, .store = &store, 
+                                                     .append_sched = active_append_sched, .index = &record_index, 
+                                                     .replay_cache = active_replay_cache };
+                memcpy(thread_params.client_ipv4, client_ipv4, sizeof(thread_params.client_ipv4));
 
-                ConnThreadParams_t *thread_params = NULL;
-                if (spawn_connection_thread(&thread_id, socket_connection_thread, client_ipv4, cfd, 
-                                            output_fd, &output_file_mutex, &thread_params, &error_code))
+                bool spawned = false;
+                if (server_mode == SERVER_MODE_CORO)
                 {
-                    ThreadNode_t *thread_node = (ThreadNode_t *)malloc(sizeof(ThreadNode_t));
-                    if (thread_node == NULL)
-                    {
-                        syslog(LOG_ERR, "malloc for next thread id failed: %s", strerror(errno));
-                        unexpected_error = true;
-                    }
-                    else
-                    {
-                        thread_node->thread_id = thread_id;
-                        thread_node->thread_params = thread_params;
-                        if (SLIST_EMPTY(thread_list_head_ptr))
-                        {
-                            SLIST_INSERT_HEAD(thread_list_head_ptr, thread_node, node);
-                        }
-                        else
-                        {
-                            SLIST_INSERT_AFTER(last_thread_node, thread_node, node);
-                        }
-
-                        last_thread_node = thread_node;
-                    }
+                    int flags = fcntl(cfd, F_GETFL);
+                    error_code = errno;
+                    spawned = (flags != -1) && (fcntl(cfd, F_SETFL, flags | O_NONBLOCK) != -1) && 
+                              spawn_connection_coro(&coro_runtime, socket_connection_thread, &thread_params, 
+                                                    &error_code);
                 }
                 else
                 {
-                    syslog(LOG_ERR, "New thread creation failed: %s", strerror(error_code));
+                    spawned = spawn_connection_thread(&conn_table, socket_connection_thread, &thread_params, 
+                                                      &handle, &error_code);
+                }
+
+                if (!spawned)
+                {
+                    async_log(LOG_ERR, "New thread creation failed: %s", strerror(error_code));
+                    server_stats_dec(&server_stats->connections_active);
+                    close(cfd);
                     unexpected_error = true;
                 }
             }
-            else
+            else if ((error_code != EAGAIN) && (error_code != EWOULDBLOCK))
             {
-                syslog(LOG_ERR, "connection accept error: %s", strerror(error_code));
+                /* Prefork workers race on a non-blocking listener, losing the race is not an error */
+                async_log(LOG_ERR, "connection accept error: %s", strerror(error_code));
             }
             break;
         }
@@ -330,22 +683,34 @@ int main (int argc, char *argv[])
 
     if (interrupt_signal_received)
     {
-        syslog(LOG_INFO, "Caught signal, exiting");
+        async_log(LOG_INFO, "Caught signal, exiting");
     }
-
-    ThreadNode_t *tmp_node = thread_list_head_ptr->slh_first;
-    while (tmp_node)
+    else if (drained)
     {
-        pthread_join(tmp_node->thread_id, NULL);
-        free(tmp_node->thread_params);
-        SLIST_REMOVE(thread_list_head_ptr, tmp_node, ThreadNode, node);
-        free(tmp_node);
-        tmp_node = thread_list_head_ptr->slh_first;
+        async_log(LOG_INFO, "Connections drained, exiting");
     }
 
-    pthread_mutex_destroy(&output_file_mutex);
+    conn_table_destroy(&conn_table);
+    coro_sched_stop(&coro_runtime);
+    record_index_stop(&record_index);
+    replay_cache_destroy(active_replay_cache);
+
     cleanup(&main_thread_res_collector);
-    timer_delete(timer_id);
+    scheduler_destroy(&scheduler);
+    /* After a handoff the stats file belongs to the successor */
+    if ((prefork_role == PREFORK_ROLE_MASTER) && !upgrade_params.handed_off)
+    {
+        server_stats_flush(statsfile, &store, metrics_params.append_sched, metrics_params.index, 
+                           metrics_params.replay_cache);
+    }
+    append_sched_stop(active_append_sched);
+    data_store_close(&store);
+    record_ring_close(&record_ring);
+    if (publish_records && (prefork_role == PREFORK_ROLE_MASTER) && !upgrade_params.handed_off)
+    {
+        shm_unlink(RECORD_RING_NAME);
+    }
+    async_log_stop();
     closelog();
 
     if (unexpected_error)
@@ -356,55 +721,279 @@ int main (int argc, char *argv[])
     return 0;
 }
 
+bool parse_server_mode (const char *name, ServerMode_t *mode)
+{
+    if (strcmp(name, "thread") == 0)
+    {
+        *mode = SERVER_MODE_THREAD;
+    }
+    else if (strcmp(name, "event") == 0)
+    {
+        *mode = SERVER_MODE_EVENT;
+    }
+    else if (strcmp(name, "coro") == 0)
+    {
+        *mode = SERVER_MODE_CORO;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
 void signal_handler (int sig)
 {
     if ((sig == SIGINT) || (sig == SIGTERM))
     {
         interrupt_signal_received = true;
     }
+    else if (sig == SIGUSR2)
+    {
+        upgrade_signal_received = true;
+    }
 }
 
-void timer_handler (union sigval sigval)
+bool start_periodic_jobs (Scheduler_t *scheduler, TimestampJobParams_t *timestamp_params, 
+                          unsigned int timestamp_interval_sec, MetricsJobParams_t *metrics_params)
 {
-    char cur_timestamp[64] = TIMESTAMP_PREFIX;
-    TimerThreadParams_t *thread_params = (TimerThreadParams_t *)sigval.sival_ptr;
+    int error_code = 0;
+    int rc = scheduler_init(scheduler, &error_code);
 
-    time_t t = time(NULL);
-    struct tm *tm = localtime(&t);
-    size_t n_byte = strftime(&cur_timestamp[TIMESTAMP_PREFIX_LEN], sizeof(cur_timestamp) - TIMESTAMP_PREFIX_LEN, 
-                             rfc2822_compliant_datetime_format, tm);
+    if (rc != SCHEDULER_OK)
+    {
+        async_log(LOG_ERR, "scheduler init failed: %s", strerror(error_code));
+        return false;
+    }
+
+    timestamp_params->store = metrics_params->store;
+    if (timestamp_interval_sec > 0U)
+    {
+        rc = scheduler_add_job(scheduler, "timestamp", timestamp_interval_sec * 1000U, 
+                               timestamp_job, (void *)timestamp_params, &error_code);
+        if (rc != SCHEDULER_OK)
+        {
+            async_log(LOG_ERR, "timestamp job setup failed (%d): %s", rc, strerror(error_code));
+            return false;
+        }
+    }
 
-    pthread_mutex_lock(thread_params->mutex);
-    ssize_t written = write(thread_params->output_fd, cur_timestamp, strlen(cur_timestamp));
-    pthread_mutex_unlock(thread_params->mutex);
+    rc = scheduler_add_job(scheduler, "metrics", metrics_flush_interval_ms, 
+                           metrics_flush_job, (void *)metrics_params, &error_code);
+    if (rc != SCHEDULER_OK)
+    {
+        async_log(LOG_ERR, "metrics job setup failed (%d): %s", rc, strerror(error_code));
+        return false;
+    }
+
+    return true;
 }
 
-void handle_completed_threads (struct slisthead *thread_list_head)
+void timestamp_job (void *ctx)
 {
-    if (thread_list_head == NULL)
+    char cur_timestamp[128] = TIMESTAMP_PREFIX;
+    TimestampJobParams_t *params = (TimestampJobParams_t *)ctx;
+    struct tm tm;
+    int error_code = 0;
+
+    time_t t = time(NULL);
+    localtime_r(&t, &tm);
+    size_t n_byte = strftime(&cur_timestamp[TIMESTAMP_PREFIX_LEN], sizeof(cur_timestamp) - TIMESTAMP_PREFIX_LEN, 
+                             params->format, &tm);
+    if (n_byte == 0U)
     {
+        ASYNC_LOG_RATELIMITED(LOG_ERR, "strftime() produced no output for format %s", params->format);
         return;
     }
 
-    ThreadNode_t *node;
-    ThreadNode_t *prev_node = thread_list_head->slh_first;
-    SLIST_FOREACH(node, thread_list_head, node)
+    n_byte += TIMESTAMP_PREFIX_LEN;
+    if (cur_timestamp[n_byte - 1] != '\n')
     {
-        if (node->thread_params->done)
-        {
-            pthread_join(node->thread_id, NULL);
-            free(node->thread_params);
-            SLIST_REMOVE(thread_list_head, node, ThreadNode, node);
-            free(node);
-            node = prev_node;
-        }
-        else
+        if (n_byte == (sizeof(cur_timestamp) - 1U))
         {
-            prev_node = node;
+            n_byte--;
         }
+        cur_timestamp[n_byte++] = '\n';
+    }
+
+    if (data_store_append(params->store, cur_timestamp, n_byte, NULL, &error_code) != DATA_STORE_OK)
+    {
+        ASYNC_LOG_RATELIMITED(LOG_ERR, "timestamp write error: %s", strerror(error_code));
+    }
+}
+
+void metrics_flush_job (void *ctx)
+{
+    MetricsJobParams_t *params = (MetricsJobParams_t *)ctx;
+
+    if (!server_stats_flush(statsfile, params->store, params->append_sched, params->index, params->replay_cache))
+    {
+        ASYNC_LOG_RATELIMITED(LOG_ERR, "metrics flush to %s failed: %s", statsfile, strerror(errno));
     }
 }
 
+bool setup_worker (ConnTable_t *conn_table, Scheduler_t *scheduler, int sfd, unsigned int worker_id)
+{
+    int error_code = 0;
+    int rc = async_log_restart_in_child(&error_code);
+
+    if (rc != ASYNC_LOG_SETUP_OK)
+    {
+        async_log(LOG_ERR, "async log restart failed (%d): %s, logging synchronously", rc, strerror(error_code));
+    }
+
+    /* Periodic jobs stay with the master, the worker keeps an empty scheduler for its own jobs */
+    scheduler_destroy(scheduler);
+    rc = scheduler_init(scheduler, &error_code);
+    if (rc != SCHEDULER_OK)
+    {
+        async_log(LOG_ERR, "worker %u scheduler init failed: %s", worker_id, strerror(error_code));
+        return false;
+    }
+
+    /* The completion eventfd inherited from the master would be shared with every other worker */
+    conn_table_destroy(conn_table);
+    rc = conn_table_init(conn_table, &error_code);
+    if (rc != CONN_TABLE_SETUP_OK)
+    {
+        async_log(LOG_ERR, "worker %u connection table init error: %s", worker_id, strerror(error_code));
+        return false;
+    }
+
+    int flags = fcntl(sfd, F_GETFL);
+    if ((flags == -1) || (fcntl(sfd, F_SETFL, flags | O_NONBLOCK) == -1))
+    {
+        async_log(LOG_ERR, "worker %u listener setup error: %s", worker_id, strerror(errno));
+        return false;
+    }
+
+    async_log(LOG_INFO, "worker %u (pid %d) accepting connections", worker_id, (int)getpid());
+
+    return true;
+}
+
+bool start_append_scheduler (AppendScheduler_t *append_sched, DataStore_t *store, 
+                             const AppendSchedConfig_t *config, AppendScheduler_t **active_append_sched)
+{
+    int error_code = 0;
+
+    if ((config->bytes_per_sec == 0U) && (config->records_per_sec == 0U))
+    {
+        return true;
+    }
+
+    int rc = append_sched_start(append_sched, store, config, &error_code);
+    if (rc != APPEND_SCHED_OK)
+    {
+        async_log(LOG_ERR, "append scheduler start failed: %s", strerror(error_code));
+        return false;
+    }
+
+    *active_append_sched = append_sched;
+
+    return true;
+}
+
+void start_record_index (RecordIndex_t *index, DataStore_t *store)
+{
+    int error_code = 0;
+    int rc = record_index_start(index, store, &error_code);
+
+    /* Only seek commands depend on the index, the server keeps storing records without it */
+    if (rc != RECORD_INDEX_OK)
+    {
+        async_log(LOG_ERR, "record index start failed (%d): %s", rc, strerror(error_code));
+    }
+}
+
+ReplayCache_t *start_replay_cache (ReplayCache_t *cache, DataStore_t *store)
+{
+    int error_code = 0;
+    int rc = replay_cache_init(cache, store, &error_code);
+
+    if (rc != REPLAY_CACHE_OK)
+    {
+        async_log(LOG_ERR, "replay cache init failed (%d): %s, replays stay uncompressed", rc, strerror(error_code));
+        return NULL;
+    }
+
+    return cache;
+}
+
+void start_record_ring (RecordRing_t *ring, DataStore_t *store, bool keep)
+{
+    int error_code = 0;
+    int rc = record_ring_open(ring, RECORD_RING_NAME, keep, &error_code);
+
+    /* Local readers lose their shortcut, clients over TCP are not affected */
+    if (rc != RECORD_RING_OK)
+    {
+        async_log(LOG_ERR, "record ring %s open failed (%d): %s, not publishing", 
+                  RECORD_RING_NAME, rc, strerror(error_code));
+        return;
+    }
+
+    data_store_set_publisher(store, publish_record, (void *)ring);
+}
+
+/* Runs with the store mutex held */
+void publish_record (void *ctx, const char *buf, size_t len, off_t offset)
+{
+    record_ring_publish((RecordRing_t *)ctx, buf, len, offset);
+}
+
+bool start_coro_runtime (CoroRuntime_t *runtime, ServerMode_t server_mode)
+{
+    int error_code = 0;
+
+    if (server_mode != SERVER_MODE_CORO)
+    {
+        return true;
+    }
+
+    int rc = coro_sched_start(runtime, 0U, &error_code);
+    if (rc != CORO_SCHED_OK)
+    {
+        async_log(LOG_ERR, "coroutine scheduler start failed (%d): %s", rc, strerror(error_code));
+        return false;
+    }
+
+    async_log(LOG_INFO, "Running connections on %u coroutine scheduler threads", runtime->num_of_threads);
+
+    return true;
+}
+
+bool hand_off_server (void *ctx)
+{
+    UpgradeParams_t *params = (UpgradeParams_t *)ctx;
+    HandoffState_t state = { .listener_fd = params->sfd, .store_fd = params->store->fd, 
+                             .store_shared_fd = params->store->shared_fd };
+    pid_t successor = -1;
+    int error_code = 0;
+
+    if (params->is_worker)
+    {
+        return true;
+    }
+
+    int rc = handoff_start_successor(params->argv, &state, &successor, &error_code);
+    if (rc != HANDOFF_OK)
+    {
+        async_log(LOG_ERR, "upgrade handoff failed (%d): %s, keep serving", rc, strerror(error_code));
+        return false;
+    }
+
+    /* The successor owns the store and runs the periodic jobs from now on */
+    data_store_disown(params->store);
+    scheduler_remove_job(params->scheduler, timestamp_job, (void *)params->timestamp_params);
+    scheduler_remove_job(params->scheduler, metrics_flush_job, (void *)params->metrics_params);
+    params->handed_off = true;
+    async_log(LOG_INFO, "Handed the listener off to pid %d, draining connections", (int)successor);
+
+    return true;
+}
+
 void *socket_connection_thread (void *params)
 {
     ConnThreadParams_t *thread_params = (ConnThreadParams_t *)params;
@@ -417,9 +1006,9 @@ void *socket_connection_thread (void *params)
     int total_byte_read = 0;
     char *buf = NULL;
     int cfd = thread_params->client_fd;
-    int output_fd = thread_params->output_fd;
+    DataStore_t *store = thread_params->store;
     char *client_ipv4 = thread_params->client_ipv4;
-    pthread_mutex_t *mutex = thread_params->mutex;
+    ReplayEncoding_t encoding = REPLAY_ENCODING_RAW;
 
     initialize_resource_collector(&conn_thread_res_collector, allocated_mem_container, 
                                   sizeof(allocated_mem_container) / sizeof(allocated_mem_container[0]), 
@@ -437,8 +1026,8 @@ void *socket_connection_thread (void *params)
             {
                 if (error_code != 0)
                 {
-                    syslog(LOG_ERR, "malloc() for %d bytes failed with error: %s", 
-                           (total_byte_read + allocated_chunk_size), strerror(error_code));
+                    async_log(LOG_ERR, "malloc() for %d bytes failed with error: %s", 
+                              (total_byte_read + allocated_chunk_size), strerror(error_code));
                 }
 
                 CLEAN_RETURN(conn_thread_res_collector, NULL);
@@ -447,7 +1036,7 @@ void *socket_connection_thread (void *params)
             available_space = allocated_chunk_size;
         }
         
-        ssize_t n_read = recv(cfd, &buf[total_byte_read], available_space, MSG_DONTWAIT);
+        ssize_t n_read = coro_recv(cfd, &buf[total_byte_read], available_space, MSG_DONTWAIT);
 
         if (n_read == 0)
         {
@@ -457,7 +1046,13 @@ void *socket_connection_thread (void *params)
 
         if (n_read == -1)
         {
-            syslog(LOG_ERR, "recv() error: %s", strerror(errno));
+            /* The coroutine runtime is stopping */
+            if (errno == ECANCELED)
+            {
+                CLEAN_RETURN(conn_thread_res_collector, NULL);
+            }
+
+            ASYNC_LOG_RATELIMITED(LOG_ERR, "recv() error: %s", strerror(errno));
             continue;
         }
 
@@ -474,39 +1069,73 @@ void *socket_connection_thread (void *params)
             buf[total_byte_read - 1] = '\n';
         }
         
-        pthread_mutex_lock(mutex);
-        ssize_t written = write(output_fd, buf, total_byte_read);
-        pthread_mutex_unlock(mutex);
-        if (written != total_byte_read)
+        off_t replay_start = 0;
+        off_t replay_size = 0;
+        uint32_t seek_record = 0U;
+        uint32_t seek_offset = 0U;
+
+        if (record_index_parse_seek(buf, total_byte_read, &seek_record, &seek_offset))
         {
-            if (written == -1)
+            /* Seek commands are answered from the store and never stored themselves */
+            int rc = seek_position(thread_params->index, seek_record, seek_offset, &replay_start);
+            if (rc != RECORD_INDEX_OK)
             {
-                syslog(LOG_ERR, "write() error: %s", strerror(errno));
+                ASYNC_LOG_RATELIMITED(LOG_ERR, "seek to record %u offset %u failed (%d)", seek_record, seek_offset, rc);
+                free_wrapper(&conn_thread_res_collector, buf);
+                buf = NULL;
+                available_space = 0;
+                total_byte_read = 0;
+                continue;
             }
-            else
+            replay_size = data_store_size(store);
+        }
+        else if (replay_cache_parse_command(buf, total_byte_read, &encoding))
+        {
+            /* Answered with a replay in the new encoding and not stored, without a cache replays stay raw */
+            if (thread_params->replay_cache == NULL)
             {
-                syslog(LOG_ERR, "write() interrupted! ");
+                encoding = REPLAY_ENCODING_RAW;
+            }
+            replay_size = data_store_size(store);
+        }
+        else
+        {
+            int rc = commit_packet(thread_params, buf, total_byte_read, &replay_size, &error_code);
+            if (rc != DATA_STORE_OK)
+            {
+                if (rc == DATA_STORE_WRITE_FAILED)
+                {
+                    async_log(LOG_ERR, "write() error: %s", strerror(error_code));
+                }
+                else
+                {
+                    async_log(LOG_ERR, "write() interrupted! ");
+                }
+
+                CLEAN_RETURN(conn_thread_res_collector, NULL);
             }
 
-            CLEAN_RETURN(conn_thread_res_collector, NULL);
+            server_stats_inc(&server_stats->packets_committed, 1UL);
+            server_stats_inc(&server_stats->bytes_committed, (unsigned long)total_byte_read);
         }
 
         free_wrapper(&conn_thread_res_collector, buf);
+        buf = NULL;
         available_space = 0;
         total_byte_read = 0;
 
-        struct stat statebuf;
-        pthread_mutex_lock(mutex);
-        if (fstat(output_fd, &statebuf) != 0)
+        if (encoding == REPLAY_ENCODING_LZ4)
         {
-            pthread_mutex_unlock(mutex);
-            syslog(LOG_ERR, "fstat() error: %s", strerror(errno));
-            CLEAN_RETURN(conn_thread_res_collector, NULL);
+            if (!send_compressed_replay(thread_params->replay_cache, cfd, replay_start, replay_size))
+            {
+                CLEAN_RETURN(conn_thread_res_collector, NULL);
+            }
+            continue;
         }
-        pthread_mutex_unlock(mutex);
 
-        int n_byte = statebuf.st_size;
-        buf = NULL;
+        /* Committed bytes never change, so the replay reads its snapshot without holding the store lock */
+        off_t replay_len = replay_size - replay_start;
+        int n_byte = (replay_len < replay_chunk_size) ? (int)replay_len : replay_chunk_size;
         while (buf == NULL)
         {
             buf = (char *)malloc_wrapper(&conn_thread_res_collector, buf, n_byte, &error_code);
@@ -518,66 +1147,138 @@ void *socket_connection_thread (void *params)
                 }
                 else
                 {
-                    syslog(LOG_ERR, "malloc() error: %s", strerror(error_code));
+                    async_log(LOG_ERR, "malloc() error: %s", strerror(error_code));
                     CLEAN_RETURN(conn_thread_res_collector, NULL);
                 }
             }
 
             if (n_byte == 0)
             {
-                syslog(LOG_ERR, "System run out of memory to be allocated! ");
+                async_log(LOG_ERR, "System run out of memory to be allocated! ");
                 CLEAN_RETURN(conn_thread_res_collector, NULL);
             }
         }
 
-        pthread_mutex_lock(mutex);
-        if (lseek(output_fd, 0, SEEK_SET) == -1)
+        for (off_t offset = replay_start; offset < replay_size; )
         {
-            pthread_mutex_unlock(mutex);
-            syslog(LOG_ERR, "lseek() error: %s", strerror(errno));
-            CLEAN_RETURN(conn_thread_res_collector, NULL);
-        }
+            size_t to_read = ((replay_size - offset) < n_byte) ? (size_t)(replay_size - offset) : (size_t)n_byte;
+            ssize_t n_read = data_store_read(store, offset, buf, to_read);
 
-        int iteration = (statebuf.st_size + n_byte - 1) / n_byte;
-        
-        for (int i = 0; i < iteration; ++i)
-        {
-            ssize_t n_read = read(output_fd, buf, n_byte);
-            ssize_t n_sent = send(cfd, buf, n_read, 0);
+            if (n_read <= 0)
+            {
+                async_log(LOG_ERR, "read() error: %s", (n_read == -1) ? strerror(errno) : "unexpected end of file");
+                CLEAN_RETURN(conn_thread_res_collector, NULL);
+            }
+
+            ssize_t n_sent = coro_send(cfd, buf, n_read, MSG_NOSIGNAL);
 
             if (n_sent != n_read)
             {
-                pthread_mutex_unlock(mutex);
                 if (n_sent == -1)
                 {
-                    syslog(LOG_ERR, "send() error: %s", strerror(errno));
+                    async_log(LOG_ERR, "send() error: %s", strerror(errno));
                 }
                 else
                 {
-                    syslog(LOG_ERR, "send() interrupted! ");
+                    async_log(LOG_ERR, "send() interrupted! ");
                 }
 
                 CLEAN_RETURN(conn_thread_res_collector, NULL);
             }
-        }
 
-        if (lseek(output_fd, 0, SEEK_END) == -1)
-        {
-            pthread_mutex_unlock(mutex);
-            syslog(LOG_ERR, "lseek() error: %s", strerror(errno));
-            CLEAN_RETURN(conn_thread_res_collector, NULL);
+            offset += n_read;
         }
-        pthread_mutex_unlock(mutex);
 
         free_wrapper(&conn_thread_res_collector, buf);
+        buf = NULL;
     }
 
     if (!connected)
     {
-        syslog(LOG_INFO, "Closed connection from %s", client_ipv4);
+        async_log(LOG_INFO, "Closed connection from %s", client_ipv4);
     }
 
-    thread_params->done = true;
-
     CLEAN_RETURN(conn_thread_res_collector, NULL);;
 }
+
+int commit_packet (ConnThreadParams_t *thread_params, const char *buf, size_t len, off_t *size_after, 
+                   int *error_code)
+{
+    if ((thread_params->client != NULL) && (coro_self() != NULL))
+    {
+        /* Waiting on the committer in here would stall every coroutine of this scheduler thread */
+        AppendRequest_t req = { .buf = buf, .len = len, .on_done = commit_resume, .ctx = (void *)coro_self() };
+        int rc = append_sched_submit_async(thread_params->append_sched, thread_params->client, &req);
+        if (rc != APPEND_SCHED_OK)
+        {
+            /* Late submitters after shutdown bypass the scheduler */
+            return data_store_append(thread_params->store, buf, len, size_after, error_code);
+        }
+
+        coro_park();
+        *error_code = req.error_code;
+        if (size_after != NULL)
+        {
+            *size_after = req.size_after;
+        }
+        return req.rc;
+    }
+
+    if (thread_params->client != NULL)
+    {
+        return append_sched_submit(thread_params->append_sched, thread_params->client, buf, len, 
+                                   size_after, error_code);
+    }
+
+    return data_store_append(thread_params->store, buf, len, size_after, error_code);
+}
+
+bool send_compressed_replay (ReplayCache_t *cache, int cfd, off_t start, off_t end)
+{
+    CompressedReplay_t *replay = NULL;
+    int error_code = 0;
+    int rc = replay_cache_prepare(cache, start, end, &replay, &error_code);
+
+    if (rc != REPLAY_CACHE_OK)
+    {
+        async_log(LOG_ERR, "compressed replay setup failed (%d): %s", rc, strerror(error_code));
+        return false;
+    }
+
+    /* Blocking sockets only return once everything is out, coroutine sockets wait for room in between */
+    do
+    {
+        rc = replay_cache_send(cache, replay, cfd, &error_code);
+    } while ((rc == REPLAY_CACHE_WOULD_BLOCK) && coro_wait_fd(cfd, EPOLLOUT));
+    free(replay);
+    if (rc != REPLAY_CACHE_OK)
+    {
+        async_log(LOG_ERR, "compressed replay send error: %s", strerror(error_code));
+        return false;
+    }
+
+    return true;
+}
+
+int seek_position (RecordIndex_t *index, uint32_t record, uint32_t offset, off_t *position)
+{
+    if (coro_self() == NULL)
+    {
+        return record_index_seek(index, record, offset, true, position);
+    }
+
+    /* Blocking on the initial build would stall every coroutine of this scheduler thread */
+    int rc = record_index_seek(index, record, offset, false, position);
+    while ((rc == RECORD_INDEX_NOT_READY) && coro_sleep_ms(seek_retry_interval_ms))
+    {
+        rc = record_index_seek(index, record, offset, false, position);
+    }
+
+    return rc;
+}
+
+/* Runs on the committer thread */
+void commit_resume (AppendRequest_t *req)
+{
+    coro_wake((Coro_t *)req->ctx);
+}
@@ -0,0 +1,215 @@
+/**
+ * \file    prefork.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Prefork worker supervisor implementation
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <syslog.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+
+#include "prefork.h"
+#include "async_log.h"
+
+static void sigchld_handler (int sig)
+{
+    /* Only there to interrupt poll() in the master */
+    (void)sig;
+}
+
+static long elapsed_ms (const struct timespec *since)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((now.tv_sec - since->tv_sec) * 1000L) + ((now.tv_nsec - since->tv_nsec) / 1000000L);
+}
+
+static void reap_workers (PreforkWorker_t *workers, unsigned int num_of_workers)
+{
+    int status = 0;
+    pid_t pid;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        for (unsigned int i = 0U; i < num_of_workers; ++i)
+        {
+            if (workers[i].pid != pid)
+            {
+                continue;
+            }
+
+            workers[i].pid = 0;
+            if (WIFSIGNALED(status))
+            {
+                async_log(LOG_ERR, "worker %u (pid %d) killed by signal %d", i, (int)pid, WTERMSIG(status));
+            }
+            else
+            {
+                async_log(LOG_ERR, "worker %u (pid %d) exited with status %d", i, (int)pid, WEXITSTATUS(status));
+            }
+            break;
+        }
+    }
+}
+
+int prefork_init (Prefork_t *prefork, unsigned int num_of_workers)
+{
+    if ((prefork == NULL) || (num_of_workers == 0U) || (num_of_workers > PREFORK_MAX_WORKERS))
+    {
+        return PREFORK_INVALID_PARAM;
+    }
+
+    memset(prefork, 0, sizeof(Prefork_t));
+    prefork->num_of_workers = num_of_workers;
+
+    return PREFORK_OK;
+}
+
+void prefork_stop (Prefork_t *prefork, int sig)
+{
+    PreforkWorker_t *workers = prefork->workers;
+
+    for (unsigned int i = 0U; i < prefork->num_of_workers; ++i)
+    {
+        if (workers[i].pid > 0)
+        {
+            kill(workers[i].pid, sig);
+        }
+    }
+
+    for (unsigned int i = 0U; i < prefork->num_of_workers; ++i)
+    {
+        if (workers[i].pid > 0)
+        {
+            while ((waitpid(workers[i].pid, NULL, 0) == -1) && (errno == EINTR))
+            {
+            }
+            workers[i].pid = 0;
+        }
+    }
+}
+
+int prefork_run (Prefork_t *prefork, Scheduler_t *scheduler, volatile bool *stop, volatile bool *upgrade, 
+                 PreforkRole_t *role, unsigned int *worker_id, int *error_code)
+{
+    struct sigaction sigact = { 0 };
+    struct sigaction old_sigact;
+    int ret = PREFORK_OK;
+
+    if ((prefork == NULL) || (scheduler == NULL) || (stop == NULL) || (upgrade == NULL) || 
+        (role == NULL) || (worker_id == NULL) || (error_code == NULL))
+    {
+        return PREFORK_INVALID_PARAM;
+    }
+
+    PreforkWorker_t *workers = prefork->workers;
+    unsigned int num_of_workers = prefork->num_of_workers;
+
+    *error_code = 0;
+    *role = PREFORK_ROLE_MASTER;
+
+    sigact.sa_handler = sigchld_handler;
+    sigact.sa_flags = SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sigact, &old_sigact);
+
+    while (!*stop && !*upgrade)
+    {
+        reap_workers(workers, num_of_workers);
+
+        for (unsigned int i = 0U; i < num_of_workers; ++i)
+        {
+            if ((workers[i].pid != 0) || 
+                ((workers[i].spawned.tv_sec != 0) && (elapsed_ms(&workers[i].spawned) < PREFORK_RESPAWN_INTERVAL_MS)))
+            {
+                continue;
+            }
+
+            clock_gettime(CLOCK_MONOTONIC, &workers[i].spawned);
+            pid_t master = getpid();
+            pid_t pid = fork();
+
+            if (pid == 0)
+            {
+                sigaction(SIGCHLD, &old_sigact, NULL);
+                /* Workers must not outlive a master killed without a chance to stop them */
+                prctl(PR_SET_PDEATHSIG, SIGTERM);
+                /* The master died before the death signal was armed, checked against its pid as it may be init */
+                if (getppid() != master)
+                {
+                    _exit(0);
+                }
+
+                *role = PREFORK_ROLE_WORKER;
+                *worker_id = i;
+                return PREFORK_OK;
+            }
+
+            if (pid == -1)
+            {
+                *error_code = errno;
+                ASYNC_LOG_RATELIMITED(LOG_ERR, "fork() for worker %u failed: %s", i, strerror(errno));
+                continue;
+            }
+
+            workers[i].pid = pid;
+            async_log(LOG_INFO, "worker %u started with pid %d", i, (int)pid);
+        }
+
+        struct pollfd pfd = { .fd = scheduler_get_fd(scheduler), .events = POLLIN };
+        int rc = poll(&pfd, 1, PREFORK_RESPAWN_INTERVAL_MS);
+
+        if (rc == -1)
+        {
+            if (errno != EINTR)
+            {
+                *error_code = errno;
+                ret = PREFORK_POLL_FAILED;
+                break;
+            }
+            continue;
+        }
+
+        if ((rc > 0) && (pfd.revents & POLLIN))
+        {
+            scheduler_dispatch(scheduler);
+        }
+    }
+
+    sigaction(SIGCHLD, &old_sigact, NULL);
+
+    return ret;
+}
@@ -0,0 +1,516 @@
+/**
+ * \file    record_index.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Record index implementation
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#include "record_index.h"
+#include "async_log.h"
+
+#define RECORD_INDEX_SEEK_COMMAND_LEN               (sizeof(RECORD_INDEX_SEEK_COMMAND) - 1U)
+#define RECORD_INDEX_READ_CHUNK                     (4096U)
+
+typedef struct
+{
+    /* Mapping of the store starting at file offset map_offset */
+    const char *map;
+    off_t map_offset;
+    /* Records starting in [start, end) belong to this scan, they may run on up to total_end */
+    off_t start;
+    off_t end;
+    off_t total_end;
+    bool collect;
+    uint64_t first_record;
+    uint64_t num_of_records;
+    off_t *samples;
+    size_t num_of_samples;
+    size_t samples_capacity;
+    bool failed;
+} IndexScan_t;
+
+static bool push_offset (off_t **array, size_t *count, size_t *capacity, off_t value)
+{
+    if (*count == *capacity)
+    {
+        size_t new_capacity = (*capacity == 0U) ? 64U : (*capacity * 2U);
+        off_t *new_array = (off_t *)realloc(*array, new_capacity * sizeof(off_t));
+        if (new_array == NULL)
+        {
+            return false;
+        }
+        *array = new_array;
+        *capacity = new_capacity;
+    }
+
+    (*array)[(*count)++] = value;
+
+    return true;
+}
+
+static inline const char *at (const IndexScan_t *scan, off_t offset)
+{
+    return &scan->map[offset - scan->map_offset];
+}
+
+/**
+ * Walk the record starts of [start, end). The first pass only counts them, the 
+ * second one, knowing the number of the first record, collects the samples. 
+ */
+static void *scan_chunk (void *params)
+{
+    IndexScan_t *scan = (IndexScan_t *)params;
+    off_t pos = scan->start;
+
+    scan->num_of_records = 0U;
+
+    if ((pos > 0) && (*at(scan, pos - 1) != '\n'))
+    {
+        const char *nl = memchr(at(scan, pos), '\n', scan->total_end - pos);
+        if (nl == NULL)
+        {
+            return NULL;
+        }
+        pos = scan->map_offset + (nl - scan->map) + 1;
+    }
+
+    while (pos < scan->end)
+    {
+        if (scan->collect)
+        {
+            uint64_t record = scan->first_record + scan->num_of_records;
+
+            if (((record % RECORD_INDEX_STRIDE) == 0U) && 
+                !push_offset(&scan->samples, &scan->num_of_samples, &scan->samples_capacity, pos))
+            {
+                scan->failed = true;
+                return NULL;
+            }
+        }
+
+        scan->num_of_records++;
+
+        const char *nl = memchr(at(scan, pos), '\n', scan->total_end - pos);
+        if (nl == NULL)
+        {
+            break;
+        }
+        pos = scan->map_offset + (nl - scan->map) + 1;
+    }
+
+    return NULL;
+}
+
+static bool merge_scan (RecordIndex_t *index, IndexScan_t *scan)
+{
+    for (size_t i = 0U; i < scan->num_of_samples; ++i)
+    {
+        if (!push_offset(&index->samples, &index->num_of_samples, &index->samples_capacity, scan->samples[i]))
+        {
+            return false;
+        }
+    }
+
+    index->num_of_records += scan->num_of_records;
+
+    return true;
+}
+
+static void release_scan (IndexScan_t *scan)
+{
+    free(scan->samples);
+    scan->samples = NULL;
+}
+
+/**
+ * Index the records in [index->indexed_size, end) with up to @param num_of_scanners 
+ * threads. Called with the mutex held, or by the builder before anyone can seek. 
+ */
+static int index_range (RecordIndex_t *index, off_t end, unsigned int num_of_scanners)
+{
+    IndexScan_t scans[RECORD_INDEX_MAX_SCANNERS];
+    pthread_t threads[RECORD_INDEX_MAX_SCANNERS];
+    off_t start = index->indexed_size;
+    long page_size = sysconf(_SC_PAGESIZE);
+    int ret = RECORD_INDEX_OK;
+
+    if (end <= start)
+    {
+        return RECORD_INDEX_OK;
+    }
+
+    /* Mapped from the page holding the byte before start, which tells whether a record starts at start */
+    off_t map_offset = (start > 0) ? ((start - 1) - ((start - 1) % page_size)) : 0;
+    size_t map_len = (size_t)(end - map_offset);
+    const char *map = (const char *)mmap(NULL, map_len, PROT_READ, MAP_SHARED, index->store->fd, map_offset);
+    if (map == MAP_FAILED)
+    {
+        return RECORD_INDEX_READ_FAILED;
+    }
+    madvise((void *)map, map_len, MADV_SEQUENTIAL);
+
+    off_t chunk = (end - start) / num_of_scanners;
+    if (chunk < RECORD_INDEX_MIN_SCAN_CHUNK)
+    {
+        num_of_scanners = (unsigned int)(((end - start) / RECORD_INDEX_MIN_SCAN_CHUNK) + 1);
+        chunk = (end - start) / num_of_scanners;
+    }
+
+    for (unsigned int i = 0U; i < num_of_scanners; ++i)
+    {
+        memset(&scans[i], 0, sizeof(IndexScan_t));
+        scans[i].map = map;
+        scans[i].map_offset = map_offset;
+        scans[i].start = start + ((off_t)i * chunk);
+        scans[i].end = ((i + 1U) == num_of_scanners) ? end : (scans[i].start + chunk);
+        scans[i].total_end = end;
+    }
+
+    /* First pass counts, second pass collects with the record numbers known; the first scan runs inline */
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        uint64_t first_record = index->num_of_records;
+        unsigned int num_of_threads = 0U;
+
+        for (unsigned int i = 0U; i < num_of_scanners; ++i)
+        {
+            scans[i].collect = (pass == 1);
+            scans[i].first_record = first_record;
+            first_record += scans[i].num_of_records;
+        }
+
+        for (unsigned int i = 1U; i < num_of_scanners; ++i)
+        {
+            if (pthread_create(&threads[i], NULL, scan_chunk, (void *)&scans[i]) != 0)
+            {
+                break;
+            }
+            num_of_threads++;
+        }
+
+        for (unsigned int i = num_of_threads + 1U; i < num_of_scanners; ++i)
+        {
+            scan_chunk(&scans[i]);
+        }
+        scan_chunk(&scans[0]);
+
+        for (unsigned int i = 1U; i <= num_of_threads; ++i)
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    for (unsigned int i = 0U; i < num_of_scanners; ++i)
+    {
+        if ((ret == RECORD_INDEX_OK) && (scans[i].failed || !merge_scan(index, &scans[i])))
+        {
+            ret = RECORD_INDEX_NO_MEMORY;
+        }
+        release_scan(&scans[i]);
+    }
+
+    munmap((void *)map, map_len);
+
+    if (ret == RECORD_INDEX_OK)
+    {
+        index->indexed_size = end;
+    }
+
+    return ret;
+}
+
+static inline void lock_index (RecordIndex_t *index)
+{
+    lock_stats_mutex_lock(&index->mutex, index->lock_stats, &index->lock_acquired_ns);
+}
+
+static inline void unlock_index (RecordIndex_t *index)
+{
+    lock_stats_mutex_unlock(&index->mutex, index->lock_stats, index->lock_acquired_ns);
+}
+
+static void *builder_thread (void *params)
+{
+    RecordIndex_t *index = (RecordIndex_t *)params;
+    long num_of_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int num_of_scanners = (num_of_cpus < 1) ? 1U : (unsigned int)num_of_cpus;
+    uint64_t counter = 1U;
+
+    if (num_of_scanners > RECORD_INDEX_MAX_SCANNERS)
+    {
+        num_of_scanners = RECORD_INDEX_MAX_SCANNERS;
+    }
+
+    /* Seeks wait for ready, so nothing else touches the index until then */
+    int rc = index_range(index, data_store_size(index->store), num_of_scanners);
+    if (rc != RECORD_INDEX_OK)
+    {
+        async_log(LOG_ERR, "record index build failed (%d), seek commands are disabled", rc);
+    }
+
+    lock_index(index);
+    index->build_status = rc;
+    index->ready = true;
+    pthread_cond_broadcast(&index->ready_cond);
+    unlock_index(index);
+
+    ssize_t written = write(index->ready_fd, &counter, sizeof(counter));
+    (void)written;
+
+    return NULL;
+}
+
+int record_index_start (RecordIndex_t *index, DataStore_t *store, int *error_code)
+{
+    if ((index == NULL) || (store == NULL) || (error_code == NULL))
+    {
+        return RECORD_INDEX_INVALID_PARAM;
+    }
+
+    memset(index, 0, sizeof(RecordIndex_t));
+    index->store = store;
+
+    index->ready_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (index->ready_fd == -1)
+    {
+        *error_code = errno;
+        return RECORD_INDEX_EVENTFD_FAILED;
+    }
+
+    pthread_mutex_init(&index->mutex, NULL);
+    index->lock_stats = lock_stats_register("record_index");
+    pthread_cond_init(&index->ready_cond, NULL);
+
+    *error_code = pthread_create(&index->builder, NULL, builder_thread, (void *)index);
+    if (*error_code != 0)
+    {
+        pthread_cond_destroy(&index->ready_cond);
+        pthread_mutex_destroy(&index->mutex);
+        close(index->ready_fd);
+        index->ready_fd = -1;
+        return RECORD_INDEX_THREAD_CREATE_FAILED;
+    }
+
+    index->builder_started = true;
+
+    return RECORD_INDEX_OK;
+}
+
+void record_index_stop (RecordIndex_t *index)
+{
+    if ((index == NULL) || !index->builder_started)
+    {
+        return;
+    }
+
+    pthread_join(index->builder, NULL);
+    index->builder_started = false;
+
+    free(index->samples);
+    index->samples = NULL;
+    close(index->ready_fd);
+    index->ready_fd = -1;
+    pthread_cond_destroy(&index->ready_cond);
+    pthread_mutex_destroy(&index->mutex);
+}
+
+int record_index_get_ready_fd (RecordIndex_t *index)
+{
+    return index->ready_fd;
+}
+
+/**
+ * Find the first newline at or after @param from. 
+ * @return its offset, -1 if there is none below the committed size 
+ */
+static off_t find_newline (DataStore_t *store, off_t from)
+{
+    char buf[RECORD_INDEX_READ_CHUNK];
+
+    for (;;)
+    {
+        ssize_t n_read = data_store_read(store, from, buf, sizeof(buf));
+        if (n_read <= 0)
+        {
+            return -1;
+        }
+
+        const char *nl = memchr(buf, '\n', n_read);
+        if (nl != NULL)
+        {
+            return from + (nl - buf);
+        }
+
+        from += n_read;
+    }
+}
+
+int record_index_seek (RecordIndex_t *index, uint32_t record, uint32_t offset, bool wait, off_t *position)
+{
+    int ret = RECORD_INDEX_OK;
+
+    if ((index == NULL) || (position == NULL) || !index->builder_started)
+    {
+        return RECORD_INDEX_INVALID_PARAM;
+    }
+
+    lock_index(index);
+    if (!index->ready && !wait)
+    {
+        unlock_index(index);
+        return RECORD_INDEX_NOT_READY;
+    }
+
+    while (!index->ready)
+    {
+        lock_stats_cond_wait(&index->ready_cond, &index->mutex, index->lock_stats, 
+                             &index->lock_acquired_ns);
+    }
+
+    /* A failed build may have merged part of the store, so the samples cannot be trusted */
+    if (index->build_status != RECORD_INDEX_OK)
+    {
+        ret = index->build_status;
+        unlock_index(index);
+        return ret;
+    }
+
+    /* Catch up with whatever was appended since, a single scanner does for the usual few records */
+    if (record >= index->num_of_records)
+    {
+        ret = index_range(index, data_store_size(index->store), 1U);
+    }
+
+    off_t start = -1;
+    if ((ret == RECORD_INDEX_OK) && (record < index->num_of_records))
+    {
+        start = index->samples[record / RECORD_INDEX_STRIDE];
+    }
+    unlock_index(index);
+
+    if (ret != RECORD_INDEX_OK)
+    {
+        return ret;
+    }
+
+    if (start == -1)
+    {
+        return RECORD_INDEX_OUT_OF_RANGE;
+    }
+
+    for (uint32_t i = 0U; i < (record % RECORD_INDEX_STRIDE); ++i)
+    {
+        off_t nl = find_newline(index->store, start);
+        if (nl == -1)
+        {
+            return RECORD_INDEX_READ_FAILED;
+        }
+        start = nl + 1;
+    }
+
+    off_t end = find_newline(index->store, start);
+    if (end == -1)
+    {
+        return RECORD_INDEX_READ_FAILED;
+    }
+
+    /* The newline belongs to the record */
+    if ((off_t)offset > (end - start))
+    {
+        return RECORD_INDEX_OUT_OF_RANGE;
+    }
+
+    *position = start + offset;
+
+    return RECORD_INDEX_OK;
+}
+
+void record_index_write_stats (RecordIndex_t *index, FILE *fp)
+{
+    if ((index == NULL) || (fp == NULL) || !index->builder_started)
+    {
+        return;
+    }
+
+    lock_index(index);
+    if (index->ready)
+    {
+        fprintf(fp, "index_records %llu\n", (unsigned long long)index->num_of_records);
+        fprintf(fp, "index_size %lld\n", (long long)index->indexed_size);
+    }
+    fprintf(fp, "index_ready %d\n", index->ready ? 1 : 0);
+    fprintf(fp, "index_build_status %d\n", index->build_status);
+    unlock_index(index);
+}
+
+bool record_index_parse_seek (const char *buf, size_t len, uint32_t *record, uint32_t *offset)
+{
+    char args[32];
+    char *end = NULL;
+
+    if ((len <= RECORD_INDEX_SEEK_COMMAND_LEN) || 
+        (memcmp(buf, RECORD_INDEX_SEEK_COMMAND, RECORD_INDEX_SEEK_COMMAND_LEN) != 0))
+    {
+        return false;
+    }
+
+    size_t args_len = len - RECORD_INDEX_SEEK_COMMAND_LEN;
+    if (args_len >= sizeof(args))
+    {
+        return false;
+    }
+
+    memcpy(args, &buf[RECORD_INDEX_SEEK_COMMAND_LEN], args_len);
+    args[args_len] = '\0';
+
+    unsigned long x = strtoul(args, &end, 10);
+    if ((end == args) || (*end != ',') || (x > UINT32_MAX))
+    {
+        return false;
+    }
+
+    char *y_start = end + 1;
+    unsigned long y = strtoul(y_start, &end, 10);
+    if ((end == y_start) || ((*end != '\n') && (*end != '\0')) || (y > UINT32_MAX))
+    {
+        return false;
+    }
+
+    *record = (uint32_t)x;
+    *offset = (uint32_t)y;
+
+    return true;
+}
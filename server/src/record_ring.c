@@ -0,0 +1,433 @@
+/**
+ * \file    record_ring.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Shared-memory ring publishing the most recent records of the
+ *          store to local readers
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "record_ring.h"
+
+#define RECORD_RING_MASK                            (RECORD_RING_MAX_RECORDS - 1U)
+
+_Static_assert((RECORD_RING_MAX_RECORDS & RECORD_RING_MASK) == 0U, "RECORD_RING_MAX_RECORDS must be a power of two");
+
+static size_t header_size (void)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return ((sizeof(RecordRingHeader_t) + page - 1U) / page) * page;
+}
+
+static bool header_valid (const RecordRingHeader_t *header)
+{
+    return (header->magic == RECORD_RING_MAGIC) && (header->version == RECORD_RING_VERSION) && 
+           (header->max_records == RECORD_RING_MAX_RECORDS) && (header->payload_size == RECORD_RING_PAYLOAD_SIZE);
+}
+
+static int map_ring (RecordRing_t *ring, int fd, int prot, int *error_code)
+{
+    ring->map_size = header_size() + RECORD_RING_PAYLOAD_SIZE;
+    ring->map = mmap(NULL, ring->map_size, prot, MAP_SHARED, fd, 0);
+    if (ring->map == MAP_FAILED)
+    {
+        *error_code = errno;
+        ring->map = NULL;
+        close(fd);
+        return RECORD_RING_MAP_FAILED;
+    }
+
+    ring->fd = fd;
+    ring->header = (RecordRingHeader_t *)ring->map;
+    ring->payload = (char *)ring->map + header_size();
+
+    return RECORD_RING_OK;
+}
+
+/**
+ * Make the sequence odd. A publisher which died mid-update left it odd already, 
+ * whatever it half wrote is replaced by this update. 
+ */
+static uint64_t begin_write (RecordRingHeader_t *header)
+{
+    uint64_t seq = atomic_load_explicit(&header->seq, memory_order_relaxed);
+
+    seq |= 1U;
+    atomic_store_explicit(&header->seq, seq, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    return seq;
+}
+
+static void end_write (RecordRingHeader_t *header, uint64_t seq)
+{
+    atomic_store_explicit(&header->seq, seq + 1U, memory_order_release);
+}
+
+/*
+ * Readers race with a publisher rewriting the ring, so they read it only with 
+ * relaxed atomic loads. A torn read then just yields a wrong value, which the 
+ * sequence check after the reads throws away. 
+ */
+static inline uint32_t load_u32 (const uint32_t *field)
+{
+    return atomic_load_explicit((const _Atomic uint32_t *)field, memory_order_relaxed);
+}
+
+static inline uint64_t load_u64 (const uint64_t *field)
+{
+    return atomic_load_explicit((const _Atomic uint64_t *)field, memory_order_relaxed);
+}
+
+/**
+ * memcpy() of a record body in relaxed atomic loads, a word at a time once 
+ * @param src is aligned, a byte at a time around that. 
+ */
+static void load_payload (char *dst, const char *src, size_t len)
+{
+    while ((len > 0U) && (((uintptr_t)src % sizeof(uint64_t)) != 0U))
+    {
+        *dst++ = atomic_load_explicit((const _Atomic char *)src++, memory_order_relaxed);
+        len--;
+    }
+
+    for (; len >= sizeof(uint64_t); len -= sizeof(uint64_t))
+    {
+        uint64_t word = load_u64((const uint64_t *)src);
+        memcpy(dst, &word, sizeof(word));
+        dst += sizeof(uint64_t);
+        src += sizeof(uint64_t);
+    }
+
+    while (len > 0U)
+    {
+        *dst++ = atomic_load_explicit((const _Atomic char *)src++, memory_order_relaxed);
+        len--;
+    }
+}
+
+static void drop_oldest (RecordRingHeader_t *header)
+{
+    header->out_offs = (header->out_offs + 1U) & RECORD_RING_MASK;
+    header->count--;
+    header->full = 0U;
+}
+
+/**
+ * Records sit in the payload region in the order they were published, wrapping 
+ * to its start when the end has no room, so the free space is the gap after the 
+ * newest record and, once the newest has wrapped, before the oldest one. 
+ * @return the payload offset to store @param len bytes at, after dropping the 
+ *      oldest records until there is room 
+ */
+static uint64_t reserve_payload (RecordRingHeader_t *header, size_t len)
+{
+    for (;;)
+    {
+        if (header->count == 0U)
+        {
+            return 0U;
+        }
+
+        const RecordRingEntry_t *oldest = &header->entry[header->out_offs];
+        const RecordRingEntry_t *newest = &header->entry[(header->in_offs - 1U) & RECORD_RING_MASK];
+        uint64_t newest_end = newest->payload_offset + newest->size;
+
+        if (newest_end > oldest->payload_offset)
+        {
+            if ((header->payload_size - newest_end) >= len)
+            {
+                return newest_end;
+            }
+            if (oldest->payload_offset >= len)
+            {
+                return 0U;
+            }
+        }
+        else if ((oldest->payload_offset - newest_end) >= len)
+        {
+            return newest_end;
+        }
+
+        drop_oldest(header);
+    }
+}
+
+int record_ring_open (RecordRing_t *ring, const char *name, bool keep, int *error_code)
+{
+    if ((ring == NULL) || (name == NULL) || (error_code == NULL))
+    {
+        return RECORD_RING_INVALID_PARAM;
+    }
+
+    ring->fd = -1;
+    ring->map = NULL;
+    ring->header = NULL;
+
+    int fd = shm_open(name, O_CREAT | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP);
+    if (fd == -1)
+    {
+        *error_code = errno;
+        return RECORD_RING_OPEN_FAILED;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || 
+        (((size_t)st.st_size != (header_size() + RECORD_RING_PAYLOAD_SIZE)) && 
+         (ftruncate(fd, header_size() + RECORD_RING_PAYLOAD_SIZE) != 0)))
+    {
+        *error_code = errno;
+        close(fd);
+        return RECORD_RING_OPEN_FAILED;
+    }
+
+    int rc = map_ring(ring, fd, PROT_READ | PROT_WRITE, error_code);
+    if (rc != RECORD_RING_OK)
+    {
+        return rc;
+    }
+
+    RecordRingHeader_t *header = ring->header;
+    if (keep && header_valid(header))
+    {
+        return RECORD_RING_OK;
+    }
+
+    /* Readers attached to a previous ring see it emptied, records_published going back is their cue */
+    uint64_t seq = begin_write(header);
+    header->version = RECORD_RING_VERSION;
+    header->max_records = RECORD_RING_MAX_RECORDS;
+    header->payload_size = RECORD_RING_PAYLOAD_SIZE;
+    header->records_published = 0U;
+    header->records_skipped = 0U;
+    header->in_offs = 0U;
+    header->out_offs = 0U;
+    header->count = 0U;
+    header->full = 0U;
+    header->magic = RECORD_RING_MAGIC;
+    end_write(header, seq);
+
+    return RECORD_RING_OK;
+}
+
+int record_ring_attach (RecordRing_t *ring, const char *name, int *error_code)
+{
+    if ((ring == NULL) || (name == NULL) || (error_code == NULL))
+    {
+        return RECORD_RING_INVALID_PARAM;
+    }
+
+    ring->fd = -1;
+    ring->map = NULL;
+    ring->header = NULL;
+
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        *error_code = errno;
+        return RECORD_RING_OPEN_FAILED;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        *error_code = errno;
+        close(fd);
+        return RECORD_RING_OPEN_FAILED;
+    }
+
+    if ((size_t)st.st_size != (header_size() + RECORD_RING_PAYLOAD_SIZE))
+    {
+        close(fd);
+        return RECORD_RING_INVALID_FORMAT;
+    }
+
+    int rc = map_ring(ring, fd, PROT_READ, error_code);
+    if (rc != RECORD_RING_OK)
+    {
+        return rc;
+    }
+
+    if (!header_valid(ring->header))
+    {
+        record_ring_close(ring);
+        return RECORD_RING_INVALID_FORMAT;
+    }
+
+    return RECORD_RING_OK;
+}
+
+void record_ring_close (RecordRing_t *ring)
+{
+    if ((ring == NULL) || (ring->map == NULL))
+    {
+        return;
+    }
+
+    munmap(ring->map, ring->map_size);
+    close(ring->fd);
+    ring->map = NULL;
+    ring->header = NULL;
+    ring->payload = NULL;
+    ring->fd = -1;
+}
+
+void record_ring_publish (RecordRing_t *ring, const char *buf, size_t len, off_t store_offset)
+{
+    if ((ring == NULL) || (ring->header == NULL) || (buf == NULL))
+    {
+        return;
+    }
+
+    RecordRingHeader_t *header = ring->header;
+    uint64_t seq = begin_write(header);
+
+    if ((len == 0U) || (len > header->payload_size))
+    {
+        header->records_skipped++;
+        end_write(header, seq);
+        return;
+    }
+
+    if (header->count == header->max_records)
+    {
+        drop_oldest(header);
+    }
+
+    uint64_t payload_offset = reserve_payload(header, len);
+    RecordRingEntry_t *entry = &header->entry[header->in_offs];
+
+    memcpy(&ring->payload[payload_offset], buf, len);
+    entry->payload_offset = payload_offset;
+    entry->size = len;
+    entry->store_offset = (uint64_t)store_offset;
+    header->in_offs = (header->in_offs + 1U) & RECORD_RING_MASK;
+    header->count++;
+    header->full = (header->count == header->max_records) ? 1U : 0U;
+    header->records_published++;
+
+    end_write(header, seq);
+}
+
+int record_ring_copy (RecordRing_t *ring, char *buf, size_t cap, RecordRingSnapshot_t *snapshot)
+{
+    if ((ring == NULL) || (ring->header == NULL) || ((buf == NULL) && (cap > 0U)) || (snapshot == NULL))
+    {
+        return RECORD_RING_INVALID_PARAM;
+    }
+
+    const RecordRingHeader_t *header = ring->header;
+
+    for (unsigned int attempt = 0U; attempt < RECORD_RING_READ_ATTEMPTS; attempt++)
+    {
+        uint64_t seq = atomic_load_explicit(&header->seq, memory_order_acquire);
+        if (seq & 1U)
+        {
+            sched_yield();
+            continue;
+        }
+
+        uint32_t out_offs = load_u32(&header->out_offs) & RECORD_RING_MASK;
+        uint32_t count = load_u32(&header->count);
+        uint64_t published = load_u64(&header->records_published);
+        size_t len = 0U;
+        bool fits = true;
+        bool valid = (count <= RECORD_RING_MAX_RECORDS);
+
+        for (uint32_t i = 0U; valid && (i < count); i++)
+        {
+            const RecordRingEntry_t *entry = &header->entry[(out_offs + i) & RECORD_RING_MASK];
+            uint64_t payload_offset = load_u64(&entry->payload_offset);
+            uint64_t size = load_u64(&entry->size);
+
+            /* Torn values only have to stay inside the mapping until the sequence check throws them away */
+            if ((payload_offset > RECORD_RING_PAYLOAD_SIZE) || (size > (RECORD_RING_PAYLOAD_SIZE - payload_offset)))
+            {
+                valid = false;
+                break;
+            }
+
+            if (fits && ((cap - len) >= size))
+            {
+                load_payload(&buf[len], &ring->payload[payload_offset], size);
+            }
+            else
+            {
+                fits = false;
+            }
+            len += size;
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&header->seq, memory_order_relaxed) != seq)
+        {
+            continue;
+        }
+
+        if (!valid)
+        {
+            return RECORD_RING_INVALID_FORMAT;
+        }
+
+        snapshot->first_record = published - count;
+        snapshot->num_of_records = count;
+        snapshot->len = len;
+        return fits ? RECORD_RING_OK : RECORD_RING_NO_SPACE;
+    }
+
+    return RECORD_RING_BUSY;
+}
+
+uint64_t record_ring_published (RecordRing_t *ring)
+{
+    const RecordRingHeader_t *header = ring->header;
+    uint64_t published = 0U;
+
+    /* A publisher that died mid-update leaves the sequence odd, the count it left is as good as any then */
+    for (unsigned int attempt = 0U; attempt < RECORD_RING_READ_ATTEMPTS; attempt++)
+    {
+        uint64_t seq = atomic_load_explicit(&header->seq, memory_order_acquire);
+        published = load_u64(&header->records_published);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (((seq & 1U) == 0U) && (atomic_load_explicit(&header->seq, memory_order_relaxed) == seq))
+        {
+            break;
+        }
+        sched_yield();
+    }
+
+    return published;
+}
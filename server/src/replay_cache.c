@@ -0,0 +1,536 @@
+/**
+ * \file    replay_cache.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Compressed replays with the sealed store segments compressed
+ *          once and kept in a cache file
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+
+#include "replay_cache.h"
+#include "server_stats.h"
+#include "async_log.h"
+
+#define REPLAY_CACHE_COMPRESS_COMMAND_LEN           (sizeof(REPLAY_CACHE_COMPRESS_COMMAND) - 1UL)
+#define MAX_FRAME_SIZE                              (REPLAY_CACHE_FRAME_HEADER_SIZE + \
+                                                     LZ4_BLOCK_BOUND(REPLAY_CACHE_SEGMENT_SIZE))
+
+static inline void put_le32 (char *p, uint32_t v)
+{
+    p[0] = (char)v;
+    p[1] = (char)(v >> 8);
+    p[2] = (char)(v >> 16);
+    p[3] = (char)(v >> 24);
+}
+
+/**
+ * Frame @param len bytes of @param raw into @param frame, which holds at least MAX_FRAME_SIZE bytes. 
+ * @return size of the frame 
+ */
+static size_t encode_frame (const char *raw, size_t len, char *frame)
+{
+    char *payload = &frame[REPLAY_CACHE_FRAME_HEADER_SIZE];
+    size_t payload_len = 0U;
+
+    /* Stored as is when compression does not save anything, which also keeps both lengths apart otherwise */
+    if ((lz4_block_compress(raw, len, payload, LZ4_BLOCK_BOUND(len), &payload_len) != LZ4_BLOCK_OK) || 
+        (payload_len >= len))
+    {
+        memcpy(payload, raw, len);
+        payload_len = len;
+    }
+
+    put_le32(&frame[0], (uint32_t)len);
+    put_le32(&frame[4], (uint32_t)payload_len);
+
+    return REPLAY_CACHE_FRAME_HEADER_SIZE + payload_len;
+}
+
+static int read_range (ReplayCache_t *cache, off_t start, size_t len, char *buf, int *error_code)
+{
+    size_t n_done = 0U;
+
+    while (n_done < len)
+    {
+        ssize_t n_read = data_store_read(cache->store, start + (off_t)n_done, &buf[n_done], len - n_done);
+        if (n_read <= 0)
+        {
+            *error_code = (n_read == -1) ? errno : 0;
+            return REPLAY_CACHE_READ_FAILED;
+        }
+        n_done += (size_t)n_read;
+    }
+
+    return REPLAY_CACHE_OK;
+}
+
+/**
+ * Compress every segment below @param num_of_segments which is not cached yet, 
+ * publishing each one under the cache mutex once its frame is written. Only 
+ * the sealer appends segments, so it reads what it published without the mutex. 
+ */
+static int seal_segments (ReplayCache_t *cache, size_t num_of_segments, char *raw, char *frame, int *error_code)
+{
+    while ((cache->num_of_segments < num_of_segments) && !atomic_load(&cache->sealer_stop))
+    {
+        size_t i = cache->num_of_segments;
+        off_t frame_start = (i == 0U) ? 0 : cache->frame_ends[i - 1U];
+
+        int rc = read_range(cache, (off_t)i * REPLAY_CACHE_SEGMENT_SIZE, REPLAY_CACHE_SEGMENT_SIZE, raw, error_code);
+        if (rc != REPLAY_CACHE_OK)
+        {
+            return rc;
+        }
+
+        size_t frame_len = encode_frame(raw, REPLAY_CACHE_SEGMENT_SIZE, frame);
+        if (pwrite(cache->fd, frame, frame_len, frame_start) != (ssize_t)frame_len)
+        {
+            *error_code = errno;
+            return REPLAY_CACHE_WRITE_FAILED;
+        }
+
+        adaptive_mutex_lock(&cache->mutex);
+        if (i == cache->capacity)
+        {
+            size_t capacity = (cache->capacity == 0U) ? 64U : (cache->capacity * 2U);
+            off_t *frame_ends = (off_t *)realloc(cache->frame_ends, capacity * sizeof(off_t));
+            if (frame_ends == NULL)
+            {
+                adaptive_mutex_unlock(&cache->mutex);
+                *error_code = ENOMEM;
+                return REPLAY_CACHE_NO_MEMORY;
+            }
+
+            cache->frame_ends = frame_ends;
+            cache->capacity = capacity;
+        }
+        cache->frame_ends[i] = frame_start + (off_t)frame_len;
+        cache->num_of_segments++;
+        adaptive_mutex_unlock(&cache->mutex);
+    }
+
+    return REPLAY_CACHE_OK;
+}
+
+static void *sealer_thread (void *params)
+{
+    ReplayCache_t *cache = (ReplayCache_t *)params;
+    char *raw = (char *)malloc(REPLAY_CACHE_SEGMENT_SIZE);
+    char *frame = (char *)malloc(MAX_FRAME_SIZE);
+    int error_code = ENOMEM;
+    int rc = REPLAY_CACHE_NO_MEMORY;
+
+    pthread_mutex_lock(&cache->sealer_mutex);
+    while ((raw != NULL) && (frame != NULL))
+    {
+        while (!atomic_load(&cache->sealer_stop) && (cache->num_of_segments >= cache->seal_target))
+        {
+            pthread_cond_wait(&cache->sealer_cond, &cache->sealer_mutex);
+        }
+
+        if (atomic_load(&cache->sealer_stop))
+        {
+            rc = REPLAY_CACHE_OK;
+            break;
+        }
+
+        size_t target = cache->seal_target;
+        pthread_mutex_unlock(&cache->sealer_mutex);
+        rc = seal_segments(cache, target, raw, frame, &error_code);
+        pthread_mutex_lock(&cache->sealer_mutex);
+
+        if (rc != REPLAY_CACHE_OK)
+        {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache->sealer_mutex);
+
+    /* Replays keep sending what is not sealed stored as is */
+    if (rc != REPLAY_CACHE_OK)
+    {
+        async_log(LOG_ERR, "replay cache sealing stopped (%d): %s", rc, strerror(error_code));
+    }
+
+    free(raw);
+    free(frame);
+
+    return NULL;
+}
+
+static void wake_sealer (ReplayCache_t *cache, size_t num_of_segments)
+{
+    pthread_mutex_lock(&cache->sealer_mutex);
+    if (num_of_segments > cache->seal_target)
+    {
+        cache->seal_target = num_of_segments;
+        pthread_cond_signal(&cache->sealer_cond);
+    }
+    pthread_mutex_unlock(&cache->sealer_mutex);
+}
+
+int replay_cache_init (ReplayCache_t *cache, DataStore_t *store, int *error_code)
+{
+    if ((cache == NULL) || (store == NULL) || (error_code == NULL))
+    {
+        return REPLAY_CACHE_INVALID_PARAM;
+    }
+
+    memset(cache, 0, sizeof(ReplayCache_t));
+    cache->store = store;
+
+    cache->fd = open(REPLAY_CACHE_DIR, O_TMPFILE | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (cache->fd == -1)
+    {
+        *error_code = errno;
+        return REPLAY_CACHE_OPEN_FAILED;
+    }
+
+    adaptive_mutex_init(&cache->mutex, "replay_cache");
+    pthread_mutex_init(&cache->sealer_mutex, NULL);
+    pthread_cond_init(&cache->sealer_cond, NULL);
+    atomic_init(&cache->sealer_stop, false);
+
+    *error_code = pthread_create(&cache->sealer, NULL, sealer_thread, (void *)cache);
+    if (*error_code != 0)
+    {
+        pthread_cond_destroy(&cache->sealer_cond);
+        pthread_mutex_destroy(&cache->sealer_mutex);
+        adaptive_mutex_destroy(&cache->mutex);
+        close(cache->fd);
+        cache->fd = -1;
+        cache->store = NULL;
+        return REPLAY_CACHE_THREAD_CREATE_FAILED;
+    }
+
+    return REPLAY_CACHE_OK;
+}
+
+void replay_cache_destroy (ReplayCache_t *cache)
+{
+    if ((cache == NULL) || (cache->store == NULL))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->sealer_mutex);
+    atomic_store(&cache->sealer_stop, true);
+    pthread_cond_signal(&cache->sealer_cond);
+    pthread_mutex_unlock(&cache->sealer_mutex);
+    pthread_join(cache->sealer, NULL);
+
+    pthread_cond_destroy(&cache->sealer_cond);
+    pthread_mutex_destroy(&cache->sealer_mutex);
+    adaptive_mutex_destroy(&cache->mutex);
+    close(cache->fd);
+    free(cache->frame_ends);
+    memset(cache, 0, sizeof(ReplayCache_t));
+    cache->fd = -1;
+}
+
+int replay_cache_prepare (ReplayCache_t *cache, off_t start, off_t end, CompressedReplay_t **replay, 
+                          int *error_code)
+{
+    if ((cache == NULL) || (cache->store == NULL) || (replay == NULL) || (error_code == NULL) || (start > end))
+    {
+        return REPLAY_CACHE_INVALID_PARAM;
+    }
+
+    /* Whole segments in between are sent from the cache, the rest of either end is compressed right here */
+    size_t first_segment = (size_t)((start + REPLAY_CACHE_SEGMENT_SIZE - 1) / REPLAY_CACHE_SEGMENT_SIZE);
+    size_t last_segment = (size_t)(end / REPLAY_CACHE_SEGMENT_SIZE);
+    off_t head_end = ((off_t)first_segment * REPLAY_CACHE_SEGMENT_SIZE < end) ? 
+                     (off_t)first_segment * REPLAY_CACHE_SEGMENT_SIZE : end;
+    off_t tail_start = ((off_t)last_segment * REPLAY_CACHE_SEGMENT_SIZE > head_end) ? 
+                       (off_t)last_segment * REPLAY_CACHE_SEGMENT_SIZE : head_end;
+
+    char *raw = (char *)malloc(REPLAY_CACHE_SEGMENT_SIZE);
+    CompressedReplay_t *out = (CompressedReplay_t *)malloc(sizeof(CompressedReplay_t) + 
+                                                           (2U * MAX_FRAME_SIZE) + REPLAY_CACHE_FRAME_HEADER_SIZE);
+    int rc = REPLAY_CACHE_OK;
+
+    if ((raw == NULL) || (out == NULL))
+    {
+        free(raw);
+        free(out);
+        *error_code = ENOMEM;
+        return REPLAY_CACHE_NO_MEMORY;
+    }
+
+    out->cache_off = 0;
+    out->cache_end = 0;
+    out->raw_off = 0;
+    out->raw_end = 0;
+    out->raw_header_sent = 0U;
+    out->len = 0U;
+    out->sent = 0U;
+
+    if (head_end > start)
+    {
+        rc = read_range(cache, start, (size_t)(head_end - start), raw, error_code);
+        if (rc == REPLAY_CACHE_OK)
+        {
+            out->len += encode_frame(raw, (size_t)(head_end - start), &out->data[out->len]);
+        }
+    }
+    out->head_len = out->len;
+
+    if ((rc == REPLAY_CACHE_OK) && (first_segment < last_segment))
+    {
+        adaptive_mutex_lock(&cache->mutex);
+        size_t sealed = cache->num_of_segments;
+        if (first_segment < sealed)
+        {
+            size_t sealed_end = (last_segment < sealed) ? last_segment : sealed;
+            out->cache_off = (first_segment == 0U) ? 0 : cache->frame_ends[first_segment - 1U];
+            out->cache_end = cache->frame_ends[sealed_end - 1U];
+        }
+        adaptive_mutex_unlock(&cache->mutex);
+
+        /* Sealed segments are a prefix of the store, the rest of the middle goes out stored as is */
+        size_t raw_first = (first_segment > sealed) ? first_segment : sealed;
+        if (raw_first < last_segment)
+        {
+            out->raw_off = (off_t)raw_first * REPLAY_CACHE_SEGMENT_SIZE;
+            out->raw_end = (off_t)last_segment * REPLAY_CACHE_SEGMENT_SIZE;
+            wake_sealer(cache, last_segment);
+        }
+    }
+
+    if ((rc == REPLAY_CACHE_OK) && (end > tail_start))
+    {
+        rc = read_range(cache, tail_start, (size_t)(end - tail_start), raw, error_code);
+        if (rc == REPLAY_CACHE_OK)
+        {
+            out->len += encode_frame(raw, (size_t)(end - tail_start), &out->data[out->len]);
+        }
+    }
+
+    free(raw);
+
+    if (rc != REPLAY_CACHE_OK)
+    {
+        free(out);
+        return rc;
+    }
+
+    memset(&out->data[out->len], 0, REPLAY_CACHE_FRAME_HEADER_SIZE);
+    out->len += REPLAY_CACHE_FRAME_HEADER_SIZE;
+
+    server_stats_inc(&server_stats->compressed_replays, 1UL);
+    server_stats_inc(&server_stats->compressed_replay_raw_bytes, (unsigned long)(end - start));
+
+    *replay = out;
+
+    return REPLAY_CACHE_OK;
+}
+
+static int send_data (CompressedReplay_t *replay, int fd, uint32_t until, int *error_code)
+{
+    while (replay->sent < until)
+    {
+        ssize_t n_sent = send(fd, &replay->data[replay->sent], until - replay->sent, MSG_NOSIGNAL);
+        if (n_sent == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            *error_code = errno;
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? REPLAY_CACHE_WOULD_BLOCK : REPLAY_CACHE_SEND_FAILED;
+        }
+
+        replay->sent += (uint32_t)n_sent;
+        server_stats_inc(&server_stats->compressed_replay_bytes_sent, (unsigned long)n_sent);
+    }
+
+    return REPLAY_CACHE_OK;
+}
+
+/**
+ * Send the segments in [raw_off, raw_end) of the store, each as a frame stored 
+ * as is: its header, then the segment itself with sendfile(). 
+ */
+static int send_stored_frames (ReplayCache_t *cache, CompressedReplay_t *replay, int fd, int *error_code)
+{
+    char header[REPLAY_CACHE_FRAME_HEADER_SIZE];
+
+    put_le32(&header[0], (uint32_t)REPLAY_CACHE_SEGMENT_SIZE);
+    put_le32(&header[4], (uint32_t)REPLAY_CACHE_SEGMENT_SIZE);
+
+    while (replay->raw_off < replay->raw_end)
+    {
+        ssize_t n_sent;
+
+        if (replay->raw_header_sent < REPLAY_CACHE_FRAME_HEADER_SIZE)
+        {
+            n_sent = send(fd, &header[replay->raw_header_sent], REPLAY_CACHE_FRAME_HEADER_SIZE - replay->raw_header_sent, 
+                          MSG_NOSIGNAL);
+        }
+        else
+        {
+            off_t segment_end = (replay->raw_off - (replay->raw_off % REPLAY_CACHE_SEGMENT_SIZE)) + 
+                                REPLAY_CACHE_SEGMENT_SIZE;
+            n_sent = sendfile(fd, cache->store->fd, &replay->raw_off, segment_end - replay->raw_off);
+        }
+
+        if (n_sent == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            *error_code = errno;
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? REPLAY_CACHE_WOULD_BLOCK : REPLAY_CACHE_SEND_FAILED;
+        }
+
+        if (n_sent == 0)
+        {
+            *error_code = EIO;
+            return REPLAY_CACHE_SEND_FAILED;
+        }
+
+        server_stats_inc(&server_stats->compressed_replay_bytes_sent, (unsigned long)n_sent);
+
+        if (replay->raw_header_sent < REPLAY_CACHE_FRAME_HEADER_SIZE)
+        {
+            replay->raw_header_sent += (uint32_t)n_sent;
+        }
+        else if ((replay->raw_off % REPLAY_CACHE_SEGMENT_SIZE) == 0)
+        {
+            replay->raw_header_sent = 0U;
+        }
+    }
+
+    return REPLAY_CACHE_OK;
+}
+
+int replay_cache_send (ReplayCache_t *cache, CompressedReplay_t *replay, int fd, int *error_code)
+{
+    if ((cache == NULL) || (replay == NULL) || (error_code == NULL))
+    {
+        return REPLAY_CACHE_INVALID_PARAM;
+    }
+
+    int rc = send_data(replay, fd, replay->head_len, error_code);
+    if (rc != REPLAY_CACHE_OK)
+    {
+        return rc;
+    }
+
+    while (replay->cache_off < replay->cache_end)
+    {
+        ssize_t n_sent = sendfile(fd, cache->fd, &replay->cache_off, replay->cache_end - replay->cache_off);
+        if (n_sent == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            *error_code = errno;
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? REPLAY_CACHE_WOULD_BLOCK : REPLAY_CACHE_SEND_FAILED;
+        }
+
+        if (n_sent == 0)
+        {
+            *error_code = EIO;
+            return REPLAY_CACHE_SEND_FAILED;
+        }
+
+        server_stats_inc(&server_stats->compressed_replay_bytes_sent, (unsigned long)n_sent);
+    }
+
+    rc = send_stored_frames(cache, replay, fd, error_code);
+    if (rc != REPLAY_CACHE_OK)
+    {
+        return rc;
+    }
+
+    return send_data(replay, fd, replay->len, error_code);
+}
+
+void replay_cache_write_stats (ReplayCache_t *cache, FILE *fp)
+{
+    if ((cache == NULL) || (cache->store == NULL) || (fp == NULL))
+    {
+        return;
+    }
+
+    adaptive_mutex_lock(&cache->mutex);
+    size_t num_of_segments = cache->num_of_segments;
+    off_t size = (num_of_segments == 0U) ? 0 : cache->frame_ends[num_of_segments - 1U];
+    adaptive_mutex_unlock(&cache->mutex);
+
+    fprintf(fp, "replay_cache_segments %zu\n", num_of_segments);
+    fprintf(fp, "replay_cache_size %lld\n", (long long)size);
+}
+
+bool replay_cache_parse_command (const char *buf, size_t len, ReplayEncoding_t *encoding)
+{
+    if ((len <= REPLAY_CACHE_COMPRESS_COMMAND_LEN) || 
+        (memcmp(buf, REPLAY_CACHE_COMPRESS_COMMAND, REPLAY_CACHE_COMPRESS_COMMAND_LEN) != 0))
+    {
+        return false;
+    }
+
+    const char *name = &buf[REPLAY_CACHE_COMPRESS_COMMAND_LEN];
+    size_t name_len = len - REPLAY_CACHE_COMPRESS_COMMAND_LEN;
+
+    if ((name[name_len - 1U] == '\n') || (name[name_len - 1U] == '\0'))
+    {
+        name_len--;
+    }
+
+    if ((name_len == 3U) && (memcmp(name, "lz4", 3U) == 0))
+    {
+        *encoding = REPLAY_ENCODING_LZ4;
+    }
+    else if ((name_len == 4U) && (memcmp(name, "none", 4U) == 0))
+    {
+        *encoding = REPLAY_ENCODING_RAW;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,199 @@
+/**
+ * \file    scheduler.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   timerfd-based periodic job scheduler implementation
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "scheduler.h"
+
+#define NSEC_PER_SEC        (1000000000L)
+
+static inline bool timespec_before (const struct timespec *a, const struct timespec *b)
+{
+    return (a->tv_sec < b->tv_sec) || ((a->tv_sec == b->tv_sec) && (a->tv_nsec < b->tv_nsec));
+}
+
+static inline void timespec_add (struct timespec *t, const struct timespec *delta)
+{
+    t->tv_sec += delta->tv_sec;
+    t->tv_nsec += delta->tv_nsec;
+    if (t->tv_nsec >= NSEC_PER_SEC)
+    {
+        t->tv_sec++;
+        t->tv_nsec -= NSEC_PER_SEC;
+    }
+}
+
+static int arm_timer (Scheduler_t *scheduler)
+{
+    struct itimerspec its = { 0 };
+
+    /* An all-zero it_value disarms the timer when there is no job left */
+    for (unsigned int i = 0U; i < scheduler->num_of_jobs; ++i)
+    {
+        if ((i == 0U) || timespec_before(&scheduler->jobs[i].next, &its.it_value))
+        {
+            its.it_value = scheduler->jobs[i].next;
+        }
+    }
+
+    return timerfd_settime(scheduler->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+int scheduler_init (Scheduler_t *scheduler, int *error_code)
+{
+    if ((scheduler == NULL) || (error_code == NULL))
+    {
+        return SCHEDULER_INVALID_PARAM;
+    }
+
+    memset(scheduler, 0, sizeof(Scheduler_t));
+    *error_code = 0;
+
+    scheduler->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (scheduler->timer_fd == -1)
+    {
+        *error_code = errno;
+        return SCHEDULER_TIMERFD_FAILED;
+    }
+
+    return SCHEDULER_OK;
+}
+
+int scheduler_add_job (Scheduler_t *scheduler, const char *name, unsigned int interval_ms, 
+                       SchedulerJobFunc_t func, void *ctx, int *error_code)
+{
+    if ((scheduler == NULL) || (func == NULL) || (interval_ms == 0U) || (error_code == NULL))
+    {
+        return SCHEDULER_INVALID_PARAM;
+    }
+
+    *error_code = 0;
+
+    if (scheduler->num_of_jobs == SCHEDULER_MAX_JOBS)
+    {
+        return SCHEDULER_TOO_MANY_JOBS;
+    }
+
+    SchedulerJob_t *job = &scheduler->jobs[scheduler->num_of_jobs];
+    job->name = name;
+    job->func = func;
+    job->ctx = ctx;
+    job->interval.tv_sec = interval_ms / 1000U;
+    job->interval.tv_nsec = (long)(interval_ms % 1000U) * 1000000L;
+    clock_gettime(CLOCK_MONOTONIC, &job->next);
+    timespec_add(&job->next, &job->interval);
+    scheduler->num_of_jobs++;
+
+    if (arm_timer(scheduler) != 0)
+    {
+        *error_code = errno;
+        scheduler->num_of_jobs--;
+        return SCHEDULER_SETTIME_FAILED;
+    }
+
+    return SCHEDULER_OK;
+}
+
+void scheduler_remove_job (Scheduler_t *scheduler, SchedulerJobFunc_t func, void *ctx)
+{
+    if (scheduler == NULL)
+    {
+        return;
+    }
+
+    for (unsigned int i = 0U; i < scheduler->num_of_jobs; ++i)
+    {
+        if ((scheduler->jobs[i].func == func) && (scheduler->jobs[i].ctx == ctx))
+        {
+            scheduler->num_of_jobs--;
+            scheduler->jobs[i] = scheduler->jobs[scheduler->num_of_jobs];
+            arm_timer(scheduler);
+            return;
+        }
+    }
+}
+
+int scheduler_get_fd (Scheduler_t *scheduler)
+{
+    return (scheduler == NULL) ? -1 : scheduler->timer_fd;
+}
+
+void scheduler_dispatch (Scheduler_t *scheduler)
+{
+    uint64_t expirations = 0U;
+    struct timespec now;
+
+    if (scheduler == NULL)
+    {
+        return;
+    }
+
+    ssize_t n_read = read(scheduler->timer_fd, &expirations, sizeof(expirations));
+    (void)n_read;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (unsigned int i = 0U; i < scheduler->num_of_jobs; ++i)
+    {
+        SchedulerJob_t *job = &scheduler->jobs[i];
+
+        if (timespec_before(&now, &job->next))
+        {
+            continue;
+        }
+
+        while (!timespec_before(&now, &job->next))
+        {
+            timespec_add(&job->next, &job->interval);
+        }
+
+        job->func(job->ctx);
+    }
+
+    arm_timer(scheduler);
+}
+
+void scheduler_destroy (Scheduler_t *scheduler)
+{
+    if ((scheduler == NULL) || (scheduler->timer_fd == -1))
+    {
+        return;
+    }
+
+    close(scheduler->timer_fd);
+    scheduler->timer_fd = -1;
+    scheduler->num_of_jobs = 0U;
+}
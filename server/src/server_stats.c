@@ -0,0 +1,104 @@
+/**
+ * \file    server_stats.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Server-wide counters implementation
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "server_stats.h"
+#include "async_log.h"
+#include "adaptive_lock.h"
+
+static ServerStats_t local_server_stats;
+ServerStats_t *server_stats = &local_server_stats;
+
+bool server_stats_share (void)
+{
+    ServerStats_t *shared = (ServerStats_t *)mmap(NULL, sizeof(ServerStats_t), PROT_READ | PROT_WRITE, 
+                                                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (shared == MAP_FAILED)
+    {
+        return false;
+    }
+
+    memcpy(shared, server_stats, sizeof(ServerStats_t));
+    server_stats = shared;
+
+    return true;
+}
+
+bool server_stats_flush (const char *path, DataStore_t *store, AppendScheduler_t *append_sched, 
+                         RecordIndex_t *index, ReplayCache_t *replay_cache)
+{
+    char tmp_path[256];
+
+    if (path == NULL)
+    {
+        return false;
+    }
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "w");
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    fprintf(fp, "connections_accepted %lu\n", atomic_load(&server_stats->connections_accepted));
+    fprintf(fp, "connections_active %lu\n", atomic_load(&server_stats->connections_active));
+    fprintf(fp, "connections_idle_closed %lu\n", atomic_load(&server_stats->connections_idle_closed));
+    fprintf(fp, "packets_committed %lu\n", atomic_load(&server_stats->packets_committed));
+    fprintf(fp, "bytes_committed %lu\n", atomic_load(&server_stats->bytes_committed));
+    fprintf(fp, "compressed_replays %lu\n", atomic_load(&server_stats->compressed_replays));
+    fprintf(fp, "compressed_replay_raw_bytes %lu\n", atomic_load(&server_stats->compressed_replay_raw_bytes));
+    fprintf(fp, "compressed_replay_bytes_sent %lu\n", atomic_load(&server_stats->compressed_replay_bytes_sent));
+    fprintf(fp, "log_records_dropped %llu\n", (unsigned long long)async_log_dropped());
+    if (store != NULL)
+    {
+        fprintf(fp, "data_store_size %lld\n", (long long)data_store_size(store));
+    }
+    record_index_write_stats(index, fp);
+    replay_cache_write_stats(replay_cache, fp);
+    append_sched_write_stats(append_sched, fp);
+    lock_stats_write(fp);
+
+    if (fclose(fp) != 0)
+    {
+        unlink(tmp_path);
+        return false;
+    }
+
+    return (rename(tmp_path, path) == 0);
+}
@@ -31,6 +31,8 @@
  * SOFTWARE. 
  */
 
+#define _GNU_SOURCE
+
 #include <stddef.h>
 #include <netdb.h>
 #include <errno.h>
@@ -66,7 +68,8 @@ int create_socket_server (char *port, int *sfd, int *error_code)
             ret = SOCKET_SERVER_GET_ADDRINFO_FAILED;
         }
 
-        *sfd = socket(sockaddrinfo->ai_family, sockaddrinfo->ai_socktype, 
+        /* A successor started on upgrade gets the listener over the handoff channel, not by inheritance */
+        *sfd = socket(sockaddrinfo->ai_family, sockaddrinfo->ai_socktype | SOCK_CLOEXEC, 
                       sockaddrinfo->ai_protocol);
         
         if (*sfd == -1)
@@ -106,7 +109,8 @@ int wait_connection (int sfd, int *cfd, struct sockaddr *client_addr, socklen_t
     else
     {
         *client_addrlen = sizeof(*client_addr);
-        *cfd = accept(sfd, client_addr, client_addrlen);
+        /* Otherwise a successor would hold the connections the draining server closes open */
+        *cfd = accept4(sfd, client_addr, client_addrlen, SOCK_CLOEXEC);
 
         if (*cfd == -1)
         {
@@ -0,0 +1,357 @@
+/**
+ * \file    c10k_idle_test.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Holds a large number of idle connections against aesdsocket 
+ *          in event mode and reports the memory they cost the server
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_NUM_OF_CONNECTIONS      (10000)
+/* User-space bytes per idle connection, see EVENT_SERVER_IDLE_CONN_BUDGET */
+#define DEFAULT_RSS_BUDGET_PER_CONN     (512L)
+#define SERVER_PORT                     (9000)
+#define ACCEPT_TIMEOUT_SEC              (30)
+
+typedef struct
+{
+    long vm_rss_kb;
+    long vm_size_kb;
+    long fds;
+    long tcp_mem_pages;
+} MemSample_t;
+
+static long read_status_kb (pid_t pid, const char *key)
+{
+    char path[64];
+    char line[256];
+    long value = -1;
+    size_t key_len = strlen(key);
+
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        if ((strncmp(line, key, key_len) == 0) && (line[key_len] == ':'))
+        {
+            value = strtol(&line[key_len + 1], NULL, 10);
+            break;
+        }
+    }
+
+    fclose(fp);
+
+    return value;
+}
+
+static long count_fds (pid_t pid)
+{
+    char path[64];
+    long count = 0;
+
+    snprintf(path, sizeof(path), "/proc/%d/fd", (int)pid);
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+    {
+        return -1;
+    }
+
+    while (readdir(dir) != NULL)
+    {
+        count++;
+    }
+
+    closedir(dir);
+
+    return count - 2;
+}
+
+static long read_tcp_mem_pages (void)
+{
+    char line[256];
+    long pages = -1;
+
+    FILE *fp = fopen("/proc/net/sockstat", "r");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        char *mem = strstr(line, " mem ");
+        if ((strncmp(line, "TCP:", 4) == 0) && (mem != NULL))
+        {
+            pages = strtol(&mem[5], NULL, 10);
+            break;
+        }
+    }
+
+    fclose(fp);
+
+    return pages;
+}
+
+static void sample (pid_t pid, MemSample_t *mem)
+{
+    mem->vm_rss_kb = read_status_kb(pid, "VmRSS");
+    mem->vm_size_kb = read_status_kb(pid, "VmSize");
+    mem->fds = count_fds(pid);
+    mem->tcp_mem_pages = read_tcp_mem_pages();
+}
+
+static int connect_server (void)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(SERVER_PORT) };
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static bool exchange_packet (int fd, const char *packet)
+{
+    char reply[4096];
+    size_t packet_len = strlen(packet);
+    size_t total = 0;
+    struct timeval tv = { .tv_sec = 5 };
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    if (send(fd, packet, packet_len, 0) != (ssize_t)packet_len)
+    {
+        return false;
+    }
+
+    /* The replay ends with our own packet */
+    while (total < sizeof(reply))
+    {
+        ssize_t n_read = recv(fd, &reply[total], sizeof(reply) - total, 0);
+        if (n_read <= 0)
+        {
+            return false;
+        }
+
+        total += n_read;
+        if ((total >= packet_len) && (memcmp(&reply[total - packet_len], packet, packet_len) == 0))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void raise_fd_limit (long needed)
+{
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        if ((long)limit.rlim_cur < needed)
+        {
+            fprintf(stderr, "warning: RLIMIT_NOFILE %ld is below the %ld descriptors needed\n", 
+                    (long)limit.rlim_cur, needed);
+        }
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    const char *server_path = "./aesdsocket";
+    long num_of_conns = DEFAULT_NUM_OF_CONNECTIONS;
+    long rss_budget = DEFAULT_RSS_BUDGET_PER_CONN;
+    int opt = 0;
+    int fd = -1;
+    bool passed = true;
+    MemSample_t before;
+    MemSample_t after;
+
+    while ((opt = getopt(argc, argv, "n:s:b:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            num_of_conns = strtol(optarg, NULL, 10);
+            break;
+
+        case 's':
+            server_path = optarg;
+            break;
+
+        case 'b':
+            rss_budget = strtol(optarg, NULL, 10);
+            break;
+
+        default:
+            fprintf(stderr, "Usage: %s [-n connections] [-s server_path] [-b rss_budget_per_conn]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    raise_fd_limit(num_of_conns + 16);
+
+    int *fds = (int *)malloc(num_of_conns * sizeof(int));
+    if (fds == NULL)
+    {
+        perror("malloc");
+        return 2;
+    }
+
+    pid_t server_pid = fork();
+    if (server_pid == -1)
+    {
+        perror("fork");
+        return 2;
+    }
+
+    if (server_pid == 0)
+    {
+        execl(server_path, server_path, "-m", "event", (char *)NULL);
+        perror("execl");
+        _exit(127);
+    }
+
+    /* Wait for the listener, then warm up the scratch buffer and the replay path */
+    for (int retry = 0; (fd == -1) && (retry < 100); ++retry)
+    {
+        usleep(50000);
+        fd = connect_server();
+    }
+
+    if ((fd == -1) || !exchange_packet(fd, "warmup\n"))
+    {
+        fprintf(stderr, "server did not come up\n");
+        kill(server_pid, SIGKILL);
+        waitpid(server_pid, NULL, 0);
+        return 1;
+    }
+    close(fd);
+    usleep(100000);
+
+    sample(server_pid, &before);
+
+    long opened = 0;
+    for (; opened < num_of_conns; ++opened)
+    {
+        fds[opened] = connect_server();
+        if (fds[opened] == -1)
+        {
+            fprintf(stderr, "connect() #%ld failed: %s\n", opened, strerror(errno));
+            passed = false;
+            break;
+        }
+    }
+
+    /* Every connection is accepted once the server holds one descriptor per connection */
+    time_t deadline = time(NULL) + ACCEPT_TIMEOUT_SEC;
+    while ((count_fds(server_pid) < (before.fds + opened)) && (time(NULL) < deadline))
+    {
+        usleep(50000);
+    }
+
+    sample(server_pid, &after);
+
+    long held = after.fds - before.fds;
+    long page_size = sysconf(_SC_PAGESIZE);
+    double rss_per_conn = (held > 0) ? (((after.vm_rss_kb - before.vm_rss_kb) * 1024.0) / held) : 0.0;
+    double vm_per_conn = (held > 0) ? (((after.vm_size_kb - before.vm_size_kb) * 1024.0) / held) : 0.0;
+    double tcp_mem_per_conn = (held > 0) ? 
+                              ((double)(after.tcp_mem_pages - before.tcp_mem_pages) * page_size / held) : 0.0;
+
+    printf("{\"connections\": %ld, \"held_by_server\": %ld, "
+           "\"rss_kb\": [%ld, %ld], \"vm_kb\": [%ld, %ld], "
+           "\"rss_bytes_per_conn\": %.1f, \"vm_bytes_per_conn\": %.1f, \"tcp_mem_bytes_per_conn\": %.1f}\n", 
+           opened, held, before.vm_rss_kb, after.vm_rss_kb, before.vm_size_kb, after.vm_size_kb, 
+           rss_per_conn, vm_per_conn, tcp_mem_per_conn);
+
+    if (held < opened)
+    {
+        fprintf(stderr, "FAIL: server only accepted %ld of %ld connections\n", held, opened);
+        passed = false;
+    }
+
+    if (rss_per_conn > rss_budget)
+    {
+        fprintf(stderr, "FAIL: %.1f RSS bytes per idle connection, budget is %ld\n", rss_per_conn, rss_budget);
+        passed = false;
+    }
+
+    /* Idle connections must still be served */
+    if ((opened > 0) && (!exchange_packet(fds[0], "first\n") || !exchange_packet(fds[opened - 1], "last\n")))
+    {
+        fprintf(stderr, "FAIL: idle connection was not served\n");
+        passed = false;
+    }
+
+    for (long i = 0; i < opened; ++i)
+    {
+        close(fds[i]);
+    }
+    free(fds);
+
+    kill(server_pid, SIGTERM);
+    waitpid(server_pid, NULL, 0);
+
+    printf("%s\n", passed ? "PASS" : "FAIL");
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,466 @@
+/**
+ * \file    lz4_block_test.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Round trips the LZ4 block codec over random, repetitive and 
+ *          incompressible input, feeds the decoder truncated and corrupted 
+ *          blocks, and decodes replays of the replay cache frame by frame
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "lz4_block.h"
+#include "replay_cache.h"
+#include "server_stats.h"
+
+#define GUARD_SIZE                      (64U)
+#define GUARD_BYTE                      (0xA5)
+#define NUM_OF_CORRUPTIONS              (20000)
+#define STORE_PATH                      "/tmp/lz4_block_test.store"
+/* Whole segments of the store: random, repetitive, log lines, random again, then a partial one */
+#define NUM_OF_STORE_SEGMENTS           (4U)
+#define STORE_TAIL_SIZE                 (1000U)
+#define STORE_SIZE                      ((NUM_OF_STORE_SEGMENTS * REPLAY_CACHE_SEGMENT_SIZE) + STORE_TAIL_SIZE)
+#define SEAL_TIMEOUT_MS                 (5000)
+
+/* The replay cache counts into the server counters, which live in server_stats.c with the rest of the server */
+static ServerStats_t test_server_stats;
+ServerStats_t *server_stats = &test_server_stats;
+
+static bool passed = true;
+
+#define CHECK(cond) \
+    do \
+    { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "FAIL: %s (%s:%d)\n", #cond, __FILE__, __LINE__); \
+            passed = false; \
+        } \
+    } while (0)
+
+static uint32_t next_random (uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static void fill_random (char *buf, size_t len, uint32_t *state)
+{
+    for (size_t i = 0U; i < len; ++i)
+    {
+        buf[i] = (char)next_random(state);
+    }
+}
+
+/* Runs of one byte mixed with a short phrase repeating at odd distances */
+static void fill_repetitive (char *buf, size_t len, uint32_t *state)
+{
+    static const char phrase[] = "abcabcabd";
+    size_t i = 0U;
+
+    while (i < len)
+    {
+        size_t run = (next_random(state) % 300U) + 1U;
+        bool use_phrase = (next_random(state) & 1U) != 0U;
+        char byte = (char)next_random(state);
+
+        for (size_t j = 0U; (j < run) && (i < len); ++j, ++i)
+        {
+            buf[i] = use_phrase ? phrase[j % (sizeof(phrase) - 1U)] : byte;
+        }
+    }
+}
+
+/* What the server stores: newline terminated lines sharing most of their bytes */
+static void fill_log_lines (char *buf, size_t len, uint32_t *state)
+{
+    size_t i = 0U;
+
+    while (i < len)
+    {
+        char line[128];
+        int n = snprintf(line, sizeof(line), "timestamp:2026-10-18 10:%02u:%02u sensor %u value %u\n", 
+                         next_random(state) % 60U, next_random(state) % 60U, next_random(state) % 8U, 
+                         next_random(state) % 100000U);
+        for (int j = 0; (j < n) && (i < len); ++j, ++i)
+        {
+            buf[i] = line[j];
+        }
+    }
+}
+
+static bool guard_intact (const char *guard)
+{
+    for (size_t i = 0U; i < GUARD_SIZE; ++i)
+    {
+        if ((unsigned char)guard[i] != GUARD_BYTE)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Compress and decompress @param len bytes of @param src, checking the block 
+ * stays within LZ4_BLOCK_BOUND() and comes back unchanged. 
+ * @return size of the compressed block 
+ */
+static size_t round_trip (const char *src, size_t len, char *block, char *out)
+{
+    size_t block_len = 0U;
+    size_t out_len = 0U;
+
+    CHECK(lz4_block_compress(src, len, block, LZ4_BLOCK_BOUND(len), &block_len) == LZ4_BLOCK_OK);
+    CHECK(block_len <= LZ4_BLOCK_BOUND(len));
+
+    memset(&out[len], GUARD_BYTE, GUARD_SIZE);
+    CHECK(lz4_block_decompress(block, block_len, out, len, &out_len) == LZ4_BLOCK_OK);
+    CHECK((out_len == len) && (memcmp(src, out, len) == 0));
+    CHECK(guard_intact(&out[len]));
+
+    return block_len;
+}
+
+static void test_round_trips (char *src, char *block, char *out)
+{
+    static const size_t sizes[] = { 0U, 1U, 4U, 12U, 13U, 100U, 4096U, 65535U, LZ4_BLOCK_MAX_INPUT };
+    void (*const fills[])(char *, size_t, uint32_t *) = { fill_random, fill_repetitive, fill_log_lines };
+    uint32_t state = 1U;
+
+    for (size_t f = 0U; f < (sizeof(fills) / sizeof(fills[0])); ++f)
+    {
+        for (size_t s = 0U; s < (sizeof(sizes) / sizeof(sizes[0])); ++s)
+        {
+            fills[f](src, sizes[s], &state);
+            size_t block_len = round_trip(src, sizes[s], block, out);
+
+            /* Repetitive input and log lines have to shrink for the replay cache to be worth it */
+            if ((f > 0U) && (sizes[s] >= 4096U))
+            {
+                CHECK(block_len < (sizes[s] / 2U));
+            }
+        }
+    }
+
+    /* A single repeated byte is one long overlapping match */
+    memset(src, 'x', LZ4_BLOCK_MAX_INPUT);
+    CHECK(round_trip(src, LZ4_BLOCK_MAX_INPUT, block, out) < 512U);
+
+    /* Incompressible input does not fit in less than its own size */
+    size_t block_len = 0U;
+    fill_random(src, LZ4_BLOCK_MAX_INPUT, &state);
+    CHECK(lz4_block_compress(src, LZ4_BLOCK_MAX_INPUT, block, LZ4_BLOCK_MAX_INPUT / 2U, &block_len) == 
+          LZ4_BLOCK_NO_SPACE);
+    CHECK(lz4_block_compress(src, LZ4_BLOCK_MAX_INPUT + 1U, block, LZ4_BLOCK_BOUND(LZ4_BLOCK_MAX_INPUT + 1U), 
+                             &block_len) != LZ4_BLOCK_OK);
+}
+
+/**
+ * Decode @param block_len bytes of @param block into a buffer of @param cap 
+ * bytes followed by a guard. 
+ * @return false if the decoder wrote past the buffer or reported more than it holds 
+ */
+static bool decode_guarded (const char *block, size_t block_len, char *out, size_t cap, int *rc, size_t *out_len)
+{
+    memset(&out[cap], GUARD_BYTE, GUARD_SIZE);
+    *out_len = 0U;
+    *rc = lz4_block_decompress(block, block_len, out, cap, out_len);
+    return guard_intact(&out[cap]) && (*out_len <= cap);
+}
+
+static void test_corrupt_blocks (char *src, char *block, char *out)
+{
+    uint32_t state = 7U;
+    size_t block_len = 0U;
+    size_t out_len = 0U;
+    int rc = 0;
+
+    fill_log_lines(src, 8192U, &state);
+    CHECK(lz4_block_compress(src, 8192U, block, LZ4_BLOCK_BOUND(8192U), &block_len) == LZ4_BLOCK_OK);
+
+    /* A cut block either fails or decodes to less than the whole input */
+    for (size_t cut = 0U; cut < block_len; ++cut)
+    {
+        CHECK(decode_guarded(block, cut, out, 8192U, &rc, &out_len));
+        CHECK((rc != LZ4_BLOCK_OK) || (out_len < 8192U));
+    }
+
+    /* Too small an output buffer is caught rather than overrun */
+    CHECK(decode_guarded(block, block_len, out, 8191U, &rc, &out_len));
+    CHECK(rc == LZ4_BLOCK_CORRUPT);
+
+    /* Random damage never takes the decoder outside its buffers */
+    char *damaged = (char *)malloc(block_len);
+    CHECK(damaged != NULL);
+    for (int i = 0; (damaged != NULL) && (i < NUM_OF_CORRUPTIONS); ++i)
+    {
+        memcpy(damaged, block, block_len);
+        int flips = (int)(next_random(&state) % 4U) + 1;
+        for (int j = 0; j < flips; ++j)
+        {
+            damaged[next_random(&state) % block_len] = (char)next_random(&state);
+        }
+        CHECK(decode_guarded(damaged, block_len, out, 8192U, &rc, &out_len));
+    }
+    free(damaged);
+
+    /* Hand made sequences: an offset of 0, one reaching before the output, a length running off the input */
+    static const char zero_offset[] = { 0x10, 'a', 0x00, 0x00, 0x00 };
+    static const char far_offset[] = { 0x10, 'a', 0x02, 0x00, 0x00 };
+    static const char long_literals[] = { (char)0xF0, (char)0xFF, 0x10, 'a' };
+    CHECK(decode_guarded(zero_offset, sizeof(zero_offset), out, 64U, &rc, &out_len) && (rc == LZ4_BLOCK_CORRUPT));
+    CHECK(decode_guarded(far_offset, sizeof(far_offset), out, 64U, &rc, &out_len) && (rc == LZ4_BLOCK_CORRUPT));
+    CHECK(decode_guarded(long_literals, sizeof(long_literals), out, 64U, &rc, &out_len) && 
+          (rc == LZ4_BLOCK_CORRUPT));
+}
+
+static uint32_t get_le32 (const char *p)
+{
+    return (uint32_t)(uint8_t)p[0] | ((uint32_t)(uint8_t)p[1] << 8) | ((uint32_t)(uint8_t)p[2] << 16) | 
+           ((uint32_t)(uint8_t)p[3] << 24);
+}
+
+/**
+ * Send @param replay over a socket pair and collect it into @param buf. 
+ * @return number of bytes received, 0 on failure 
+ */
+static size_t receive_replay (ReplayCache_t *cache, CompressedReplay_t *replay, char *buf, size_t cap)
+{
+    int fds[2];
+    size_t total = 0U;
+    int error_code = 0;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) != 0)
+    {
+        return 0U;
+    }
+
+    int rc = REPLAY_CACHE_WOULD_BLOCK;
+    while (rc == REPLAY_CACHE_WOULD_BLOCK)
+    {
+        rc = replay_cache_send(cache, replay, fds[0], &error_code);
+
+        ssize_t n_read;
+        while ((total < cap) && ((n_read = recv(fds[1], &buf[total], cap - total, 0)) > 0))
+        {
+            total += (size_t)n_read;
+        }
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+
+    return (rc == REPLAY_CACHE_OK) ? total : 0U;
+}
+
+/**
+ * Decode the frames of a replay in @param buf into @param out, counting the 
+ * frames stored as is and the compressed ones. 
+ * @return number of bytes decoded, or -1 if the frames are malformed 
+ */
+static long decode_frames (const char *buf, size_t len, char *out, size_t cap, size_t *stored, size_t *compressed)
+{
+    size_t pos = 0U;
+    size_t out_len = 0U;
+
+    *stored = 0U;
+    *compressed = 0U;
+
+    for (;;)
+    {
+        if ((len - pos) < REPLAY_CACHE_FRAME_HEADER_SIZE)
+        {
+            return -1;
+        }
+
+        uint32_t raw_len = get_le32(&buf[pos]);
+        uint32_t payload_len = get_le32(&buf[pos + 4U]);
+        pos += REPLAY_CACHE_FRAME_HEADER_SIZE;
+
+        if (raw_len == 0U)
+        {
+            break;
+        }
+
+        if ((payload_len > (len - pos)) || (raw_len > (cap - out_len)) || (raw_len > REPLAY_CACHE_SEGMENT_SIZE))
+        {
+            return -1;
+        }
+
+        if (payload_len == raw_len)
+        {
+            memcpy(&out[out_len], &buf[pos], raw_len);
+            (*stored)++;
+        }
+        else
+        {
+            size_t block_out = 0U;
+            if ((lz4_block_decompress(&buf[pos], payload_len, &out[out_len], raw_len, &block_out) != LZ4_BLOCK_OK) || 
+                (block_out != raw_len))
+            {
+                return -1;
+            }
+            (*compressed)++;
+        }
+
+        pos += payload_len;
+        out_len += raw_len;
+    }
+
+    /* Nothing follows the end frame */
+    return (pos == len) ? (long)out_len : -1;
+}
+
+/**
+ * Replay [@param start, @param end) of the store and check it decodes to those bytes. 
+ */
+static void check_replay (ReplayCache_t *cache, const char *data, off_t start, off_t end, char *buf, char *out, 
+                          size_t *stored, size_t *compressed)
+{
+    CompressedReplay_t *replay = NULL;
+    int error_code = 0;
+
+    CHECK(replay_cache_prepare(cache, start, end, &replay, &error_code) == REPLAY_CACHE_OK);
+    if (replay == NULL)
+    {
+        return;
+    }
+
+    size_t len = receive_replay(cache, replay, buf, 2U * STORE_SIZE);
+    free(replay);
+    CHECK(len > 0U);
+
+    long out_len = decode_frames(buf, len, out, STORE_SIZE, stored, compressed);
+    CHECK(out_len == (long)(end - start));
+    CHECK((out_len == (long)(end - start)) && (memcmp(out, &data[start], (size_t)(end - start)) == 0));
+}
+
+static void test_replay_frames (char *src)
+{
+    DataStore_t store;
+    ReplayCache_t cache;
+    int error_code = 0;
+    uint32_t state = 3U;
+    size_t stored = 0U;
+    size_t compressed = 0U;
+
+    fill_random(&src[0], REPLAY_CACHE_SEGMENT_SIZE, &state);
+    fill_repetitive(&src[REPLAY_CACHE_SEGMENT_SIZE], REPLAY_CACHE_SEGMENT_SIZE, &state);
+    fill_log_lines(&src[2U * REPLAY_CACHE_SEGMENT_SIZE], REPLAY_CACHE_SEGMENT_SIZE, &state);
+    fill_random(&src[3U * REPLAY_CACHE_SEGMENT_SIZE], REPLAY_CACHE_SEGMENT_SIZE + STORE_TAIL_SIZE, &state);
+
+    if (data_store_open(&store, STORE_PATH, false, &error_code) != DATA_STORE_OK)
+    {
+        fprintf(stderr, "data_store_open() failed: %s\n", strerror(error_code));
+        passed = false;
+        return;
+    }
+    CHECK(data_store_append(&store, src, STORE_SIZE, NULL, &error_code) == DATA_STORE_OK);
+
+    if (replay_cache_init(&cache, &store, &error_code) != REPLAY_CACHE_OK)
+    {
+        fprintf(stderr, "replay_cache_init() failed: %s\n", strerror(error_code));
+        passed = false;
+        data_store_close(&store);
+        unlink(STORE_PATH);
+        return;
+    }
+
+    char *buf = (char *)malloc(2U * STORE_SIZE);
+    char *out = (char *)malloc(STORE_SIZE);
+    CHECK((buf != NULL) && (out != NULL));
+
+    if ((buf != NULL) && (out != NULL))
+    {
+        /* Nothing is sealed before the first replay, every whole segment goes out stored as is and the 
+           random tail does not shrink either */
+        check_replay(&cache, src, 0, STORE_SIZE, buf, out, &stored, &compressed);
+        CHECK((stored == (NUM_OF_STORE_SEGMENTS + 1U)) && (compressed == 0U));
+
+        for (int waited = 0; (cache.num_of_segments < NUM_OF_STORE_SEGMENTS) && (waited < SEAL_TIMEOUT_MS); ++waited)
+        {
+            usleep(1000);
+        }
+        CHECK(cache.num_of_segments == NUM_OF_STORE_SEGMENTS);
+
+        /* Sealed, the random segments and tail still fall back to frames stored as is */
+        check_replay(&cache, src, 0, STORE_SIZE, buf, out, &stored, &compressed);
+        CHECK((stored == 3U) && (compressed == 2U));
+
+        /* Unaligned ends compress their partial segments per replay */
+        check_replay(&cache, src, 100, (2 * REPLAY_CACHE_SEGMENT_SIZE) + 5000, buf, out, &stored, &compressed);
+        check_replay(&cache, src, REPLAY_CACHE_SEGMENT_SIZE + 1, REPLAY_CACHE_SEGMENT_SIZE + 2, buf, out, &stored, 
+                     &compressed);
+
+        /* An empty replay is just the end frame */
+        check_replay(&cache, src, STORE_SIZE, STORE_SIZE, buf, out, &stored, &compressed);
+        CHECK((stored == 0U) && (compressed == 0U));
+    }
+
+    free(buf);
+    free(out);
+    replay_cache_destroy(&cache);
+    data_store_close(&store);
+    unlink(STORE_PATH);
+}
+
+int main (void)
+{
+    char *src = (char *)malloc(STORE_SIZE);
+    char *block = (char *)malloc(LZ4_BLOCK_BOUND(LZ4_BLOCK_MAX_INPUT + 1U));
+    char *out = (char *)malloc(LZ4_BLOCK_MAX_INPUT + GUARD_SIZE);
+
+    if ((src == NULL) || (block == NULL) || (out == NULL))
+    {
+        perror("malloc");
+        return 2;
+    }
+
+    test_round_trips(src, block, out);
+    test_corrupt_blocks(src, block, out);
+    test_replay_frames(src);
+
+    free(src);
+    free(block);
+    free(out);
+
+    printf("%s\n", passed ? "PASS" : "FAIL");
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,302 @@
+/**
+ * \file    record_ring_test.c
+ * \author  Looi Kian Seong
+ * \date    October 18, 2026
+ * \brief   Reads the shared memory record ring with record_ring_copy() while 
+ *          another process publishes to it, and checks every snapshot
+ * 
+ *          in event mode and reports the memory they cost the server
+ * 
+ * This project is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by the Open Source
+ * Initiative. See the LICENSE file or visit:
+ * https://opensource.org/licenses/MIT
+ * 
+ * Copyright (c) 2023 Looi Kian Seong 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "record_ring.h"
+
+#define DEFAULT_NUM_OF_RECORDS          (200000ULL)
+/* Records published before the writer starts, which has to keep them */
+#define NUM_OF_EARLY_RECORDS            (10ULL)
+/* Every LARGE_RECORD_INTERVAL-th record is large enough to drop many older ones out of the payload region */
+#define LARGE_RECORD_INTERVAL           (97ULL)
+#define MAX_RECORD_SIZE                 (300UL * 1024UL)
+
+/**
+ * Record @param n is its number, then filler derived from it up to a size 
+ * derived from it, then a newline, so a torn, stale or misplaced record shows. 
+ * @return the size of record @param n, written to @param buf unless NULL 
+ */
+static size_t make_record (unsigned long long n, char *buf)
+{
+    size_t size = (size_t)((n * 7919ULL) % 600ULL) + 32U;
+    if ((n % LARGE_RECORD_INTERVAL) == 0ULL)
+    {
+        size = (size_t)((n * 104729ULL) % (MAX_RECORD_SIZE - (100UL * 1024UL))) + (100UL * 1024UL);
+    }
+
+    if (buf != NULL)
+    {
+        int prefix = snprintf(buf, size, "%llu ", n);
+        for (size_t i = (size_t)prefix; i < (size - 1U); ++i)
+        {
+            buf[i] = (char)('a' + ((n + i) % 26ULL));
+        }
+        buf[size - 1U] = '\n';
+    }
+
+    return size;
+}
+
+/**
+ * Publish records @param first up to @param last, each at the store offset 
+ * it would have after the ones before it. 
+ */
+static void publish_records (RecordRing_t *ring, unsigned long long first, unsigned long long last, char *scratch)
+{
+    for (unsigned long long n = first; n < last; ++n)
+    {
+        size_t size = make_record(n, scratch);
+        record_ring_publish(ring, scratch, size, (off_t)(n * 1024ULL));
+    }
+}
+
+/**
+ * Walk the records copied into @param buf and compare each one with the record 
+ * its number in @param snapshot says it is. 
+ */
+static bool check_snapshot (const char *buf, const RecordRingSnapshot_t *snapshot, char *expected)
+{
+    size_t pos = 0U;
+
+    for (uint64_t i = 0U; i < snapshot->num_of_records; ++i)
+    {
+        unsigned long long n = (unsigned long long)(snapshot->first_record + i);
+        size_t size = make_record(n, expected);
+
+        if (((snapshot->len - pos) < size) || (memcmp(&buf[pos], expected, size) != 0))
+        {
+            fprintf(stderr, "FAIL: record %llu, %llu of %llu in the snapshot, is not intact\n", 
+                    n, (unsigned long long)i, (unsigned long long)snapshot->num_of_records);
+            return false;
+        }
+        pos += size;
+    }
+
+    if (pos != snapshot->len)
+    {
+        fprintf(stderr, "FAIL: snapshot of %zu bytes holds %zu bytes of records\n", snapshot->len, pos);
+        return false;
+    }
+
+    return true;
+}
+
+int main (int argc, char *argv[])
+{
+    char name[64];
+    unsigned long long num_of_records = DEFAULT_NUM_OF_RECORDS;
+    int opt = 0;
+    int error_code = 0;
+    bool passed = true;
+    RecordRing_t writer = { .fd = -1 };
+    RecordRing_t reader = { .fd = -1 };
+    RecordRingSnapshot_t snapshot;
+
+    /* Not RECORD_RING_NAME, a server running alongside keeps its ring */
+    snprintf(name, sizeof(name), "/aesdsocket-records-test-%d", (int)getpid());
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            num_of_records = strtoull(optarg, NULL, 10);
+            break;
+
+        default:
+            fprintf(stderr, "Usage: %s [-n records]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    char *buf = (char *)malloc(RECORD_RING_PAYLOAD_SIZE);
+    char *scratch = (char *)malloc(MAX_RECORD_SIZE);
+    if ((buf == NULL) || (scratch == NULL))
+    {
+        perror("malloc");
+        return 2;
+    }
+
+    if (record_ring_attach(&reader, name, &error_code) != RECORD_RING_OPEN_FAILED)
+    {
+        fprintf(stderr, "FAIL: attached to a ring nobody created\n");
+        passed = false;
+    }
+
+    int rc = record_ring_open(&writer, name, false, &error_code);
+    if (rc != RECORD_RING_OK)
+    {
+        fprintf(stderr, "record_ring_open() failed (%d): %s\n", rc, strerror(error_code));
+        return 2;
+    }
+    publish_records(&writer, 0ULL, NUM_OF_EARLY_RECORDS, scratch);
+
+    rc = record_ring_attach(&reader, name, &error_code);
+    if (rc != RECORD_RING_OK)
+    {
+        fprintf(stderr, "record_ring_attach() failed (%d): %s\n", rc, strerror(error_code));
+        record_ring_close(&writer);
+        shm_unlink(name);
+        return 2;
+    }
+
+    /* The writer reopens the ring the way a server taking over the listener does */
+    pid_t writer_pid = fork();
+    if (writer_pid == -1)
+    {
+        perror("fork");
+        return 2;
+    }
+
+    if (writer_pid == 0)
+    {
+        RecordRing_t successor = { .fd = -1 };
+
+        if ((record_ring_open(&successor, name, true, &error_code) != RECORD_RING_OK) || 
+            (record_ring_published(&successor) != NUM_OF_EARLY_RECORDS))
+        {
+            _exit(3);
+        }
+        publish_records(&successor, NUM_OF_EARLY_RECORDS, num_of_records, scratch);
+        record_ring_close(&successor);
+        _exit(0);
+    }
+
+    uint64_t prev_first = 0U;
+    uint64_t prev_end = 0U;
+    unsigned long long snapshots = 0ULL;
+    unsigned long long live_snapshots = 0ULL;
+    int status = 0;
+
+    while (passed && (waitpid(writer_pid, &status, WNOHANG) == 0))
+    {
+        rc = record_ring_copy(&reader, buf, RECORD_RING_PAYLOAD_SIZE, &snapshot);
+        if (rc != RECORD_RING_OK)
+        {
+            fprintf(stderr, "FAIL: record_ring_copy() returned %d with the writer running\n", rc);
+            passed = false;
+            break;
+        }
+
+        uint64_t end = snapshot.first_record + snapshot.num_of_records;
+        if ((snapshot.first_record < prev_first) || (end < prev_end))
+        {
+            fprintf(stderr, "FAIL: snapshot of records %llu to %llu went back from %llu to %llu\n", 
+                    (unsigned long long)snapshot.first_record, (unsigned long long)end, 
+                    (unsigned long long)prev_first, (unsigned long long)prev_end);
+            passed = false;
+            break;
+        }
+
+        passed = check_snapshot(buf, &snapshot, scratch);
+        prev_first = snapshot.first_record;
+        prev_end = end;
+        snapshots++;
+        live_snapshots += (end < num_of_records) ? 1ULL : 0ULL;
+    }
+
+    if (!passed)
+    {
+        kill(writer_pid, SIGKILL);
+        waitpid(writer_pid, &status, 0);
+    }
+    else if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+    {
+        fprintf(stderr, "FAIL: writer did not run to the end, wait status %#x\n", status);
+        passed = false;
+    }
+
+    /* With the writer gone the ring ends at its last record */
+    rc = record_ring_copy(&reader, buf, RECORD_RING_PAYLOAD_SIZE, &snapshot);
+    if (passed && ((rc != RECORD_RING_OK) || (snapshot.num_of_records == 0U) || 
+                   ((snapshot.first_record + snapshot.num_of_records) != num_of_records) || 
+                   !check_snapshot(buf, &snapshot, scratch)))
+    {
+        fprintf(stderr, "FAIL: final snapshot (%d) does not end at record %llu\n", rc, num_of_records);
+        passed = false;
+    }
+
+    if (passed && (live_snapshots == 0ULL))
+    {
+        fprintf(stderr, "FAIL: no snapshot was taken while the writer was running\n");
+        passed = false;
+    }
+
+    /* Too small a buffer gets the size it takes */
+    size_t full_len = snapshot.len;
+    if (passed && ((record_ring_copy(&reader, buf, 1U, &snapshot) != RECORD_RING_NO_SPACE) || 
+                   (snapshot.len != full_len)))
+    {
+        fprintf(stderr, "FAIL: a copy into 1 byte did not ask for %zu bytes\n", full_len);
+        passed = false;
+    }
+
+    /* A record larger than the payload region is skipped, not published */
+    char *oversized = (char *)calloc(RECORD_RING_PAYLOAD_SIZE + 1U, 1U);
+    if (passed && (oversized != NULL))
+    {
+        record_ring_publish(&writer, oversized, RECORD_RING_PAYLOAD_SIZE + 1U, 0);
+        if ((record_ring_published(&reader) != num_of_records) || 
+            (record_ring_copy(&reader, buf, RECORD_RING_PAYLOAD_SIZE, &snapshot) != RECORD_RING_OK) || 
+            (snapshot.len != full_len))
+        {
+            fprintf(stderr, "FAIL: an oversized record changed the ring\n");
+            passed = false;
+        }
+    }
+    free(oversized);
+
+    record_ring_close(&reader);
+    record_ring_close(&writer);
+    shm_unlink(name);
+    free(buf);
+    free(scratch);
+
+    printf("{\"records\": %llu, \"snapshots\": %llu, \"snapshots_while_writing\": %llu}\n", 
+           num_of_records, snapshots, live_snapshots);
+    printf("%s\n", passed ? "PASS" : "FAIL");
+
+    return passed ? 0 : 1;
+}
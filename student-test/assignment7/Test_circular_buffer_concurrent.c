@@ -0,0 +1,302 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "../../aesd-char-driver/aesd-circular-buffer-concurrent.h"
+
+#define STRESS_PAYLOADS         (4096)
+#define STRESS_WRITES           (100000)
+#define STRESS_READERS          (3)
+#define STRESS_WRITERS          (4)
+
+static struct aesd_concurrent_circular_buffer stress_buffer;
+static char stress_payload[STRESS_PAYLOADS][32];
+static atomic_bool stress_done;
+static atomic_int stress_failures;
+static atomic_long stress_lookups;
+static int stress_writer_count;
+
+/* One buffer more than the ring has slots, so the writer always has one free until add_entry hands one back */
+#define RECYCLED_BUFFERS        ((int)AESDCHAR_RING_SIZE + 1)
+#define RECYCLED_SIZE           (32)
+
+static char recycled_buffer[RECYCLED_BUFFERS][RECYCLED_SIZE];
+
+/**
+ * Payload n reads "<n>:" padded with a varying number of '.', ending in a newline.
+ * Every payload is distinct and never freed, so readers can check any entry they get back.
+ */
+static void make_payloads(void)
+{
+    for (int i = 0; i < STRESS_PAYLOADS; i++)
+    {
+        int len = snprintf(stress_payload[i], sizeof(stress_payload[i]), "%d:", i);
+        int pad = i % 17;
+        memset(&stress_payload[i][len], '.', pad);
+        stress_payload[i][len + pad] = '\n';
+        stress_payload[i][len + pad + 1] = '\0';
+    }
+}
+
+static void add_payload(int index)
+{
+    struct aesd_buffer_entry entry;
+    entry.buffptr = stress_payload[index % STRESS_PAYLOADS];
+    entry.size = strlen(entry.buffptr);
+    aesd_concurrent_circular_buffer_add_entry(&stress_buffer, &entry);
+}
+
+static void *stress_reader(void *arg)
+{
+    unsigned int seed = (unsigned int)(size_t)arg;
+
+    while (!atomic_load(&stress_done))
+    {
+        struct aesd_buffer_entry entry;
+        size_t offset_rtn;
+        size_t fpos = rand_r(&seed) % (AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED * 24);
+
+        if (aesd_concurrent_circular_buffer_find_entry_offset_for_fpos(&stress_buffer, fpos,
+                    &offset_rtn, &entry) == NULL)
+        {
+            continue;
+        }
+        atomic_fetch_add(&stress_lookups, 1);
+
+        /* A torn copy would pair one payload with another's size or offset */
+        if ((entry.buffptr == NULL) || (entry.size != strlen(entry.buffptr)) || (offset_rtn >= entry.size))
+        {
+            atomic_fetch_add(&stress_failures, 1);
+        }
+    }
+
+    return NULL;
+}
+
+static void *stress_writer(void *arg)
+{
+    int writer = (int)(size_t)arg;
+
+    for (int i = writer; i < STRESS_WRITES; i += stress_writer_count)
+    {
+        add_payload(i);
+        /* Let readers in between adds even on a single core */
+        if ((i % 1024) == writer)
+        {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Walks the whole buffer by file position and checks every entry follows the previous one
+ */
+static size_t verify_contiguous(void)
+{
+    size_t fpos = 0;
+    size_t entries = 0;
+    struct aesd_buffer_entry entry;
+    size_t offset_rtn;
+
+    while (aesd_concurrent_circular_buffer_find_entry_offset_for_fpos(&stress_buffer, fpos,
+                &offset_rtn, &entry) != NULL)
+    {
+        TEST_ASSERT_EQUAL_UINT_MESSAGE(0, offset_rtn, "Entries should start where the previous one ended");
+        TEST_ASSERT_EQUAL_UINT(strlen(entry.buffptr), entry.size);
+        fpos += entry.size;
+        entries++;
+    }
+
+    return entries;
+}
+
+static void run_stress(int writers)
+{
+    pthread_t reader_threads[STRESS_READERS];
+    pthread_t writer_threads[STRESS_WRITERS];
+
+    make_payloads();
+    aesd_concurrent_circular_buffer_init(&stress_buffer);
+    atomic_store(&stress_done, false);
+    atomic_store(&stress_failures, 0);
+    atomic_store(&stress_lookups, 0);
+    stress_writer_count = writers;
+
+    for (int i = 0; i < STRESS_READERS; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&reader_threads[i], NULL, stress_reader, (void *)(size_t)(i + 1)));
+    }
+
+    if (writers == 1)
+    {
+        stress_writer((void *)(size_t)0);
+    }
+    else
+    {
+        for (int i = 0; i < writers; i++)
+        {
+            TEST_ASSERT_EQUAL_INT(0, pthread_create(&writer_threads[i], NULL, stress_writer, (void *)(size_t)i));
+        }
+        for (int i = 0; i < writers; i++)
+        {
+            pthread_join(writer_threads[i], NULL);
+        }
+    }
+
+    atomic_store(&stress_done, true);
+    for (int i = 0; i < STRESS_READERS; i++)
+    {
+        pthread_join(reader_threads[i], NULL);
+    }
+
+    TEST_ASSERT_TRUE_MESSAGE(atomic_load(&stress_lookups) > 0, "Readers never ran alongside the writers");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, atomic_load(&stress_failures), "Readers returned torn entries");
+    TEST_ASSERT_TRUE(atomic_load(&stress_buffer.head) == STRESS_WRITES);
+    TEST_ASSERT_EQUAL_UINT(AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, verify_contiguous());
+}
+
+void test_concurrent_circular_buffer_single_writer()
+{
+    run_stress(1);
+
+    /* With one writer the newest entry is the last one written */
+    struct aesd_buffer_entry entry;
+    size_t offset_rtn;
+    size_t fpos = 0;
+    const char *last = NULL;
+    while (aesd_concurrent_circular_buffer_find_entry_offset_for_fpos(&stress_buffer, fpos,
+                &offset_rtn, &entry) != NULL)
+    {
+        last = entry.buffptr;
+        fpos += entry.size;
+    }
+    TEST_ASSERT_EQUAL_PTR(stress_payload[(STRESS_WRITES - 1) % STRESS_PAYLOADS], last);
+}
+
+void test_concurrent_circular_buffer_multiple_writers()
+{
+    run_stress(STRESS_WRITERS);
+}
+
+/**
+ * Payload n is one letter, picked by n, repeated to a length picked by the letter and ending in a newline.
+ * A copy of a payload rewritten mid-copy mixes two letters or disagrees with its own length.
+ */
+static size_t make_recycled_payload(int n, char *buf)
+{
+    char letter = (char)('a' + (n % 26));
+    size_t size = 8 + ((size_t)(letter - 'a') % 17);
+
+    memset(buf, letter, size - 1);
+    buf[size - 1] = '\n';
+    return size;
+}
+
+static void *recycled_reader(void *arg)
+{
+    unsigned int seed = (unsigned int)(size_t)arg;
+
+    while (!atomic_load(&stress_done))
+    {
+        char copy[RECYCLED_SIZE];
+        /* Offset 0 always copies a whole entry, the oldest */
+        size_t fpos = (rand_r(&seed) % 4 == 0) ? 0 : rand_r(&seed) % (AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED * 16);
+        size_t len = aesd_concurrent_circular_buffer_copy_for_fpos(&stress_buffer, fpos, copy, sizeof(copy));
+
+        if (len == 0)
+        {
+            continue;
+        }
+        atomic_fetch_add(&stress_lookups, 1);
+
+        size_t letters = (copy[len - 1] == '\n') ? len - 1 : len;
+        bool intact = (letters == 0) || ((copy[0] >= 'a') && (copy[0] <= 'z'));
+        for (size_t i = 1; intact && (i < letters); i++)
+        {
+            intact = (copy[i] == copy[0]);
+        }
+        if ((fpos == 0) && intact && (letters > 0))
+        {
+            intact = (len == 8 + ((size_t)(copy[0] - 'a') % 17)) && (copy[len - 1] == '\n');
+        }
+        if (!intact)
+        {
+            atomic_fetch_add(&stress_failures, 1);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * The writer rewrites every payload buffer add_entry hands back for a later entry right away, while readers
+ * copy entries out with aesd_concurrent_circular_buffer_copy_for_fpos(), which has to notice the rewrites
+ */
+void test_concurrent_circular_buffer_recycled_payloads()
+{
+    pthread_t reader_threads[STRESS_READERS];
+    char *free_buffers[RECYCLED_BUFFERS];
+    int num_free = 0;
+
+    aesd_concurrent_circular_buffer_init(&stress_buffer);
+    atomic_store(&stress_done, false);
+    atomic_store(&stress_failures, 0);
+    atomic_store(&stress_lookups, 0);
+
+    for (int i = 0; i < RECYCLED_BUFFERS; i++)
+    {
+        free_buffers[num_free++] = recycled_buffer[i];
+    }
+
+    for (int i = 0; i < STRESS_READERS; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&reader_threads[i], NULL, recycled_reader, (void *)(size_t)(i + 1)));
+    }
+
+    for (int n = 0; n < STRESS_WRITES; n++)
+    {
+        struct aesd_buffer_entry entry;
+        char *buf = free_buffers[--num_free];
+
+        entry.buffptr = buf;
+        entry.size = make_recycled_payload(n, buf);
+        const char *dropped = aesd_concurrent_circular_buffer_add_entry(&stress_buffer, &entry);
+        if (dropped != NULL)
+        {
+            free_buffers[num_free++] = (char *)dropped;
+        }
+        TEST_ASSERT_TRUE(num_free > 0);
+
+        if ((n % 1024) == 0)
+        {
+            sched_yield();
+        }
+    }
+
+    atomic_store(&stress_done, true);
+    for (int i = 0; i < STRESS_READERS; i++)
+    {
+        pthread_join(reader_threads[i], NULL);
+    }
+
+    TEST_ASSERT_TRUE_MESSAGE(atomic_load(&stress_lookups) > 0, "Readers never ran alongside the writer");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, atomic_load(&stress_failures), "Readers copied rewritten payloads");
+
+    /* Once quiet, copies walk the whole buffer and end where the content ends */
+    size_t fpos = 0;
+    size_t entries = 0;
+    char copy[RECYCLED_SIZE];
+    size_t len;
+    while ((len = aesd_concurrent_circular_buffer_copy_for_fpos(&stress_buffer, fpos, copy, sizeof(copy))) > 0)
+    {
+        TEST_ASSERT_EQUAL_INT('\n', copy[len - 1]);
+        fpos += len;
+        entries++;
+    }
+    TEST_ASSERT_EQUAL_UINT(AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, entries);
+}